@@ -0,0 +1,84 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _AUDIO_BOARD_CAPTURE_H_
+#define _AUDIO_BOARD_CAPTURE_H_
+
+#include <esp_err.h>
+#include <driver/i2s.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Capture DMA sizing, trading latency for headroom against preemption */
+typedef enum audio_board_capture_profile {
+    AUDIO_BOARD_CAPTURE_LOW_LATENCY = 0,
+    AUDIO_BOARD_CAPTURE_BALANCED,
+    AUDIO_BOARD_CAPTURE_ROBUST,
+    AUDIO_BOARD_CAPTURE_PROFILE_MAX,
+} audio_board_capture_profile_t;
+
+/**
+ * @brief  profile selected for this board in menuconfig
+ */
+audio_board_capture_profile_t audio_board_capture_profile_default();
+
+/**
+ * @brief  fill in the capture I2S configuration for a profile
+ *
+ * Same as audio_board_i2s_init_default() apart from the DMA ring size.
+ */
+esp_err_t audio_board_i2s_capture_config(audio_board_capture_profile_t profile, i2s_config_t *i2s_cfg);
+
+/**
+ * @brief  interleaved slots per frame in the capture DMA buffers
+ */
+int audio_board_capture_slots();
+
+/**
+ * @brief  slot within a capture frame that carries the microphone
+ *
+ * The right channel comes first in RIGHT_LEFT frames.
+ */
+int audio_board_capture_mic_slot();
+
+/**
+ * @brief  number of microphones in a capture frame
+ *
+ * With two, the right channel mic is first and both slots are used.
+ */
+int audio_board_capture_mics();
+
+/**
+ * @brief  distance between the microphones in mm, 0 with a single mic
+ */
+int audio_board_mic_spacing_mm();
+
+/**
+ * @brief  sample width the speaker DAC takes: 16, 24 or 32
+ *
+ * 24-bit samples are sign extended in 32-bit DMA words.
+ */
+int audio_board_speaker_bits();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _AUDIO_BOARD_CAPTURE_H_ */
@@ -19,6 +19,7 @@
 #include <string.h>
 #include <esp_log.h>
 #include <audio_board.h>
+#include "audio_board_capture.h"
 
 #define PLAT_TAG "AUDIO_BOARD"
 
@@ -42,6 +43,7 @@ esp_err_t audio_board_i2s_pin_config(int port_num, i2s_pin_config_t *pf_i2s_pin)
             pf_i2s_pin->bck_io_num = GPIO_NUM_13;
             pf_i2s_pin->ws_io_num =  GPIO_NUM_18;
             pf_i2s_pin->data_out_num = -1;
+            /* A second mic shares this line on the other channel */
             pf_i2s_pin->data_in_num = GPIO_NUM_5;
             break;
         default:
@@ -92,6 +94,99 @@ esp_err_t audio_board_i2s_init_default(i2s_config_t *i2s_cfg_dft)
     return ESP_OK;
 }
 
+static const struct {
+    int dma_buf_count;
+    int dma_buf_len;
+} capture_profiles[AUDIO_BOARD_CAPTURE_PROFILE_MAX] = {
+    [AUDIO_BOARD_CAPTURE_LOW_LATENCY] = { 3, 300 },
+    [AUDIO_BOARD_CAPTURE_BALANCED]    = { 4, 480 },
+    [AUDIO_BOARD_CAPTURE_ROBUST]      = { 8, 480 },
+};
+
+audio_board_capture_profile_t audio_board_capture_profile_default()
+{
+#if defined(CONFIG_AUDIO_BOARD_CAPTURE_ROBUST)
+    return AUDIO_BOARD_CAPTURE_ROBUST;
+#elif defined(CONFIG_AUDIO_BOARD_CAPTURE_BALANCED)
+    return AUDIO_BOARD_CAPTURE_BALANCED;
+#else
+    return AUDIO_BOARD_CAPTURE_LOW_LATENCY;
+#endif
+}
+
+esp_err_t audio_board_i2s_capture_config(audio_board_capture_profile_t profile, i2s_config_t *i2s_cfg)
+{
+    PLAT_ASSERT(i2s_cfg, "Error assigning capture config", ESP_ERR_INVALID_ARG);
+    if (profile >= AUDIO_BOARD_CAPTURE_PROFILE_MAX) {
+        ESP_LOGE(PLAT_TAG, "Invalid capture profile %d", profile);
+        return ESP_ERR_INVALID_ARG;
+    }
+    audio_board_i2s_init_default(i2s_cfg);
+#ifdef CONFIG_AUDIO_BOARD_MIC_32BIT
+    i2s_cfg->bits_per_sample = 32;
+#endif
+#if defined(CONFIG_AUDIO_BOARD_MIC_32BIT) || defined(CONFIG_AUDIO_BOARD_MIC_STEREO)
+    /* Both slots are captured; with one mic its slot is picked in software,
+     * see audio_board_capture_mic_slot() */
+    i2s_cfg->channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT;
+#elif defined(CONFIG_AUDIO_BOARD_MIC_LEFT)
+    i2s_cfg->channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+#endif
+    i2s_cfg->dma_buf_count = capture_profiles[profile].dma_buf_count;
+    i2s_cfg->dma_buf_len = capture_profiles[profile].dma_buf_len;
+    return ESP_OK;
+}
+
+int audio_board_capture_mic_slot()
+{
+    if (audio_board_capture_slots() == 1) {
+        return 0;
+    }
+#ifdef CONFIG_AUDIO_BOARD_MIC_LEFT
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+int audio_board_capture_slots()
+{
+#if defined(CONFIG_AUDIO_BOARD_MIC_32BIT) || defined(CONFIG_AUDIO_BOARD_MIC_STEREO)
+    return 2;
+#else
+    return 1;
+#endif
+}
+
+int audio_board_capture_mics()
+{
+#ifdef CONFIG_AUDIO_BOARD_MIC_STEREO
+    return 2;
+#else
+    return 1;
+#endif
+}
+
+int audio_board_mic_spacing_mm()
+{
+#ifdef CONFIG_AUDIO_BOARD_MIC_STEREO
+    return CONFIG_AUDIO_BOARD_MIC_SPACING_MM;
+#else
+    return 0;
+#endif
+}
+
+int audio_board_speaker_bits()
+{
+#if defined(CONFIG_AUDIO_BOARD_SPEAKER_32BIT)
+    return 32;
+#elif defined(CONFIG_AUDIO_BOARD_SPEAKER_24BIT)
+    return 24;
+#else
+    return 16;
+#endif
+}
+
 esp_err_t audio_board_button_config(adc1_channel_t *pf_button_pin)
 {
     *pf_button_pin = ADC1_CHANNEL_3;
@@ -0,0 +1,184 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#include <string.h>
+#include "adpcm.h"
+
+static const int16_t step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t index_table[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static inline int clamp16(int v)
+{
+    if (v > INT16_MAX) {
+        return INT16_MAX;
+    } else if (v < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return v;
+}
+
+/* Updates the predictor state for one code, shared by the encoder and
+ * decoder so they can't drift apart */
+static inline void step(int *pred, int *index, int code)
+{
+    int s = step_table[*index];
+    int vpdiff = s >> 3;
+
+    if (code & 4) {
+        vpdiff += s;
+    }
+    if (code & 2) {
+        vpdiff += s >> 1;
+    }
+    if (code & 1) {
+        vpdiff += s >> 2;
+    }
+    *pred = clamp16((code & 8) ? *pred - vpdiff : *pred + vpdiff);
+    *index += index_table[code & 7];
+    if (*index < 0) {
+        *index = 0;
+    } else if (*index > 88) {
+        *index = 88;
+    }
+}
+
+static inline int encode_one(int *pred, int *index, int sample)
+{
+    int diff = sample - *pred;
+    int s = step_table[*index];
+    int code = 0;
+
+    if (diff < 0) {
+        code = 8;
+        diff = -diff;
+    }
+    if (diff >= s) {
+        code |= 4;
+        diff -= s;
+    }
+    if (diff >= s >> 1) {
+        code |= 2;
+        diff -= s >> 1;
+    }
+    if (diff >= s >> 2) {
+        code |= 1;
+    }
+    step(pred, index, code);
+    return code;
+}
+
+void adpcm_encode(adpcm_state_t *st, const int16_t *in, uint8_t *out, int samples)
+{
+    int pred = st->predictor, index = st->index;
+
+    for (int i = 0; i < samples; i += 2) {
+        int lo = encode_one(&pred, &index, in[i]);
+        int hi = encode_one(&pred, &index, in[i + 1]);
+        *out++ = lo | (hi << 4);
+    }
+    st->predictor = pred;
+    st->index = index;
+}
+
+void adpcm_decode(adpcm_state_t *st, const uint8_t *in, int16_t *out, int samples)
+{
+    int pred = st->predictor, index = st->index;
+
+    for (int i = 0; i < samples; i += 2) {
+        uint8_t b = *in++;
+        step(&pred, &index, b & 0xf);
+        *out++ = pred;
+        step(&pred, &index, b >> 4);
+        *out++ = pred;
+    }
+    st->predictor = pred;
+    st->index = index;
+}
+
+size_t adpcm_history_block_size(int frame_samples)
+{
+    return sizeof(adpcm_state_t) + frame_samples / 2;
+}
+
+uint32_t adpcm_history_init(adpcm_history_t *h, void *buf, size_t size, int frame_samples)
+{
+    memset(h, 0, sizeof(*h));
+    if (frame_samples <= 0 || (frame_samples & 1)) {
+        return 0;
+    }
+    h->buf = buf;
+    h->frame_samples = frame_samples;
+    h->block_size = adpcm_history_block_size(frame_samples);
+    h->frames = size / h->block_size;
+    return h->frames;
+}
+
+void adpcm_history_push(adpcm_history_t *h, const int16_t *frame)
+{
+    uint8_t *block;
+
+    if (!h->frames) {
+        return;
+    }
+    block = h->buf + (h->next % h->frames) * h->block_size;
+    memcpy(block, &h->enc, sizeof(adpcm_state_t));
+    adpcm_encode(&h->enc, frame, block + sizeof(adpcm_state_t), h->frame_samples);
+    /* The block must be complete before readers can see it */
+    __sync_synchronize();
+    h->next++;
+}
+
+uint32_t adpcm_history_first(const adpcm_history_t *h)
+{
+    uint32_t next = h->next;
+    return (next >= h->frames) ? next - h->frames + 1 : 0;
+}
+
+/* The block of `frame` is safe while next stays at most frame + frames - 1,
+ * i.e. the writer isn't working on a frame that reuses it */
+static inline int held(const adpcm_history_t *h, uint32_t frame)
+{
+    uint32_t next = h->next;
+    return frame < next && next - frame < h->frames;
+}
+
+int adpcm_history_read(const adpcm_history_t *h, uint32_t frame, int16_t *out)
+{
+    const uint8_t *block;
+    adpcm_state_t st;
+
+    if (!h->frames || !held(h, frame)) {
+        return -1;
+    }
+    block = h->buf + (frame % h->frames) * h->block_size;
+    memcpy(&st, block, sizeof(st));
+    adpcm_decode(&st, block + sizeof(adpcm_state_t), out, h->frame_samples);
+    __sync_synchronize();
+    return held(h, frame) ? 0 : -1;
+}
@@ -0,0 +1,100 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _ADPCM_H_
+#define _ADPCM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * IMA-ADPCM, 4 bits per 16-bit sample, low nibble first as in WAV files.
+ *
+ * The history is a ring of fixed size blocks, one per frame. Each block
+ * starts with the encoder state at the start of the frame (a keyframe), so
+ * any frame still in the ring can be decoded on its own.
+ */
+
+/** Predictor state, also the keyframe stored ahead of each block */
+typedef struct adpcm_state {
+    int16_t predictor;
+    uint8_t index;
+    uint8_t reserved;
+} adpcm_state_t;
+
+typedef struct adpcm_history {
+    uint8_t *buf;
+    int frame_samples;
+    int block_size;
+    uint32_t frames;        /* capacity */
+    volatile uint32_t next; /* index of the next frame to be pushed */
+    adpcm_state_t enc;
+} adpcm_history_t;
+
+/**
+ * @brief  encode samples, which must be an even number
+ */
+void adpcm_encode(adpcm_state_t *st, const int16_t *in, uint8_t *out, int samples);
+
+/**
+ * @brief  decode samples, which must be an even number
+ */
+void adpcm_decode(adpcm_state_t *st, const uint8_t *in, int16_t *out, int samples);
+
+/**
+ * @brief  bytes one frame takes in a history, keyframe included
+ */
+size_t adpcm_history_block_size(int frame_samples);
+
+/**
+ * @brief  set up a history in caller provided memory
+ *
+ * @return number of frames the history holds, 0 if `size` is too small or
+ *         frame_samples is odd
+ */
+uint32_t adpcm_history_init(adpcm_history_t *h, void *buf, size_t size, int frame_samples);
+
+/**
+ * @brief  encode one frame into the history, overwriting the oldest
+ */
+void adpcm_history_push(adpcm_history_t *h, const int16_t *frame);
+
+/**
+ * @brief  oldest frame index that can be read
+ */
+uint32_t adpcm_history_first(const adpcm_history_t *h);
+
+/**
+ * @brief  decode one frame by index
+ *
+ * Safe against a concurrent adpcm_history_push() from one other task: a
+ * frame overwritten while it was being decoded is reported as gone.
+ *
+ * @return 0 on success, -1 if the frame is no longer or not yet held
+ */
+int adpcm_history_read(const adpcm_history_t *h, uint32_t frame, int16_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ADPCM_H_ */
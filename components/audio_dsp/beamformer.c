@@ -0,0 +1,225 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "fft.h"
+#include "beamformer.h"
+
+#define BF_FRAME        FFT_REAL_N
+#define BF_HOP          (BF_FRAME / 2)
+/* Delay lines, power of two and longer than the furthest read back */
+#define BF_HIST         32
+#define BF_DELAY        (BF_MAX_LAG + 1)
+#define SOUND_MM_PER_S  343000
+/* GCC-PHAT only looks at 300 Hz - 4 kHz, where speech has its energy and
+ * the mic spacing doesn't alias */
+#define GCC_LOW_HZ      300
+#define GCC_HIGH_HZ     4000
+/* Mean level of the hop needed to update the steering, ~-50 dBFS */
+#define GATE_LEVEL      100
+/* Correlation peak needed to trust an estimate, as a fraction of a fully
+ * coherent one; noise that differs between the mics falls well under it */
+#define COHERENCE_DIV   4
+/* Steering moves 1/2^n of the way to each new estimate */
+#define TRACK_SHIFT     2
+
+struct beamformer {
+    beamformer_config_t cfg;
+    int max_lag;
+    int bin_lo, bin_hi;
+    int32_t peak_min;
+    int16_t frame[2][BF_FRAME];
+    int fill;
+    uint32_t level;
+    int16_t hist[2][BF_HIST];
+    int pos;
+    int32_t work[FFT_REAL_N];
+    fft_cplx_t spec[2][FFT_BINS];
+    beamformer_stats_t stats;
+};
+
+static int16_t window[BF_FRAME];
+static bool window_ready;
+
+beamformer_t *beamformer_create(const beamformer_config_t *cfg)
+{
+    int max_lag = (cfg->mic_spacing_mm * cfg->sample_rate + SOUND_MM_PER_S - 1) / SOUND_MM_PER_S;
+    beamformer_t *bf;
+
+    if (max_lag < 1 || max_lag >= BF_MAX_LAG) {
+        return NULL;
+    }
+    bf = calloc(1, sizeof(beamformer_t));
+    if (!bf) {
+        return NULL;
+    }
+    fft_init();
+    if (!window_ready) {
+        for (int i = 0; i < BF_FRAME; i++) {
+            window[i] = lround(0.5 * (1 - cos(2 * M_PI * i / BF_FRAME)) * INT16_MAX);
+        }
+        window_ready = true;
+    }
+    bf->cfg = *cfg;
+    bf->max_lag = max_lag;
+    bf->bin_lo = GCC_LOW_HZ * FFT_REAL_N / cfg->sample_rate;
+    bf->bin_hi = GCC_HIGH_HZ * FFT_REAL_N / cfg->sample_rate;
+    if (bf->bin_hi > FFT_BINS - 1) {
+        bf->bin_hi = FFT_BINS - 1;
+    }
+    /* Unit magnitude in every bin of the band sums to this at the peak */
+    bf->peak_min = (2 * (bf->bin_hi - bf->bin_lo + 1) << 14) / FFT_REAL_N / COHERENCE_DIV;
+    bf->fill = BF_HOP;
+    bf->stats.max_delay_q8 = (cfg->mic_spacing_mm * cfg->sample_rate * 256LL) / SOUND_MM_PER_S;
+    return bf;
+}
+
+void beamformer_destroy(beamformer_t *bf)
+{
+    free(bf);
+}
+
+static void analyse(beamformer_t *bf, int ch)
+{
+    for (int i = 0; i < BF_FRAME; i++) {
+        bf->work[i] = (bf->frame[ch][i] * window[i]) >> 11;
+    }
+    fft_real_forward(bf->work, bf->spec[ch]);
+}
+
+/* Cross spectrum with PHAT weighting (unit magnitude per bin) turned back
+ * into a cross correlation, whose peak is the delay between the mics */
+static void gcc_phat(beamformer_t *bf)
+{
+    fft_cplx_t *R = bf->spec[0];
+    const fft_cplx_t *X2 = bf->spec[1];
+    int32_t *cc = bf->work;
+
+    analyse(bf, 0);
+    analyse(bf, 1);
+    for (int k = 0; k < FFT_BINS; k++) {
+        if (k < bf->bin_lo || k > bf->bin_hi) {
+            R[k].re = R[k].im = 0;
+            continue;
+        }
+        int64_t re = (int64_t) R[k].re * X2[k].re + (int64_t) R[k].im * X2[k].im;
+        int64_t im = (int64_t) R[k].im * X2[k].re - (int64_t) R[k].re * X2[k].im;
+        uint64_t are = llabs(re), aim = llabs(im);
+        /* |R| to within 4%, alpha max plus beta min */
+        uint64_t mag = (are > aim) ? are + (aim * 3 >> 3) : aim + (are * 3 >> 3);
+        int sh = 64 - __builtin_clzll(mag | 1) - 40;
+        if (sh > 0) {
+            re >>= sh;
+            im >>= sh;
+            mag >>= sh;
+        }
+        if (mag == 0) {
+            R[k].re = R[k].im = 0;
+            continue;
+        }
+        R[k].re = (re << 14) / (int64_t) mag;
+        R[k].im = (im << 14) / (int64_t) mag;
+    }
+    fft_real_inverse(R, cc);
+
+    int best = 0;
+    for (int lag = -bf->max_lag; lag <= bf->max_lag; lag++) {
+        if (cc[lag & (BF_FRAME - 1)] > cc[best & (BF_FRAME - 1)]) {
+            best = lag;
+        }
+    }
+    /* Parabolic interpolation around the peak */
+    int32_t cm = cc[(best - 1) & (BF_FRAME - 1)];
+    int32_t c0 = cc[best & (BF_FRAME - 1)];
+    int32_t cp = cc[(best + 1) & (BF_FRAME - 1)];
+    if (c0 < bf->peak_min) {
+        return;
+    }
+    int32_t den = cm - 2 * c0 + cp;
+    int32_t delay_q8 = best * 256;
+    if (den < 0) {
+        delay_q8 += ((cm - cp) * 128) / den;
+    }
+    /* cc peaks at minus the delay of the second mic */
+    delay_q8 = -delay_q8;
+    if (delay_q8 > bf->stats.max_delay_q8) {
+        delay_q8 = bf->stats.max_delay_q8;
+    } else if (delay_q8 < -bf->stats.max_delay_q8) {
+        delay_q8 = -bf->stats.max_delay_q8;
+    }
+    bf->stats.delay_q8 += (delay_q8 - bf->stats.delay_q8) >> TRACK_SHIFT;
+    bf->stats.updates++;
+}
+
+static void analysis_push(beamformer_t *bf, int16_t l, int16_t r)
+{
+    bf->frame[0][bf->fill] = l;
+    bf->frame[1][bf->fill] = r;
+    bf->level += abs(l);
+    if (++bf->fill < BF_FRAME) {
+        return;
+    }
+    bf->stats.frames++;
+    if (bf->level / BF_HOP >= GATE_LEVEL) {
+        gcc_phat(bf);
+    }
+    memmove(bf->frame[0], bf->frame[0] + BF_HOP, BF_HOP * sizeof(int16_t));
+    memmove(bf->frame[1], bf->frame[1] + BF_HOP, BF_HOP * sizeof(int16_t));
+    bf->fill = BF_HOP;
+    bf->level = 0;
+}
+
+int beamformer_process(beamformer_t *bf, int16_t *buf, int frames)
+{
+    int pos = bf->pos;
+    int32_t delay = bf->stats.delay_q8;
+
+    for (int n = 0; n < frames; n++) {
+        int16_t l = buf[2 * n], r = buf[2 * n + 1];
+
+        if (bf->cfg.mode == BEAMFORMER_STEERED) {
+            analysis_push(bf, l, r);
+            delay = bf->stats.delay_q8;
+        }
+        bf->hist[0][pos] = l;
+        bf->hist[1][pos] = r;
+
+        /* The second mic hears the source delay samples after the first, so
+         * it is read delay samples closer to now; whole samples plus a
+         * fraction */
+        int32_t d = BF_DELAY * 256 - delay;
+        int di = d >> 8, df = d & 0xff;
+        int32_t a = bf->hist[1][(pos - di) & (BF_HIST - 1)];
+        int32_t b = bf->hist[1][(pos - di - 1) & (BF_HIST - 1)];
+        int32_t x2 = (a * (256 - df) + b * df) >> 8;
+        int32_t x1 = bf->hist[0][(pos - BF_DELAY) & (BF_HIST - 1)];
+
+        buf[n] = (x1 + x2) >> 1;
+        pos = (pos + 1) & (BF_HIST - 1);
+    }
+    bf->pos = pos;
+    return frames;
+}
+
+void beamformer_get_stats(const beamformer_t *bf, beamformer_stats_t *stats)
+{
+    *stats = bf->stats;
+}
@@ -0,0 +1,83 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _BEAMFORMER_H_
+#define _BEAMFORMER_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Two microphone delay-and-sum beamformer. In steered mode the delay
+ * between the mics is estimated with GCC-PHAT on 512 sample frames every
+ * 256 samples, interpolated to a fraction of a sample, and tracked while
+ * one source dominates. Broadside mode just averages the mics, which
+ * favours sources perpendicular to the mic axis.
+ */
+
+#define BF_MAX_LAG      8       /*!< largest inter-mic delay in samples, ~170 mm at 16 kHz */
+
+typedef enum beamformer_mode {
+    BEAMFORMER_BROADSIDE,
+    BEAMFORMER_STEERED,
+} beamformer_mode_t;
+
+typedef struct beamformer_config {
+    beamformer_mode_t mode;
+    int mic_spacing_mm;
+    int sample_rate;
+} beamformer_config_t;
+
+typedef struct beamformer_stats {
+    int delay_q8;           /*!< how far the second mic lags the first, 1/256 samples */
+    int max_delay_q8;       /*!< delay for a source on the mic axis */
+    uint32_t frames;        /*!< analysis frames */
+    uint32_t updates;       /*!< frames loud and coherent enough to update the steering */
+} beamformer_stats_t;
+
+typedef struct beamformer beamformer_t;
+
+/**
+ * @brief  allocate a beamformer, about 8 KB
+ *
+ * @return NULL if out of memory or the mic spacing is out of range
+ */
+beamformer_t *beamformer_create(const beamformer_config_t *cfg);
+
+void beamformer_destroy(beamformer_t *bf);
+
+/**
+ * @brief  combine interleaved stereo frames into one channel, in place
+ *
+ * The mono output is written over the start of `buf` and is delayed by
+ * BF_MAX_LAG + 1 samples.
+ *
+ * @return number of mono samples, always `frames`
+ */
+int beamformer_process(beamformer_t *bf, int16_t *buf, int frames);
+
+void beamformer_get_stats(const beamformer_t *bf, beamformer_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BEAMFORMER_H_ */
@@ -0,0 +1,140 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#include <string.h>
+#include "capture_tap.h"
+
+#define HDR_SIZE    sizeof(capture_tap_header_t)
+
+static inline uint32_t pad4(uint32_t n)
+{
+    return (n + 3) & ~3;
+}
+
+int capture_tap_init(capture_tap_t *tap, capture_tap_stream_t stream, void *mem, size_t size)
+{
+    memset(tap, 0, sizeof(*tap));
+    tap->buf = mem;
+    tap->size = size & ~3;
+    tap->stream = stream;
+    return tap->size > HDR_SIZE ? 0 : -1;
+}
+
+uint32_t capture_tap_used(const capture_tap_t *tap)
+{
+    uint32_t wr = tap->wr, rd = tap->rd;
+
+    return wr >= rd ? wr - rd : tap->size - rd + wr;
+}
+
+/*
+ * Frames never wrap. One that doesn't fit before the end of the ring goes
+ * to the start instead, after a zero magic marking the rest of the end as
+ * unused if there is room for one; the reader also skips any tail too
+ * short for a header. wr never catches up with rd, so the two only meet
+ * when the ring is empty.
+ */
+bool capture_tap_push(capture_tap_t *tap, const void *pcm, uint32_t len, int bits, int channels,
+                      uint32_t sample_rate, uint64_t timestamp_us)
+{
+    capture_tap_header_t hdr = {
+        .magic = CAPTURE_TAP_MAGIC,
+        .version = CAPTURE_TAP_VERSION,
+        .stream = tap->stream,
+        .bits = bits,
+        .channels = channels,
+        .seq = tap->seq++,
+        .sample_rate = sample_rate,
+        .len = len,
+        .timestamp_us = timestamp_us,
+    };
+    uint32_t need = HDR_SIZE + pad4(len);
+    uint32_t wr = tap->wr, rd = tap->rd;
+    uint32_t at, used;
+
+    if (wr >= rd && tap->size - wr >= need + (rd == 0)) {
+        at = wr;
+    } else if (wr >= rd && rd > need) {
+        if (tap->size - wr >= HDR_SIZE) {
+            uint32_t zero = 0;
+            memcpy(tap->buf + wr, &zero, sizeof(zero));
+        }
+        at = 0;
+    } else if (wr < rd && rd - wr > need) {
+        at = wr;
+    } else {
+        tap->stats.dropped++;
+        tap->stats.dropped_bytes += len;
+        return false;
+    }
+
+    memcpy(tap->buf + at, &hdr, HDR_SIZE);
+    memcpy(tap->buf + at + HDR_SIZE, pcm, len);
+    /* The frame must land before the reader sees the new offset */
+    __sync_synchronize();
+    wr = at + need;
+    tap->wr = (wr == tap->size) ? 0 : wr;
+    tap->stats.frames++;
+    used = capture_tap_used(tap);
+    if (used > tap->stats.max_used) {
+        tap->stats.max_used = used;
+    }
+    return true;
+}
+
+const void *capture_tap_peek(capture_tap_t *tap, uint32_t *len)
+{
+    uint32_t wr = tap->wr, rd = tap->rd;
+    capture_tap_header_t hdr;
+
+    __sync_synchronize();
+    if (rd == wr) {
+        return NULL;
+    }
+    if (tap->size - rd >= HDR_SIZE) {
+        memcpy(&hdr, tap->buf + rd, HDR_SIZE);
+    }
+    if (tap->size - rd < HDR_SIZE || hdr.magic == 0) {
+        /* The writer went back to the start */
+        tap->rd = rd = 0;
+        memcpy(&hdr, tap->buf, HDR_SIZE);
+    }
+    *len = HDR_SIZE + pad4(hdr.len);
+    return tap->buf + rd;
+}
+
+void capture_tap_consume(capture_tap_t *tap)
+{
+    uint32_t rd = tap->rd;
+    capture_tap_header_t hdr;
+
+    memcpy(&hdr, tap->buf + rd, HDR_SIZE);
+    rd += HDR_SIZE + pad4(hdr.len);
+    /* Done with the frame before the writer may reuse its space */
+    __sync_synchronize();
+    tap->rd = (rd == tap->size) ? 0 : rd;
+}
+
+void capture_tap_drain(capture_tap_t *tap)
+{
+    uint32_t len;
+
+    while (capture_tap_peek(tap, &len)) {
+        capture_tap_consume(tap);
+    }
+}
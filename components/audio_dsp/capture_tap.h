@@ -0,0 +1,130 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _CAPTURE_TAP_H_
+#define _CAPTURE_TAP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Capture tap: copies of the capture path's audio, queued without ever
+ * blocking for a sender task to stream to a host collector
+ * (tools/capture_tap_recv.py).
+ *
+ * Each tap is a single producer, single consumer ring of whole frames, so a
+ * frame is either queued complete or dropped, and the sender can always
+ * hand one contiguous frame to the socket. Every frame offered gets the
+ * next sequence number, queued or not, so the host sees the drops as gaps.
+ *
+ * On the wire each frame is a capture_tap_header_t followed by len bytes
+ * of interleaved little-endian PCM, padded to a multiple of 4.
+ */
+
+#define CAPTURE_TAP_MAGIC       0x50415443  /* "CTAP" */
+#define CAPTURE_TAP_VERSION     1
+
+typedef enum capture_tap_stream {
+    CAPTURE_TAP_RAW,        /*!< I2S DMA buffers as dsp_write_cb gets them */
+    CAPTURE_TAP_PROCESSED,  /*!< conditioned 16-bit mono frames, as uploaded */
+    CAPTURE_TAP_STREAMS,
+} capture_tap_stream_t;
+
+/** Frame header, little-endian */
+typedef struct __attribute__((packed)) capture_tap_header {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t stream;         /*!< capture_tap_stream_t */
+    uint8_t bits;           /*!< 16 or 32 */
+    uint8_t channels;
+    uint32_t seq;           /*!< per stream, counts dropped frames too */
+    uint32_t sample_rate;
+    uint32_t len;           /*!< PCM bytes that follow, before padding */
+    uint64_t timestamp_us;  /*!< device esp_timer time the frame was captured */
+} capture_tap_header_t;
+
+typedef struct capture_tap_stats {
+    uint32_t frames;        /*!< queued */
+    uint32_t dropped;       /*!< offered while the ring was full */
+    uint32_t dropped_bytes;
+    uint32_t max_used;      /*!< ring high water mark, bytes */
+} capture_tap_stats_t;
+
+typedef struct capture_tap {
+    uint8_t *buf;
+    uint32_t size;
+    uint8_t stream;
+    volatile uint32_t wr;   /* byte offsets, wr == rd is empty */
+    volatile uint32_t rd;
+    /* Producer only */
+    uint32_t seq;
+    capture_tap_stats_t stats;
+} capture_tap_t;
+
+/**
+ * @brief  set up a tap in caller provided memory
+ *
+ * @param  size     bytes of mem, rounded down to a multiple of 4
+ *
+ * @return 0 on success, -1 if size can't hold a header
+ */
+int capture_tap_init(capture_tap_t *tap, capture_tap_stream_t stream, void *mem, size_t size);
+
+/**
+ * @brief  queue a frame, from the producer task; never blocks
+ *
+ * @return true if queued, false if it was dropped for lack of space
+ */
+bool capture_tap_push(capture_tap_t *tap, const void *pcm, uint32_t len, int bits, int channels,
+                      uint32_t sample_rate, uint64_t timestamp_us);
+
+/**
+ * @brief  oldest queued frame, header and padded PCM, from the consumer task
+ *
+ * @param  len      set to the bytes to send
+ *
+ * @return NULL if nothing is queued. The frame stays valid until
+ *         capture_tap_consume().
+ */
+const void *capture_tap_peek(capture_tap_t *tap, uint32_t *len);
+
+/**
+ * @brief  release the frame returned by capture_tap_peek()
+ */
+void capture_tap_consume(capture_tap_t *tap);
+
+/**
+ * @brief  drop everything queued, from the consumer task
+ */
+void capture_tap_drain(capture_tap_t *tap);
+
+/**
+ * @brief  bytes queued
+ */
+uint32_t capture_tap_used(const capture_tap_t *tap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CAPTURE_TAP_H_ */
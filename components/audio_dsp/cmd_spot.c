@@ -0,0 +1,393 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "cmd_spot.h"
+#include "endpoint.h"
+#include "fft.h"
+
+#define WINDOW_LEN          320     /* 20 ms at 16 kHz, zero padded to FFT_REAL_N */
+#define HOP_LEN             (WINDOW_LEN / 2)
+#define MEL_LOW_HZ          125
+#define MEL_HIGH_HZ         7500
+/* Features are in 1/2 dB, less this many dB so speech fits a byte */
+#define FEAT_STEPS_PER_DB   2
+#define FEAT_OFFSET_DB      20
+/* Hops kept either side of the speech */
+#define LEAD_HOPS           5
+/* VAD as in the dialog's endpointer */
+#define SPEECH_RATIO_Q8     (3 * 256)
+#define MIN_LEVEL           50
+#define MIN_SPEECH_MS       100
+/* Segments and templates this far apart in length never match */
+#define MAX_LENGTH_RATIO    2
+
+typedef struct cmd_template {
+    int label;
+    int hops;
+    const int8_t *feat;
+} cmd_template_t;
+
+struct cmd_spot {
+    cmd_spot_config_t cfg;
+    endpoint_t ep;
+    cmd_template_t templates[CMD_SPOT_MAX_TEMPLATES];
+    int max_hops;                   /* segment limit for this utterance */
+    cmd_spot_result_t result;
+    cmd_spot_match_t match;
+    int16_t prev[HOP_LEN];          /* second half of the last window */
+    int16_t pending[HOP_LEN];       /* samples towards the next hop */
+    int pending_len;
+    /* Segment: raw log-mel while it grows, mean normalised once it ends */
+    uint8_t raw[CMD_SPOT_MAX_HOPS][CMD_SPOT_BANDS];
+    int8_t seg[CMD_SPOT_MAX_HOPS][CMD_SPOT_BANDS];
+    int hops;
+    bool speech_seen;
+    int32_t fft_in[FFT_REAL_N];
+    fft_cplx_t fft_out[FFT_BINS];
+    int32_t dtw[2][CMD_SPOT_MAX_HOPS + 1];
+};
+
+static int16_t window[WINDOW_LEN];
+/* Triangular mel filters: each bin feeds band bin_band[k] with weight
+ * bin_w[k] (Q15), and the band above with the rest. Below the lowest band
+ * bin_band[k] is -1, and outside all of them BIN_UNUSED. */
+#define BIN_UNUSED  -2
+static int8_t bin_band[FFT_BINS];
+static uint16_t bin_w[FFT_BINS];
+static bool tables_ready;
+
+static float hz_to_mel(float hz)
+{
+    return 2595 * log10f(1 + hz / 700);
+}
+
+static void tables_init(int sample_rate)
+{
+    float lo = hz_to_mel(MEL_LOW_HZ), hi = hz_to_mel(MEL_HIGH_HZ);
+    /* Band centres, with the edges of the lowest and highest filters */
+    float centre[CMD_SPOT_BANDS + 2];
+
+    for (int i = 0; i < WINDOW_LEN; i++) {
+        window[i] = lround(0.5 * (1 - cos(2 * M_PI * i / WINDOW_LEN)) * INT16_MAX);
+    }
+    for (int b = 0; b < CMD_SPOT_BANDS + 2; b++) {
+        float mel = lo + (hi - lo) * b / (CMD_SPOT_BANDS + 1);
+        centre[b] = 700 * (powf(10, mel / 2595) - 1);
+    }
+    for (int k = 0; k < FFT_BINS; k++) {
+        float hz = (float) k * sample_rate / FFT_REAL_N;
+        int b = 0;
+
+        bin_band[k] = BIN_UNUSED;
+        if (hz <= centre[0] || hz >= centre[CMD_SPOT_BANDS + 1]) {
+            continue;
+        }
+        while (hz >= centre[b + 1]) {
+            b++;
+        }
+        /* Between centres b and b + 1: rising edge of filter b, falling
+         * edge of filter b - 1, in band numbers less the lower edge */
+        bin_band[k] = b - 1;
+        bin_w[k] = lroundf((centre[b + 1] - hz) / (centre[b + 1] - centre[b]) * 32767);
+    }
+    tables_ready = true;
+}
+
+cmd_spot_t *cmd_spot_create(const cmd_spot_config_t *cfg)
+{
+    cmd_spot_t *cs = calloc(1, sizeof(cmd_spot_t));
+    endpoint_config_t ep_cfg = {
+        .sample_rate = cfg->sample_rate,
+        .trailing_silence_ms = cfg->trailing_silence_ms,
+        .no_speech_ms = cfg->no_speech_ms,
+        .min_speech_ms = MIN_SPEECH_MS,
+        .speech_ratio_q8 = SPEECH_RATIO_Q8,
+        .min_level = MIN_LEVEL,
+    };
+
+    if (!cs) {
+        return NULL;
+    }
+    fft_init();
+    if (!tables_ready) {
+        tables_init(cfg->sample_rate);
+    }
+    cs->cfg = *cfg;
+    endpoint_init(&cs->ep, &ep_cfg);
+    return cs;
+}
+
+void cmd_spot_destroy(cmd_spot_t *cs)
+{
+    free(cs);
+}
+
+void cmd_spot_set_template(cmd_spot_t *cs, int slot, int label, const int8_t *feat, int hops)
+{
+    cmd_template_t *t = &cs->templates[slot];
+
+    t->label = label;
+    t->feat = feat;
+    t->hops = hops > CMD_SPOT_MAX_HOPS ? CMD_SPOT_MAX_HOPS : hops;
+}
+
+void cmd_spot_start(cmd_spot_t *cs, bool any_length)
+{
+    int longest = 0;
+
+    for (int i = 0; i < CMD_SPOT_MAX_TEMPLATES; i++) {
+        if (cs->templates[i].hops > longest) {
+            longest = cs->templates[i].hops;
+        }
+    }
+    cs->max_hops = CMD_SPOT_MAX_HOPS;
+    if (!any_length && longest * MAX_LENGTH_RATIO < CMD_SPOT_MAX_HOPS) {
+        cs->max_hops = longest * MAX_LENGTH_RATIO;
+    }
+    cs->hops = 0;
+    cs->speech_seen = false;
+    cs->result = CMD_SPOT_PENDING;
+    memset(&cs->match, 0, sizeof(cs->match));
+    cs->match.label = -1;
+    cs->match.runner_up = INT32_MAX;
+    endpoint_start(&cs->ep);
+}
+
+void cmd_spot_stop(cmd_spot_t *cs)
+{
+    cs->result = CMD_SPOT_IDLE;
+    endpoint_stop(&cs->ep);
+}
+
+/* Log-mel frame of the window ending with this hop */
+static void features(cmd_spot_t *cs, const int16_t *hop, uint8_t *out)
+{
+    float band[CMD_SPOT_BANDS] = { 0 };
+    int32_t *x = cs->fft_in;
+
+    for (int i = 0; i < HOP_LEN; i++) {
+        x[i] = (cs->prev[i] * window[i]) >> 15;
+        x[HOP_LEN + i] = (hop[i] * window[HOP_LEN + i]) >> 15;
+    }
+    memset(x + WINDOW_LEN, 0, (FFT_REAL_N - WINDOW_LEN) * sizeof(int32_t));
+    memcpy(cs->prev, hop, sizeof(cs->prev));
+    fft_real_forward(x, cs->fft_out);
+
+    for (int k = 0; k < FFT_BINS; k++) {
+        int b = bin_band[k];
+        float p;
+
+        if (b == BIN_UNUSED) {
+            continue;
+        }
+        p = (float) cs->fft_out[k].re * cs->fft_out[k].re + (float) cs->fft_out[k].im * cs->fft_out[k].im;
+        if (b >= 0) {
+            band[b] += p * bin_w[k] * (1.0f / 32767);
+        }
+        if (b + 1 < CMD_SPOT_BANDS) {
+            band[b + 1] += p * (32767 - bin_w[k]) * (1.0f / 32767);
+        }
+    }
+    for (int b = 0; b < CMD_SPOT_BANDS; b++) {
+        float v = (10 * log10f(band[b] + 1) - FEAT_OFFSET_DB) * FEAT_STEPS_PER_DB;
+        out[b] = v < 0 ? 0 : v > UINT8_MAX ? UINT8_MAX : v;
+    }
+}
+
+/* Mean normalises the segment into seg, which takes out the channel and
+ * the talker's level */
+static void normalise(cmd_spot_t *cs)
+{
+    for (int b = 0; b < CMD_SPOT_BANDS; b++) {
+        int32_t sum = 0, mean;
+
+        for (int i = 0; i < cs->hops; i++) {
+            sum += cs->raw[i][b];
+        }
+        mean = (sum + cs->hops / 2) / cs->hops;
+        for (int i = 0; i < cs->hops; i++) {
+            int v = cs->raw[i][b] - mean;
+            cs->seg[i][b] = v < INT8_MIN ? INT8_MIN : v > INT8_MAX ? INT8_MAX : v;
+        }
+    }
+}
+
+static inline int frame_distance(const int8_t *a, const int8_t *b)
+{
+    int d = 0;
+
+    for (int k = 0; k < CMD_SPOT_BANDS; k++) {
+        d += abs(a[k] - b[k]);
+    }
+    return d;
+}
+
+/* Symmetric DTW in a band around the diagonal, as the mean band difference
+ * along the best path in 1/10 dB; INT32_MAX if the lengths are too far apart */
+static int32_t dtw_distance(cmd_spot_t *cs, const cmd_template_t *t)
+{
+    const int n = cs->hops, m = t->hops;
+    int32_t *prev = cs->dtw[0], *cur = cs->dtw[1], *tmp;
+    int width;
+
+    if (n > m * MAX_LENGTH_RATIO || m > n * MAX_LENGTH_RATIO) {
+        return INT32_MAX;
+    }
+    /* Wide enough for the path to get from corner to corner, and some */
+    width = abs(n - m) + (n > m ? n : m) / 4 + 1;
+    for (int j = 0; j <= m; j++) {
+        prev[j] = INT32_MAX;
+    }
+    prev[0] = 0;
+    for (int i = 1; i <= n; i++) {
+        int centre = i * m / n;
+        int lo = centre - width < 1 ? 1 : centre - width;
+        int hi = centre + width > m ? m : centre + width;
+
+        for (int j = 0; j <= m; j++) {
+            cur[j] = INT32_MAX;
+        }
+        for (int j = lo; j <= hi; j++) {
+            int32_t d = frame_distance(cs->seg[i - 1], t->feat + (j - 1) * CMD_SPOT_BANDS);
+            int32_t best = INT32_MAX;
+
+            if (prev[j - 1] != INT32_MAX) {
+                best = prev[j - 1] + 2 * d;
+            }
+            if (prev[j] != INT32_MAX && prev[j] + d < best) {
+                best = prev[j] + d;
+            }
+            if (cur[j - 1] != INT32_MAX && cur[j - 1] + d < best) {
+                best = cur[j - 1] + d;
+            }
+            cur[j] = best;
+        }
+        tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+    if (prev[m] == INT32_MAX) {
+        return INT32_MAX;
+    }
+    /* Path weights sum to n + m; features are in 1/2 dB */
+    return (int64_t) prev[m] * 10 / ((int64_t) (n + m) * CMD_SPOT_BANDS * FEAT_STEPS_PER_DB);
+}
+
+static cmd_spot_result_t match(cmd_spot_t *cs)
+{
+    cmd_spot_match_t *mt = &cs->match;
+    int32_t best[CMD_SPOT_MAX_TEMPLATES];
+
+    int trailing = cs->ep.silence_ms / CMD_SPOT_HOP_MS - LEAD_HOPS;
+
+    /* Leave LEAD_HOPS of the trailing silence */
+    if (trailing > 0) {
+        cs->hops -= trailing;
+    }
+    if (cs->hops < 1) {
+        return CMD_SPOT_NO_COMMAND;
+    }
+    normalise(cs);
+    mt->hops = cs->hops;
+    for (int i = 0; i < CMD_SPOT_MAX_TEMPLATES; i++) {
+        const cmd_template_t *t = &cs->templates[i];
+        best[i] = t->hops ? dtw_distance(cs, t) : INT32_MAX;
+        if (best[i] != INT32_MAX && (mt->label < 0 || best[i] < mt->distance)) {
+            mt->label = t->label;
+            mt->distance = best[i];
+        }
+    }
+    if (mt->label < 0) {
+        return CMD_SPOT_NO_MATCH;
+    }
+    for (int i = 0; i < CMD_SPOT_MAX_TEMPLATES; i++) {
+        if (cs->templates[i].hops && cs->templates[i].label != mt->label && best[i] < mt->runner_up) {
+            mt->runner_up = best[i];
+        }
+    }
+    if (mt->distance > cs->cfg.max_distance ||
+            (mt->runner_up != INT32_MAX &&
+             (int64_t) mt->distance * 100 > (int64_t) mt->runner_up * (100 - cs->cfg.margin_pct))) {
+        return CMD_SPOT_NO_MATCH;
+    }
+    return CMD_SPOT_MATCH;
+}
+
+/* One hop: VAD, features while the segment is open, and the decision */
+static void hop(cmd_spot_t *cs, const int16_t *samples)
+{
+    endpoint_state_t st = endpoint_process(&cs->ep, samples, HOP_LEN);
+
+    if (cs->result != CMD_SPOT_PENDING) {
+        memcpy(cs->prev, samples, sizeof(cs->prev));
+        return;
+    }
+    if (!cs->speech_seen && cs->ep.speech) {
+        cs->speech_seen = true;
+    }
+    if (!cs->speech_seen && cs->hops == LEAD_HOPS) {
+        /* Only the lead-in before the speech is kept */
+        memmove(cs->raw[0], cs->raw[1], (LEAD_HOPS - 1) * CMD_SPOT_BANDS);
+        cs->hops--;
+    }
+    features(cs, samples, cs->raw[cs->hops++]);
+
+    if (st == ENDPOINT_END) {
+        cs->result = match(cs);
+    } else if (st == ENDPOINT_NO_SPEECH || cs->hops >= cs->max_hops) {
+        cs->result = CMD_SPOT_NO_COMMAND;
+    }
+}
+
+cmd_spot_result_t cmd_spot_process(cmd_spot_t *cs, const int16_t *buf, int samples)
+{
+    while (samples) {
+        int n = HOP_LEN - cs->pending_len;
+
+        if (n > samples) {
+            n = samples;
+        }
+        memcpy(cs->pending + cs->pending_len, buf, n * sizeof(int16_t));
+        cs->pending_len += n;
+        buf += n;
+        samples -= n;
+        if (cs->pending_len == HOP_LEN) {
+            hop(cs, cs->pending);
+            cs->pending_len = 0;
+        }
+    }
+    return cs->result;
+}
+
+void cmd_spot_get_match(const cmd_spot_t *cs, cmd_spot_match_t *match)
+{
+    *match = cs->match;
+}
+
+const int8_t *cmd_spot_segment(const cmd_spot_t *cs, int *hops)
+{
+    if (cs->result != CMD_SPOT_MATCH && cs->result != CMD_SPOT_NO_MATCH) {
+        *hops = 0;
+        return NULL;
+    }
+    *hops = cs->hops;
+    return cs->seg[0];
+}
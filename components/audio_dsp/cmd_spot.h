@@ -0,0 +1,135 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _CMD_SPOT_H_
+#define _CMD_SPOT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Spots a few fixed commands in the utterance after the wake word, by
+ * dynamic time warping against enrolled templates. Audio becomes log-mel
+ * frames (16 bands, 10 ms hop over 20 ms Hann windows); an energy VAD finds
+ * the spoken segment; when it ends the segment, mean normalised per band,
+ * is matched against every template. The best template names the command
+ * if it is close enough and clearly closer than any other command's.
+ *
+ * Templates are segments captured by the same code, see cmd_spot_segment(),
+ * so they are usually enrolled by saying each command a couple of times.
+ *
+ * Features cost one 512 point FFT per hop once started, the match a DTW
+ * against every template when the segment ends; tools/cmd_bench.c
+ * measures both.
+ */
+
+#define CMD_SPOT_BANDS          16
+#define CMD_SPOT_HOP_MS         10
+/** Longest segment, and template, in hops */
+#define CMD_SPOT_MAX_HOPS       120
+#define CMD_SPOT_MAX_TEMPLATES  24
+/** Bytes of one template at most */
+#define CMD_SPOT_TEMPLATE_SIZE  (CMD_SPOT_MAX_HOPS * CMD_SPOT_BANDS)
+
+typedef enum cmd_spot_result {
+    CMD_SPOT_IDLE,          /*!< not started */
+    CMD_SPOT_PENDING,       /*!< waiting for the segment to end */
+    CMD_SPOT_MATCH,         /*!< a command, see cmd_spot_get_match() */
+    CMD_SPOT_NO_MATCH,      /*!< a segment, but no command matched it well enough */
+    CMD_SPOT_NO_COMMAND,    /*!< no speech, or longer than any command */
+} cmd_spot_result_t;
+
+typedef struct cmd_spot_config {
+    int sample_rate;            /*!< 16000 */
+    int max_distance;           /*!< worst match accepted, mean band difference in 1/10 dB */
+    int margin_pct;             /*!< the match must be this much closer than any other command's */
+    int trailing_silence_ms;    /*!< silence that ends the segment */
+    int no_speech_ms;           /*!< give up if there is no speech this long */
+} cmd_spot_config_t;
+
+typedef struct cmd_spot_match {
+    int label;                  /*!< of the best template, -1 if there are none */
+    int distance;               /*!< to it, 1/10 dB */
+    int runner_up;              /*!< best distance for any other label, INT32_MAX if none */
+    int hops;                   /*!< segment length */
+} cmd_spot_match_t;
+
+typedef struct cmd_spot cmd_spot_t;
+
+/**
+ * @brief  allocate a spotter, about 8 KB
+ *
+ * @return NULL if out of memory
+ */
+cmd_spot_t *cmd_spot_create(const cmd_spot_config_t *cfg);
+
+void cmd_spot_destroy(cmd_spot_t *cs);
+
+/**
+ * @brief  set or clear a template
+ *
+ * @param  slot     0 to CMD_SPOT_MAX_TEMPLATES - 1
+ * @param  label    command the template stands for, 0 or more
+ * @param  feat     hops * CMD_SPOT_BANDS bytes, as from cmd_spot_segment();
+ *                  not copied, and must stay put while it is set
+ * @param  hops     0 clears the slot
+ */
+void cmd_spot_set_template(cmd_spot_t *cs, int slot, int label, const int8_t *feat, int hops);
+
+/**
+ * @brief  start looking for a command from the next block
+ *
+ * @param  any_length   allow segments up to CMD_SPOT_MAX_HOPS, for
+ *                      enrolling; otherwise a segment much longer than
+ *                      the longest template is given up on early
+ */
+void cmd_spot_start(cmd_spot_t *cs, bool any_length);
+
+/**
+ * @brief  stop looking, the VAD keeps running
+ */
+void cmd_spot_stop(cmd_spot_t *cs);
+
+/**
+ * @brief  feed a block of 16-bit mono samples
+ *
+ * Should be fed all the time, not just after cmd_spot_start(), so the VAD's
+ * noise floor is current. Blocks can be any size.
+ *
+ * @return PENDING until a result, which then stays until the next start or stop
+ */
+cmd_spot_result_t cmd_spot_process(cmd_spot_t *cs, const int16_t *buf, int samples);
+
+void cmd_spot_get_match(const cmd_spot_t *cs, cmd_spot_match_t *match);
+
+/**
+ * @brief  the segment behind a MATCH or NO_MATCH result, for enrolling it
+ *
+ * @return hops * CMD_SPOT_BANDS bytes, valid until the next start
+ */
+const int8_t *cmd_spot_segment(const cmd_spot_t *cs, int *hops);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CMD_SPOT_H_ */
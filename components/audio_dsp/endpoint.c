@@ -0,0 +1,96 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "endpoint.h"
+
+/* Noise floor falls 1/2^n of the way to a quieter frame, and creeps up
+ * 1/2^n of the way to a louder one, so speech barely moves it */
+#define FLOOR_FALL_SHIFT    2
+#define FLOOR_RISE_SHIFT    8
+
+void endpoint_init(endpoint_t *ep, const endpoint_config_t *cfg)
+{
+    memset(ep, 0, sizeof(*ep));
+    ep->cfg = *cfg;
+}
+
+void endpoint_start(endpoint_t *ep)
+{
+    ep->state = ENDPOINT_WAITING;
+    ep->elapsed_ms = 0;
+    ep->speech_ms = 0;
+    ep->silence_ms = 0;
+}
+
+void endpoint_stop(endpoint_t *ep)
+{
+    ep->state = ENDPOINT_IDLE;
+}
+
+static bool vad(endpoint_t *ep, const int16_t *buf, int samples)
+{
+    uint32_t sum = 0;
+
+    for (int i = 0; i < samples; i++) {
+        sum += abs(buf[i]);
+    }
+    int32_t level_q4 = (sum << 4) / samples;
+
+    if (ep->floor_q4 == 0) {
+        ep->floor_q4 = level_q4 ? level_q4 : 1;
+    } else if (level_q4 < ep->floor_q4) {
+        ep->floor_q4 += (level_q4 - ep->floor_q4) >> FLOOR_FALL_SHIFT;
+    } else {
+        ep->floor_q4 += ((level_q4 - ep->floor_q4) >> FLOOR_RISE_SHIFT) + 1;
+    }
+    return level_q4 >= (ep->cfg.min_level << 4) &&
+           (int64_t) level_q4 * 256 >= (int64_t) ep->floor_q4 * ep->cfg.speech_ratio_q8;
+}
+
+endpoint_state_t endpoint_process(endpoint_t *ep, const int16_t *buf, int samples)
+{
+    int frame_ms = samples * 1000 / ep->cfg.sample_rate;
+
+    ep->speech = vad(ep, buf, samples);
+    switch (ep->state) {
+    case ENDPOINT_WAITING:
+    case ENDPOINT_SPEECH:
+        ep->elapsed_ms += frame_ms;
+        if (ep->speech) {
+            ep->speech_ms += frame_ms;
+            ep->silence_ms = 0;
+            if (ep->speech_ms >= ep->cfg.min_speech_ms) {
+                ep->state = ENDPOINT_SPEECH;
+            }
+        } else {
+            ep->silence_ms += frame_ms;
+        }
+        if (ep->state == ENDPOINT_SPEECH && ep->silence_ms >= ep->cfg.trailing_silence_ms) {
+            ep->state = ENDPOINT_END;
+        } else if (ep->state == ENDPOINT_WAITING && ep->cfg.no_speech_ms &&
+                   ep->elapsed_ms >= ep->cfg.no_speech_ms) {
+            ep->state = ENDPOINT_NO_SPEECH;
+        }
+        break;
+    default:
+        break;
+    }
+    return ep->state;
+}
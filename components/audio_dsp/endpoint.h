@@ -0,0 +1,88 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _ENDPOINT_H_
+#define _ENDPOINT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * End of speech detection. An energy VAD against a tracked noise floor
+ * marks each frame as speech or not; once an utterance has had enough
+ * speech, a run of trailing silence ends it. Frames should be fed all the
+ * time, not just during utterances, so the noise floor is current when one
+ * starts.
+ */
+
+typedef enum endpoint_state {
+    ENDPOINT_IDLE,          /*!< not in an utterance */
+    ENDPOINT_WAITING,       /*!< utterance started, no speech yet */
+    ENDPOINT_SPEECH,        /*!< speech heard, waiting for trailing silence */
+    ENDPOINT_END,           /*!< trailing silence after speech */
+    ENDPOINT_NO_SPEECH,     /*!< gave up waiting for speech */
+} endpoint_state_t;
+
+typedef struct endpoint_config {
+    int sample_rate;
+    int trailing_silence_ms;    /*!< silence after speech that ends the utterance */
+    int no_speech_ms;           /*!< give up if there is no speech this long, 0 never */
+    int min_speech_ms;          /*!< speech needed before trailing silence counts */
+    int speech_ratio_q8;        /*!< level over the noise floor that is speech, 256 is 1x */
+    int min_level;              /*!< mean absolute level below which nothing is speech */
+} endpoint_config_t;
+
+typedef struct endpoint {
+    endpoint_config_t cfg;
+    int32_t floor_q4;           /* noise floor, 4 fractional bits */
+    endpoint_state_t state;
+    bool speech;                /* last frame was speech */
+    int elapsed_ms;
+    int speech_ms;
+    int silence_ms;
+} endpoint_t;
+
+void endpoint_init(endpoint_t *ep, const endpoint_config_t *cfg);
+
+/**
+ * @brief  start an utterance, from the next frame
+ */
+void endpoint_start(endpoint_t *ep);
+
+/**
+ * @brief  stop tracking the utterance, the VAD keeps running
+ */
+void endpoint_stop(endpoint_t *ep);
+
+/**
+ * @brief  feed one frame of 16-bit mono samples
+ *
+ * @return state after the frame; ENDPOINT_END and ENDPOINT_NO_SPEECH stay
+ *         until the next endpoint_start() or endpoint_stop()
+ */
+endpoint_state_t endpoint_process(endpoint_t *ep, const int16_t *buf, int samples);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ENDPOINT_H_ */
@@ -0,0 +1,165 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#include <math.h>
+#include <stdbool.h>
+#include "fft.h"
+
+/* Twiddles are Q30, W^k = exp(-2 pi i k / FFT_REAL_N). The complex FFT uses
+ * every other one, the real split stage all of the first half. */
+#define TW_SHIFT        30
+#define TW_COUNT        (3 * FFT_CPLX_N / 2)
+
+static fft_cplx_t twiddle[TW_COUNT];
+static uint8_t digit_rev[FFT_CPLX_N];
+static bool fft_ready;
+
+static inline int32_t mul_tw(int32_t a, int32_t w)
+{
+    return ((int64_t) a * w + (1 << (TW_SHIFT - 1))) >> TW_SHIFT;
+}
+
+void fft_init()
+{
+    if (fft_ready) {
+        return;
+    }
+    for (int k = 0; k < TW_COUNT; k++) {
+        double a = -2 * M_PI * k / FFT_REAL_N;
+        twiddle[k].re = lround(cos(a) * (1 << TW_SHIFT));
+        twiddle[k].im = lround(sin(a) * (1 << TW_SHIFT));
+    }
+    for (int i = 0; i < FFT_CPLX_N; i++) {
+        int r = 0;
+        for (int n = 1, v = i; n < FFT_CPLX_N; n <<= 2, v >>= 2) {
+            r = (r << 2) | (v & 3);
+        }
+        digit_rev[i] = r;
+    }
+    fft_ready = true;
+}
+
+/* Decimation in frequency, radix-4, in place. Leaves the output in base-4
+ * digit reversed order. Each stage can grow the magnitude by 4. */
+static void cfft_radix4(fft_cplx_t *x)
+{
+    for (int len = FFT_CPLX_N, tw_step = 2; len >= 4; len >>= 2, tw_step <<= 2) {
+        int q = len >> 2;
+        for (int g = 0; g < FFT_CPLX_N; g += len) {
+            fft_cplx_t *p = x + g;
+            for (int j = 0; j < q; j++) {
+                fft_cplx_t a = p[j], b = p[j + q], c = p[j + 2 * q], d = p[j + 3 * q];
+                int32_t t0r = a.re + c.re, t0i = a.im + c.im;
+                int32_t t1r = a.re - c.re, t1i = a.im - c.im;
+                int32_t t2r = b.re + d.re, t2i = b.im + d.im;
+                /* -j * (b - d) */
+                int32_t t3r = b.im - d.im, t3i = d.re - b.re;
+
+                p[j].re = t0r + t2r;
+                p[j].im = t0i + t2i;
+                if (j == 0) {
+                    p[j + q].re = t1r + t3r;
+                    p[j + q].im = t1i + t3i;
+                    p[j + 2 * q].re = t0r - t2r;
+                    p[j + 2 * q].im = t0i - t2i;
+                    p[j + 3 * q].re = t1r - t3r;
+                    p[j + 3 * q].im = t1i - t3i;
+                    continue;
+                }
+                const fft_cplx_t *w1 = &twiddle[j * tw_step];
+                const fft_cplx_t *w2 = &twiddle[2 * j * tw_step];
+                const fft_cplx_t *w3 = &twiddle[3 * j * tw_step];
+                int32_t yr, yi;
+
+                yr = t1r + t3r;
+                yi = t1i + t3i;
+                p[j + q].re = mul_tw(yr, w1->re) - mul_tw(yi, w1->im);
+                p[j + q].im = mul_tw(yr, w1->im) + mul_tw(yi, w1->re);
+                yr = t0r - t2r;
+                yi = t0i - t2i;
+                p[j + 2 * q].re = mul_tw(yr, w2->re) - mul_tw(yi, w2->im);
+                p[j + 2 * q].im = mul_tw(yr, w2->im) + mul_tw(yi, w2->re);
+                yr = t1r - t3r;
+                yi = t1i - t3i;
+                p[j + 3 * q].re = mul_tw(yr, w3->re) - mul_tw(yi, w3->im);
+                p[j + 3 * q].im = mul_tw(yr, w3->im) + mul_tw(yi, w3->re);
+            }
+        }
+    }
+    for (int i = 0; i < FFT_CPLX_N; i++) {
+        int r = digit_rev[i];
+        if (i < r) {
+            fft_cplx_t t = x[i];
+            x[i] = x[r];
+            x[r] = t;
+        }
+    }
+}
+
+/* The even and odd samples are transformed together as one complex signal
+ * and separated afterwards:
+ *   E = (Z[k] + Z*[N-k]) / 2,  O = (Z[k] - Z*[N-k]) / 2j,  X[k] = E + W^k O */
+void fft_real_forward(int32_t *x, fft_cplx_t *X)
+{
+    fft_cplx_t *z = (fft_cplx_t *) x;
+
+    cfft_radix4(z);
+    X[0].re = z[0].re + z[0].im;
+    X[0].im = 0;
+    X[FFT_CPLX_N].re = z[0].re - z[0].im;
+    X[FFT_CPLX_N].im = 0;
+    for (int k = 1; k < FFT_CPLX_N; k++) {
+        const fft_cplx_t *zk = &z[k], *zm = &z[FFT_CPLX_N - k];
+        const fft_cplx_t *w = &twiddle[k];
+        int32_t er = (zk->re + zm->re) >> 1;
+        int32_t ei = (zk->im - zm->im) >> 1;
+        int32_t or = (zk->im + zm->im) >> 1;
+        int32_t oi = (zm->re - zk->re) >> 1;
+
+        X[k].re = er + mul_tw(or, w->re) - mul_tw(oi, w->im);
+        X[k].im = ei + mul_tw(oi, w->re) + mul_tw(or, w->im);
+    }
+}
+
+/* Undoes the split, E = (X[k] + X*[N-k]) / 2, O = (X[k] - X*[N-k]) W^-k / 2,
+ * Z[k] = E + jO, then an inverse complex FFT computed as conj(FFT(conj(Z))) */
+void fft_real_inverse(const fft_cplx_t *X, int32_t *x)
+{
+    fft_cplx_t *z = (fft_cplx_t *) x;
+
+    for (int k = 0; k < FFT_CPLX_N; k++) {
+        const fft_cplx_t *xk = &X[k], *xm = &X[FFT_CPLX_N - k];
+        const fft_cplx_t *w = &twiddle[k];
+        int32_t er = (xk->re + xm->re) >> 1;
+        int32_t ei = (xk->im - xm->im) >> 1;
+        int32_t dr = (xk->re - xm->re) >> 1;
+        int32_t di = (xk->im + xm->im) >> 1;
+        int32_t or = mul_tw(dr, w->re) + mul_tw(di, w->im);
+        int32_t oi = mul_tw(di, w->re) - mul_tw(dr, w->im);
+
+        /* conj(E + jO) */
+        z[k].re = er - oi;
+        z[k].im = -(ei + or);
+    }
+    cfft_radix4(z);
+    /* conj and 1/N, N = FFT_CPLX_N = 2^8 */
+    for (int k = 0; k < FFT_CPLX_N; k++) {
+        z[k].re = (z[k].re + (1 << 7)) >> 8;
+        z[k].im = (-z[k].im + (1 << 7)) >> 8;
+    }
+}
@@ -0,0 +1,67 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _FFT_H_
+#define _FFT_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Real FFT length; computed as a radix-4 complex FFT of half the length */
+#define FFT_REAL_N      512
+#define FFT_CPLX_N      (FFT_REAL_N / 2)
+#define FFT_BINS        (FFT_REAL_N / 2 + 1)
+
+typedef struct fft_cplx {
+    int32_t re;
+    int32_t im;
+} fft_cplx_t;
+
+/**
+ * @brief  build the twiddle and digit reversal tables
+ *
+ * Needs to be called once before the transforms are used; later calls do
+ * nothing.
+ */
+void fft_init();
+
+/**
+ * @brief  forward real FFT, unscaled
+ *
+ * @param x  FFT_REAL_N samples, used as work space and destroyed. Inputs
+ *           must stay within +-2^21 so the transform can't overflow.
+ * @param X  FFT_BINS output bins, DC to Nyquist
+ */
+void fft_real_forward(int32_t *x, fft_cplx_t *X);
+
+/**
+ * @brief  inverse of fft_real_forward(), including the 1/N scaling
+ *
+ * @param X  FFT_BINS bins, left untouched
+ * @param x  FFT_REAL_N output samples
+ */
+void fft_real_inverse(const fft_cplx_t *X, int32_t *x);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FFT_H_ */
@@ -0,0 +1,138 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#include <stdlib.h>
+#include "frontend.h"
+
+#define DC_BLOCK_SHIFT      8
+#define GAIN_UNITY_Q8       256
+
+static inline int16_t sat16(int32_t v)
+{
+    if (v > INT16_MAX) {
+        return INT16_MAX;
+    } else if (v < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return v;
+}
+
+void frontend_init(frontend_t *fe, const frontend_config_t *cfg)
+{
+    fe->cfg = *cfg;
+    fe->dc_acc = 0;
+    fe->dc_x1 = 0;
+    fe->pe_x1 = 0;
+    fe->stats.gain_q8 = GAIN_UNITY_Q8;
+    fe->stats.level = 0;
+    fe->stats.frames = 0;
+    fe->stats.gated_frames = 0;
+}
+
+/* y[n] = x[n] - x[n-1] + (1 - 2^-8) y[n-1], with the feedback kept in Q8 so
+ * the pole doesn't need a multiply */
+static void dc_block(frontend_t *fe, int16_t *buf, int samples)
+{
+    int32_t acc = fe->dc_acc;
+    int32_t x1 = fe->dc_x1;
+
+    for (int i = 0; i < samples; i++) {
+        int32_t x = buf[i];
+        acc += ((x - x1) << 8) - (acc >> DC_BLOCK_SHIFT);
+        x1 = x;
+        buf[i] = sat16(acc >> 8);
+    }
+    fe->dc_acc = acc;
+    fe->dc_x1 = x1;
+}
+
+/* y[n] = x[n] - 15/16 x[n-1] */
+static void preemphasis(frontend_t *fe, int16_t *buf, int samples)
+{
+    int32_t x1 = fe->pe_x1;
+
+    for (int i = 0; i < samples; i++) {
+        int32_t x = buf[i];
+        buf[i] = sat16(x - x1 + (x1 >> 4));
+        x1 = x;
+    }
+    fe->pe_x1 = x1;
+}
+
+static int frame_level(const int16_t *buf, int samples)
+{
+    uint32_t sum = 0;
+
+    for (int i = 0; i < samples; i++) {
+        sum += abs(buf[i]);
+    }
+    return sum / samples;
+}
+
+static void agc(frontend_t *fe, int16_t *buf, int samples)
+{
+    const frontend_config_t *cfg = &fe->cfg;
+    int level = frame_level(buf, samples);
+    int gain = fe->stats.gain_q8;
+    int target = gain;
+
+    fe->stats.level = level;
+    if (level < cfg->gate_level) {
+        /* Don't pump up the noise floor between utterances */
+        fe->stats.gated_frames++;
+    } else {
+        target = (cfg->target_level * GAIN_UNITY_Q8) / level;
+        if (target > cfg->max_gain_q8) {
+            target = cfg->max_gain_q8;
+        }
+        if (target < gain) {
+            target = gain - ((gain - target) >> cfg->attack_shift);
+        } else {
+            target = gain + ((target - gain + (1 << cfg->release_shift) - 1) >> cfg->release_shift);
+        }
+    }
+    fe->stats.gain_q8 = target;
+
+    if (gain == GAIN_UNITY_Q8 && target == GAIN_UNITY_Q8) {
+        return;
+    }
+    /* Ramp from the previous frame's gain, in Q16 */
+    int32_t g = gain << 8;
+    int32_t step = ((target - gain) << 8) / samples;
+    for (int i = 0; i < samples; i++) {
+        g += step;
+        buf[i] = sat16((buf[i] * (g >> 8)) >> 8);
+    }
+}
+
+void frontend_process(frontend_t *fe, int16_t *buf, int samples)
+{
+    if (samples <= 0) {
+        return;
+    }
+    fe->stats.frames++;
+    if (fe->cfg.dc_block) {
+        dc_block(fe, buf, samples);
+    }
+    if (fe->cfg.preemphasis) {
+        preemphasis(fe, buf, samples);
+    }
+    if (fe->cfg.agc) {
+        agc(fe, buf, samples);
+    }
+}
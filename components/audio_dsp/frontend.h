@@ -0,0 +1,74 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _FRONTEND_H_
+#define _FRONTEND_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Front-end conditioning configuration */
+typedef struct frontend_config {
+    bool dc_block;          /*!< one-pole DC blocker, ~10 Hz at 16 kHz */
+    bool preemphasis;       /*!< first order pre-emphasis, 1 - 15/16 z^-1 */
+    bool agc;               /*!< automatic gain control */
+    int target_level;       /*!< AGC target mean absolute sample level */
+    int gate_level;         /*!< frames quieter than this don't move the AGC gain */
+    int max_gain_q8;        /*!< AGC gain ceiling, 256 is unity */
+    int attack_shift;       /*!< gain moves 1/2^shift of the way down per frame */
+    int release_shift;      /*!< gain moves 1/2^shift of the way up per frame */
+} frontend_config_t;
+
+/** AGC state, for diagnostics */
+typedef struct frontend_stats {
+    int gain_q8;            /*!< gain applied at the end of the last frame */
+    int level;              /*!< mean absolute level of the last frame, before AGC */
+    uint32_t frames;
+    uint32_t gated_frames;
+} frontend_stats_t;
+
+typedef struct frontend {
+    frontend_config_t cfg;
+    int32_t dc_acc;         /* DC blocker output, 8 fractional bits */
+    int16_t dc_x1;
+    int16_t pe_x1;
+    frontend_stats_t stats;
+} frontend_t;
+
+/**
+ * @brief  reset the filter state and set the configuration
+ */
+void frontend_init(frontend_t *fe, const frontend_config_t *cfg);
+
+/**
+ * @brief  condition one frame of 16-bit mono samples in place
+ *
+ * Filters run per sample; the AGC gain is updated once per frame and ramped
+ * across it so gain changes don't click.
+ */
+void frontend_process(frontend_t *fe, int16_t *buf, int samples);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FRONTEND_H_ */
@@ -0,0 +1,102 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#include "gain_ramp.h"
+
+#define COS_STEPS   32
+
+/* 0.5 - 0.5 cos(pi i / COS_STEPS) in Q15 */
+static const uint16_t raised_cosine[COS_STEPS + 1] = {
+    0, 79, 315, 705, 1247, 1935, 2761, 3719, 4799, 5990, 7282, 8661, 10114,
+    11628, 13188, 14778, 16384, 17990, 19580, 21140, 22654, 24107, 25486,
+    26778, 27969, 29049, 30007, 30833, 31521, 32063, 32453, 32689, 32768
+};
+
+static uint32_t ramp_request(int32_t target_q15, int32_t step_q15)
+{
+    if (target_q15 < 0) {
+        target_q15 = 0;
+    } else if (target_q15 > GAIN_RAMP_UNITY) {
+        target_q15 = GAIN_RAMP_UNITY;
+    }
+    if (step_q15 < 1) {
+        step_q15 = 1;
+    } else if (step_q15 > UINT16_MAX) {
+        step_q15 = UINT16_MAX;
+    }
+    return (uint32_t) target_q15 << 16 | step_q15;
+}
+
+void gain_ramp_init(gain_ramp_t *g, int32_t gain_q15)
+{
+    g->request = ramp_request(gain_q15, 1);
+    g->gain = g->request >> 16;
+}
+
+void gain_ramp_set(gain_ramp_t *g, int32_t target_q15, int32_t step_q15)
+{
+    g->request = ramp_request(target_q15, step_q15);
+}
+
+void gain_ramp_apply(gain_ramp_t *g, int16_t *buf, int frames, int channels)
+{
+    uint32_t request = g->request;
+    int32_t from = g->gain, step = request & 0xffff;
+    int32_t to = request >> 16;
+    int64_t acc, inc;
+    int i, c;
+
+    if (to > from + step) {
+        to = from + step;
+    } else if (to < from - step) {
+        to = from - step;
+    }
+    g->gain = to;
+    if (from == to) {
+        if (to == GAIN_RAMP_UNITY) {
+            return;
+        }
+        for (i = 0; i < frames * channels; i++) {
+            buf[i] = (buf[i] * to) >> 15;
+        }
+        return;
+    }
+    /* Q15 gain with 16 more fractional bits for the interpolation */
+    acc = (int64_t) from << 16;
+    inc = (((int64_t) (to - from)) << 16) / frames;
+    for (i = 0; i < frames; i++, acc += inc) {
+        int32_t gain = acc >> 16;
+        for (c = 0; c < channels; c++) {
+            buf[i * channels + c] = (buf[i * channels + c] * gain) >> 15;
+        }
+    }
+}
+
+int32_t gain_raised_cosine(uint32_t pos, uint32_t len)
+{
+    uint32_t x, i, frac;
+
+    if (pos >= len) {
+        return GAIN_RAMP_UNITY;
+    }
+    /* Table index with 8 fractional bits, linearly interpolated */
+    x = (uint32_t) (((uint64_t) pos * COS_STEPS << 8) / len);
+    i = x >> 8;
+    frac = x & 0xff;
+    return raised_cosine[i] + (((raised_cosine[i + 1] - raised_cosine[i]) * (int32_t) frac) >> 8);
+}
@@ -0,0 +1,68 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _GAIN_RAMP_H_
+#define _GAIN_RAMP_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Smoothed gain for audio processed in blocks, applied in place. Each
+ * block moves the gain towards its target by at most one step, and the
+ * gain is interpolated linearly across the block, so level changes don't
+ * zipper. Gains are at most unity.
+ */
+
+#define GAIN_RAMP_UNITY     32768   /*!< 1.0 in Q15 */
+
+typedef struct gain_ramp {
+    int32_t gain;               /* Q15, at the start of the next block */
+    /* Q15 target << 16 | Q15 most change per block, in one word so a
+     * block never sees the target of one gain_ramp_set() with the step of
+     * another */
+    volatile uint32_t request;
+} gain_ramp_t;
+
+void gain_ramp_init(gain_ramp_t *g, int32_t gain_q15);
+
+/**
+ * @brief  head for a new gain, at most step_q15 per block; may be called from another task
+ *
+ * The target is clamped to 0..GAIN_RAMP_UNITY and the step to 1..65535.
+ */
+void gain_ramp_set(gain_ramp_t *g, int32_t target_q15, int32_t step_q15);
+
+/**
+ * @brief  scale a block of interleaved frames in place
+ */
+void gain_ramp_apply(gain_ramp_t *g, int16_t *buf, int frames, int channels);
+
+/**
+ * @brief  raised cosine from 0 to GAIN_RAMP_UNITY as pos goes from 0 to len
+ */
+int32_t gain_raised_cosine(uint32_t pos, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _GAIN_RAMP_H_ */
@@ -0,0 +1,205 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#include <string.h>
+#include "jitter_buffer.h"
+#include "gain_ramp.h"
+
+static inline uint32_t ms_to_frames(const jitter_buffer_config_t *cfg, int ms)
+{
+    return (uint32_t) ms * cfg->sample_rate / 1000;
+}
+
+static inline uint32_t frames_to_ms(const jitter_buffer_t *jb, uint32_t frames)
+{
+    return (uint64_t) frames * 1000 / jb->cfg.sample_rate;
+}
+
+size_t jitter_buffer_mem_size(const jitter_buffer_config_t *cfg)
+{
+    return ms_to_frames(cfg, cfg->capacity_ms) * cfg->channels * sizeof(int16_t);
+}
+
+int jitter_buffer_init(jitter_buffer_t *jb, const jitter_buffer_config_t *cfg, void *mem)
+{
+    if (cfg->channels < 1 || cfg->channels > JITTER_BUFFER_MAX_CHANNELS ||
+            cfg->start_ms > cfg->capacity_ms || cfg->resume_ms > cfg->capacity_ms) {
+        return -1;
+    }
+    memset(jb, 0, sizeof(*jb));
+    jb->cfg = *cfg;
+    jb->buf = mem;
+    jb->frames = ms_to_frames(cfg, cfg->capacity_ms);
+    jb->start_frames = ms_to_frames(cfg, cfg->start_ms);
+    jb->resume_frames = ms_to_frames(cfg, cfg->resume_ms);
+    jb->fade_frames = ms_to_frames(cfg, cfg->fade_ms);
+    jb->idle_frames = ms_to_frames(cfg, cfg->idle_ms);
+    if (!jb->frames) {
+        return -1;
+    }
+    return 0;
+}
+
+uint32_t jitter_buffer_depth(const jitter_buffer_t *jb)
+{
+    return jb->wr - jb->rd;
+}
+
+int jitter_buffer_write(jitter_buffer_t *jb, const int16_t *in, int frames)
+{
+    int ch = jb->cfg.channels;
+    uint32_t wr = jb->wr;
+    uint32_t space = jb->frames - (wr - jb->rd);
+    uint32_t n = (uint32_t) frames < space ? (uint32_t) frames : space;
+    uint32_t pos = wr % jb->frames;
+    uint32_t first = jb->frames - pos;
+
+    if (first > n) {
+        first = n;
+    }
+    memcpy(jb->buf + pos * ch, in, first * ch * sizeof(int16_t));
+    memcpy(jb->buf, in + first * ch, (n - first) * ch * sizeof(int16_t));
+    /* The samples must land before the reader sees the new count */
+    __sync_synchronize();
+    jb->wr = wr + n;
+    return n;
+}
+
+/* Copies n frames out of the ring, fading in if a fade is running */
+static void play(jitter_buffer_t *jb, int16_t *out, uint32_t n)
+{
+    int ch = jb->cfg.channels;
+    uint32_t pos = jb->rd % jb->frames;
+    uint32_t first = jb->frames - pos;
+    uint32_t i;
+    int c;
+
+    if (first > n) {
+        first = n;
+    }
+    memcpy(out, jb->buf + pos * ch, first * ch * sizeof(int16_t));
+    memcpy(out + first * ch, jb->buf, (n - first) * ch * sizeof(int16_t));
+    for (i = 0; i < n && jb->fade_in; i++, jb->fade_in--) {
+        int32_t gain = gain_raised_cosine(jb->fade_frames - jb->fade_in, jb->fade_frames);
+        for (c = 0; c < ch; c++) {
+            out[i * ch + c] = (out[i * ch + c] * gain) >> 15;
+        }
+    }
+    if (n) {
+        for (c = 0; c < ch; c++) {
+            jb->last[c] = out[(n - 1) * ch + c];
+        }
+    }
+    /* Done with the samples before the writer may reuse their space */
+    __sync_synchronize();
+    jb->rd += n;
+}
+
+static void start_playing(jitter_buffer_t *jb)
+{
+    jb->state = JITTER_BUFFER_PLAYING;
+    jb->fade_in = jb->fade_frames;
+}
+
+jitter_buffer_state_t jitter_buffer_read(jitter_buffer_t *jb, int16_t *out, int frames)
+{
+    int ch = jb->cfg.channels;
+    uint32_t wr = jb->wr;
+    uint32_t depth, done = 0;
+    int i, c;
+
+    __sync_synchronize();
+    depth = wr - jb->rd;
+    if (wr != jb->seen_wr) {
+        jb->seen_wr = wr;
+        jb->stalled = 0;
+    }
+
+    if (jb->state == JITTER_BUFFER_IDLE) {
+        if (depth >= jb->start_frames || (depth && jb->stalled >= jb->idle_frames)) {
+            jb->streams++;
+            start_playing(jb);
+        }
+    } else if (jb->state == JITTER_BUFFER_UNDERRUN) {
+        if (depth >= jb->resume_frames || (depth && jb->stalled >= jb->idle_frames)) {
+            /* More data came after the gap, so it was a real underrun */
+            jb->underruns++;
+            jb->concealed += jb->pending;
+            jb->pending = 0;
+            start_playing(jb);
+        } else if (jb->stalled >= jb->idle_frames) {
+            /* Nothing more came, the stream just ended */
+            jb->state = JITTER_BUFFER_IDLE;
+            jb->pending = 0;
+        }
+    }
+
+    if (jb->reset_depth) {
+        jb->reset_depth = false;
+        jb->max_depth = 0;
+        jb->depth_sum = 0;
+        jb->depth_reads = 0;
+    }
+    if (depth > jb->max_depth) {
+        jb->max_depth = depth;
+    }
+    if (jb->state == JITTER_BUFFER_PLAYING) {
+        jb->depth_sum += depth;
+        jb->depth_reads++;
+        done = depth < (uint32_t) frames ? depth : (uint32_t) frames;
+        play(jb, out, done);
+        if (done < (uint32_t) frames) {
+            jb->state = JITTER_BUFFER_UNDERRUN;
+            jb->fade_out = jb->fade_frames;
+        }
+    }
+
+    /* Whatever is left is silence, ramping down from the last sample
+     * played so the cut doesn't click */
+    for (i = done; i < frames; i++) {
+        int32_t gain = 0;
+        if (jb->fade_out) {
+            gain = gain_raised_cosine(--jb->fade_out, jb->fade_frames);
+        }
+        for (c = 0; c < ch; c++) {
+            out[i * ch + c] = (jb->last[c] * gain) >> 15;
+        }
+    }
+    if (jb->state == JITTER_BUFFER_UNDERRUN) {
+        jb->pending += frames - done;
+    }
+    if (jb->stalled < jb->idle_frames) {
+        jb->stalled += frames;
+    }
+    return jb->state;
+}
+
+void jitter_buffer_get_stats(jitter_buffer_t *jb, jitter_buffer_stats_t *stats, bool reset)
+{
+    uint32_t depth = jb->wr - jb->rd;
+
+    stats->underruns = jb->underruns;
+    stats->concealed_ms = frames_to_ms(jb, jb->concealed);
+    stats->depth_ms = frames_to_ms(jb, depth);
+    stats->avg_depth_ms = jb->depth_reads ? frames_to_ms(jb, jb->depth_sum / jb->depth_reads) : 0;
+    stats->max_depth_ms = frames_to_ms(jb, jb->max_depth);
+    stats->streams = jb->streams;
+    if (reset) {
+        jb->reset_depth = true;
+    }
+}
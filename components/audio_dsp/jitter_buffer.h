@@ -0,0 +1,141 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _JITTER_BUFFER_H_
+#define _JITTER_BUFFER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Playback jitter buffer. One task writes decoded PCM as it arrives from
+ * the network, another reads fixed periods for the DAC and always gets a
+ * full period back. Playback starts once the buffer holds the start
+ * watermark. If it then runs dry, the last sample is ramped down to zero
+ * with a raised cosine instead of stopping dead, silence is played until
+ * the buffer holds the resume watermark, and playback fades back in.
+ *
+ * The SDK doesn't say when a stream ends, so an empty buffer that gets no
+ * more data for idle_ms is taken as the end of the stream rather than an
+ * underrun, and a tail shorter than the watermark is played out once the
+ * writer has gone quiet that long.
+ */
+
+#define JITTER_BUFFER_MAX_CHANNELS  2
+
+typedef enum jitter_buffer_state {
+    JITTER_BUFFER_IDLE,         /*!< no stream, buffering up to the start watermark */
+    JITTER_BUFFER_PLAYING,
+    JITTER_BUFFER_UNDERRUN,     /*!< ran dry mid-stream, buffering up to the resume watermark */
+} jitter_buffer_state_t;
+
+typedef struct jitter_buffer_config {
+    int sample_rate;
+    int channels;
+    int capacity_ms;        /*!< writes block above this depth */
+    int start_ms;           /*!< depth needed to start a stream */
+    int resume_ms;          /*!< depth needed to resume after an underrun */
+    int fade_ms;            /*!< length of the fade out and fade in */
+    int idle_ms;            /*!< writer silence that ends a stream */
+} jitter_buffer_config_t;
+
+typedef struct jitter_buffer_stats {
+    uint32_t underruns;
+    uint32_t concealed_ms;  /*!< silence played because of underruns */
+    uint32_t depth_ms;
+    uint32_t avg_depth_ms;  /*!< mean depth while playing, since the last reset */
+    uint32_t max_depth_ms;
+    uint32_t streams;
+} jitter_buffer_stats_t;
+
+typedef struct jitter_buffer {
+    jitter_buffer_config_t cfg;
+    int16_t *buf;
+    uint32_t frames;            /* capacity */
+    uint32_t start_frames;
+    uint32_t resume_frames;
+    uint32_t fade_frames;
+    uint32_t idle_frames;
+    volatile uint32_t wr;       /* frames written, free running */
+    volatile uint32_t rd;       /* frames read, free running */
+    volatile bool reset_depth;  /* asked by jitter_buffer_get_stats(), done by the reader */
+    /* Reader only */
+    jitter_buffer_state_t state;
+    int16_t last[JITTER_BUFFER_MAX_CHANNELS];
+    uint32_t fade_in;           /* frames of fade in left */
+    uint32_t fade_out;          /* frames of fade out left */
+    uint32_t seen_wr;
+    uint32_t stalled;           /* frames played since wr last moved */
+    uint32_t pending;           /* silence played in the current underrun */
+    uint32_t underruns;
+    uint32_t concealed;
+    uint32_t streams;
+    uint64_t depth_sum;
+    uint32_t depth_reads;
+    uint32_t max_depth;
+} jitter_buffer_t;
+
+/**
+ * @brief  bytes of sample memory jitter_buffer_init() needs
+ */
+size_t jitter_buffer_mem_size(const jitter_buffer_config_t *cfg);
+
+/**
+ * @brief  set up a buffer in caller provided memory of jitter_buffer_mem_size()
+ *
+ * @return 0 on success, -1 on a bad configuration
+ */
+int jitter_buffer_init(jitter_buffer_t *jb, const jitter_buffer_config_t *cfg, void *mem);
+
+/**
+ * @brief  queue interleaved frames, from the writer task
+ *
+ * @return frames taken, fewer than `frames` if the buffer filled up
+ */
+int jitter_buffer_write(jitter_buffer_t *jb, const int16_t *in, int frames);
+
+/**
+ * @brief  frames buffered
+ */
+uint32_t jitter_buffer_depth(const jitter_buffer_t *jb);
+
+/**
+ * @brief  fill one period of interleaved frames, from the reader task
+ *
+ * @return state after the period; the output is silent while IDLE
+ */
+jitter_buffer_state_t jitter_buffer_read(jitter_buffer_t *jb, int16_t *out, int frames);
+
+/**
+ * @brief  counters and depth, from the reader task or a racy snapshot
+ *
+ * @param  reset    restart the mean and the high water mark; the reader
+ *                  does this at its next period, as they are its own
+ */
+void jitter_buffer_get_stats(jitter_buffer_t *jb, jitter_buffer_stats_t *stats, bool reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _JITTER_BUFFER_H_ */
@@ -0,0 +1,233 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "fft.h"
+#include "noise_suppress.h"
+
+/* Samples are scaled up by 2^4 going into the FFT for precision, which keeps
+ * a full scale frame within what fft_real_forward() can take */
+#define IN_SHIFT        4
+/* Bin power is kept in 32 bits, this scale puts a -60 dBFS noise floor at
+ * about 64 and only saturates on loud tones, where the gain is 1 anyway */
+#define POWER_SHIFT     20
+/* Power smoothing, alpha = 0.8 */
+#define SMOOTH_Q15      6554
+/* Minimum search over NS_SUBWIN windows of NS_SUBWIN_FRAMES frames, ~1.5 s */
+#define NS_SUBWIN       6
+#define NS_SUBWIN_FRAMES 16
+/* Compensates for the minimum being below the mean noise power, 1.5 in Q8 */
+#define NOISE_BIAS_Q8   384
+/* Decision directed a priori SNR weight, 0.98 */
+#define DD_Q15          32113
+#define SNR_MAX_Q8      (1 << 20)
+
+struct noise_suppress {
+    noise_suppress_config_t cfg;
+    int16_t in[NS_FRAME];
+    int in_fill;
+    int16_t out[NS_HOP + NS_MAX_BLOCK];
+    int out_len;
+    int32_t ola[NS_HOP];
+    int32_t work[FFT_REAL_N];
+    fft_cplx_t spec[FFT_BINS];
+    uint32_t smooth[FFT_BINS];
+    uint32_t cur_min[FFT_BINS];
+    uint32_t sub_min[NS_SUBWIN][FFT_BINS];
+    uint32_t clean[FFT_BINS];
+    int sub_frames;
+    int sub_idx;
+    noise_suppress_stats_t stats;
+};
+
+static int16_t window[NS_FRAME];
+static bool window_ready;
+
+static inline int16_t sat16(int32_t v)
+{
+    if (v > INT16_MAX) {
+        return INT16_MAX;
+    } else if (v < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return v;
+}
+
+/* num / den in Q8, capped at SNR_MAX_Q8 */
+static inline uint32_t ratio_q8(uint32_t num, uint32_t den)
+{
+    uint32_t r;
+
+    if (den == 0) {
+        den = 1;
+    }
+    if (num < (1U << 24)) {
+        r = (num << 8) / den;
+    } else {
+        r = ((uint64_t) num << 8) / den;
+    }
+    return (r > SNR_MAX_Q8) ? SNR_MAX_Q8 : r;
+}
+
+noise_suppress_t *noise_suppress_create(const noise_suppress_config_t *cfg)
+{
+    noise_suppress_t *ns = calloc(1, sizeof(noise_suppress_t));
+
+    if (!ns) {
+        return NULL;
+    }
+    fft_init();
+    if (!window_ready) {
+        /* sqrt of a periodic Hann window, so analysis * synthesis overlap-adds to 1 */
+        for (int i = 0; i < NS_FRAME; i++) {
+            window[i] = lround(sqrt(0.5 * (1 - cos(2 * M_PI * i / NS_FRAME))) * INT16_MAX);
+        }
+        window_ready = true;
+    }
+    ns->cfg = *cfg;
+    ns->in_fill = NS_HOP;
+    ns->out_len = NS_HOP;
+    for (int u = 0; u < NS_SUBWIN; u++) {
+        memset(ns->sub_min[u], 0xff, sizeof(ns->sub_min[u]));
+    }
+    return ns;
+}
+
+void noise_suppress_destroy(noise_suppress_t *ns)
+{
+    free(ns);
+}
+
+static void update_noise_and_gain(noise_suppress_t *ns)
+{
+    const int min_gain = ns->cfg.min_gain_q15;
+    bool first = (ns->stats.frames == 0);
+    bool sub_done = (++ns->sub_frames == NS_SUBWIN_FRAMES);
+    uint32_t gain_sum = 0;
+
+    for (int k = 0; k < FFT_BINS; k++) {
+        fft_cplx_t *X = &ns->spec[k];
+        uint64_t p64 = ((int64_t) X->re * X->re + (int64_t) X->im * X->im) >> POWER_SHIFT;
+        uint32_t p = (p64 > UINT32_MAX) ? UINT32_MAX : p64;
+        uint32_t s = ns->smooth[k];
+        uint32_t noise;
+
+        if (first) {
+            s = p;
+            ns->cur_min[k] = p;
+        } else if (p > s) {
+            s += ((uint64_t) (p - s) * SMOOTH_Q15) >> 15;
+        } else {
+            s -= ((uint64_t) (s - p) * SMOOTH_Q15) >> 15;
+        }
+        ns->smooth[k] = s;
+
+        if (s < ns->cur_min[k]) {
+            ns->cur_min[k] = s;
+        }
+        noise = ns->cur_min[k];
+        for (int u = 0; u < NS_SUBWIN; u++) {
+            if (ns->sub_min[u][k] < noise) {
+                noise = ns->sub_min[u][k];
+            }
+        }
+        noise = ((uint64_t) noise * NOISE_BIAS_Q8) >> 8;
+        if (sub_done) {
+            ns->sub_min[ns->sub_idx][k] = ns->cur_min[k];
+            ns->cur_min[k] = s;
+        }
+
+        /* Decision directed a priori SNR from the last frame's clean power
+         * estimate and this frame's a posteriori SNR */
+        uint32_t post = ratio_q8(p, noise);
+        uint32_t ml = (post > 256) ? post - 256 : 0;
+        uint32_t prio = ((uint64_t) DD_Q15 * ratio_q8(ns->clean[k], noise) +
+                         (uint64_t) (32768 - DD_Q15) * ml) >> 15;
+        /* Wiener gain prio / (1 + prio) */
+        int32_t g = 32768 - (int32_t) ((256U << 15) / (prio + 256));
+        if (g < min_gain) {
+            g = min_gain;
+        }
+        ns->clean[k] = ((uint64_t) p * (((uint32_t) g * g) >> 15)) >> 15;
+        X->re = ((int64_t) X->re * g) >> 15;
+        X->im = ((int64_t) X->im * g) >> 15;
+        gain_sum += g;
+    }
+    if (sub_done) {
+        ns->sub_frames = 0;
+        ns->sub_idx = (ns->sub_idx + 1) % NS_SUBWIN;
+    }
+    ns->stats.mean_gain_q15 = gain_sum / FFT_BINS;
+}
+
+static void process_frame(noise_suppress_t *ns)
+{
+    int32_t *w = ns->work;
+    int16_t *out = ns->out + ns->out_len;
+
+    for (int i = 0; i < NS_FRAME; i++) {
+        w[i] = (ns->in[i] * window[i]) >> (15 - IN_SHIFT);
+    }
+    fft_real_forward(w, ns->spec);
+    update_noise_and_gain(ns);
+    fft_real_inverse(ns->spec, w);
+
+    for (int i = 0; i < NS_HOP; i++) {
+        int32_t v = ns->ola[i] + (int32_t) (((int64_t) w[i] * window[i]) >> 15);
+        out[i] = sat16((v + (1 << (IN_SHIFT - 1))) >> IN_SHIFT);
+        ns->ola[i] = ((int64_t) w[i + NS_HOP] * window[i + NS_HOP]) >> 15;
+    }
+    ns->out_len += NS_HOP;
+    ns->stats.frames++;
+}
+
+void noise_suppress_process(noise_suppress_t *ns, int16_t *buf, int samples)
+{
+    int done = 0;
+
+    if (samples > NS_MAX_BLOCK) {
+        samples = NS_MAX_BLOCK;
+    }
+    while (done < samples) {
+        int n = NS_FRAME - ns->in_fill;
+        if (n > samples - done) {
+            n = samples - done;
+        }
+        memcpy(ns->in + ns->in_fill, buf + done, n * sizeof(int16_t));
+        ns->in_fill += n;
+        done += n;
+        if (ns->in_fill == NS_FRAME) {
+            process_frame(ns);
+            memmove(ns->in, ns->in + NS_HOP, NS_HOP * sizeof(int16_t));
+            ns->in_fill = NS_HOP;
+        }
+    }
+    /* There is always enough output: it was primed with one hop, and every
+     * hop of input produces a hop of output */
+    memcpy(buf, ns->out, samples * sizeof(int16_t));
+    ns->out_len -= samples;
+    memmove(ns->out, ns->out + samples, ns->out_len * sizeof(int16_t));
+}
+
+void noise_suppress_get_stats(const noise_suppress_t *ns, noise_suppress_stats_t *stats)
+{
+    *stats = ns->stats;
+}
@@ -0,0 +1,77 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _NOISE_SUPPRESS_H_
+#define _NOISE_SUPPRESS_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * STFT noise suppressor: 512 point sqrt-Hann frames with 50% overlap (16 ms
+ * hop at 16 kHz), a minimum statistics noise estimate and a decision
+ * directed Wiener gain per bin. Everything but the table setup is integer.
+ *
+ * CPU budget: 10% of one 240 MHz core, i.e. 480k cycles per 20 ms of audio.
+ */
+
+#define NS_FRAME        512
+#define NS_HOP          (NS_FRAME / 2)
+/** Delay from input to output, in samples */
+#define NS_LATENCY      NS_FRAME
+/** Largest block noise_suppress_process() accepts */
+#define NS_MAX_BLOCK    512
+
+typedef struct noise_suppress_config {
+    int min_gain_q15;       /*!< gain floor per bin, limits musical noise; 32768 is 0 dB */
+} noise_suppress_config_t;
+
+typedef struct noise_suppress_stats {
+    uint32_t frames;        /*!< STFT frames processed */
+    int mean_gain_q15;      /*!< mean gain across bins in the last frame */
+} noise_suppress_stats_t;
+
+typedef struct noise_suppress noise_suppress_t;
+
+/**
+ * @brief  allocate a suppressor, about 20 KB
+ *
+ * @return NULL if out of memory
+ */
+noise_suppress_t *noise_suppress_create(const noise_suppress_config_t *cfg);
+
+void noise_suppress_destroy(noise_suppress_t *ns);
+
+/**
+ * @brief  suppress noise in a block of 16-bit mono samples, in place
+ *
+ * The output is delayed by NS_LATENCY samples. Blocks can be any size up to
+ * NS_MAX_BLOCK and don't need to line up with the hop.
+ */
+void noise_suppress_process(noise_suppress_t *ns, int16_t *buf, int samples);
+
+void noise_suppress_get_stats(const noise_suppress_t *ns, noise_suppress_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NOISE_SUPPRESS_H_ */
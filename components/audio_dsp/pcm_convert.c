@@ -0,0 +1,194 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#include <string.h>
+#include "pcm_convert.h"
+
+/* The output overwrites the input buffer, tell the compiler so */
+typedef int16_t __attribute__((__may_alias__)) alias_s16_t;
+
+static inline int16_t sat16(int32_t v)
+{
+    if (v > INT16_MAX) {
+        return INT16_MAX;
+    } else if (v < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return v;
+}
+
+/* xorshift32, enough for dither noise */
+static inline uint32_t noise(uint32_t *s)
+{
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *s = x;
+    return x;
+}
+
+/* The shift is done in 64 bits so rounding and dither can't overflow a full
+ * scale slot, and so shifts below 16 (i.e. gain) saturate correctly. */
+#define CONVERT_ROUND(x)    sat16((int32_t) (((int64_t) (x) + round) >> shift))
+#define CONVERT_DITHER(x)   sat16((int32_t) (((int64_t) (x) + round + tpdf(&seed, mask)) >> shift))
+
+/* Difference of two uniform values, triangular over +-1 output LSB */
+static inline int32_t tpdf(uint32_t *seed, uint32_t mask)
+{
+    uint32_t r = noise(seed);
+    return (int32_t) (r & mask) - (int32_t) ((r >> 16) & mask);
+}
+
+int pcm_convert_s32_to_s16(pcm_convert_t *cv, int32_t *buf, int frames)
+{
+    const int shift = cv->shift;
+    const int step = cv->channels;
+    const int64_t round = (shift > 0) ? (1LL << (shift - 1)) : 0;
+    const int32_t *in = buf + cv->channel;
+    alias_s16_t *out = (alias_s16_t *) buf;
+    int i = 0;
+
+    if (cv->dither && shift > 0) {
+        /* Both noise halves come from one 32-bit draw, so the dither span is
+         * limited to 16 bits, which covers every shift that makes sense */
+        uint32_t mask = (shift >= 16) ? 0xffff : ((1U << shift) - 1);
+        uint32_t seed = cv->seed;
+        for (; i + 4 <= frames; i += 4, in += 4 * step) {
+            out[i] = CONVERT_DITHER(in[0]);
+            out[i + 1] = CONVERT_DITHER(in[step]);
+            out[i + 2] = CONVERT_DITHER(in[2 * step]);
+            out[i + 3] = CONVERT_DITHER(in[3 * step]);
+        }
+        for (; i < frames; i++, in += step) {
+            out[i] = CONVERT_DITHER(in[0]);
+        }
+        cv->seed = seed;
+        return frames;
+    }
+
+    for (; i + 4 <= frames; i += 4, in += 4 * step) {
+        out[i] = CONVERT_ROUND(in[0]);
+        out[i + 1] = CONVERT_ROUND(in[step]);
+        out[i + 2] = CONVERT_ROUND(in[2 * step]);
+        out[i + 3] = CONVERT_ROUND(in[3 * step]);
+    }
+    for (; i < frames; i++, in += step) {
+        out[i] = CONVERT_ROUND(in[0]);
+    }
+    return frames;
+}
+
+int pcm_select_s16(int16_t *buf, int frames, int channels, int channel)
+{
+    const int16_t *in = buf + channel;
+    int i = 0;
+
+    if (channels == 1) {
+        return frames;
+    }
+    for (; i + 4 <= frames; i += 4, in += 4 * channels) {
+        buf[i] = in[0];
+        buf[i + 1] = in[channels];
+        buf[i + 2] = in[2 * channels];
+        buf[i + 3] = in[3 * channels];
+    }
+    for (; i < frames; i++, in += channels) {
+        buf[i] = in[0];
+    }
+    return frames;
+}
+
+/* One body for every output kernel. It is only ever called with constant
+ * arguments from the wrappers below, so each of them is compiled down to a
+ * loop with the slot type, shift and channel handling fixed. The multiply
+ * is a left shift that is also defined for negative samples. */
+#define PCM_OUT_BODY(type, shift, channels)                              \
+    do {                                                                 \
+        type *o = out;                                                   \
+        int i = 0;                                                       \
+        for (; i + 2 <= frames; i += 2, in += 2 * (channels), o += 4) {  \
+            o[0] = (type) (in[0] * (1 << (shift)));                      \
+            o[1] = (type) (in[(channels) - 1] * (1 << (shift)));         \
+            o[2] = (type) (in[(channels)] * (1 << (shift)));             \
+            o[3] = (type) (in[2 * (channels) - 1] * (1 << (shift)));     \
+        }                                                                \
+        for (; i < frames; i++, in += (channels), o += 2) {              \
+            o[0] = (type) (in[0] * (1 << (shift)));                      \
+            o[1] = (type) (in[(channels) - 1] * (1 << (shift)));         \
+        }                                                                \
+    } while (0)
+
+static void out_s16_mono(void *out, const int16_t *in, int frames)
+{
+    PCM_OUT_BODY(int16_t, 0, 1);
+}
+
+static void out_s16_stereo(void *out, const int16_t *in, int frames)
+{
+    memcpy(out, in, frames * 2 * sizeof(int16_t));
+}
+
+static void out_s24_mono(void *out, const int16_t *in, int frames)
+{
+    PCM_OUT_BODY(int32_t, 8, 1);
+}
+
+static void out_s24_stereo(void *out, const int16_t *in, int frames)
+{
+    PCM_OUT_BODY(int32_t, 8, 2);
+}
+
+static void out_s32_mono(void *out, const int16_t *in, int frames)
+{
+    PCM_OUT_BODY(int32_t, 16, 1);
+}
+
+static void out_s32_stereo(void *out, const int16_t *in, int frames)
+{
+    PCM_OUT_BODY(int32_t, 16, 2);
+}
+
+static const pcm_out_fn_t out_kernels[PCM_OUT_FORMAT_MAX][2] = {
+    [PCM_OUT_S16]       = { out_s16_mono, out_s16_stereo },
+    [PCM_OUT_S24_IN_32] = { out_s24_mono, out_s24_stereo },
+    [PCM_OUT_S32]       = { out_s32_mono, out_s32_stereo },
+};
+
+pcm_out_fn_t pcm_out_kernel(int channels, pcm_out_format_t format)
+{
+    if (channels < 1 || channels > 2 || format >= PCM_OUT_FORMAT_MAX) {
+        return NULL;
+    }
+    return out_kernels[format][channels - 1];
+}
+
+int pcm_out_frame_bytes(pcm_out_format_t format)
+{
+    return format == PCM_OUT_S16 ? 2 * sizeof(int16_t) : 2 * sizeof(int32_t);
+}
+
+void pcm_mix_s16(int16_t *dst, const int16_t *src, int frames, int src_channels)
+{
+    int i;
+
+    for (i = 0; i < frames; i++, src += src_channels, dst += 2) {
+        dst[0] = sat16(dst[0] + src[0]);
+        dst[1] = sat16(dst[1] + src[src_channels - 1]);
+    }
+}
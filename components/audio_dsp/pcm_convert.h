@@ -0,0 +1,94 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _PCM_CONVERT_H_
+#define _PCM_CONVERT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Conversion of 32-bit I2S slots to 16-bit PCM */
+typedef struct pcm_convert {
+    int shift;          /*!< right shift from the 32-bit slot, 16 keeps the top 16 bits */
+    bool dither;        /*!< add TPDF dither of +-1 output LSB before truncating */
+    int channels;       /*!< interleaved channels in the input */
+    int channel;        /*!< channel to keep */
+    uint32_t seed;      /*!< dither noise state, any non-zero value */
+} pcm_convert_t;
+
+/**
+ * @brief  convert 32-bit slots to 16-bit samples in place
+ *
+ * Keeps one channel out of `frames` interleaved frames, shifts with rounding
+ * (or dither) and saturates. The output is written over the start of `buf`.
+ *
+ * @return number of 16-bit samples written
+ */
+int pcm_convert_s32_to_s16(pcm_convert_t *cv, int32_t *buf, int frames);
+
+/**
+ * @brief  keep one channel of interleaved 16-bit frames, in place
+ *
+ * @return number of 16-bit samples written
+ */
+int pcm_select_s16(int16_t *buf, int frames, int channels, int channel);
+
+/** I2S output slot formats, two slots (left, right) per frame */
+typedef enum pcm_out_format {
+    PCM_OUT_S16,            /*!< 16-bit slots */
+    PCM_OUT_S24_IN_32,      /*!< 24-bit samples, sign extended in 32-bit slots */
+    PCM_OUT_S32,            /*!< 32-bit slots, sample in the top 16 bits */
+    PCM_OUT_FORMAT_MAX,
+} pcm_out_format_t;
+
+/**
+ * Convert `frames` interleaved 16-bit frames to output slots. `in` and `out`
+ * must not overlap.
+ */
+typedef void (*pcm_out_fn_t)(void *out, const int16_t *in, int frames);
+
+/**
+ * @brief  pick the conversion kernel for an input channel count
+ *
+ * Each combination is a separate function with the sizes and shifts fixed
+ * at compile time, so select it once per stream and call it per block.
+ * Mono input is copied to both slots.
+ *
+ * @return NULL if channels isn't 1 or 2
+ */
+pcm_out_fn_t pcm_out_kernel(int channels, pcm_out_format_t format);
+
+/**
+ * @brief  bytes per output frame
+ */
+int pcm_out_frame_bytes(pcm_out_format_t format);
+
+/**
+ * @brief  add mono or stereo frames into stereo 16-bit frames, saturating
+ */
+void pcm_mix_s16(int16_t *dst, const int16_t *src, int frames, int src_channels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PCM_CONVERT_H_ */
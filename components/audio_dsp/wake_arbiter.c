@@ -0,0 +1,240 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#include <string.h>
+#include <math.h>
+#include "wake_arbiter.h"
+
+/* Score units: 1/16 dB of SNR above the confidence byte */
+#define SCORE_SNR_STEPS_PER_DB  16
+#define SCORE_MAX_SNR_DB        90
+
+static inline int32_t since(uint32_t now_ms, uint32_t t_ms)
+{
+    return (int32_t) (now_ms - t_ms);
+}
+
+static inline bool beats(uint32_t score, uint32_t id, uint32_t other_score, uint32_t other_id)
+{
+    return score > other_score || (score == other_score && id > other_id);
+}
+
+static bool peer_alive(const wake_arbiter_t *arb, const wake_arbiter_peer_t *p, uint32_t now_ms)
+{
+    return p->device_id && (!arb->cfg.peer_timeout_ms || since(now_ms, p->heard_ms) < arb->cfg.peer_timeout_ms);
+}
+
+/* Known peer, else a free slot, else the one heard from longest ago */
+static wake_arbiter_peer_t *peer_get(wake_arbiter_t *arb, uint32_t id)
+{
+    wake_arbiter_peer_t *slot = NULL;
+
+    for (int i = 0; i < WAKE_ARBITER_MAX_PEERS; i++) {
+        wake_arbiter_peer_t *p = &arb->peers[i];
+        if (p->device_id == id) {
+            return p;
+        }
+        if (!slot || (slot->device_id && (!p->device_id || since(slot->heard_ms, p->heard_ms) > 0))) {
+            slot = p;
+        }
+    }
+    memset(slot, 0, sizeof(*slot));
+    slot->device_id = id;
+    return slot;
+}
+
+static void msg_fill(const wake_arbiter_t *arb, wake_arbiter_msg_type_t type, wake_arbiter_msg_t *msg)
+{
+    memset(msg, 0, sizeof(*msg));
+    msg->magic = WAKE_ARBITER_MAGIC;
+    msg->version = WAKE_ARBITER_VERSION;
+    msg->type = type;
+    msg->device_id = arb->cfg.device_id;
+    msg->event = arb->event;
+    msg->score = arb->score;
+}
+
+static wake_arbiter_result_t decide(wake_arbiter_t *arb, wake_arbiter_result_t result, uint32_t now_ms)
+{
+    uint32_t ms = since(now_ms, arb->claim_ms);
+
+    arb->state = result;
+    arb->stats.decide_ms_total += ms;
+    if (ms > arb->stats.max_decide_ms) {
+        arb->stats.max_decide_ms = ms;
+    }
+    if (result == WAKE_ARBITER_WIN) {
+        arb->stats.wins++;
+    }
+    return result;
+}
+
+void wake_arbiter_init(wake_arbiter_t *arb, const wake_arbiter_config_t *cfg)
+{
+    memset(arb, 0, sizeof(*arb));
+    arb->cfg = *cfg;
+}
+
+uint32_t wake_arbiter_score(uint32_t level, uint32_t floor, int confidence)
+{
+    float snr_db = 20 * log10f((float) (level + 1) / (floor + 1));
+
+    if (snr_db < 0) {
+        snr_db = 0;
+    } else if (snr_db > SCORE_MAX_SNR_DB) {
+        snr_db = SCORE_MAX_SNR_DB;
+    }
+    if (confidence < 0) {
+        confidence = 0;
+    } else if (confidence > 255) {
+        confidence = 255;
+    }
+    return ((uint32_t) (snr_db * SCORE_SNR_STEPS_PER_DB) << 8) | confidence;
+}
+
+wake_arbiter_result_t wake_arbiter_claim(wake_arbiter_t *arb, uint32_t score, uint32_t now_ms,
+                                         wake_arbiter_msg_t *msg)
+{
+    int alive = 0;
+
+    if (arb->state == WAKE_ARBITER_PENDING) {
+        msg_fill(arb, WAKE_ARBITER_CLAIM, msg);
+        return arb->state;
+    }
+    arb->event++;
+    arb->score = score;
+    arb->claim_ms = now_ms;
+    arb->stats.claims++;
+    msg_fill(arb, WAKE_ARBITER_CLAIM, msg);
+
+    for (int i = 0; i < WAKE_ARBITER_MAX_PEERS; i++) {
+        const wake_arbiter_peer_t *p = &arb->peers[i];
+        if (p->won && since(now_ms, p->won_ms) < arb->cfg.hold_ms) {
+            arb->stats.suppressed++;
+            return decide(arb, WAKE_ARBITER_LOSE, now_ms);
+        }
+    }
+    for (int i = 0; i < WAKE_ARBITER_MAX_PEERS; i++) {
+        const wake_arbiter_peer_t *p = &arb->peers[i];
+        if (!peer_alive(arb, p, now_ms)) {
+            continue;
+        }
+        alive++;
+        /* Someone fired first, and better */
+        if (p->claimed && since(now_ms, p->claim_ms) <= arb->cfg.window_ms &&
+                beats(p->claim_score, p->device_id, score, arb->cfg.device_id)) {
+            arb->stats.losses++;
+            return decide(arb, WAKE_ARBITER_LOSE, now_ms);
+        }
+    }
+    if (!alive) {
+        arb->stats.solo_wins++;
+        return decide(arb, WAKE_ARBITER_WIN, now_ms);
+    }
+    arb->state = WAKE_ARBITER_PENDING;
+    return arb->state;
+}
+
+wake_arbiter_result_t wake_arbiter_receive(wake_arbiter_t *arb, const void *buf, size_t len, uint32_t now_ms)
+{
+    wake_arbiter_msg_t msg;
+    wake_arbiter_peer_t *p;
+
+    if (len != sizeof(msg)) {
+        return arb->state;
+    }
+    memcpy(&msg, buf, sizeof(msg));
+    if (msg.magic != WAKE_ARBITER_MAGIC || msg.version != WAKE_ARBITER_VERSION ||
+            msg.device_id == arb->cfg.device_id || !msg.device_id) {
+        return arb->state;
+    }
+    p = peer_get(arb, msg.device_id);
+    p->heard_ms = now_ms;
+
+    if (msg.type == WAKE_ARBITER_CLAIM) {
+        p->claimed = true;
+        p->claim_ms = now_ms;
+        p->claim_score = msg.score;
+        if (arb->state == WAKE_ARBITER_PENDING &&
+                beats(msg.score, msg.device_id, arb->score, arb->cfg.device_id)) {
+            arb->stats.losses++;
+            return decide(arb, WAKE_ARBITER_LOSE, now_ms);
+        }
+    } else if (msg.type == WAKE_ARBITER_WON) {
+        p->won = true;
+        p->won_ms = now_ms;
+        /* It is already talking to the cloud, a second dialog is worse
+         * than the slightly worse microphone */
+        if (arb->state == WAKE_ARBITER_PENDING) {
+            arb->stats.suppressed++;
+            return decide(arb, WAKE_ARBITER_LOSE, now_ms);
+        }
+    }
+    return arb->state;
+}
+
+wake_arbiter_result_t wake_arbiter_poll(wake_arbiter_t *arb, uint32_t now_ms, wake_arbiter_msg_t *msg)
+{
+    if (arb->state == WAKE_ARBITER_PENDING && since(now_ms, arb->claim_ms) >= arb->cfg.window_ms) {
+        msg_fill(arb, WAKE_ARBITER_WON, msg);
+        return decide(arb, WAKE_ARBITER_WIN, now_ms);
+    }
+    return arb->state;
+}
+
+wake_arbiter_result_t wake_arbiter_resolve(wake_arbiter_t *arb, uint32_t now_ms, wake_arbiter_msg_t *msg)
+{
+    if (arb->state == WAKE_ARBITER_PENDING) {
+        arb->stats.forced++;
+        msg_fill(arb, WAKE_ARBITER_WON, msg);
+        return decide(arb, WAKE_ARBITER_WIN, now_ms);
+    }
+    return arb->state;
+}
+
+void wake_arbiter_done(wake_arbiter_t *arb)
+{
+    arb->state = WAKE_ARBITER_IDLE;
+}
+
+int wake_arbiter_timeout(const wake_arbiter_t *arb, uint32_t now_ms)
+{
+    int32_t left;
+
+    if (arb->state != WAKE_ARBITER_PENDING) {
+        return -1;
+    }
+    left = arb->cfg.window_ms - since(now_ms, arb->claim_ms);
+    return left > 0 ? left : 0;
+}
+
+void wake_arbiter_hello(wake_arbiter_t *arb, wake_arbiter_msg_t *msg)
+{
+    msg_fill(arb, WAKE_ARBITER_HELLO, msg);
+}
+
+void wake_arbiter_get_stats(wake_arbiter_t *arb, wake_arbiter_stats_t *stats, uint32_t now_ms)
+{
+    *stats = arb->stats;
+    stats->peers = 0;
+    for (int i = 0; i < WAKE_ARBITER_MAX_PEERS; i++) {
+        if (peer_alive(arb, &arb->peers[i], now_ms)) {
+            stats->peers++;
+        }
+    }
+}
@@ -0,0 +1,180 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _WAKE_ARBITER_H_
+#define _WAKE_ARBITER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Wake word arbitration between devices on one LAN, so that only the unit
+ * that heard the wake word best opens a dialog. Transport and clock are
+ * the caller's: it sends the messages this hands back to every device in
+ * the group (UDP multicast on the device), feeds in what it receives, and
+ * passes the time in ms to every call.
+ *
+ * On a detection a device claims it with its score. A claim that beats
+ * every other claim heard within window_ms either side of it wins. A
+ * device loses at once when it hears a better claim, and the winner
+ * announces its win, which suppresses later detections of the same wake
+ * word on units slow to fire for hold_ms. A device that hasn't heard from
+ * a peer within peer_timeout_ms (every device beacons) wins straight away,
+ * so a lone unit has no added latency.
+ */
+
+#define WAKE_ARBITER_MAGIC      0x42524157  /* "WARB" */
+#define WAKE_ARBITER_VERSION    1
+#define WAKE_ARBITER_MAX_PEERS  8
+
+typedef enum wake_arbiter_msg_type {
+    WAKE_ARBITER_HELLO = 1,     /*!< beacon, the sender is in the group */
+    WAKE_ARBITER_CLAIM,         /*!< the sender detected the wake word */
+    WAKE_ARBITER_WON,           /*!< the sender won and is opening a dialog */
+} wake_arbiter_msg_type_t;
+
+/** Message on the wire, little-endian */
+typedef struct __attribute__((packed)) wake_arbiter_msg {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t type;               /*!< wake_arbiter_msg_type_t */
+    uint16_t reserved;
+    uint32_t device_id;
+    uint32_t event;             /*!< sender's claim counter */
+    uint32_t score;
+} wake_arbiter_msg_t;
+
+typedef enum wake_arbiter_result {
+    WAKE_ARBITER_IDLE,          /*!< no claim of ours outstanding */
+    WAKE_ARBITER_PENDING,       /*!< waiting out the window */
+    WAKE_ARBITER_WIN,
+    WAKE_ARBITER_LOSE,
+} wake_arbiter_result_t;
+
+typedef struct wake_arbiter_config {
+    uint32_t device_id;         /*!< unique in the group, breaks score ties */
+    int window_ms;              /*!< wait for better claims after ours */
+    int hold_ms;                /*!< a win elsewhere suppresses our detections this long */
+    int peer_timeout_ms;        /*!< peers not heard from this long are gone */
+} wake_arbiter_config_t;
+
+typedef struct wake_arbiter_stats {
+    uint32_t claims;
+    uint32_t wins;
+    uint32_t solo_wins;         /*!< won with no peers around, no wait */
+    uint32_t losses;            /*!< lost to a better claim */
+    uint32_t suppressed;        /*!< lost to a win announced before our claim */
+    uint32_t forced;            /*!< decided early by wake_arbiter_resolve() */
+    uint32_t decide_ms_total;   /*!< claim to decision, all claims */
+    uint32_t max_decide_ms;
+    int peers;                  /*!< peers heard from within the timeout */
+} wake_arbiter_stats_t;
+
+typedef struct wake_arbiter_peer {
+    uint32_t device_id;         /* 0 for a free slot */
+    uint32_t heard_ms;
+    uint32_t claim_ms;
+    uint32_t claim_score;
+    bool claimed;
+    uint32_t won_ms;
+    bool won;
+} wake_arbiter_peer_t;
+
+typedef struct wake_arbiter {
+    wake_arbiter_config_t cfg;
+    wake_arbiter_result_t state;
+    uint32_t event;
+    uint32_t score;
+    uint32_t claim_ms;
+    wake_arbiter_peer_t peers[WAKE_ARBITER_MAX_PEERS];
+    wake_arbiter_stats_t stats;
+} wake_arbiter_t;
+
+void wake_arbiter_init(wake_arbiter_t *arb, const wake_arbiter_config_t *cfg);
+
+/**
+ * @brief  score for a detection: SNR around the trigger, then confidence
+ *
+ * @param  level        peak mean absolute frame level around the wake word
+ * @param  floor        mean absolute level of the background noise
+ * @param  confidence   engine confidence, 0 to 255
+ */
+uint32_t wake_arbiter_score(uint32_t level, uint32_t floor, int confidence);
+
+/**
+ * @brief  claim a detection of ours
+ *
+ * @param  msg  the claim, to send to the group whatever the result
+ *
+ * @return WIN or LOSE if decided at once, else PENDING until
+ *         wake_arbiter_poll() or wake_arbiter_receive() decides
+ */
+wake_arbiter_result_t wake_arbiter_claim(wake_arbiter_t *arb, uint32_t score, uint32_t now_ms,
+                                         wake_arbiter_msg_t *msg);
+
+/**
+ * @brief  take in a message from the group; our own are ignored
+ *
+ * @return LOSE if it decided our pending claim, else the current state
+ */
+wake_arbiter_result_t wake_arbiter_receive(wake_arbiter_t *arb, const void *buf, size_t len, uint32_t now_ms);
+
+/**
+ * @brief  decide a pending claim once its window has passed
+ *
+ * @param  msg  set to the win announcement to send if it returns WIN
+ *
+ * @return WIN once the window closes without a better claim, else the
+ *         current state
+ */
+wake_arbiter_result_t wake_arbiter_poll(wake_arbiter_t *arb, uint32_t now_ms, wake_arbiter_msg_t *msg);
+
+/**
+ * @brief  decide a pending claim now, on the claims heard so far
+ *
+ * For when the caller can't wait any longer. A WIN is announced in msg.
+ */
+wake_arbiter_result_t wake_arbiter_resolve(wake_arbiter_t *arb, uint32_t now_ms, wake_arbiter_msg_t *msg);
+
+/**
+ * @brief  finish with a decided claim, back to IDLE
+ */
+void wake_arbiter_done(wake_arbiter_t *arb);
+
+/**
+ * @brief  ms until a pending claim's window closes, -1 if none is pending
+ */
+int wake_arbiter_timeout(const wake_arbiter_t *arb, uint32_t now_ms);
+
+/**
+ * @brief  beacon to send every peer_timeout_ms / 3 or so
+ */
+void wake_arbiter_hello(wake_arbiter_t *arb, wake_arbiter_msg_t *msg);
+
+void wake_arbiter_get_stats(wake_arbiter_t *arb, wake_arbiter_stats_t *stats, uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WAKE_ARBITER_H_ */
@@ -0,0 +1,60 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#include <string.h>
+#include "wake_detect.h"
+
+void wake_detect_init(wake_detect_t *wd, const wake_detect_config_t *cfg)
+{
+    memset(wd, 0, sizeof(*wd));
+    wd->cfg = *cfg;
+    /* 0 would count every chunk as a hit */
+    if (wd->cfg.min_confidence < 1) {
+        wd->cfg.min_confidence = 1;
+    }
+}
+
+void wake_detect_reset(wake_detect_t *wd)
+{
+    wd->run = 0;
+}
+
+bool wake_detect_update(wake_detect_t *wd, int confidence, uint32_t now_ms)
+{
+    if (wd->holding) {
+        if ((int32_t) (now_ms - wd->hold_until_ms) < 0) {
+            wd->run = 0;
+            return false;
+        }
+        wd->holding = false;
+    }
+    if (confidence < wd->cfg.min_confidence) {
+        wd->run = 0;
+        return false;
+    }
+    /* Trigger once per run of consecutive hits, when it gets long enough */
+    if (++wd->run != wd->cfg.hits) {
+        return false;
+    }
+    wd->detections++;
+    if (wd->cfg.refractory_ms > 0) {
+        wd->holding = true;
+        wd->hold_until_ms = now_ms + wd->cfg.refractory_ms;
+    }
+    return true;
+}
@@ -0,0 +1,74 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _WAKE_DETECT_H_
+#define _WAKE_DETECT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Turns per-chunk wake word engine confidences into detections. A chunk at
+ * or above min_confidence is a hit; a long enough run of hits is a
+ * detection, after which everything is ignored for the refractory window.
+ * Shared by the device and the host benchmark so both make the same
+ * decisions.
+ */
+
+typedef struct wake_detect_config {
+    int min_confidence;     /*!< engine confidence that counts as a hit, see wake_engine.h */
+    int hits;               /*!< consecutive engine hits needed for a detection */
+    int refractory_ms;      /*!< hits are ignored for this long after a detection */
+} wake_detect_config_t;
+
+typedef struct wake_detect {
+    wake_detect_config_t cfg;
+    int run;
+    bool holding;
+    uint32_t hold_until_ms;
+    uint32_t detections;
+} wake_detect_t;
+
+void wake_detect_init(wake_detect_t *wd, const wake_detect_config_t *cfg);
+
+/**
+ * @brief  drop a partial run of hits, e.g. after a gap in the audio
+ *
+ * A refractory window in progress still runs to its end.
+ */
+void wake_detect_reset(wake_detect_t *wd);
+
+/**
+ * @brief  feed the engine's confidence for one chunk
+ *
+ * @param  now_ms  time of the chunk, from any monotonic clock; chunks the
+ *                 engine didn't see just don't get an update
+ *
+ * @return true on the chunk that completes a detection
+ */
+bool wake_detect_update(wake_detect_t *wd, int confidence, uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WAKE_DETECT_H_ */
@@ -0,0 +1,56 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _WAKE_ENGINE_H_
+#define _WAKE_ENGINE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Interface to a wake word engine. Each engine provides one const
+ * wake_engine_t; the application picks one at build time. Only
+ * wake_detect, not the engine, decides what counts as a detection.
+ */
+
+#define WAKE_ENGINE_CONFIDENCE_MAX  100
+
+typedef struct wake_engine {
+    const char *name;
+    int (*init)(void);                  /*!< 0 on success */
+    int (*sample_rate)(void);
+    int (*chunk_samples)(void);
+    int max_batch;                      /*!< most chunks one detect() call takes, at least 1 */
+    /**
+     * Run `chunks` consecutive chunks of chunk_samples() each, writing a
+     * confidence of 0 to WAKE_ENGINE_CONFIDENCE_MAX per chunk. Engines that
+     * amortise per call overhead (model setup, DMA) over a batch advertise
+     * a max_batch above 1.
+     */
+    void (*detect)(int16_t *samples, int chunks, uint8_t *confidence);
+    void (*reset)(void);                /*!< forget past audio, e.g. after a gap; may be NULL */
+} wake_engine_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WAKE_ENGINE_H_ */
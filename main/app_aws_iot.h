@@ -0,0 +1,75 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _APP_AWS_IOT_H_
+#define _APP_AWS_IOT_H_
+
+#include <stdint.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum aws_iot_event_type {
+    AWS_IOT_EVT_WAKE_WORD = 1,
+    AWS_IOT_EVT_BENCH,          /*!< synthetic load from the capture-stress command */
+    AWS_IOT_EVT_HEAP_INTERNAL_FREE,     /*!< sysmon samples, bytes */
+    AWS_IOT_EVT_HEAP_INTERNAL_MIN,
+    AWS_IOT_EVT_HEAP_INTERNAL_LARGEST,
+    AWS_IOT_EVT_HEAP_PSRAM_FREE,
+    AWS_IOT_EVT_HEAP_PSRAM_MIN,
+    AWS_IOT_EVT_HEAP_PSRAM_LARGEST,
+    AWS_IOT_EVT_STACK_MIN,              /*!< lowest task stack high-water mark, bytes */
+    AWS_IOT_EVT_WAKE_SKIPPED,           /*!< wake word chunks skipped to catch up since the last report */
+    AWS_IOT_EVT_CAPTURE_LOST,           /*!< capture stream lost on a regrow, the capture profile; a restart follows */
+} aws_iot_event_type_t;
+
+typedef struct aws_iot_event {
+    uint32_t boot;              /*!< boot counter when the event was raised */
+    uint32_t seq;               /*!< per-boot sequence number, for de-duplication */
+    uint32_t timestamp;         /*!< seconds since epoch, or since boot if time isn't set */
+    aws_iot_event_type_t type;
+    int32_t value;
+} aws_iot_event_t;
+
+/**
+ * @brief  start the AWS IoT task
+ */
+void aws_iot_init();
+
+/**
+ * @brief  queue an event for publishing and wake the AWS IoT task
+ *
+ * Never blocks, so it is safe to call from the audio path. While MQTT is not
+ * connected, or the queue is full, the event is kept in the flash telemetry
+ * log and replayed on reconnect. AWS_IOT_EVT_BENCH events never go to the
+ * log, they are dropped instead. Returns ESP_FAIL if the event had to be
+ * dropped.
+ */
+esp_err_t aws_iot_post_event(aws_iot_event_type_t type, int32_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _APP_AWS_IOT_H_ */
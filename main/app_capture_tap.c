@@ -0,0 +1,270 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+#include <lwip/netdb.h>
+#include "app_capture_tap.h"
+#include "app_tasks.h"
+
+#ifdef CONFIG_APP_CAPTURE_TAP
+
+#define CAPTURE_TAP_POLL_MS     10
+#define CAPTURE_TAP_RETRY_MS    1000
+#define CAPTURE_TAP_SEND_TIMEOUT_S  5
+/* Wait for the sender task to close the connection on stop */
+#define CAPTURE_TAP_STOP_MS     (CAPTURE_TAP_SEND_TIMEOUT_S * 1000 + 500)
+#define CAPTURE_TAP_HOST_LEN    64
+
+static const char *TAG = "capture_tap";
+
+static struct {
+    capture_tap_t tap[CAPTURE_TAP_STREAMS];
+    void *mem[CAPTURE_TAP_STREAMS];
+    /* Checked by the producers before touching their tap */
+    volatile bool active[CAPTURE_TAP_STREAMS];
+    volatile bool running;
+    /* Set by start, cleared by the sender once its connection is closed */
+    volatile bool sending;
+    volatile bool connected;
+    TaskHandle_t task;
+    char host[CAPTURE_TAP_HOST_LEN];
+    int port;
+    uint32_t connects;
+    uint32_t sent_frames;
+    uint64_t sent_bytes;
+} ct;
+
+void app_capture_tap_push(capture_tap_stream_t stream, const void *pcm, int len, int bits, int channels,
+                          int sample_rate)
+{
+    if (!ct.active[stream]) {
+        return;
+    }
+    capture_tap_push(&ct.tap[stream], pcm, len, bits, channels, sample_rate, esp_timer_get_time());
+}
+
+static int capture_tap_connect()
+{
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *addrs, *cur;
+    struct timeval tv = { .tv_sec = CAPTURE_TAP_SEND_TIMEOUT_S };
+    char port[8];
+    int fd = -1;
+
+    snprintf(port, sizeof(port), "%d", ct.port);
+    if (getaddrinfo(ct.host, port, &hints, &addrs) != 0 || !addrs) {
+        ESP_LOGE(TAG, "DNS lookup of %s failed", ct.host);
+        return -1;
+    }
+    for (cur = addrs; cur; cur = cur->ai_next) {
+        fd = socket(cur->ai_family, cur->ai_socktype, cur->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, cur->ai_addr, cur->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+    if (fd >= 0) {
+        /* A stalled collector fails the send instead of holding the task forever */
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+    return fd;
+}
+
+static int capture_tap_send(int fd, const uint8_t *buf, uint32_t len)
+{
+    while (len) {
+        int n = send(fd, buf, len, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* A frame cut off by a dropped connection is sent again whole on the next
+ * one; the collector starts parsing afresh on every connection. */
+static void capture_tap_run()
+{
+    const void *frame;
+    uint32_t len;
+    bool idle;
+    int fd = -1;
+
+    while (ct.running) {
+        if (fd < 0) {
+            fd = capture_tap_connect();
+            if (fd < 0) {
+                vTaskDelay(CAPTURE_TAP_RETRY_MS / portTICK_RATE_MS);
+                continue;
+            }
+            ESP_LOGI(TAG, "Streaming to %s:%d", ct.host, ct.port);
+            ct.connects++;
+            ct.connected = true;
+        }
+        idle = true;
+        for (int s = 0; s < CAPTURE_TAP_STREAMS && fd >= 0; s++) {
+            frame = capture_tap_peek(&ct.tap[s], &len);
+            if (!frame) {
+                continue;
+            }
+            idle = false;
+            if (capture_tap_send(fd, frame, len) != 0) {
+                ESP_LOGW(TAG, "Connection to %s:%d lost", ct.host, ct.port);
+                ct.connected = false;
+                close(fd);
+                fd = -1;
+                break;
+            }
+            capture_tap_consume(&ct.tap[s]);
+            ct.sent_frames++;
+            ct.sent_bytes += len;
+        }
+        if (idle) {
+            vTaskDelay(CAPTURE_TAP_POLL_MS / portTICK_RATE_MS);
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    ct.connected = false;
+}
+
+/* Parks between runs, its static stack and TCB can't be handed back safely
+ * while the idle task may still be cleaning up after a delete */
+static void capture_tap_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        capture_tap_run();
+        ct.sending = false;
+    }
+}
+
+esp_err_t app_capture_tap_start(const char *host, int port, uint32_t streams)
+{
+    size_t size = CONFIG_APP_CAPTURE_TAP_BUFFER_KB * 1024;
+
+    if (ct.running || ct.sending) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (strlen(host) >= sizeof(ct.host) || port <= 0 || port > 65535 || !streams) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    /* Kept for good once allocated, a producer may still be in a push
+     * when the tap is stopped */
+    for (int s = 0; s < CAPTURE_TAP_STREAMS; s++) {
+        if (!(streams & (1 << s)) || ct.mem[s]) {
+            continue;
+        }
+        ct.mem[s] = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+        if (!ct.mem[s]) {
+            ESP_LOGE(TAG, "No PSRAM for the capture tap");
+            return ESP_ERR_NO_MEM;
+        }
+        capture_tap_init(&ct.tap[s], s, ct.mem[s], size);
+    }
+    strcpy(ct.host, host);
+    ct.port = port;
+    if (!ct.task) {
+        ct.task = app_task_create(APP_TASK_CAPTURE_TAP, &capture_tap_task, NULL);
+        if (!ct.task) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    ct.running = true;
+    ct.sending = true;
+    xTaskNotifyGive(ct.task);
+    for (int s = 0; s < CAPTURE_TAP_STREAMS; s++) {
+        ct.active[s] = (streams & (1 << s)) != 0;
+    }
+    return ESP_OK;
+}
+
+void app_capture_tap_stop()
+{
+    int waited = 0;
+
+    for (int s = 0; s < CAPTURE_TAP_STREAMS; s++) {
+        ct.active[s] = false;
+    }
+    ct.running = false;
+    while (ct.sending && waited < CAPTURE_TAP_STOP_MS) {
+        vTaskDelay(CAPTURE_TAP_POLL_MS / portTICK_RATE_MS);
+        waited += CAPTURE_TAP_POLL_MS;
+    }
+    /* With the sender gone this task is the only consumer */
+    for (int s = 0; s < CAPTURE_TAP_STREAMS && !ct.sending; s++) {
+        if (ct.mem[s]) {
+            capture_tap_drain(&ct.tap[s]);
+        }
+    }
+}
+
+void app_capture_tap_get_stats(app_capture_tap_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->enabled = true;
+    stats->running = ct.running;
+    stats->connected = ct.connected;
+    for (int s = 0; s < CAPTURE_TAP_STREAMS; s++) {
+        stats->streams[s] = ct.active[s];
+        stats->tap[s] = ct.tap[s].stats;
+    }
+    stats->connects = ct.connects;
+    stats->sent_frames = ct.sent_frames;
+    stats->sent_kb = ct.sent_bytes / 1024;
+}
+
+#else
+
+esp_err_t app_capture_tap_start(const char *host, int port, uint32_t streams)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void app_capture_tap_stop()
+{
+}
+
+void app_capture_tap_get_stats(app_capture_tap_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif /* CONFIG_APP_CAPTURE_TAP */
@@ -0,0 +1,83 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _APP_CAPTURE_TAP_H_
+#define _APP_CAPTURE_TAP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+#include <capture_tap.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct app_capture_tap_stats {
+    bool enabled;               /*!< built in, see CONFIG_APP_CAPTURE_TAP */
+    bool running;
+    bool connected;
+    bool streams[CAPTURE_TAP_STREAMS];
+    uint32_t connects;
+    uint32_t sent_frames;
+    uint32_t sent_kb;
+    capture_tap_stats_t tap[CAPTURE_TAP_STREAMS];
+} app_capture_tap_stats_t;
+
+/**
+ * @brief  start streaming capture frames to a host collector
+ *
+ * Connects to host:port over TCP from a task of its own, and reconnects if
+ * the connection drops. Frames that don't fit the buffer meanwhile are
+ * counted and dropped.
+ *
+ * @param  streams  bit mask of (1 << capture_tap_stream_t)
+ */
+esp_err_t app_capture_tap_start(const char *host, int port, uint32_t streams);
+
+/**
+ * @brief  stop streaming and drop whatever is still queued
+ */
+void app_capture_tap_stop();
+
+void app_capture_tap_get_stats(app_capture_tap_stats_t *stats);
+
+#ifdef CONFIG_APP_CAPTURE_TAP
+/**
+ * @brief  offer a frame to the tap, from the capture path
+ *
+ * Never blocks; does nothing unless the stream is being tapped.
+ */
+void app_capture_tap_push(capture_tap_stream_t stream, const void *pcm, int len, int bits, int channels,
+                          int sample_rate);
+#else
+static inline void app_capture_tap_push(capture_tap_stream_t stream, const void *pcm, int len, int bits,
+                                        int channels, int sample_rate)
+{
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _APP_CAPTURE_TAP_H_ */
@@ -0,0 +1,428 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <mem_utils.h>
+#include <nvs.h>
+#include "app_cmd_spot.h"
+#include "app_playback.h"
+
+static const char *cmd_names[APP_CMD_MAX] = {
+    [APP_CMD_STOP] = "stop",
+    [APP_CMD_CANCEL] = "cancel",
+    [APP_CMD_VOLUME_UP] = "volume_up",
+    [APP_CMD_VOLUME_DOWN] = "volume_down",
+    [APP_CMD_MUTE] = "mute",
+    [APP_CMD_UNMUTE] = "unmute",
+};
+
+const char *app_cmd_name(app_cmd_t cmd)
+{
+    return (unsigned) cmd < APP_CMD_MAX ? cmd_names[cmd] : "none";
+}
+
+#ifdef CONFIG_APP_CMD_SPOT
+
+#define CMD_SAMP_RATE           16000
+#define CMD_FRAME_MS            20
+#define CMD_TRAILING_SILENCE_MS 300
+#define CMD_NO_SPEECH_MS        1000
+#define CMD_SLOTS               3       /* templates per command */
+#define CMD_VOLUME_STEP         10
+#define CMD_HOLD_SIZE           (CONFIG_APP_CMD_SPOT_HOLD_MS * CMD_SAMP_RATE / 1000 * sizeof(int16_t))
+#define CMD_NVS_NAMESPACE       "cmd_spot"
+
+static const char *TAG = "cmd_spot";
+
+static struct {
+    cmd_spot_t *cs;
+    /* Guards the templates, which the CLI changes while read_rb_task matches */
+    SemaphoreHandle_t lock;
+    int8_t (*tpl)[CMD_SPOT_TEMPLATE_SIZE];
+    int tpl_hops[APP_CMD_MAX * CMD_SLOTS];
+    int templates;
+    uint8_t *hold;
+    size_t held;
+    bool active;
+    uint32_t frames;            /* since the start */
+    cmd_spot_result_t result;
+    /* Enrollment asked for by the CLI, cmd + 1, and the segment it got */
+    volatile int enroll;
+    SemaphoreHandle_t enroll_ack;
+    bool enrolling;
+    int8_t segment[CMD_SPOT_TEMPLATE_SIZE];
+    int segment_hops;
+    app_cmd_spot_stats_t stats;
+} sp;
+
+static void avg_max(uint32_t *avg, uint32_t *max, uint32_t v)
+{
+    *avg += ((int32_t) v - (int32_t) *avg) / 32;
+    if (v > *max) {
+        *max = v;
+    }
+}
+
+static void template_set(int slot, int hops)
+{
+    if (!sp.tpl_hops[slot] != !hops) {
+        sp.templates += hops ? 1 : -1;
+    }
+    sp.tpl_hops[slot] = hops;
+    cmd_spot_set_template(sp.cs, slot, slot / CMD_SLOTS, sp.tpl[slot], hops);
+}
+
+static void template_key(int slot, char *key)
+{
+    sprintf(key, "%s%d", cmd_names[slot / CMD_SLOTS], slot % CMD_SLOTS);
+}
+
+static void templates_load()
+{
+    nvs_handle handle;
+    char key[16];
+
+    if (nvs_open(CMD_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    for (int slot = 0; slot < APP_CMD_MAX * CMD_SLOTS; slot++) {
+        size_t len = CMD_SPOT_TEMPLATE_SIZE;
+        template_key(slot, key);
+        if (nvs_get_blob(handle, key, sp.tpl[slot], &len) == ESP_OK && len % CMD_SPOT_BANDS == 0) {
+            template_set(slot, len / CMD_SPOT_BANDS);
+        }
+    }
+    nvs_close(handle);
+}
+
+esp_err_t app_cmd_spot_init()
+{
+    cmd_spot_config_t cfg = {
+        .sample_rate = CMD_SAMP_RATE,
+        .max_distance = CONFIG_APP_CMD_SPOT_MAX_DISTANCE,
+        .margin_pct = CONFIG_APP_CMD_SPOT_MARGIN,
+        .trailing_silence_ms = CMD_TRAILING_SILENCE_MS,
+        .no_speech_ms = CMD_NO_SPEECH_MS,
+    };
+
+    sp.tpl = mem_alloc(APP_CMD_MAX * CMD_SLOTS * CMD_SPOT_TEMPLATE_SIZE, EXTERNAL);
+    sp.hold = mem_alloc(CMD_HOLD_SIZE, EXTERNAL);
+    sp.cs = cmd_spot_create(&cfg);
+    sp.lock = xSemaphoreCreateMutex();
+    sp.enroll_ack = xSemaphoreCreateBinary();
+    if (!sp.tpl || !sp.hold || !sp.cs || !sp.lock || !sp.enroll_ack) {
+        ESP_LOGE(TAG, "No memory for command spotting");
+        mem_free(sp.tpl);
+        mem_free(sp.hold);
+        cmd_spot_destroy(sp.cs);
+        if (sp.lock) {
+            vSemaphoreDelete(sp.lock);
+        }
+        if (sp.enroll_ack) {
+            vSemaphoreDelete(sp.enroll_ack);
+        }
+        memset(&sp, 0, sizeof(sp));
+        return ESP_ERR_NO_MEM;
+    }
+    templates_load();
+    sp.stats.enabled = true;
+    ESP_LOGI(TAG, "%d command templates, holding up to %d ms", sp.templates, CONFIG_APP_CMD_SPOT_HOLD_MS);
+    return ESP_OK;
+}
+
+void app_cmd_spot_start()
+{
+    if (!sp.cs || (!sp.templates && !sp.enroll)) {
+        return;
+    }
+    sp.enrolling = sp.enroll != 0;
+    sp.active = true;
+    sp.held = 0;
+    sp.frames = 0;
+    sp.stats.utterances++;
+    cmd_spot_start(sp.cs, sp.enrolling);
+}
+
+void app_cmd_spot_stop()
+{
+    if (sp.active) {
+        sp.active = false;
+        cmd_spot_stop(sp.cs);
+    }
+}
+
+/* Hands the segment to the CLI task waiting in app_cmd_spot_enroll() */
+static void enroll_done(cmd_spot_result_t r)
+{
+    const int8_t *seg = NULL;
+
+    if (r == CMD_SPOT_MATCH || r == CMD_SPOT_NO_MATCH) {
+        seg = cmd_spot_segment(sp.cs, &sp.segment_hops);
+        memcpy(sp.segment, seg, sp.segment_hops * CMD_SPOT_BANDS);
+    } else {
+        sp.segment_hops = 0;
+    }
+    sp.enroll = 0;
+    xSemaphoreGive(sp.enroll_ack);
+}
+
+app_cmd_spot_result_t app_cmd_spot_frame(const int16_t *buf, size_t len)
+{
+    int64_t start;
+    uint32_t us;
+    cmd_spot_result_t r;
+
+    if (!sp.cs) {
+        return APP_CMD_SPOT_IDLE;
+    }
+    if (!sp.active) {
+        /* Only the VAD runs, to keep up with the background noise */
+        cmd_spot_process(sp.cs, buf, len / sizeof(int16_t));
+        return APP_CMD_SPOT_IDLE;
+    }
+    start = esp_timer_get_time();
+    xSemaphoreTake(sp.lock, portMAX_DELAY);
+    r = cmd_spot_process(sp.cs, buf, len / sizeof(int16_t));
+    xSemaphoreGive(sp.lock);
+    us = esp_timer_get_time() - start;
+    sp.frames++;
+
+    if (r == CMD_SPOT_PENDING) {
+        avg_max(&sp.stats.frame_avg_us, &sp.stats.frame_max_us, us);
+        if (sp.held + len <= CMD_HOLD_SIZE) {
+            memcpy(sp.hold + sp.held, buf, len);
+            sp.held += len;
+            return APP_CMD_SPOT_HOLD;
+        }
+        sp.stats.hold_full++;
+    } else {
+        avg_max(&sp.stats.match_avg_us, &sp.stats.match_max_us, us);
+        cmd_spot_get_match(sp.cs, &sp.stats.last);
+    }
+    sp.active = false;
+    cmd_spot_stop(sp.cs);
+    sp.result = r;
+    if (sp.enrolling) {
+        /* Nothing for the cloud, it was the user teaching us */
+        enroll_done(r);
+        return APP_CMD_SPOT_LOCAL;
+    }
+    if (r == CMD_SPOT_MATCH) {
+        sp.stats.local[sp.stats.last.label]++;
+        avg_max(&sp.stats.local_avg_ms, &sp.stats.local_max_ms, sp.frames * CMD_FRAME_MS);
+        return APP_CMD_SPOT_LOCAL;
+    }
+    if (r == CMD_SPOT_NO_MATCH) {
+        sp.stats.no_match++;
+    } else if (r == CMD_SPOT_NO_COMMAND) {
+        sp.stats.no_command++;
+    }
+    avg_max(&sp.stats.cloud_avg_ms, &sp.stats.cloud_max_ms, sp.frames * CMD_FRAME_MS);
+    ESP_LOGI(TAG, "No command, to the cloud after %u ms", sp.frames * CMD_FRAME_MS);
+    return APP_CMD_SPOT_CLOUD;
+}
+
+const void *app_cmd_spot_held(size_t *len)
+{
+    *len = sp.held;
+    return sp.hold;
+}
+
+bool app_cmd_spot_act()
+{
+    app_cmd_t cmd = sp.stats.last.label;
+
+    if (sp.enrolling || sp.result != CMD_SPOT_MATCH) {
+        return false;
+    }
+    ESP_LOGI(TAG, "Command %s, %d.%d dB off, after %u ms", app_cmd_name(cmd),
+             sp.stats.last.distance / 10, sp.stats.last.distance % 10, sp.frames * CMD_FRAME_MS);
+    switch (cmd) {
+    case APP_CMD_STOP:
+    case APP_CMD_CANCEL:
+        app_playback_stop();
+        break;
+    case APP_CMD_VOLUME_UP:
+        app_playback_set_volume(app_playback_get_volume() + CMD_VOLUME_STEP);
+        break;
+    case APP_CMD_VOLUME_DOWN:
+        app_playback_set_volume(app_playback_get_volume() - CMD_VOLUME_STEP);
+        break;
+    case APP_CMD_MUTE:
+        app_playback_set_mute(true);
+        break;
+    case APP_CMD_UNMUTE:
+        app_playback_set_mute(false);
+        break;
+    default:
+        break;
+    }
+    /* Every command changes state AVS keeps too, and only its own
+     * directive makes it stop the stream or send the event */
+    return true;
+}
+
+esp_err_t app_cmd_spot_enroll(app_cmd_t cmd, int timeout_ms)
+{
+    nvs_handle handle;
+    esp_err_t err;
+    char key[16];
+    int slot = -1, first;
+
+    if (!sp.cs) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    /* Drop a late answer to an earlier enrollment */
+    xSemaphoreTake(sp.enroll_ack, 0);
+    sp.enroll = cmd + 1;
+    if (xSemaphoreTake(sp.enroll_ack, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        sp.enroll = 0;
+        return ESP_ERR_TIMEOUT;
+    }
+    if (!sp.segment_hops) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    xSemaphoreTake(sp.lock, portMAX_DELAY);
+    for (int i = 0; i < CMD_SLOTS && slot < 0; i++) {
+        if (!sp.tpl_hops[cmd * CMD_SLOTS + i]) {
+            slot = cmd * CMD_SLOTS + i;
+        }
+    }
+    if (slot < 0) {
+        /* Full: the oldest is first, the rest move up */
+        slot = cmd * CMD_SLOTS;
+        for (int i = 0; i < CMD_SLOTS - 1; i++) {
+            memcpy(sp.tpl[slot + i], sp.tpl[slot + i + 1], sp.tpl_hops[slot + i + 1] * CMD_SPOT_BANDS);
+            template_set(slot + i, sp.tpl_hops[slot + i + 1]);
+        }
+        slot += CMD_SLOTS - 1;
+    }
+    memcpy(sp.tpl[slot], sp.segment, sp.segment_hops * CMD_SPOT_BANDS);
+    template_set(slot, sp.segment_hops);
+    xSemaphoreGive(sp.lock);
+    /* Every slot of the command if they moved up */
+    first = slot == cmd * CMD_SLOTS + CMD_SLOTS - 1 ? cmd * CMD_SLOTS : slot;
+
+    err = nvs_open(CMD_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (int s = first; s <= slot && err == ESP_OK; s++) {
+        template_key(s, key);
+        err = nvs_set_blob(handle, key, sp.tpl[s], sp.tpl_hops[s] * CMD_SPOT_BANDS);
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t app_cmd_spot_forget(app_cmd_t cmd)
+{
+    nvs_handle handle;
+    char key[16];
+
+    if (!sp.cs) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(sp.lock, portMAX_DELAY);
+    for (int slot = 0; slot < APP_CMD_MAX * CMD_SLOTS; slot++) {
+        if (cmd == APP_CMD_MAX || slot / CMD_SLOTS == cmd) {
+            template_set(slot, 0);
+        }
+    }
+    xSemaphoreGive(sp.lock);
+    if (nvs_open(CMD_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return ESP_OK;
+    }
+    for (int slot = 0; slot < APP_CMD_MAX * CMD_SLOTS; slot++) {
+        if (cmd == APP_CMD_MAX || slot / CMD_SLOTS == cmd) {
+            template_key(slot, key);
+            nvs_erase_key(handle, key);
+        }
+    }
+    nvs_commit(handle);
+    nvs_close(handle);
+    return ESP_OK;
+}
+
+void app_cmd_spot_get_stats(app_cmd_spot_stats_t *stats)
+{
+    *stats = sp.stats;
+    stats->templates = sp.templates;
+}
+
+#else
+
+esp_err_t app_cmd_spot_init()
+{
+    return ESP_OK;
+}
+
+void app_cmd_spot_start()
+{
+}
+
+void app_cmd_spot_stop()
+{
+}
+
+app_cmd_spot_result_t app_cmd_spot_frame(const int16_t *buf, size_t len)
+{
+    return APP_CMD_SPOT_IDLE;
+}
+
+const void *app_cmd_spot_held(size_t *len)
+{
+    *len = 0;
+    return NULL;
+}
+
+bool app_cmd_spot_act()
+{
+    return false;
+}
+
+esp_err_t app_cmd_spot_enroll(app_cmd_t cmd, int timeout_ms)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t app_cmd_spot_forget(app_cmd_t cmd)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void app_cmd_spot_get_stats(app_cmd_spot_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif /* CONFIG_APP_CMD_SPOT */
@@ -0,0 +1,132 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _APP_CMD_SPOT_H_
+#define _APP_CMD_SPOT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <cmd_spot.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Commands acted on locally, ahead of the cloud */
+typedef enum app_cmd {
+    APP_CMD_STOP,
+    APP_CMD_CANCEL,
+    APP_CMD_VOLUME_UP,
+    APP_CMD_VOLUME_DOWN,
+    APP_CMD_MUTE,
+    APP_CMD_UNMUTE,
+    APP_CMD_MAX,
+} app_cmd_t;
+
+typedef enum app_cmd_spot_result {
+    APP_CMD_SPOT_IDLE,          /*!< not spotting, the dialog goes on as usual */
+    APP_CMD_SPOT_HOLD,          /*!< the frame is held, a command may still come */
+    APP_CMD_SPOT_LOCAL,         /*!< a command, see app_cmd_spot_act(); the frame isn't held */
+    APP_CMD_SPOT_CLOUD,         /*!< not a command, upload the held audio; the frame isn't held */
+} app_cmd_spot_result_t;
+
+typedef struct app_cmd_spot_stats {
+    bool enabled;
+    int templates;
+    uint32_t utterances;        /*!< dialogs spotted in */
+    uint32_t local[APP_CMD_MAX];
+    uint32_t no_match;          /*!< to the cloud, no command close enough */
+    uint32_t no_command;        /*!< to the cloud, no speech or too long for a command */
+    uint32_t hold_full;         /*!< to the cloud, out of room to hold the audio */
+    uint32_t frame_avg_us;      /*!< spotting, per 20 ms frame */
+    uint32_t frame_max_us;
+    uint32_t match_avg_us;      /*!< frame that ends the segment and matches it */
+    uint32_t match_max_us;
+    uint32_t local_avg_ms;      /*!< dialog start to a local command */
+    uint32_t local_max_ms;
+    uint32_t cloud_avg_ms;      /*!< dialog start to falling through, the added cloud latency */
+    uint32_t cloud_max_ms;
+    cmd_spot_match_t last;      /*!< last segment matched */
+} app_cmd_spot_stats_t;
+
+const char *app_cmd_name(app_cmd_t cmd);
+
+/**
+ * @brief  load the enrolled templates, if CONFIG_APP_CMD_SPOT is set
+ */
+esp_err_t app_cmd_spot_init();
+
+/**
+ * @brief  start spotting at the start of a dialog
+ *
+ * Only if there are templates, or an enrollment is waiting.
+ */
+void app_cmd_spot_start();
+
+void app_cmd_spot_stop();
+
+/**
+ * @brief  feed every captured frame, dialog or not, from read_rb_task
+ */
+app_cmd_spot_result_t app_cmd_spot_frame(const int16_t *buf, size_t len);
+
+/**
+ * @brief  audio held since the start, to upload after APP_CMD_SPOT_CLOUD
+ */
+const void *app_cmd_spot_held(size_t *len);
+
+/**
+ * @brief  carry out the command after APP_CMD_SPOT_LOCAL
+ *
+ * The speaker answers at once. AVS keeps its own playback, volume and mute
+ * state, and the SDK has no call to report a local change, so a command
+ * still has to reach the cloud: AVS then stops its stream or sends
+ * VolumeChanged or MuteChanged, and its directive lands on the state set
+ * here.
+ *
+ * @return true if the held audio must still be uploaded as for
+ *         APP_CMD_SPOT_CLOUD, false after an enrollment
+ */
+bool app_cmd_spot_act();
+
+/**
+ * @brief  take the command said in the next dialog as a template for cmd
+ *
+ * Blocks until the dialog has been spotted in, or timeout_ms. The oldest
+ * of the command's templates makes way if it already has all it can.
+ */
+esp_err_t app_cmd_spot_enroll(app_cmd_t cmd, int timeout_ms);
+
+/**
+ * @brief  drop a command's templates, or everyone's for APP_CMD_MAX
+ */
+esp_err_t app_cmd_spot_forget(app_cmd_t cmd);
+
+void app_cmd_spot_get_stats(app_cmd_spot_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _APP_CMD_SPOT_H_ */
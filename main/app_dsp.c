@@ -23,55 +23,205 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <sys/time.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/queue.h>
+#include <freertos/semphr.h>
 
 #include <esp_log.h>
 #include <speech_recognizer.h>
 #include <mem_utils.h>
 #include "app_dsp.h"
+#include "app_playback.h"
 #include <ui_led.h>
 #include <ui_button.h>
 #include <i2s_stream.h>
 #include <media_hal.h>
 #include <audio_board.h>
+#include <audio_board_capture.h>
+#include <pcm_convert.h>
+#include <frontend.h>
+#include <noise_suppress.h>
+#include <beamformer.h>
+#include <adpcm.h>
+#include <wake_detect.h>
+#include <wake_engine.h>
+#include <endpoint.h>
+#include <esp_heap_caps.h>
+#include <xtensa/hal.h>
 #include <media_hal.h>
+#include <esp_timer.h>
+#include <esp_system.h>
 #include <ringbuf.h>
 #include "resampling.h"
-//Speech recognition headers
-#include <esp_wwe.h>
+#include "app_capture_tap.h"
+#include "app_wake_arbiter.h"
+#include "app_tasks.h"
+#include "app_cmd_spot.h"
+#ifdef CONFIG_AWS_IOT_SDK
+#include "app_aws_iot.h"
+#endif
 
-#define WWE_TASK_STACK (8 * 1024)
 #define DETECT_SAMP_RATE 16000UL
 #define SAMP_RATE 16000UL
 #define SAMP_BITS 16
 #define SAMPLE_FRAME 320
 #define SAMPLE_MS 20
 #define PCM_SIZE (4 * 1024)
+#define PCM_SIZE_MS ((PCM_SIZE * 1000) / (SAMP_RATE * sizeof(int16_t)))
+#ifdef CONFIG_APP_WAKE_ARBITER
+/* Audio past pcm_store while a claim is pending, the whole window plus the
+ * frames nn_task takes to get to the claim */
+#define CLAIM_HOLD_SIZE ((CONFIG_APP_WAKE_ARBITER_WINDOW_MS + 2 * SAMPLE_MS) * SAMP_RATE / 1000 * sizeof(int16_t))
+#else
+#define CLAIM_HOLD_SIZE 0
+#endif
 //Sample size for 20millisec data on 48KHz/16bit sampling. Division factor is (sectomillisec * bitsinbytes)
 #define SAMPLE_SZ ((SAMP_RATE * I2S_BITS_PER_SAMPLE_16BIT * SAMPLE_MS) / (1000 * 8))
+#define CAPTURE_BYTES_PER_SEC (SAMP_RATE * sizeof(int16_t))
+#define CAPTURE_MONITOR_PERIOD_MS 1000
+/* Allowed drift between the I2S clock and esp_timer, per monitor period */
+#define CAPTURE_DRIFT_PPM 1000
+/* After a regrow that couldn't set up any ring, before restarting */
+#define CAPTURE_RECOVER_TRIES 10
+#define CAPTURE_RECOVER_MS 1000
+/* 10% of a 240 MHz core per 20 ms frame, see noise_suppress.h */
+#define NS_CYCLE_BUDGET (240 * 1000 * SAMPLE_MS / 10)
+/* AGC aims for about -20 dBFS mean level and ignores frames below ~-60 dBFS */
+#define AGC_TARGET_LEVEL 3000
+#define AGC_GATE_LEVEL 30
+#define AGC_ATTACK_SHIFT 1
+#define AGC_RELEASE_SHIFT 5
+/* Frame levels kept for scoring a wake word, about its length */
+#define WAKE_LEVEL_FRAMES 50
+/* Report skipped wake word chunks at most this often */
+#define WAKE_SKIP_REPORT_MS 60000
+/* Speech is 10 dB over the noise floor and above ~-56 dBFS; see tools/ep_sim.c */
+#define EP_SPEECH_RATIO_Q8 (3 * 256)
+#define EP_MIN_LEVEL 50
+#define EP_MIN_SPEECH_MS 200
+#ifndef CONFIG_APP_DSP_MIC_SHIFT
+#define CONFIG_APP_DSP_MIC_SHIFT 16
+#endif
 static const char *TAG = "dsp";
 
-#ifdef CONFIG_AWS_IOT_SDK
-extern xQueueHandle wake_word_sem;
+#ifdef CONFIG_APP_DSP_WAKE_ENGINE_CUSTOM
+extern const wake_engine_t wake_engine_custom;
+#define WAKE_ENGINE (&wake_engine_custom)
+#else
+extern const wake_engine_t wake_engine_esp_wwe;
+#define WAKE_ENGINE (&wake_engine_esp_wwe)
 #endif
 
+static const app_dsp_params_t default_params = {
+    .version = 0,
+    .wake_hits = 1,
+    .vad_threshold = 0,
+    .preroll_ms = PCM_SIZE_MS,
+    .gain_q8 = 256,
+};
+
+/*
+ * Dialog state of the capture path, a single word so every frame goes to
+ * exactly one consumer. Any task may move it along with dsp_state_cas();
+ * read_rb_task samples it once per frame and finishes STOPPING, which lets
+ * alexa_app_speech_stop() know no more audio will be uploaded.
+ *
+ *   IDLE -> TRIGGERED      wake word or button, pcm_store fills
+ *   IDLE -> STREAMING      the SDK starts a recognize itself
+ *   TRIGGERED -> STREAMING pcm_store flushed, read_rb_task
+ *   TRIGGERED/STREAMING -> STOPPING -> IDLE
+ */
+typedef enum dsp_state {
+    DSP_STATE_IDLE,         /* listening for the wake word */
+    DSP_STATE_TRIGGERED,
+    DSP_STATE_STREAMING,
+    DSP_STATE_STOPPING,
+} dsp_state_t;
+
+/* Wait for read_rb_task to finish a stop, a couple of frames */
+#define DSP_STOP_ACK_MS 100
+
 static struct dsp_data {
     int item_chunk_size;
-    bool detect_wakeword;
-    bool speech_recog_en;
+    /* Capture frames cut into the engine's chunks, in read_rb_task */
+    int16_t *wake_chunk;
+    int wake_chunk_fill;
+    const wake_engine_t *engine;
+    int engine_batch;
+    uint32_t chunk_us;
+    app_dsp_wake_stats_t wake_stats;
+    /* Skips are reported by nn_task and flushed by the sysmon timer */
+    portMUX_TYPE wake_report_lock;
+    int64_t wake_report_us;
+    uint32_t wake_reported;
+    /* Levels of the frames sent to the engine, for arbitration */
+    uint16_t wake_levels[WAKE_LEVEL_FRAMES];
+    uint32_t wake_level_pos;
+    /* nn_task is holding a TRIGGERED dialog while other devices decide */
+    volatile bool arbitrating;
+    /* The wake word went to another device, so nothing was cued */
+    bool arb_lost;
+    /* In PSRAM, what didn't fit in pcm_store while arbitrating */
+    uint8_t *claim_hold;
+    int claim_held;
+    /* dsp_state_t, see dsp_state_cas() */
+    volatile uint32_t state;
+    /* Given by read_rb_task once it finished a stop that is waited for */
+    SemaphoreHandle_t stop_ack;
+    volatile bool stop_waiting;
     QueueHandle_t recog_queue;
     ringbuf_t *temp_rb;
     audio_resample_config_t resample;
     i2s_stream_t *read_i2s_stream;
     TaskHandle_t nn_task_handle;
     int pcm_stored_data;
-    bool write_to_store;
+    int pcm_store_limit;
+    /* params is only written by read_rb_task, at frame boundaries */
+    app_dsp_params_t params;
+    frontend_t frontend;
+    noise_suppress_t *ns;
+    app_dsp_ns_stats_t ns_stats;
+    adpcm_history_t history;
+    endpoint_t endpoint;
+    volatile int64_t endpoint_end_us;
+    /* End of speech of the last dialog ended locally, until its response */
+    volatile int64_t speech_end_us;
+    app_dsp_endpoint_stats_t ep_stats;
+    uint32_t wake_frame;
+    uint32_t history_avg_cycles;
+    uint32_t history_max_cycles;
+    app_dsp_params_t pending_params;
+    bool params_pending;
+    portMUX_TYPE params_lock;
+    /* Capture accounting. capture_bytes is only written by the i2s reader
+     * stream task, the monitor state only by the monitor timer. */
+    volatile uint32_t capture_bytes;
+    audio_board_capture_profile_t capture_profile;
+    int capture_bits;
+    pcm_convert_t mic_cv;
+    beamformer_t *bf;
+    uint32_t bf_avg_cycles;
+    uint32_t bf_max_cycles;
+    int dma_buf_bytes;
+    esp_timer_handle_t capture_monitor;
+    int64_t monitor_us;
+    uint32_t monitor_bytes;
+    int32_t capture_deficit;
+    volatile bool monitor_restart;
+    /* Set by the monitor, the stream is regrown by read_rb_task */
+    volatile bool regrow_pending;
+    /* dsp_write_cb drops buffers while read_rb_task replaces the stream */
+    volatile bool capture_paused;
+    app_dsp_capture_stats_t stats;
     int16_t data_buf[SAMPLE_SZ];
     char pcm_store[PCM_SIZE];
-} dd;
+} dd = {
+    .params_lock = portMUX_INITIALIZER_UNLOCKED,
+    .wake_report_lock = portMUX_INITIALIZER_UNLOCKED,
+};
 
 static media_hal_config_t media_hal_conf = {
     .op_mode    = MEDIA_HAL_MODE_SLAVE,
@@ -89,22 +239,366 @@ static esp_err_t reader_stream_event_handler(void *arg, int event, void *data)
     return ESP_OK;
 }
 
+static int beamform(int16_t *buf, int frames)
+{
+    uint32_t start = xthal_get_ccount(), cycles;
+
+    frames = beamformer_process(dd.bf, buf, frames);
+    cycles = xthal_get_ccount() - start;
+    dd.bf_avg_cycles += ((int32_t) cycles - (int32_t) dd.bf_avg_cycles) / 32;
+    if (cycles > dd.bf_max_cycles) {
+        dd.bf_max_cycles = cycles;
+    }
+    return frames;
+}
+
+/* Reduces a DMA buffer to 16-bit mono in place, returns the new length */
+static int capture_convert(void *data, int len)
+{
+    int frame_size = dd.mic_cv.channels * (dd.capture_bits / 8);
+    int samples = len / frame_size;
+
+    if (dd.capture_bits == 32) {
+        samples = pcm_convert_s32_to_s16(&dd.mic_cv, data, samples);
+    } else if (dd.mic_cv.channels > 1) {
+        samples = pcm_select_s16(data, samples, dd.mic_cv.channels, dd.mic_cv.channel);
+    }
+    if (dd.bf) {
+        /* Both mics are still interleaved, the beamformer folds them into one */
+        samples = beamform(data, samples / 2);
+    }
+    return samples * sizeof(int16_t);
+}
+
 static ssize_t dsp_write_cb(void *h, void *data, int len, uint32_t wait)
 {
     ssize_t sent_len;
+    int pcm_len, in_frame;
     if(len == 0) {
         return 0;
     }
-    sent_len = rb_write(dd.temp_rb, data, len, wait);
-    return sent_len;
+    if (dd.capture_paused) {
+        return len;
+    }
+    /* Before the conversion, which works in place */
+    app_capture_tap_push(CAPTURE_TAP_RAW, data, len, dd.capture_bits, audio_board_capture_slots(), SAMP_RATE);
+    pcm_len = capture_convert(data, len);
+    dd.capture_bytes += pcm_len;
+    sent_len = rb_write(dd.temp_rb, data, pcm_len, wait);
+    if (sent_len < pcm_len) {
+        dd.stats.ring_overruns++;
+        dd.stats.ring_lost_bytes += pcm_len - (sent_len > 0 ? sent_len : 0);
+        if (sent_len <= 0) {
+            return sent_len;
+        }
+        /* The stream counts in its own units: the input frames whose audio
+         * made it into the ring */
+        in_frame = audio_board_capture_slots() * (dd.capture_bits / 8);
+        return ((int64_t) sent_len * len / pcm_len) / in_frame * in_frame;
+    }
+    /* The stream only cares that the whole buffer was consumed */
+    return len;
+}
+
+static esp_err_t capture_stream_create(audio_board_capture_profile_t profile)
+{
+    i2s_stream_config_t i2s_cfg;
+    memset(&i2s_cfg, 0, sizeof(i2s_cfg));
+    i2s_cfg.i2s_num = 1;
+    audio_board_i2s_capture_config(profile, &i2s_cfg.i2s_config);
+    //i2s_cfg.media_hal_cfg = media_hal_init(&media_hal_conf);
+
+    dd.read_i2s_stream = i2s_reader_stream_create(&i2s_cfg);
+    if (dd.read_i2s_stream) {
+        ESP_LOGI(TAG, "Created I2S audio stream");
+    } else {
+        ESP_LOGE(TAG, "Failed creating I2S audio stream");
+        return ESP_FAIL;
+    }
+    i2s_stream_set_stack_size(dd.read_i2s_stream, app_task_stack_size(APP_TASK_I2S_READER));
+
+    audio_io_fn_arg_t stream_reader_fn = {
+        .func = dsp_write_cb,
+        .arg = NULL,
+    };
+    audio_event_fn_arg_t stream_event_fn = {
+        .func = reader_stream_event_handler,
+    };
+    if (audio_stream_init(&dd.read_i2s_stream->base, "i2s_reader", &stream_reader_fn, &stream_event_fn) != 0) {
+        ESP_LOGE(TAG, "Failed creating audio stream");
+        i2s_stream_destroy(dd.read_i2s_stream);
+        dd.read_i2s_stream = NULL;
+        return ESP_FAIL;
+    }
+    dd.capture_profile = profile;
+    dd.stats.profile = profile;
+    dd.capture_bits = i2s_cfg.i2s_config.bits_per_sample;
+    dd.mic_cv.shift = CONFIG_APP_DSP_MIC_SHIFT;
+#ifdef CONFIG_APP_DSP_MIC_DITHER
+    dd.mic_cv.dither = true;
+#endif
+    /* The beamformer takes both mics, otherwise only the first is kept */
+    dd.mic_cv.channels = audio_board_capture_slots();
+    if (dd.bf) {
+        dd.mic_cv.channels /= audio_board_capture_mics();
+    }
+    dd.mic_cv.channel = audio_board_capture_mic_slot();
+    if (!dd.mic_cv.seed) {
+        dd.mic_cv.seed = 1;
+    }
+    /* dma_buf_len is in frames, and the monitor counts 16-bit mono output */
+    dd.dma_buf_bytes = i2s_cfg.i2s_config.dma_buf_len * sizeof(int16_t);
+    dd.monitor_restart = true;
+    return ESP_OK;
+}
+
+#ifdef CONFIG_APP_DSP_CAPTURE_ADAPTIVE
+/* Recreating the stream reinstalls the I2S driver with the bigger ring. The
+ * gap this leaves in the audio is far shorter than the overruns it avoids.
+ *
+ * Runs on read_rb_task between frames, which is the only other user of the
+ * capture state dsp_write_cb works with. The stream's own task is parked
+ * first: once paused, dsp_write_cb no longer waits for room in the ring, and
+ * draining the ring releases it if it already was waiting. */
+static bool capture_stream_regrow()
+{
+    audio_board_capture_profile_t profile = dd.capture_profile + 1;
+
+    dd.regrow_pending = false;
+    ESP_LOGW(TAG, "Capture overruns, growing DMA ring to profile %d", profile);
+    dd.capture_paused = true;
+    while (rb_read(dd.temp_rb, (uint8_t *)dd.data_buf, SAMPLE_SZ, 0) > 0) {
+    }
+    audio_stream_stop(&dd.read_i2s_stream->base);
+    i2s_stream_destroy(dd.read_i2s_stream);
+    if (capture_stream_create(profile) == ESP_OK) {
+        dd.stats.regrows++;
+    } else if (capture_stream_create(profile - 1) != ESP_OK) {
+        dd.read_i2s_stream = NULL;
+        return false;
+    }
+    dd.capture_paused = false;
+    audio_stream_start(&dd.read_i2s_stream->base);
+    return true;
+}
+
+/* Neither ring could be set up again, most likely for want of DMA capable
+ * RAM. Nothing reaches the wake word engine or the cloud meanwhile, so the
+ * device restarts rather than stay deaf. */
+static void capture_stream_recover()
+{
+    audio_board_capture_profile_t profile = dd.capture_profile;
+
+    ESP_LOGE(TAG, "Lost the capture stream, retrying profile %d", profile);
+#ifdef CONFIG_AWS_IOT_SDK
+    aws_iot_post_event(AWS_IOT_EVT_CAPTURE_LOST, profile);
+#endif
+    for (int i = 0; i < CAPTURE_RECOVER_TRIES; i++) {
+        vTaskDelay(CAPTURE_RECOVER_MS / portTICK_RATE_MS);
+        if (capture_stream_create(profile) == ESP_OK) {
+            dd.capture_paused = false;
+            audio_stream_start(&dd.read_i2s_stream->base);
+            return;
+        }
+    }
+    ESP_LOGE(TAG, "No capture stream, restarting");
+    esp_restart();
+}
+#endif
+
+/* Compares what the capture stream delivered against what the sample clock
+ * produced. Audio buffered in the DMA ring shows up as a deficit that is paid
+ * back once the reader catches up; audio the driver dropped never is. */
+static void capture_monitor_cb(void *arg)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t bytes = dd.capture_bytes;
+    int32_t expected, received;
+
+    /* Nothing is captured while the stream is being replaced */
+    if (dd.regrow_pending || dd.capture_paused) {
+        return;
+    }
+    if (dd.monitor_restart) {
+        dd.monitor_restart = false;
+        dd.monitor_us = now;
+        dd.monitor_bytes = bytes;
+        dd.capture_deficit = 0;
+        return;
+    }
+    expected = ((now - dd.monitor_us) * CAPTURE_BYTES_PER_SEC) / 1000000;
+    received = bytes - dd.monitor_bytes;
+    dd.monitor_us = now;
+    dd.monitor_bytes = bytes;
+
+    dd.capture_deficit += expected - received - (expected * (int64_t) CAPTURE_DRIFT_PPM) / 1000000;
+    if (dd.capture_deficit < -dd.dma_buf_bytes) {
+        dd.capture_deficit = -dd.dma_buf_bytes;
+    }
+    /* Up to one DMA buffer can legitimately be in flight */
+    if (dd.capture_deficit <= dd.dma_buf_bytes) {
+        return;
+    }
+    dd.stats.dma_overruns++;
+    dd.stats.dma_lost_bytes += dd.capture_deficit - dd.dma_buf_bytes;
+    ESP_LOGW(TAG, "Capture DMA overrun, ~%d bytes lost", dd.capture_deficit - dd.dma_buf_bytes);
+    dd.capture_deficit = 0;
+#ifdef CONFIG_APP_DSP_CAPTURE_ADAPTIVE
+    /* Not from here: stopping the stream blocks, and dsp_write_cb may be
+     * using the capture state capture_stream_create() rewrites */
+    if (dd.capture_profile + 1 < AUDIO_BOARD_CAPTURE_PROFILE_MAX) {
+        dd.regrow_pending = true;
+    }
+#endif
+}
+
+static void capture_monitor_init()
+{
+    esp_timer_create_args_t timer_conf = {
+        .callback = capture_monitor_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "capture_mon_tm"
+    };
+    if (esp_timer_create(&timer_conf, &dd.capture_monitor) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create capture monitor timer");
+        return;
+    }
+    esp_timer_start_periodic(dd.capture_monitor, CAPTURE_MONITOR_PERIOD_MS * 1000U);
+}
+
+void app_dsp_get_frontend_stats(frontend_stats_t *stats)
+{
+    *stats = dd.frontend.stats;
+}
+
+void app_dsp_get_beam_stats(app_dsp_beam_stats_t *stats)
+{
+    beamformer_stats_t bf;
+
+    memset(stats, 0, sizeof(*stats));
+    if (!dd.bf) {
+        return;
+    }
+    beamformer_get_stats(dd.bf, &bf);
+    stats->enabled = true;
+#ifdef CONFIG_APP_DSP_BEAMFORMER_STEERED
+    stats->steered = true;
+#endif
+    stats->delay_q8 = bf.delay_q8;
+    stats->max_delay_q8 = bf.max_delay_q8;
+    stats->updates = bf.updates;
+    stats->avg_cycles = dd.bf_avg_cycles;
+    stats->max_cycles = dd.bf_max_cycles;
+}
+
+/* Created once, the capture stream may be recreated around it */
+static void beamformer_setup()
+{
+    if (audio_board_capture_mics() < 2) {
+        return;
+    }
+    beamformer_config_t cfg = {
+        .mode = BEAMFORMER_BROADSIDE,
+        .mic_spacing_mm = audio_board_mic_spacing_mm(),
+        .sample_rate = SAMP_RATE,
+    };
+#ifdef CONFIG_APP_DSP_BEAMFORMER_STEERED
+    cfg.mode = BEAMFORMER_STEERED;
+#endif
+    dd.bf = beamformer_create(&cfg);
+    if (!dd.bf) {
+        ESP_LOGE(TAG, "Failed to create beamformer for %d mm mic spacing", cfg.mic_spacing_mm);
+    }
+}
+
+static void frontend_setup()
+{
+    frontend_config_t cfg = {
+        .target_level = AGC_TARGET_LEVEL,
+        .gate_level = AGC_GATE_LEVEL,
+        .attack_shift = AGC_ATTACK_SHIFT,
+        .release_shift = AGC_RELEASE_SHIFT,
+    };
+#ifdef CONFIG_APP_DSP_DC_BLOCK
+    cfg.dc_block = true;
+#endif
+#ifdef CONFIG_APP_DSP_PREEMPHASIS
+    cfg.preemphasis = true;
+#endif
+#ifdef CONFIG_APP_DSP_AGC
+    cfg.agc = true;
+    cfg.max_gain_q8 = 256 * powf(10, CONFIG_APP_DSP_AGC_MAX_GAIN_DB / 20.0f);
+#endif
+    frontend_init(&dd.frontend, &cfg);
+
+#ifdef CONFIG_APP_DSP_NOISE_SUPPRESS
+    noise_suppress_config_t ns_cfg = {
+        .min_gain_q15 = 32768 * powf(10, -CONFIG_APP_DSP_NS_MAX_ATTENUATION_DB / 20.0f),
+    };
+    dd.ns = noise_suppress_create(&ns_cfg);
+    if (!dd.ns) {
+        ESP_LOGE(TAG, "No memory for noise suppression, uplink stays unprocessed");
+    }
+#endif
+}
+
+void app_dsp_get_capture_stats(app_dsp_capture_stats_t *stats)
+{
+    *stats = dd.stats;
+}
+
+void app_dsp_reset_capture_stats()
+{
+    int profile = dd.stats.profile;
+
+    memset(&dd.stats, 0, sizeof(dd.stats));
+    dd.stats.profile = profile;
+}
+
+/* Moves the state from `from` to `to`, if nobody else moved it first */
+static bool dsp_state_cas(dsp_state_t from, dsp_state_t to)
+{
+    uint32_t set = to;
+
+    uxPortCompareSet(&dd.state, from, &set);
+    return set == from;
+}
+
+/* Called with the cloud's StopCapture: how long after the local end it came */
+static void endpoint_account()
+{
+    int64_t end = dd.endpoint_end_us;
+
+    if (!end) {
+        return;
+    }
+    dd.endpoint_end_us = 0;
+    dd.ep_stats.stop_lag_ms += (esp_timer_get_time() - end) / 1000;
+    dd.ep_stats.stops++;
 }
 
 int alexa_app_speech_stop()
 {
+    dsp_state_t state;
+
     ESP_LOGI(TAG, "Sending stop command");
-    dd.speech_recog_en = false;
-    vTaskDelay(20/portTICK_RATE_MS);
-    dd.detect_wakeword = true;
+    /* Drop a late acknowledgement of an earlier stop */
+    xSemaphoreTake(dd.stop_ack, 0);
+    dd.stop_waiting = true;
+    do {
+        state = dd.state;
+        if (state != DSP_STATE_TRIGGERED && state != DSP_STATE_STREAMING) {
+            break;
+        }
+    } while (!dsp_state_cas(state, DSP_STATE_STOPPING));
+    if (dd.state == DSP_STATE_STOPPING &&
+        xSemaphoreTake(dd.stop_ack, pdMS_TO_TICKS(DSP_STOP_ACK_MS)) != pdTRUE) {
+        /* Capture has stalled; the stop still completes with the next frame */
+        ESP_LOGW(TAG, "Capture didn't acknowledge the stop");
+    }
+    dd.stop_waiting = false;
+    endpoint_account();
     ESP_LOGI(TAG, "Stopped I2S audio stream");
     return ESP_OK;
 }
@@ -112,9 +606,9 @@ int alexa_app_speech_stop()
 int alexa_app_speech_start()
 {
     ESP_LOGI(TAG, "Sending start command");
-    dd.detect_wakeword = false;
+    /* Once triggered, flushing pcm_store moves on to streaming */
+    dsp_state_cas(DSP_STATE_IDLE, DSP_STATE_STREAMING);
     ESP_LOGI(TAG, "Starting I2S audio stream");
-    dd.speech_recog_en = true;
     return ESP_OK;
 }
 
@@ -123,128 +617,665 @@ void app_dsp_reset()
     return;
 }
 
-void app_dsp_send_recognize()
+void app_dsp_get_params(app_dsp_params_t *params)
 {
-    ESP_LOGI(TAG, "Sending start command");
-    dd.detect_wakeword = false;
-    ESP_LOGI(TAG, "Starting I2S audio stream");
-    dd.pcm_stored_data = 0;
-    dd.write_to_store = true;
+    portENTER_CRITICAL(&dd.params_lock);
+    *params = dd.params;
+    portEXIT_CRITICAL(&dd.params_lock);
+}
+
+void app_dsp_get_staged_params(app_dsp_params_t *params)
+{
+    portENTER_CRITICAL(&dd.params_lock);
+    *params = dd.params_pending ? dd.pending_params : dd.params;
+    portEXIT_CRITICAL(&dd.params_lock);
+}
+
+esp_err_t app_dsp_set_params(const app_dsp_params_t *params)
+{
+    if (params->wake_hits < 1 || params->wake_hits > APP_DSP_WAKE_HITS_MAX ||
+        params->vad_threshold < 0 || params->vad_threshold > APP_DSP_VAD_THRESHOLD_MAX ||
+        params->preroll_ms < SAMPLE_MS || params->preroll_ms > PCM_SIZE_MS ||
+        params->gain_q8 < 0 || params->gain_q8 > APP_DSP_GAIN_Q8_MAX) {
+        ESP_LOGE(TAG, "Rejecting DSP params version %u", params->version);
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&dd.params_lock);
+    dd.pending_params = *params;
+    dd.params_pending = true;
+    portEXIT_CRITICAL(&dd.params_lock);
+    return ESP_OK;
+}
+
+/* Called by read_rb_task between frames, so a frame is never processed with
+ * a mix of old and new parameters */
+static void apply_pending_params()
+{
+    if (!dd.params_pending) {
+        return;
+    }
+    portENTER_CRITICAL(&dd.params_lock);
+    dd.params = dd.pending_params;
+    dd.params_pending = false;
+    portEXIT_CRITICAL(&dd.params_lock);
+
+    dd.pcm_store_limit = (dd.params.preroll_ms * SAMP_RATE * sizeof(int16_t)) / 1000;
+    ESP_LOGI(TAG, "Applied DSP params version %u: wake_hits %d vad %d preroll %d ms gain %d/256",
+             dd.params.version, dd.params.wake_hits, dd.params.vad_threshold,
+             dd.params.preroll_ms, dd.params.gain_q8);
+}
+
+static void apply_gain(int16_t *buf, int samples, int gain_q8)
+{
+    for (int i = 0; i < samples; i++) {
+        int32_t v = (buf[i] * gain_q8) >> 8;
+        if (v > INT16_MAX) {
+            v = INT16_MAX;
+        } else if (v < INT16_MIN) {
+            v = INT16_MIN;
+        }
+        buf[i] = v;
+    }
+}
+
+static int frame_level(const int16_t *buf, int samples)
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < samples; i++) {
+        sum += abs(buf[i]);
+    }
+    return sum / samples;
+}
+
+static void suppress_noise(int16_t *buf, int samples)
+{
+    uint32_t start, cycles;
+
+    if (!dd.ns) {
+        return;
+    }
+    start = xthal_get_ccount();
+    noise_suppress_process(dd.ns, buf, samples);
+    cycles = xthal_get_ccount() - start;
+
+    /* Running average over ~32 frames */
+    dd.ns_stats.avg_cycles += ((int32_t) cycles - (int32_t) dd.ns_stats.avg_cycles) / 32;
+    if (cycles > dd.ns_stats.max_cycles) {
+        dd.ns_stats.max_cycles = cycles;
+    }
+    if (cycles > NS_CYCLE_BUDGET) {
+        dd.ns_stats.over_budget++;
+    }
+}
+
+void app_dsp_get_ns_stats(app_dsp_ns_stats_t *stats)
+{
+    noise_suppress_stats_t ns;
+
+    *stats = dd.ns_stats;
+    stats->enabled = (dd.ns != NULL);
+    if (dd.ns) {
+        noise_suppress_get_stats(dd.ns, &ns);
+        stats->mean_gain_q15 = ns.mean_gain_q15;
+    }
+}
+
+/* Frames are small enough that the encode cost hardly varies, so it is
+ * only reported, not budgeted */
+static void history_push(const int16_t *buf)
+{
+    uint32_t start, cycles;
+
+    if (!dd.history.frames) {
+        return;
+    }
+    start = xthal_get_ccount();
+    adpcm_history_push(&dd.history, buf);
+    cycles = xthal_get_ccount() - start;
+    dd.history_avg_cycles += ((int32_t) cycles - (int32_t) dd.history_avg_cycles) / 32;
+    if (cycles > dd.history_max_cycles) {
+        dd.history_max_cycles = cycles;
+    }
+}
+
+static void history_setup()
+{
+#if CONFIG_APP_DSP_HISTORY_SECONDS > 0
+    size_t size = adpcm_history_block_size(APP_DSP_HISTORY_FRAME_SAMPLES) *
+                  (CONFIG_APP_DSP_HISTORY_SECONDS * 1000 / SAMPLE_MS + 1);
+    void *buf = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+
+    if (!buf) {
+        ESP_LOGE(TAG, "No PSRAM for %d s of capture history", CONFIG_APP_DSP_HISTORY_SECONDS);
+        return;
+    }
+    adpcm_history_init(&dd.history, buf, size, APP_DSP_HISTORY_FRAME_SAMPLES);
+#endif
+}
+
+void app_dsp_get_history_stats(app_dsp_history_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!dd.history.frames) {
+        return;
+    }
+    stats->enabled = true;
+    stats->first_frame = adpcm_history_first(&dd.history);
+    stats->next_frame = dd.history.next;
+    stats->wake_frame = dd.wake_frame;
+    stats->frames = dd.history.frames;
+    stats->bytes = dd.history.frames * dd.history.block_size;
+    stats->raw_bytes = dd.history.frames * APP_DSP_HISTORY_FRAME_SAMPLES * sizeof(int16_t);
+    stats->avg_cycles = dd.history_avg_cycles;
+    stats->max_cycles = dd.history_max_cycles;
+}
+
+esp_err_t app_dsp_history_read(uint32_t frame, int16_t *buf)
+{
+    if (!dd.history.frames) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return adpcm_history_read(&dd.history, frame, buf) == 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+static void endpoint_setup()
+{
+    endpoint_config_t cfg = {
+        .sample_rate = SAMP_RATE,
+        .speech_ratio_q8 = EP_SPEECH_RATIO_Q8,
+        .min_level = EP_MIN_LEVEL,
+        .min_speech_ms = EP_MIN_SPEECH_MS,
+#ifdef CONFIG_APP_DSP_ENDPOINT
+        .trailing_silence_ms = CONFIG_APP_DSP_ENDPOINT_SILENCE_MS,
+        .no_speech_ms = CONFIG_APP_DSP_ENDPOINT_NO_SPEECH_MS,
+#endif
+    };
+    endpoint_init(&dd.endpoint, &cfg);
+}
+
+/* Cues the end of the utterance locally. Only the earcon follows it, the
+ * recognize stream can't be ended from here so the upload goes on, as is,
+ * until the cloud's StopCapture. An utterance cut short still reaches AVS
+ * whole that way. */
+static void endpoint_step(const int16_t *buf, int samples)
+{
+#ifdef CONFIG_APP_DSP_ENDPOINT
+    endpoint_state_t prev, st;
+
+    prev = dd.endpoint.state;
+    st = endpoint_process(&dd.endpoint, buf, samples);
+    if (st != prev && (st == ENDPOINT_END || st == ENDPOINT_NO_SPEECH)) {
+        ESP_LOGI(TAG, "Local end of %s", st == ENDPOINT_END ? "speech" : "capture, no speech");
+        dd.endpoint_end_us = esp_timer_get_time();
+        app_playback_earcon(EARCON_END);
+        if (st == ENDPOINT_END) {
+            /* The speech itself ended a trailing silence ago */
+            dd.speech_end_us = dd.endpoint_end_us - dd.endpoint.silence_ms * 1000LL;
+            dd.ep_stats.local_ends++;
+        } else {
+            dd.ep_stats.no_speech++;
+        }
+    }
+#endif
+}
+
+void app_dsp_response_started()
+{
+    int64_t end = dd.speech_end_us;
+    uint32_t ms;
+
+    if (!end) {
+        return;
+    }
+    dd.speech_end_us = 0;
+    ms = (esp_timer_get_time() - end) / 1000;
+    dd.ep_stats.responses++;
+    dd.ep_stats.response_ms += ms;
+    if (ms > dd.ep_stats.max_response_ms) {
+        dd.ep_stats.max_response_ms = ms;
+    }
+}
+
+void app_dsp_get_endpoint_stats(app_dsp_endpoint_stats_t *stats)
+{
+    *stats = dd.ep_stats;
+#ifdef CONFIG_APP_DSP_ENDPOINT
+    stats->enabled = true;
+#endif
+}
+
+/* Tells the user and the cloud side that a dialog is starting */
+static void wake_cue()
+{
+    app_playback_earcon(EARCON_WAKE);
 #ifdef CONFIG_AWS_IOT_SDK
-    xSemaphoreGive(wake_word_sem);
+    aws_iot_post_event(AWS_IOT_EVT_WAKE_WORD, 0);
 #endif
     ui_led_set(true);
 }
 
+void app_dsp_send_recognize()
+{
+    ESP_LOGI(TAG, "Sending start command");
+    if (!dsp_state_cas(DSP_STATE_IDLE, DSP_STATE_TRIGGERED)) {
+        ESP_LOGI(TAG, "Dialog already in progress");
+        return;
+    }
+    ESP_LOGI(TAG, "Starting I2S audio stream");
+    dd.wake_frame = dd.history.next;
+    wake_cue();
+}
+
+static int wake_peak_level()
+{
+    int peak = 0;
+
+    for (int i = 0; i < WAKE_LEVEL_FRAMES; i++) {
+        if (dd.wake_levels[i] > peak) {
+            peak = dd.wake_levels[i];
+        }
+    }
+    return peak;
+}
+
+/* A wake word from nn_task. With other devices around, the audio after it
+ * is held in pcm_store, and in claim_hold past the preroll, while they
+ * decide which heard it best. Only the winner cues the user and goes on to
+ * the recognize. */
+static void wake_detected(int confidence)
+{
+    uint32_t score;
+
+    if (!app_wake_arbiter_running()) {
+        app_dsp_send_recognize();
+        return;
+    }
+    dd.arbitrating = true;
+    if (!dsp_state_cas(DSP_STATE_IDLE, DSP_STATE_TRIGGERED)) {
+        dd.arbitrating = false;
+        return;
+    }
+    dd.wake_frame = dd.history.next;
+    /* The endpointer's noise floor is in the same mean absolute units */
+    score = wake_arbiter_score(wake_peak_level(), dd.endpoint.floor_q4 >> 4, confidence);
+    if (app_wake_arbiter_claim(score)) {
+        wake_cue();
+    } else {
+        dd.arb_lost = true;
+        if (!dsp_state_cas(DSP_STATE_TRIGGERED, DSP_STATE_IDLE)) {
+            dd.arb_lost = false;
+        }
+    }
+    dd.arbitrating = false;
+}
+
+/* Runs at a frame boundary when read_rb_task sees a new state */
+static void dsp_state_enter(dsp_state_t from, dsp_state_t to)
+{
+    switch (to) {
+    case DSP_STATE_TRIGGERED:
+        dd.pcm_stored_data = 0;
+        dd.claim_held = 0;
+        app_cmd_spot_start();
+        /* fall through */
+    case DSP_STATE_STREAMING:
+        if (from == DSP_STATE_IDLE) {
+            endpoint_start(&dd.endpoint);
+            dd.endpoint_end_us = 0;
+            dd.speech_end_us = 0;
+            dd.ep_stats.utterances++;
+        }
+        break;
+    case DSP_STATE_IDLE:
+        /* Unless the endpointer already cued the end locally, or the wake
+         * word went to another device and was never cued */
+        if (!dd.arb_lost && dd.endpoint.state != ENDPOINT_END && dd.endpoint.state != ENDPOINT_NO_SPEECH) {
+            app_playback_earcon(EARCON_END);
+        }
+        dd.arb_lost = false;
+        endpoint_stop(&dd.endpoint);
+        app_cmd_spot_stop();
+        break;
+    default:
+        break;
+    }
+}
+
+/* Samples the state for the next frame, finishing a stop if one is pending */
+static dsp_state_t dsp_state_frame(dsp_state_t applied)
+{
+    dsp_state_t state = dd.state;
+
+    if (state == DSP_STATE_STOPPING) {
+        /* Only read_rb_task leaves STOPPING, so this can't fail */
+        dsp_state_cas(DSP_STATE_STOPPING, DSP_STATE_IDLE);
+        state = DSP_STATE_IDLE;
+        if (dd.stop_waiting) {
+            xSemaphoreGive(dd.stop_ack);
+        }
+    }
+    if (state != applied) {
+        dsp_state_enter(applied, state);
+    }
+    return state;
+}
+
+/* Cuts capture frames into chunks of the engine's size for nn_task. A frame
+ * that isn't passed on drops the part-filled chunk, so that each chunk is
+ * contiguous audio. */
+static void wake_feed(const int16_t *frame, int samples)
+{
+    int chunk = dd.item_chunk_size / sizeof(int16_t);
+
+    while (samples) {
+        int n = chunk - dd.wake_chunk_fill < samples ? chunk - dd.wake_chunk_fill : samples;
+
+        memcpy(dd.wake_chunk + dd.wake_chunk_fill, frame, n * sizeof(int16_t));
+        dd.wake_chunk_fill += n;
+        frame += n;
+        samples -= n;
+        if (dd.wake_chunk_fill == chunk) {
+            if (xQueueSend(dd.recog_queue, dd.wake_chunk, 0) != pdTRUE) {
+                dd.wake_stats.queue_drops++;
+            }
+            dd.wake_chunk_fill = 0;
+        }
+    }
+}
+
 void read_rb_task(void *arg)
 {
-    size_t sent_len;
+    size_t sent_len, held_len;
+    const void *held;
+    app_cmd_spot_result_t spot;
+    dsp_state_t state = DSP_STATE_IDLE;
     while(1) {
         rb_read(dd.temp_rb, (uint8_t *)dd.data_buf, SAMPLE_SZ, portMAX_DELAY);
+#ifdef CONFIG_APP_DSP_CAPTURE_ADAPTIVE
+        if (dd.regrow_pending) {
+            if (!capture_stream_regrow()) {
+                capture_stream_recover();
+            }
+            continue;
+        }
+#endif
         sent_len = SAMPLE_SZ;
-        if(dd.detect_wakeword) {
-            xQueueSend(dd.recog_queue, dd.data_buf, 0);
-        } else if(dd.speech_recog_en) {
+        state = dsp_state_frame(state);
+        apply_pending_params();
+        if (dd.params.gain_q8 != 256) {
+            apply_gain(dd.data_buf, SAMPLE_SZ / sizeof(int16_t), dd.params.gain_q8);
+        }
+        /* Conditioned once here, for both the wake word engine and the cloud */
+        frontend_process(&dd.frontend, dd.data_buf, SAMPLE_SZ / sizeof(int16_t));
+        history_push(dd.data_buf);
+        if(state == DSP_STATE_IDLE) {
+            int level = frame_level(dd.data_buf, SAMPLE_SZ / sizeof(int16_t));
+            dd.wake_levels[dd.wake_level_pos++ % WAKE_LEVEL_FRAMES] = level;
+            /* Quiet frames can't contain the wake word, don't spend the NN on them */
+            if (dd.params.vad_threshold == 0 || level >= dd.params.vad_threshold) {
+                wake_feed(dd.data_buf, SAMPLE_SZ / sizeof(int16_t));
+            } else {
+                dd.wake_chunk_fill = 0;
+            }
+        } else {
+            dd.wake_chunk_fill = 0;
+        }
+        /* Fed every frame to keep the noise floor current, on the audio
+         * before suppression as in tools/ep_sim.c */
+        endpoint_step(dd.data_buf, SAMPLE_SZ / sizeof(int16_t));
+        /* Only the uplink is denoised, the wake word engine got its copy
+         * above. It keeps running in between so that the noise estimate is
+         * current when an utterance starts. */
+        suppress_noise(dd.data_buf, SAMPLE_SZ / sizeof(int16_t));
+        app_capture_tap_push(CAPTURE_TAP_PROCESSED, dd.data_buf, SAMPLE_SZ, SAMP_BITS, 1, SAMP_RATE);
+        spot = app_cmd_spot_frame(dd.data_buf, sent_len);
+        if(state == DSP_STATE_IDLE) {
+            continue;
+        } else if(state == DSP_STATE_STREAMING) {
             speech_recognizer_record(dd.data_buf, sent_len);
             //printf("recorded speech %d\n", sent_len);
-        } else if (dd.write_to_store) {
-            if ( (dd.pcm_stored_data + sent_len) < sizeof(dd.pcm_store)) {
+        } else if (state == DSP_STATE_TRIGGERED) {
+            if (spot == APP_CMD_SPOT_HOLD) {
+                /* Held until it is known whether the cloud is needed */
+                continue;
+            } else if (spot != APP_CMD_SPOT_IDLE && dd.arbitrating && !app_wake_arbiter_resolve()) {
+                continue;
+            } else if (spot == APP_CMD_SPOT_LOCAL || spot == APP_CMD_SPOT_CLOUD) {
+                /* A command is heard at once, and still goes up so that AVS
+                 * follows it */
+                if (spot == APP_CMD_SPOT_LOCAL && !app_cmd_spot_act()) {
+                    dsp_state_cas(DSP_STATE_TRIGGERED, DSP_STATE_IDLE);
+                    continue;
+                }
+                ESP_LOGI(TAG, "Sending recognize command");
+                speech_recognizer_recognize(0, TAP);
+                held = app_cmd_spot_held(&held_len);
+                speech_recognizer_record((void *) held, held_len);
+                speech_recognizer_record(dd.data_buf, sent_len);
+                if (dsp_state_cas(DSP_STATE_TRIGGERED, DSP_STATE_STREAMING)) {
+                    state = DSP_STATE_STREAMING;
+                }
+                continue;
+            }
+            if ( (dd.pcm_stored_data + sent_len) < dd.pcm_store_limit) {
                 //printf("Writing to store at pcm_stored_data %d %d sizeof %d\n", dd.pcm_stored_data, sent_len, sizeof(dd.pcm_store));
                 memcpy(dd.pcm_store + dd.pcm_stored_data, dd.data_buf, sent_len);
                 dd.pcm_stored_data += sent_len;
+            } else if (dd.arbitrating && dd.claim_hold && dd.claim_held + sent_len <= CLAIM_HOLD_SIZE) {
+                /* The claim is still open, whatever the preroll */
+                memcpy(dd.claim_hold + dd.claim_held, dd.data_buf, sent_len);
+                dd.claim_held += sent_len;
+            } else if (dd.arbitrating && !app_wake_arbiter_resolve()) {
+                /* Another device has it, nn_task is standing down */
+                continue;
             } else {
                 /* store buffer is full, raise the 'Recognize' event, and flush the data */
                 ESP_LOGI(TAG, "Sending recognize command");
                 speech_recognizer_recognize(0, TAP);
                 speech_recognizer_record(dd.pcm_store, dd.pcm_stored_data);
-                ESP_LOGI(TAG, "Flushed store data: %d\n", dd.pcm_stored_data);
+                if (dd.claim_held) {
+                    speech_recognizer_record(dd.claim_hold, dd.claim_held);
+                }
+                ESP_LOGI(TAG, "Flushed store data: %d\n", dd.pcm_stored_data + dd.claim_held);
                 //Send data which is not flushed in buffer
                 speech_recognizer_record(dd.data_buf, sent_len);
-                dd.write_to_store = false;
-                dd.speech_recog_en = true;
+                /* A stop that came in meanwhile wins */
+                if (dsp_state_cas(DSP_STATE_TRIGGERED, DSP_STATE_STREAMING)) {
+                    state = DSP_STATE_STREAMING;
+                }
             }
         }
     }
 }
 
-void nn_task(void *arg)
+bool app_dsp_in_dialog()
+{
+    return dd.state != DSP_STATE_IDLE;
+}
+
+void app_dsp_get_wake_stats(app_dsp_wake_stats_t *stats, bool reset)
+{
+    *stats = dd.wake_stats;
+    if (reset) {
+        memset(&dd.wake_stats, 0, sizeof(dd.wake_stats));
+        dd.wake_stats.budget_us = stats->budget_us;
+        dd.wake_reported = 0;
+    }
+}
+
+void app_dsp_report_wake_skips()
 {
-    int frequency = esp_wwe_get_sample_rate();
-    int audio_chunksize = esp_wwe_get_sample_chunksize();
+#ifdef CONFIG_AWS_IOT_SDK
+    int64_t now = esp_timer_get_time();
+    uint32_t skipped = 0;
+
+    portENTER_CRITICAL(&dd.wake_report_lock);
+    if (dd.wake_stats.skipped_chunks != dd.wake_reported &&
+        (!dd.wake_report_us || now - dd.wake_report_us >= WAKE_SKIP_REPORT_MS * 1000LL)) {
+        skipped = dd.wake_stats.skipped_chunks - dd.wake_reported;
+        dd.wake_reported = dd.wake_stats.skipped_chunks;
+        dd.wake_report_us = now;
+    }
+    portEXIT_CRITICAL(&dd.wake_report_lock);
+    if (skipped) {
+        aws_iot_post_event(AWS_IOT_EVT_WAKE_SKIPPED, skipped);
+    }
+#endif
+}
+
+/* Accounts one detect() call over n chunks against the audio it covered.
+ * Returns true if the engine had fallen so far behind that the queued
+ * chunks were dropped; the engine must then start afresh. */
+static bool wake_deadline(uint32_t us, int n)
+{
+    app_dsp_wake_stats_t *st = &dd.wake_stats;
+    uint32_t waiting = uxQueueMessagesWaiting(dd.recog_queue);
+
+    st->calls++;
+    st->avg_us += ((int32_t) us - (int32_t) st->avg_us) / 32;
+    if (us > st->max_us) {
+        st->max_us = us;
+    }
+    if (us > n * dd.chunk_us) {
+        st->deadline_misses++;
+    }
+    st->backlog_ms = waiting * dd.chunk_us / 1000;
+    if (st->backlog_ms > st->max_backlog_ms) {
+        st->max_backlog_ms = st->backlog_ms;
+    }
+    if (!waiting || st->backlog_ms < CONFIG_APP_DSP_WAKE_MAX_LAG_MS) {
+        return false;
+    }
+    /* All at once, so the engine restarts on contiguous audio rather than
+     * the queue dropping chunks here and there */
+    xQueueReset(dd.recog_queue);
+    st->skips++;
+    st->skipped_chunks += waiting;
+    app_dsp_report_wake_skips();
+    return true;
+}
 
-    int16_t *buffer = malloc(audio_chunksize*sizeof(int16_t));
-    assert(buffer);
-    int chunks=0;
-    int priv_ms = 0;
+void nn_task(void *arg)
+{
+    const wake_engine_t *engine = dd.engine;
+    int chunk = engine->chunk_samples();
+    int batch = dd.engine_batch;
+    int16_t *buffer = malloc(batch * chunk * sizeof(int16_t));
+    uint32_t *chunk_ms = malloc(batch * sizeof(uint32_t));
+    uint8_t *confidence = malloc(batch);
+    assert(buffer && chunk_ms && confidence);
+    bool was_detecting = false;
+    wake_detect_config_t wd_cfg = {
+        .min_confidence = CONFIG_APP_DSP_WAKE_MIN_CONFIDENCE,
+        .hits = dd.params.wake_hits,
+        .refractory_ms = CONFIG_APP_DSP_WAKE_REFRACTORY_MS,
+    };
+    wake_detect_t wd;
+    wake_detect_init(&wd, &wd_cfg);
     while(1) {
-        if (dd.detect_wakeword) {
-            xQueueReceive(dd.recog_queue, buffer, portMAX_DELAY);
-            int r = esp_wwe_detect(buffer);
-            if (r && dd.detect_wakeword) {
-                int new_ms = (chunks*audio_chunksize*1000)/frequency;
-                printf("%.2f: Neural network detection triggered output %d.\n", (float)new_ms/1000.0, r);
-                int x = (new_ms - priv_ms);
-                priv_ms = new_ms;
-                if(x != 20) {
-                    app_dsp_send_recognize();
-                }
-            }
-            chunks++;
-        } else {
-            memset(buffer, 0, (audio_chunksize * 2));
+        if (dd.state != DSP_STATE_IDLE) {
+            was_detecting = false;
             vTaskDelay(100/portTICK_RATE_MS);
+            continue;
+        }
+        if (!was_detecting) {
+            /* The audio jumps over the dialog, don't let the engine join
+             * up the two sides */
+            if (engine->reset) {
+                engine->reset();
+            }
+            wake_detect_reset(&wd);
+            was_detecting = true;
+        }
+        int n = 0;
+        while (n < batch && dd.state == DSP_STATE_IDLE) {
+            if (xQueueReceive(dd.recog_queue, buffer + n * chunk, 100/portTICK_RATE_MS) == pdTRUE) {
+                chunk_ms[n++] = esp_timer_get_time() / 1000;
+            }
+        }
+        if (n < batch) {
+            continue;
+        }
+        int64_t start = esp_timer_get_time();
+        engine->detect(buffer, n, confidence);
+        uint32_t us = esp_timer_get_time() - start;
+        /* Picks up wake_hits changes from app_dsp_set_params() */
+        wd.cfg.hits = dd.params.wake_hits;
+        /* Stop at a detection, the rest of the batch belongs to the dialog */
+        for (int i = 0; i < n && dd.state == DSP_STATE_IDLE; i++) {
+            if (confidence[i] >= wd.cfg.min_confidence) {
+                printf("%.2f: Wake word engine hit, confidence %d.\n", chunk_ms[i] / 1000.0f, confidence[i]);
+            }
+            if (wake_detect_update(&wd, confidence[i], chunk_ms[i])) {
+                wake_detected(confidence[i]);
+            }
+        }
+        if (wake_deadline(us, n)) {
+            was_detecting = false;
         }
     }
 }
 
 void app_dsp_init(void)
 {
+    dd.params = default_params;
+    frontend_setup();
+    beamformer_setup();
+    history_setup();
+    endpoint_setup();
+    dd.pcm_store_limit = sizeof(dd.pcm_store);
     dd.temp_rb = rb_init("nn-recog", 4 * 1024);
     ui_led_init();
     ui_button_init();
 
-    i2s_stream_config_t i2s_cfg;
-    memset(&i2s_cfg, 0, sizeof(i2s_cfg));
-    i2s_cfg.i2s_num = 1;
-    audio_board_i2s_init_default(&i2s_cfg.i2s_config);
-    //i2s_cfg.media_hal_cfg = media_hal_init(&media_hal_conf);
-
-    dd.read_i2s_stream = i2s_reader_stream_create(&i2s_cfg);
-    if (dd.read_i2s_stream) {
-        ESP_LOGI(TAG, "Created I2S audio stream");
-    } else {
-        ESP_LOGE(TAG, "Failed creating I2S audio stream");
-    }
-    i2s_stream_set_stack_size(dd.read_i2s_stream, 5000);
-
-    audio_io_fn_arg_t stream_reader_fn = {
-        .func = dsp_write_cb,
-        .arg = NULL,
-    };
-    audio_event_fn_arg_t stream_event_fn = {
-        .func = reader_stream_event_handler,
-    };
-    if (audio_stream_init(&dd.read_i2s_stream->base, "i2s_reader", &stream_reader_fn, &stream_event_fn) != 0) {
-        ESP_LOGE(TAG, "Failed creating audio stream");
-        i2s_stream_destroy(dd.read_i2s_stream);
-        dd.read_i2s_stream = NULL;
+    if (capture_stream_create(audio_board_capture_profile_default()) != ESP_OK) {
+        return;
     }
 
-    if (esp_wwe_init() != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to init ESP-WWE");
+    dd.engine = WAKE_ENGINE;
+    if (dd.engine->init() != 0 || dd.engine->sample_rate() != DETECT_SAMP_RATE) {
+        ESP_LOGE(TAG, "Failed to init wake word engine %s", dd.engine->name);
         return;
     }
+    dd.engine_batch = CONFIG_APP_DSP_WAKE_ENGINE_BATCH;
+    if (dd.engine_batch > dd.engine->max_batch) {
+        dd.engine_batch = dd.engine->max_batch;
+    }
+    ESP_LOGI(TAG, "Wake word engine %s, %d chunk(s) per call", dd.engine->name, dd.engine_batch);
+    app_wake_arbiter_init();
+#ifdef CONFIG_APP_WAKE_ARBITER
+    if (app_wake_arbiter_running()) {
+        dd.claim_hold = mem_alloc(CLAIM_HOLD_SIZE, EXTERNAL);
+        if (!dd.claim_hold) {
+            /* Claims are then cut short when pcm_store fills */
+            ESP_LOGW(TAG, "No memory to hold audio over the arbitration window");
+        }
+    }
+#endif
+    app_cmd_spot_init();
 
     //Initialize sound source
-    dd.item_chunk_size = esp_wwe_get_sample_chunksize() * sizeof(int16_t);
-    dd.recog_queue = xQueueCreate(1, dd.item_chunk_size);
-    xTaskCreate(&nn_task, "nn", WWE_TASK_STACK, NULL, (CONFIG_ESP32_PTHREAD_TASK_PRIO_DEFAULT - 1), &dd.nn_task_handle);
-    xTaskCreate(&read_rb_task, "rb read task", WWE_TASK_STACK, NULL, (CONFIG_ESP32_PTHREAD_TASK_PRIO_DEFAULT - 1), NULL);
+    dd.item_chunk_size = dd.engine->chunk_samples() * sizeof(int16_t);
+    dd.wake_chunk = heap_caps_malloc(dd.item_chunk_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!dd.wake_chunk) {
+        ESP_LOGE(TAG, "No memory for the wake word chunk");
+        return;
+    }
+    dd.chunk_us = dd.engine->chunk_samples() * 1000000ULL / DETECT_SAMP_RATE;
+    dd.wake_stats.budget_us = dd.engine_batch * dd.chunk_us;
+    /* Room for a whole batch while the engine runs one, and for the lag
+     * allowed before wake_deadline() skips */
+    dd.stop_ack = xSemaphoreCreateBinary();
+    dd.recog_queue = xQueueCreate(dd.engine_batch + CONFIG_APP_DSP_WAKE_MAX_LAG_MS * 1000 / dd.chunk_us,
+                                  dd.item_chunk_size);
+    dd.nn_task_handle = app_task_create(APP_TASK_NN, &nn_task, NULL);
+    app_task_create(APP_TASK_RB_READ, &read_rb_task, NULL);
     
     audio_stream_start(&dd.read_i2s_stream->base);
     vTaskDelay(10/portTICK_RATE_MS);
     audio_stream_stop(&dd.read_i2s_stream->base);
     vTaskDelay(10/portTICK_RATE_MS);
     audio_stream_start(&dd.read_i2s_stream->base);
-    dd.detect_wakeword = true;
+    dd.monitor_restart = true;
+    capture_monitor_init();
 }
@@ -23,7 +23,11 @@
 #ifndef _APP_DSP_H_
 #define _APP_DSP_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
 #include <alexa_app_cb.h>
+#include <frontend.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,8 +37,200 @@ typedef enum dsp_called_states {
     ALEXA_CAN_START = (ALEXA_END_STATES + 1),
 } dsp_called_states_t;
 
+/** Tunable DSP parameters, see app_dsp_set_params() */
+typedef struct app_dsp_params {
+    uint32_t version;       /*!< opaque version of this parameter set, reported back once applied */
+    int wake_hits;          /*!< consecutive wake word engine hits needed for a detection */
+    int vad_threshold;      /*!< mean absolute sample level below which frames skip the wake word engine, 0 disables */
+    int preroll_ms;         /*!< audio buffered after the wake word before the recognize event */
+    int gain_q8;            /*!< capture gain, 256 is unity */
+} app_dsp_params_t;
+
+#define APP_DSP_WAKE_HITS_MAX       10
+#define APP_DSP_VAD_THRESHOLD_MAX   32767
+#define APP_DSP_GAIN_Q8_MAX         (16 * 256)
+
+/** Microphone capture health, see app_dsp_get_capture_stats() */
+typedef struct app_dsp_capture_stats {
+    int profile;                /*!< audio_board_capture_profile_t in use */
+    uint32_t dma_overruns;      /*!< times the I2S DMA ring wrapped before it was read */
+    uint32_t dma_lost_bytes;    /*!< estimated audio lost to DMA overruns */
+    uint32_t ring_overruns;     /*!< writes to the DSP ring buffer that didn't fit */
+    uint32_t ring_lost_bytes;   /*!< audio dropped because read_rb_task fell behind */
+    uint32_t regrows;           /*!< times the DMA ring was grown after overruns */
+} app_dsp_capture_stats_t;
+
+/** Uplink noise suppression cost, see app_dsp_get_ns_stats() */
+typedef struct app_dsp_ns_stats {
+    bool enabled;
+    uint32_t avg_cycles;        /*!< CPU cycles per 20 ms frame, running average */
+    uint32_t max_cycles;
+    uint32_t over_budget;       /*!< frames that went over the CPU budget */
+    int mean_gain_q15;          /*!< mean gain across bins in the last STFT frame */
+} app_dsp_ns_stats_t;
+
+/** Two microphone beamformer state, see app_dsp_get_beam_stats() */
+typedef struct app_dsp_beam_stats {
+    bool enabled;
+    bool steered;               /*!< steered by direction of arrival, else fixed broadside */
+    int delay_q8;               /*!< second mic's lag behind the first, 1/256 samples */
+    int max_delay_q8;           /*!< delay of a source in line with the mics */
+    uint32_t updates;           /*!< frames the steering was updated from */
+    uint32_t avg_cycles;        /*!< CPU cycles per DMA buffer, running average */
+    uint32_t max_cycles;
+} app_dsp_beam_stats_t;
+
+/** Local end of speech detection, see app_dsp_get_endpoint_stats() */
+typedef struct app_dsp_endpoint_stats {
+    bool enabled;
+    uint32_t utterances;        /*!< utterances the endpointer followed */
+    uint32_t local_ends;        /*!< ended by trailing silence before the cloud stopped capture */
+    uint32_t no_speech;         /*!< given up on for lack of speech */
+    uint32_t stops;             /*!< StopCaptures that came after a local end */
+    uint32_t stop_lag_ms;       /*!< total time from those local ends to StopCapture */
+    uint32_t responses;         /*!< locally ended utterances whose response started playing */
+    uint32_t response_ms;       /*!< total time from the end of speech to the response */
+    uint32_t max_response_ms;
+} app_dsp_endpoint_stats_t;
+
+/** Wake word engine real-time budget, see app_dsp_get_wake_stats() */
+typedef struct app_dsp_wake_stats {
+    uint32_t calls;             /*!< engine detect() calls */
+    uint32_t budget_us;         /*!< audio one call covers */
+    uint32_t avg_us;            /*!< time per call, running average */
+    uint32_t max_us;
+    uint32_t deadline_misses;   /*!< calls that took longer than the audio they covered */
+    uint32_t backlog_ms;        /*!< audio queued for the engine after the last call */
+    uint32_t max_backlog_ms;
+    uint32_t skips;             /*!< times the backlog was dropped to catch up */
+    uint32_t skipped_chunks;
+    uint32_t queue_drops;       /*!< chunks that found the engine's queue full */
+} app_dsp_wake_stats_t;
+
+/** Samples in one 20 ms frame of the capture history */
+#define APP_DSP_HISTORY_FRAME_SAMPLES   320
+
+/** Compressed capture history, see app_dsp_get_history_stats() */
+typedef struct app_dsp_history_stats {
+    bool enabled;
+    uint32_t first_frame;       /*!< oldest frame that can be read */
+    uint32_t next_frame;        /*!< frame the next 20 ms of capture goes to */
+    uint32_t wake_frame;        /*!< frame being captured at the last wake word, 0 if none */
+    uint32_t frames;            /*!< capacity in frames */
+    uint32_t bytes;             /*!< memory used, keyframes included */
+    uint32_t raw_bytes;         /*!< memory 16-bit PCM of the same length would need */
+    uint32_t avg_cycles;        /*!< encode cycles per frame, running average */
+    uint32_t max_cycles;
+} app_dsp_history_stats_t;
+
 void app_dsp_init(void);
 
+/**
+ * @brief  register the DSP console commands
+ */
+void app_dsp_register_cli();
+
+/**
+ * @brief  get the capture overrun counters
+ *
+ * DMA overruns are inferred from the capture byte rate falling behind the
+ * sample clock, so they are an estimate accurate to about one DMA buffer.
+ */
+void app_dsp_get_capture_stats(app_dsp_capture_stats_t *stats);
+
+void app_dsp_reset_capture_stats();
+
+/**
+ * @brief  get the front-end conditioning (AGC) state
+ */
+void app_dsp_get_frontend_stats(frontend_stats_t *stats);
+
+/**
+ * @brief  get the uplink noise suppression state
+ */
+void app_dsp_get_ns_stats(app_dsp_ns_stats_t *stats);
+
+/**
+ * @brief  get the two microphone beamformer state
+ */
+void app_dsp_get_beam_stats(app_dsp_beam_stats_t *stats);
+
+/**
+ * @brief  get the end of speech detection counters
+ */
+void app_dsp_get_endpoint_stats(app_dsp_endpoint_stats_t *stats);
+
+/**
+ * @brief  note that the speaker started on a new stream, i.e. a response
+ *
+ * Times the response from the end of speech of the last utterance that
+ * ended locally, see app_dsp_endpoint_stats_t.
+ */
+void app_dsp_response_started();
+
+/**
+ * @brief  whether a dialog is open, from the wake word until capture stops
+ */
+bool app_dsp_in_dialog();
+
+/**
+ * @brief  get the wake word engine deadline counters
+ *
+ * @param  reset    zero the counters after reading them
+ */
+void app_dsp_get_wake_stats(app_dsp_wake_stats_t *stats, bool reset);
+
+/**
+ * @brief  publish the wake word chunks skipped since the last report
+ *
+ * Reports go out at most once every minute. A skip reports at once if it
+ * can, and the sysmon timer calls this to flush skips held back by the
+ * limit.
+ */
+void app_dsp_report_wake_skips();
+
+/**
+ * @brief  get the capture history state
+ */
+void app_dsp_get_history_stats(app_dsp_history_stats_t *stats);
+
+/**
+ * @brief  decode one frame of the capture history
+ *
+ * The history holds the conditioned audio the wake word engine sees, before
+ * noise suppression. Frames are numbered from when capture started.
+ *
+ * @param  buf  APP_DSP_HISTORY_FRAME_SAMPLES samples
+ *
+ * @return ESP_ERR_NOT_FOUND if the frame isn't held (any more), or
+ *         ESP_ERR_INVALID_STATE if the history is disabled
+ */
+esp_err_t app_dsp_history_read(uint32_t frame, int16_t *buf);
+
+/**
+ * @brief  get the parameter set currently in use by the audio path
+ */
+void app_dsp_get_params(app_dsp_params_t *params);
+
+/**
+ * @brief  get the parameter set the audio path will use next
+ *
+ * This is the set last staged with app_dsp_set_params() while the audio path
+ * hasn't picked it up yet, otherwise the one in use. Partial updates must be
+ * merged onto this, not onto app_dsp_get_params(), or a second update staged
+ * before the first is applied would undo it.
+ */
+void app_dsp_get_staged_params(app_dsp_params_t *params);
+
+/**
+ * @brief  stage a new parameter set
+ *
+ * The whole set is validated and then picked up atomically by the audio
+ * path at the next frame boundary. Returns ESP_ERR_INVALID_ARG if any field
+ * is out of range, in which case nothing changes.
+ */
+esp_err_t app_dsp_set_params(const app_dsp_params_t *params);
+
 void app_dsp_send_recognize();
 
 void app_dsp_reset(void);
@@ -0,0 +1,735 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_log.h>
+#include <esp_console.h>
+#include <esp_timer.h>
+#include "app_dsp.h"
+#include "app_playback.h"
+#include "sysmon.h"
+#include "app_capture_tap.h"
+#include "app_wake_arbiter.h"
+#include "app_cmd_spot.h"
+#include "app_playback.h"
+#include "app_tasks.h"
+#ifdef CONFIG_AWS_IOT_SDK
+#include "app_aws_iot.h"
+#include "telemetry_store.h"
+#endif
+
+#define STRESS_PERIOD_MS        20
+#define STRESS_DEFAULT_LOAD     70
+#define STRESS_TASK_STACK       2048
+#define STRESS_TONE_HZ          440
+/* The tone goes through the resampler, like the cloud's audio */
+#define STRESS_PLAY_STACK       4096
+/* Frames of history shown before and after the last wake word */
+#define WAKE_FRAMES_BEFORE      50
+#define WAKE_FRAMES_AFTER       10
+/* Long enough for an earcon played from the CLI to have started */
+#define EARCON_WAIT_MS          100
+/* Between repeated earcons, longer than any cue so each starts on an idle speaker */
+#define EARCON_REPEAT_MS        1000
+#define SYSMON_DEFAULT_SAMPLES  10
+#define SYSMON_MAX_SAMPLES      64
+/* Scripted workload of "tasks profile" */
+#define TASKS_PROFILE_DEFAULT_S 30
+#define TASKS_PROFILE_EARCON_MS 1500
+#define TASKS_PROFILE_DIALOG_MS 10000
+
+static const char *TAG = "dsp_cli";
+
+static volatile bool stress_running;
+static int stress_load_pct;
+
+static void print_capture_stats(const app_dsp_capture_stats_t *stats)
+{
+    printf("profile: %d\n", stats->profile);
+    printf("dma overruns: %u (~%u bytes lost)\n", stats->dma_overruns, stats->dma_lost_bytes);
+    printf("ring overruns: %u (%u bytes lost)\n", stats->ring_overruns, stats->ring_lost_bytes);
+    printf("dma regrows: %u\n", stats->regrows);
+}
+
+static int capture_stats_cli_handler(int argc, char *argv[])
+{
+    app_dsp_capture_stats_t stats;
+
+    app_dsp_get_capture_stats(&stats);
+    print_capture_stats(&stats);
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        app_dsp_reset_capture_stats();
+    }
+    return 0;
+}
+
+static int frontend_cli_handler(int argc, char *argv[])
+{
+    frontend_stats_t stats;
+
+    app_dsp_get_frontend_stats(&stats);
+    printf("agc gain: %d/256 (%.1f dB)\n", stats.gain_q8,
+           stats.gain_q8 ? 20 * log10f(stats.gain_q8 / 256.0f) : -INFINITY);
+    printf("frame level: %d\n", stats.level);
+    printf("frames: %u, gated: %u\n", stats.frames, stats.gated_frames);
+    return 0;
+}
+
+static int ns_cli_handler(int argc, char *argv[])
+{
+    app_dsp_ns_stats_t stats;
+
+    app_dsp_get_ns_stats(&stats);
+    if (!stats.enabled) {
+        printf("Noise suppression is disabled\n");
+        return 0;
+    }
+    printf("cycles per 20 ms frame: avg %u, max %u\n", stats.avg_cycles, stats.max_cycles);
+    printf("frames over budget: %u\n", stats.over_budget);
+    printf("mean bin gain: %.1f dB\n", 20 * log10f(stats.mean_gain_q15 / 32768.0f + 1e-6f));
+    return 0;
+}
+
+static int beam_cli_handler(int argc, char *argv[])
+{
+    app_dsp_beam_stats_t stats;
+
+    app_dsp_get_beam_stats(&stats);
+    if (!stats.enabled) {
+        printf("Beamformer is disabled\n");
+        return 0;
+    }
+    printf("mode: %s\n", stats.steered ? "steered" : "broadside");
+    if (stats.steered) {
+        /* Positive angles are towards the first (right channel) mic */
+        float s = (float) stats.delay_q8 / stats.max_delay_q8;
+        printf("delay: %.2f samples (%.0f deg), %u updates\n", stats.delay_q8 / 256.0f,
+               asinf(fmaxf(-1, fminf(1, s))) * 180 / M_PI, stats.updates);
+    }
+    printf("cycles per DMA buffer: avg %u, max %u\n", stats.avg_cycles, stats.max_cycles);
+    return 0;
+}
+
+static int nn_cli_handler(int argc, char *argv[])
+{
+    app_dsp_wake_stats_t stats;
+
+    app_dsp_get_wake_stats(&stats, argc > 1 && strcmp(argv[1], "reset") == 0);
+    printf("detect calls: %u, avg %u us, max %u us, budget %u us (%u%% load)\n", stats.calls, stats.avg_us,
+           stats.max_us, stats.budget_us, stats.budget_us ? stats.avg_us * 100 / stats.budget_us : 0);
+    printf("deadline misses: %u\n", stats.deadline_misses);
+    printf("backlog: %u ms, max %u ms\n", stats.backlog_ms, stats.max_backlog_ms);
+    printf("skips: %u (%u chunks), queue drops: %u\n", stats.skips, stats.skipped_chunks, stats.queue_drops);
+    return 0;
+}
+
+static int arbiter_cli_handler(int argc, char *argv[])
+{
+    app_wake_arbiter_stats_t stats;
+    uint32_t decided;
+
+    app_wake_arbiter_get_stats(&stats);
+    if (!stats.enabled) {
+        printf("Wake word arbitration is disabled\n");
+        return 0;
+    }
+    printf("peers: %d, messages received: %u, send errors: %u\n", stats.arb.peers, stats.rx, stats.tx_errors);
+    printf("claims: %u, won: %u (%u alone), lost: %u, suppressed: %u, forced: %u\n", stats.arb.claims,
+           stats.arb.wins, stats.arb.solo_wins, stats.arb.losses, stats.arb.suppressed, stats.arb.forced);
+    decided = stats.arb.claims;
+    if (decided) {
+        printf("added trigger latency: avg %u ms, max %u ms\n", stats.arb.decide_ms_total / decided,
+               stats.arb.max_decide_ms);
+    }
+    return 0;
+}
+
+static int endpoint_cli_handler(int argc, char *argv[])
+{
+    app_dsp_endpoint_stats_t stats;
+
+    app_dsp_get_endpoint_stats(&stats);
+    if (!stats.enabled) {
+        printf("Local end of speech detection is disabled\n");
+        return 0;
+    }
+    printf("utterances: %u, ended locally: %u, no speech: %u\n", stats.utterances, stats.local_ends, stats.no_speech);
+    if (stats.stops) {
+        printf("local end to the cloud's stop: %u ms on average\n", stats.stop_lag_ms / stats.stops);
+    }
+    if (stats.responses) {
+        printf("end of speech to response: %u ms on average, %u ms at most, over %u responses\n",
+               stats.response_ms / stats.responses, stats.max_response_ms, stats.responses);
+    }
+    return 0;
+}
+
+static int playback_cli_handler(int argc, char *argv[])
+{
+    app_playback_stats_t stats;
+
+    app_playback_get_stats(&stats, argc > 1 && strcmp(argv[1], "reset") == 0);
+    if (!stats.enabled) {
+        printf("Playback jitter buffer is disabled\n");
+        return 0;
+    }
+    printf("streams: %u, underruns: %u, concealed: %u ms\n", stats.jb.streams, stats.jb.underruns, stats.jb.concealed_ms);
+    printf("depth: %u ms, mean while playing %u ms, peak %u ms\n", stats.jb.depth_ms, stats.jb.avg_depth_ms,
+           stats.jb.max_depth_ms);
+    printf("speaker dma underflows: %u, late writes: %u\n", stats.underflows, stats.late_writes);
+    return 0;
+}
+
+static int earcon_cli_handler(int argc, char *argv[])
+{
+    app_playback_stats_t stats;
+    uint32_t min_us = UINT32_MAX, max_us = 0;
+    uint64_t sum_us = 0;
+    int id, count = 1, n = 0;
+
+    if (argc > 1) {
+        for (id = 0; id < EARCON_MAX; id++) {
+            if (strcmp(argv[1], earcon_name(id)) == 0) {
+                break;
+            }
+        }
+        if (id == EARCON_MAX || !earcon_get(id)) {
+            printf("No earcon '%s' in the partition\n", argv[1]);
+            return 1;
+        }
+        if (argc > 2) {
+            count = atoi(argv[2]);
+            if (count < 1) {
+                printf("Invalid count\n");
+                return 1;
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            uint32_t played;
+
+            app_playback_get_stats(&stats, false);
+            played = stats.earcons;
+            app_playback_earcon(id);
+            vTaskDelay((count > 1 ? EARCON_REPEAT_MS : EARCON_WAIT_MS) / portTICK_RATE_MS);
+            app_playback_get_stats(&stats, false);
+            if (stats.earcons == played) {
+                continue;
+            }
+            if (stats.earcon_latency_us < min_us) {
+                min_us = stats.earcon_latency_us;
+            }
+            if (stats.earcon_latency_us > max_us) {
+                max_us = stats.earcon_latency_us;
+            }
+            sum_us += stats.earcon_latency_us;
+            n++;
+        }
+    }
+    app_playback_get_stats(&stats, false);
+    printf("earcons played: %u\n", stats.earcons);
+    if (n > 1) {
+        /* The block is heard once the DMA buffers queued ahead of it have played */
+        printf("trigger to queued over %d of %d: min %u us, avg %u us, max %u us\n", n, count, min_us,
+               (uint32_t) (sum_us / n), max_us);
+        printf("trigger to sound: at most %u us\n", max_us + stats.dma_latency_us);
+    } else if (stats.earcons) {
+        printf("trigger to sound: %u us queued, %u us at most, worst queued %u us\n", stats.earcon_latency_us,
+               stats.earcon_latency_us + stats.dma_latency_us, stats.earcon_max_latency_us);
+    }
+    return 0;
+}
+
+static const char *tap_stream_names[CAPTURE_TAP_STREAMS] = {
+    [CAPTURE_TAP_RAW] = "raw",
+    [CAPTURE_TAP_PROCESSED] = "processed",
+};
+
+/* Enrolling waits for the user to say the wake word and the command */
+#define CMD_ENROLL_TIMEOUT_MS 15000
+
+static int cmd_cli_handler(int argc, char *argv[])
+{
+    app_cmd_spot_stats_t stats;
+    app_cmd_t cmd = APP_CMD_MAX;
+    esp_err_t err = ESP_OK;
+
+    if (argc > 2) {
+        for (cmd = 0; cmd < APP_CMD_MAX && strcmp(argv[2], app_cmd_name(cmd)) != 0; cmd++) {
+        }
+    }
+    if (argc > 1 && strcmp(argv[1], "enroll") == 0) {
+        if (cmd == APP_CMD_MAX) {
+            printf("usage: %s enroll <command>, one of:", argv[0]);
+            for (cmd = 0; cmd < APP_CMD_MAX; cmd++) {
+                printf(" %s", app_cmd_name(cmd));
+            }
+            printf("\n");
+            return -1;
+        }
+        printf("Say the wake word, then \"%s\"\n", app_cmd_name(cmd));
+        err = app_cmd_spot_enroll(cmd, CMD_ENROLL_TIMEOUT_MS);
+    } else if (argc > 1 && strcmp(argv[1], "forget") == 0) {
+        err = app_cmd_spot_forget(cmd);
+    }
+    if (err != ESP_OK) {
+        printf("Failed: %s\n", err == ESP_ERR_NOT_FOUND ? "no speech heard" : esp_err_to_name(err));
+        return -1;
+    }
+
+    app_cmd_spot_get_stats(&stats);
+    if (!stats.enabled) {
+        printf("Command spotting is disabled\n");
+        return 0;
+    }
+    printf("%d templates, %u utterances, volume %d%s\n", stats.templates, stats.utterances,
+           app_playback_get_volume(), app_playback_get_mute() ? " (muted)" : "");
+    for (cmd = 0; cmd < APP_CMD_MAX; cmd++) {
+        printf("%s: %u  ", app_cmd_name(cmd), stats.local[cmd]);
+    }
+    printf("\nto the cloud: %u not matched, %u not a command, %u out of room\n", stats.no_match,
+           stats.no_command, stats.hold_full);
+    printf("per frame: avg %u us, max %u us; matching: avg %u us, max %u us\n", stats.frame_avg_us,
+           stats.frame_max_us, stats.match_avg_us, stats.match_max_us);
+    printf("decided after: local avg %u ms, max %u ms; cloud avg %u ms, max %u ms\n", stats.local_avg_ms,
+           stats.local_max_ms, stats.cloud_avg_ms, stats.cloud_max_ms);
+    if (stats.last.hops && stats.last.label >= 0) {
+        printf("last: %d ms, closest %s at %d.%d dB", stats.last.hops * CMD_SPOT_HOP_MS,
+               app_cmd_name(stats.last.label), stats.last.distance / 10, stats.last.distance % 10);
+        if (stats.last.runner_up != INT32_MAX) {
+            printf(", next %d.%d dB", stats.last.runner_up / 10, stats.last.runner_up % 10);
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+static int tap_cli_handler(int argc, char *argv[])
+{
+    app_capture_tap_stats_t stats;
+    uint32_t streams = 0;
+    esp_err_t err;
+
+    if (argc > 1 && strcmp(argv[1], "stop") == 0) {
+        app_capture_tap_stop();
+    } else if (argc > 1 && strcmp(argv[1], "start") == 0) {
+        if (argc < 4) {
+            printf("usage: %s start <host> <port> [raw|processed]...\n", argv[0]);
+            return -1;
+        }
+        for (int i = 4; i < argc; i++) {
+            for (int s = 0; s < CAPTURE_TAP_STREAMS; s++) {
+                if (strcmp(argv[i], tap_stream_names[s]) == 0) {
+                    streams |= 1 << s;
+                }
+            }
+        }
+        if (argc == 4) {
+            streams = (1 << CAPTURE_TAP_STREAMS) - 1;
+        }
+        err = app_capture_tap_start(argv[2], atoi(argv[3]), streams);
+        if (err != ESP_OK) {
+            printf("Failed to start the tap: %s\n", esp_err_to_name(err));
+            return -1;
+        }
+    }
+
+    app_capture_tap_get_stats(&stats);
+    if (!stats.enabled) {
+        printf("Capture tap is not built in\n");
+        return 0;
+    }
+    printf("%s, %s, %u connections\n", stats.running ? "running" : "stopped",
+           stats.connected ? "connected" : "not connected", stats.connects);
+    printf("sent: %u frames, %u KB\n", stats.sent_frames, stats.sent_kb);
+    for (int s = 0; s < CAPTURE_TAP_STREAMS; s++) {
+        printf("%s%s: %u queued, %u dropped (%u bytes), buffer peak %u bytes\n", tap_stream_names[s],
+               stats.streams[s] ? "" : " (off)", stats.tap[s].frames, stats.tap[s].dropped,
+               stats.tap[s].dropped_bytes, stats.tap[s].max_used);
+    }
+    return 0;
+}
+
+static int sysmon_cli_handler(int argc, char *argv[])
+{
+    sysmon_stats_t stats;
+    sysmon_sample_t *samples;
+    sysmon_task_t *tasks;
+    int n = SYSMON_DEFAULT_SAMPLES;
+
+    if (argc > 1) {
+        n = atoi(argv[1]);
+        if (n <= 0 || n > SYSMON_MAX_SAMPLES) {
+            printf("Between 1 and %d samples\n", SYSMON_MAX_SAMPLES);
+            return -1;
+        }
+    }
+    sysmon_sample_now();
+    sysmon_get_stats(&stats);
+    if (!stats.samples) {
+        printf("Heap and stack sampling is not running\n");
+        return 0;
+    }
+    samples = malloc(n * sizeof(sysmon_sample_t));
+    tasks = malloc((stats.tasks ? stats.tasks : 1) * sizeof(sysmon_task_t));
+    if (!samples || !tasks) {
+        free(samples);
+        free(tasks);
+        return -1;
+    }
+
+    n = sysmon_get_samples(samples, n);
+    printf("%8s %8s %8s %8s %8s %8s %8s %6s\n", "uptime", "int free", "int min", "int blk",
+           "ps free", "ps min", "ps blk", "stack");
+    for (int i = 0; i < n; i++) {
+        const sysmon_sample_t *s = &samples[i];
+        printf("%8u %8u %8u %8u %8u %8u %8u ", s->uptime_s, s->internal.free, s->internal.min_free,
+               s->internal.largest, s->psram.free, s->psram.min_free, s->psram.largest);
+        if (s->tasks) {
+            printf("%6u %s\n", s->stack_min, s->stack_min_task);
+        } else {
+            printf("%6s\n", "-");
+        }
+    }
+
+    n = sysmon_get_tasks(tasks, stats.tasks);
+    printf("stack never used:\n");
+    for (int i = 0; i < n; i++) {
+        printf("  %-16s %6u\n", tasks[i].name, tasks[i].stack_free);
+    }
+    if (stats.failed || stats.skipped) {
+        printf("  (%u samples without the tasks, %u skipped)\n", stats.failed, stats.skipped);
+    }
+    printf("%u samples every %u s, last %u kept\n", stats.samples, stats.period_s, stats.ring_len);
+    printf("sample cost: %u us, max %u us\n", stats.sample_us, stats.max_sample_us);
+    free(samples);
+    free(tasks);
+    return 0;
+}
+
+/* Level of each 20 ms frame around the last wake word, decoded from the
+ * history */
+static void print_wake_levels(const app_dsp_history_stats_t *stats)
+{
+    int16_t *buf = malloc(APP_DSP_HISTORY_FRAME_SAMPLES * sizeof(int16_t));
+    uint32_t frame = stats->wake_frame - WAKE_FRAMES_BEFORE;
+
+    if (!buf) {
+        return;
+    }
+    if (stats->wake_frame < WAKE_FRAMES_BEFORE || frame < stats->first_frame) {
+        frame = stats->first_frame;
+    }
+    for (; frame < stats->wake_frame + WAKE_FRAMES_AFTER; frame++) {
+        if (app_dsp_history_read(frame, buf) != ESP_OK) {
+            break;
+        }
+        uint32_t sum = 0;
+        for (int i = 0; i < APP_DSP_HISTORY_FRAME_SAMPLES; i++) {
+            sum += abs(buf[i]);
+        }
+        printf("%c%u: %5u\n", frame == stats->wake_frame ? '*' : ' ', frame, sum / APP_DSP_HISTORY_FRAME_SAMPLES);
+    }
+    free(buf);
+}
+
+static int history_cli_handler(int argc, char *argv[])
+{
+    app_dsp_history_stats_t stats;
+
+    app_dsp_get_history_stats(&stats);
+    if (!stats.enabled) {
+        printf("Capture history is disabled\n");
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "wake") == 0) {
+        if (!stats.wake_frame) {
+            printf("No wake word yet\n");
+        } else {
+            print_wake_levels(&stats);
+        }
+        return 0;
+    }
+    printf("frames: %u-%u of %u (%u s)\n", stats.first_frame, stats.next_frame, stats.frames,
+           stats.frames * APP_DSP_HISTORY_FRAME_SAMPLES / 16000);
+    printf("memory: %u bytes, %u saved against raw PCM\n", stats.bytes, stats.raw_bytes - stats.bytes);
+    printf("encode cycles per frame: avg %u, max %u\n", stats.avg_cycles, stats.max_cycles);
+    if (stats.wake_frame) {
+        printf("last wake word: frame %u\n", stats.wake_frame);
+    }
+    return 0;
+}
+
+/* Stands in for decoding/playback: busy for stress_load_pct of every period,
+ * at a priority above the capture path */
+static void stress_cpu_task(void *arg)
+{
+    while (stress_running) {
+        int64_t end = esp_timer_get_time() + (STRESS_PERIOD_MS * 10 * stress_load_pct);
+        while (esp_timer_get_time() < end) {
+        }
+        vTaskDelay(((STRESS_PERIOD_MS * (100 - stress_load_pct)) / 100) / portTICK_RATE_MS + 1);
+    }
+    vTaskDelete(NULL);
+}
+
+/* The speaker path, with a tone standing in for the cloud's audio */
+static void stress_playback_task(void *arg)
+{
+    while (stress_running) {
+        app_playback_tone(STRESS_TONE_HZ, STRESS_PERIOD_MS * 10);
+    }
+    vTaskDelete(NULL);
+}
+
+#ifdef CONFIG_AWS_IOT_SDK
+/* MQTT/TLS traffic, one publish per period. What the queue can't take is
+ * dropped, not logged to flash. */
+static void stress_mqtt_task(void *arg)
+{
+    int32_t n = 0;
+
+    while (stress_running) {
+        aws_iot_post_event(AWS_IOT_EVT_BENCH, n++);
+        vTaskDelay(STRESS_PERIOD_MS / portTICK_RATE_MS);
+    }
+    vTaskDelete(NULL);
+}
+#endif
+
+static void stress_start()
+{
+    stress_running = true;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        xTaskCreatePinnedToCore(&stress_cpu_task, "stress_cpu", STRESS_TASK_STACK, NULL,
+                                CONFIG_ESP32_PTHREAD_TASK_PRIO_DEFAULT, NULL, core);
+    }
+    xTaskCreate(&stress_playback_task, "stress_play", STRESS_PLAY_STACK, NULL, 5, NULL);
+#ifdef CONFIG_AWS_IOT_SDK
+    xTaskCreate(&stress_mqtt_task, "stress_mqtt", STRESS_TASK_STACK, NULL, 5, NULL);
+#endif
+}
+
+static int capture_stress_cli_handler(int argc, char *argv[])
+{
+    app_dsp_capture_stats_t before, after;
+    app_playback_stats_t play_before, play_after;
+#ifdef CONFIG_AWS_IOT_SDK
+    telemetry_store_stats_t log_before, log_after;
+#endif
+    int seconds;
+
+    if (argc < 2) {
+        printf("usage: %s <seconds> [cpu load %%]\n", argv[0]);
+        return -1;
+    }
+    if (stress_running) {
+        printf("Stress test already running\n");
+        return -1;
+    }
+    seconds = atoi(argv[1]);
+    stress_load_pct = (argc > 2) ? atoi(argv[2]) : STRESS_DEFAULT_LOAD;
+    if (seconds <= 0 || stress_load_pct < 0 || stress_load_pct > 95) {
+        printf("Invalid arguments\n");
+        return -1;
+    }
+
+    app_dsp_get_capture_stats(&before);
+    app_playback_get_stats(&play_before, false);
+#ifdef CONFIG_AWS_IOT_SDK
+    telemetry_store_get_stats(&log_before);
+#endif
+    stress_start();
+    ESP_LOGI(TAG, "Stressing capture for %d s at %d%% CPU load", seconds, stress_load_pct);
+    vTaskDelay((seconds * 1000) / portTICK_RATE_MS);
+    stress_running = false;
+    app_dsp_get_capture_stats(&after);
+    app_playback_get_stats(&play_after, false);
+
+    after.dma_overruns -= before.dma_overruns;
+    after.dma_lost_bytes -= before.dma_lost_bytes;
+    after.ring_overruns -= before.ring_overruns;
+    after.ring_lost_bytes -= before.ring_lost_bytes;
+    after.regrows -= before.regrows;
+    printf("Capture during stress test (started on profile %d):\n", before.profile);
+    print_capture_stats(&after);
+    printf("speaker dma underflows: %u, late writes: %u\n", play_after.underflows - play_before.underflows,
+           play_after.late_writes - play_before.late_writes);
+#ifdef CONFIG_AWS_IOT_SDK
+    telemetry_store_get_stats(&log_after);
+    printf("telemetry log: %u writes, %u erases, %u erases held back until quiet\n",
+           log_after.writes - log_before.writes, log_after.erases - log_before.erases,
+           log_after.deferred - log_before.deferred);
+#endif
+    return 0;
+}
+
+/* Takes the tasks down their deep paths: every earcon, a dialog with the
+ * cloud and local command spotting, then the capture path, speaker and MQTT
+ * under load. A running tap is included. */
+static void tasks_profile(int seconds)
+{
+    for (int id = 0; id < EARCON_MAX; id++) {
+        if (earcon_get(id)) {
+            printf("Playing earcon %s\n", earcon_name(id));
+            app_playback_earcon(id);
+            vTaskDelay(TASKS_PROFILE_EARCON_MS / portTICK_RATE_MS);
+        }
+    }
+    printf("Starting a dialog, ask Alexa something\n");
+    app_dsp_send_recognize();
+    vTaskDelay(TASKS_PROFILE_DIALOG_MS / portTICK_RATE_MS);
+    printf("Loading the CPU, speaker and MQTT for %d s\n", seconds);
+    stress_load_pct = STRESS_DEFAULT_LOAD;
+    stress_start();
+    vTaskDelay((seconds * 1000) / portTICK_RATE_MS);
+    stress_running = false;
+}
+
+static int tasks_cli_handler(int argc, char *argv[])
+{
+    app_task_stats_t stats[APP_TASK_MAX];
+    uint32_t internal = 0, internal_rec = 0;
+    int seconds = TASKS_PROFILE_DEFAULT_S;
+    bool measured = true;
+
+    if (argc > 1) {
+        if (strcmp(argv[1], "profile") != 0 || (argc > 2 && (seconds = atoi(argv[2])) <= 0)) {
+            printf("usage: %s [profile [seconds]]\n", argv[0]);
+            return -1;
+        }
+        if (stress_running) {
+            printf("Stress test already running\n");
+            return -1;
+        }
+        tasks_profile(seconds);
+    }
+    sysmon_sample_now();
+    app_task_get_stats(stats);
+    printf("%-16s %-8s %6s %6s %6s\n", "task", "stack in", "size", "used", "advise");
+    for (int id = 0; id < APP_TASK_MAX; id++) {
+        const app_task_stats_t *s = &stats[id];
+        if (!s->enabled) {
+            continue;
+        }
+        if (!s->running) {
+            printf("%-16s %-8s %6u %6s %6s\n", s->name, s->mem == APP_TASK_PSRAM ? "psram" : "internal",
+                   s->stack, "-", "-");
+        } else {
+            printf("%-16s %-8s %6u %6u %6u\n", s->name, s->mem == APP_TASK_PSRAM ? "psram" : "internal",
+                   s->stack, s->used, s->recommended);
+        }
+        if (s->mem == APP_TASK_INTERNAL) {
+            internal += s->stack;
+            internal_rec += s->running ? s->recommended : s->stack;
+            measured = measured && s->running;
+        }
+    }
+    printf("internal stacks: %u bytes, %u advised", internal, internal_rec);
+    if (internal_rec < internal) {
+        printf(", %u to recover", internal - internal_rec);
+    }
+    printf("%s\n", measured ? "" : " (tasks not running counted as is)");
+#ifndef CONFIG_APP_TASK_PROFILE
+    printf("Use is capped by the current sizes, build with CONFIG_APP_TASK_PROFILE to measure\n");
+#endif
+    return 0;
+}
+
+static esp_console_cmd_t dsp_cmds[] = {
+    {
+        .command = "capture-stats",
+        .help = "Show microphone capture overrun counters. Usage: capture-stats [reset]",
+        .func = capture_stats_cli_handler,
+    }, {
+        .command = "frontend",
+        .help = "Show the microphone front-end AGC state",
+        .func = frontend_cli_handler,
+    }, {
+        .command = "ns",
+        .help = "Show the uplink noise suppression CPU cost and attenuation",
+        .func = ns_cli_handler,
+    }, {
+        .command = "beam",
+        .help = "Show the two microphone beamformer steering and CPU cost",
+        .func = beam_cli_handler,
+    }, {
+        .command = "nn",
+        .help = "Show wake word engine deadline misses, backlog and skipped chunks. Usage: nn [reset]",
+        .func = nn_cli_handler,
+    }, {
+        .command = "arbiter",
+        .help = "Show wake word arbitration with other devices on the LAN",
+        .func = arbiter_cli_handler,
+    }, {
+        .command = "cmd",
+        .help = "Show local command spotting, or teach it commands. Usage: cmd [enroll <command>|forget [<command>]]",
+        .func = cmd_cli_handler,
+    }, {
+        .command = "endpoint",
+        .help = "Show local end of speech detection counters",
+        .func = endpoint_cli_handler,
+    }, {
+        .command = "playback",
+        .help = "Show the speaker jitter buffer underruns and depth. Usage: playback [reset]",
+        .func = playback_cli_handler,
+    }, {
+        .command = "earcon",
+        .help = "Play an earcon and show the trigger to sound latency. Usage: earcon [wake|end|error] [count]",
+        .func = earcon_cli_handler,
+    }, {
+        .command = "sysmon",
+        .help = "Sample the heaps and task stacks now and show the recent samples. Usage: sysmon [samples]",
+        .func = sysmon_cli_handler,
+    }, {
+        .command = "tap",
+        .help = "Stream capture audio to tools/capture_tap_recv.py. Usage: tap [start <host> <port> [raw|processed]...|stop]",
+        .func = tap_cli_handler,
+    }, {
+        .command = "history",
+        .help = "Show the compressed capture history, or frame levels around the last wake word. Usage: history [wake]",
+        .func = history_cli_handler,
+    }, {
+        .command = "capture-stress",
+        .help = "Load the CPU, speaker and MQTT while capturing and report overruns. Usage: capture-stress <seconds> [cpu load %]",
+        .func = capture_stress_cli_handler,
+    }, {
+        .command = "tasks",
+        .help = "Show app task stack use and advised sizes, after a scripted workload with profile. Usage: tasks [profile [seconds]]",
+        .func = tasks_cli_handler,
+    },
+};
+
+void app_dsp_register_cli()
+{
+    int cmds_num = sizeof(dsp_cmds) / sizeof(esp_console_cmd_t);
+    int i;
+    for (i = 0; i < cmds_num; i++) {
+        ESP_LOGI(TAG, "Registering command: %s", dsp_cmds[i].command);
+        esp_console_cmd_register(&dsp_cmds[i]);
+    }
+}
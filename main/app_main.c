@@ -30,10 +30,12 @@
 #include <diag_cli.h>
 #include <alexa.h>
 #include "app_dsp.h"
+#include "app_playback.h"
+#include "sysmon.h"
 #include "ui_led.h"
 
 #ifdef CONFIG_AWS_IOT_SDK
-extern void aws_iot_init();
+#include "app_aws_iot.h"
 #endif
 
 #define SOFTAP_SSID_PREFIX  "ESP-Alexa-"
@@ -49,6 +51,7 @@ const int CONNECTED_BIT = BIT0;
 const int PROV_DONE_BIT = BIT1;
 
 static esp_timer_handle_t timer;
+static bool sta_connected;
 
 static void _stop_softap_cb(void *arg)
 {
@@ -81,6 +84,7 @@ static int app_cm_cb(conn_mgr_event_t event, void *data)
             esp_timer_start_once(timer, 15000 * 1000U);
         }
         xEventGroupSetBits(cm_event_group, CONNECTED_BIT);
+        sta_connected = true;
         break;
     }
     case CM_EVT_STA_GOT_IPV6:
@@ -88,6 +92,11 @@ static int app_cm_cb(conn_mgr_event_t event, void *data)
         break;
     case CM_EVT_STA_DISCONNECTED:
         ESP_LOGI(TAG, "got station disconnected event\n");
+        /* Once per lost connection, not for every failed retry */
+        if (sta_connected) {
+            app_playback_earcon(EARCON_ERROR);
+            sta_connected = false;
+        }
         break;
     case CM_EVT_SOFTAP_NW_CRED_RCVD:
         ESP_LOGI(TAG, "got station network credential recieved event");
@@ -115,8 +124,6 @@ static int app_cm_cb(conn_mgr_event_t event, void *data)
     return 0;
 }
 
-extern int i2s_playback_init();
-
 int app_main()
 {
     ESP_LOGI(TAG, "==== Alexa SDK version: %s ====", alexa_get_sdk_version());
@@ -139,6 +146,8 @@ int app_main()
 
     scli_init();
     diag_register_cli();
+    app_dsp_register_cli();
+    sysmon_init();
     ui_led_init();
 
     cm_event_group = xEventGroupCreate();
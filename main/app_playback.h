@@ -0,0 +1,100 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _APP_PLAYBACK_H_
+#define _APP_PLAYBACK_H_
+
+#include <stdbool.h>
+#include <jitter_buffer.h>
+#include "earcon.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Speaker jitter buffer health, see app_playback_get_stats() */
+typedef struct app_playback_stats {
+    bool enabled;
+    jitter_buffer_stats_t jb;
+    uint32_t earcons;               /*!< earcons played */
+    uint32_t earcon_latency_us;     /*!< trigger to first block queued for the DMA, last earcon */
+    uint32_t earcon_max_latency_us;
+    uint32_t dma_latency_us;        /*!< most a queued block waits in the DMA before it is heard */
+    uint32_t underflows;            /*!< writes that came after the speaker DMA ran dry */
+    uint32_t late_writes;           /*!< writes that came with less than a DMA buffer left */
+} app_playback_stats_t;
+
+/**
+ * @brief  set up the speaker I2S port and the playback buffer
+ */
+int i2s_playback_init();
+
+/**
+ * @brief  get the playback buffer counters
+ *
+ * @param  reset    restart the mean and peak depth
+ */
+void app_playback_get_stats(app_playback_stats_t *stats, bool reset);
+
+/**
+ * @brief  play a tone through the same path as the cloud's audio
+ *
+ * For load tests. Blocks the way the SDK's playback callback does, so once
+ * the playback buffer is full it returns about ms later.
+ */
+void app_playback_tone(int hz, int ms);
+
+/**
+ * @brief  play a cue from the earcon partition over whatever is playing
+ *
+ * Returns at once; does nothing if the cue isn't in the partition.
+ */
+void app_playback_earcon(earcon_id_t id);
+
+/**
+ * @brief  set the speaker volume, 0 to 100 as in AVS; unmutes
+ */
+void app_playback_set_volume(int volume);
+
+int app_playback_get_volume();
+
+void app_playback_set_mute(bool mute);
+
+bool app_playback_get_mute();
+
+/**
+ * @brief  whether a stream or an earcon is playing or about to
+ */
+bool app_playback_busy();
+
+/**
+ * @brief  silence the stream that is playing, until the next one starts
+ *
+ * A stream ends with a gap in the writes, as for the playback buffer.
+ */
+void app_playback_stop();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _APP_PLAYBACK_H_ */
@@ -21,45 +21,185 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
 #include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
 #include <alexa_app_cb.h>
 #include <resampling.h>
 #include <audio_board.h>
+#include <audio_board_capture.h>
+#include <jitter_buffer.h>
+#include <gain_ramp.h>
+#include <pcm_convert.h>
+#include "app_playback.h"
+#include "app_dsp.h"
+#include "app_tasks.h"
+#include "earcon.h"
 #include "ui_led.h"
 
 #define I2S_PORT_NUM I2S_NUM_0
-#define DES_BITS_PER_SAM 16
-#define SRC_BITS_PER_SAM 16
 /* The standard sampling rate we will setup for the hardware */
 #define SAMPLING_RATE    48000
 #define CONVERT_BUF_SIZE 1024
 #define BUF_SZ (CONVERT_BUF_SIZE * 2)
+#define PLAYBACK_CHANNELS 2
+#define PLAYBACK_FADE_MS 5
+/* Longer gaps between writes are taken as the end of a stream */
+#define PLAYBACK_IDLE_MS 500
+/* Ducking ramps down quickly so the user is heard, and back up gently */
+#define PLAYBACK_DUCK_MS 100
+#define PLAYBACK_RESTORE_MS 500
+#define PLAYBACK_VOLUME_MS 100
+#define PLAYBACK_STOP_MS 20
 
 static const char *TAG = "SIMPLE_ALEXA_CB";
 
 static int16_t convert_buf[BUF_SZ];
+/* Mono streams copied to both channels for the jitter buffer */
+static int16_t stereo_buf[BUF_SZ];
 
-static inline int heap_caps_get_free_size_sram()
+/* Speaker output, written one I2S DMA buffer at a time */
+static struct {
+    pcm_out_format_t format;
+    int frame_bytes;
+    int block_frames;           /* frames per DMA buffer */
+    int queued_frames;          /* frames the DMA can hold ahead of the one playing */
+    void *block;                /* converted frames for one DMA buffer */
+    int stream_channels;        /* channels stream_out was picked for */
+    pcm_out_fn_t stream_out;    /* writer kernel, for the speaker or the jitter buffer */
+    gain_ramp_t duck;
+    int32_t duck_gain;          /* Q15 gain while ducked */
+    /* Local volume, after the duck; cues keep their level */
+    gain_ramp_t volume;
+    int volume_pct;
+    bool muted;
+    volatile bool stopped;      /* the stream playing was stopped, drop it */
+    int64_t last_write_us;
+    /* Audio held by the DMA when the last write returned, 0 if idle */
+    int64_t dma_write_us;
+    int64_t dma_fill_us;
+    uint32_t underflows;
+    uint32_t late_writes;
+} out;
+
+static struct {
+    bool enabled;
+    jitter_buffer_t jb;
+    SemaphoreHandle_t data;     /* given by the writer after each write */
+    SemaphoreHandle_t space;    /* given by the playback task after each period */
+    int16_t *period;            /* one DMA buffer of 16-bit frames */
+    pcm_out_fn_t period_out;    /* NULL if the speaker takes 16-bit frames as they are */
+} pb;
+
+/* Earcon played by the playback task, from the flash mapping */
+static struct {
+    volatile int pending;       /* earcon_id_t + 1, 0 for none */
+    int64_t trigger_us;
+    const earcon_t *cur;
+    uint32_t pos;
+    uint32_t plays;
+    uint32_t latency_us;        /* trigger to first block queued, last play */
+    uint32_t max_latency_us;
+} cue;
+
+/* Q15 step per output block for a full scale ramp over ms */
+static int32_t ramp_step(int ms)
+{
+    return (int64_t) GAIN_RAMP_UNITY * out.block_frames * 1000 / ((int64_t) SAMPLING_RATE * ms);
+}
+
+/* Lower whatever is playing while the user talks and Alexa thinks. The
+ * response is spoken at full level. */
+static void playback_duck(bool duck)
+{
+    if (!out.block) {
+        return;
+    }
+    if (duck) {
+        gain_ramp_set(&out.duck, out.duck_gain, ramp_step(PLAYBACK_DUCK_MS));
+    } else {
+        gain_ramp_set(&out.duck, GAIN_RAMP_UNITY, ramp_step(PLAYBACK_RESTORE_MS));
+    }
+}
+
+/* Q15 gain for the volume, 0.5 dB a step as on the AVS 0 to 100 scale */
+static int32_t volume_gain()
+{
+    if (out.muted || out.stopped || out.volume_pct == 0) {
+        return 0;
+    }
+    return GAIN_RAMP_UNITY * powf(10, (out.volume_pct - 100) / 40.0f);
+}
+
+static void volume_apply(int ms)
 {
-    return heap_caps_get_free_size(MALLOC_CAP_8BIT) - heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    if (out.block) {
+        gain_ramp_set(&out.volume, volume_gain(), ramp_step(ms));
+    }
+}
+
+void app_playback_set_volume(int volume)
+{
+    out.volume_pct = volume < 0 ? 0 : volume > 100 ? 100 : volume;
+    out.muted = false;
+    volume_apply(PLAYBACK_VOLUME_MS);
+}
+
+int app_playback_get_volume()
+{
+    return out.volume_pct;
+}
+
+void app_playback_set_mute(bool mute)
+{
+    out.muted = mute;
+    volume_apply(PLAYBACK_VOLUME_MS);
+}
+
+bool app_playback_get_mute()
+{
+    return out.muted;
+}
+
+bool app_playback_busy()
+{
+    if (cue.cur || cue.pending) {
+        return true;
+    }
+    if (pb.enabled && jitter_buffer_depth(&pb.jb)) {
+        return true;
+    }
+    return esp_timer_get_time() - out.last_write_us < PLAYBACK_IDLE_MS * 1000LL;
+}
+
+void app_playback_stop()
+{
+    out.stopped = true;
+    volume_apply(PLAYBACK_STOP_MS);
 }
 
 void alexa_app_dialog_states(alexa_dialog_states_t alexa_states)
 {
     ui_led_set(alexa_states);
+    playback_duck(alexa_states == ALEXA_LISTENING || alexa_states == ALEXA_THINKING);
     ESP_LOGI(TAG, "Current mode is: %d", alexa_states);
 }
 
 int alexa_app_set_volume(int vol)
 {
-    ESP_LOGW(TAG, "Set volume not supported !");
+    app_playback_set_volume(vol);
     return 0;
 }
 
 int alexa_app_set_mute(alexa_mute_state_t alexa_mute_state)
 {
-    ESP_LOGW(TAG, "Mute not supported !");
+    app_playback_set_mute(alexa_mute_state == ALEXA_MUTE);
     return 0;
 }
 
@@ -68,6 +208,260 @@ int alexa_app_raise_alert(alexa_alert_types_t alexa_alert_type, alexa_alert_stat
     return 0;
 }
 
+static pcm_out_format_t speaker_format()
+{
+    switch (audio_board_speaker_bits()) {
+    case 24:
+        return PCM_OUT_S24_IN_32;
+    case 32:
+        return PCM_OUT_S32;
+    default:
+        return PCM_OUT_S16;
+    }
+}
+
+static int64_t frames_us(int frames)
+{
+    return (int64_t) frames * 1000000 / SAMPLING_RATE;
+}
+
+/* All speaker audio goes through here, which keeps track of what the DMA
+ * holds. A write that comes after the DMA played out everything it had is
+ * an underflow, and the DMA repeats stale buffers until it arrives; one that
+ * comes with less than a block left is late. Writes resuming after an idle
+ * gap don't count. */
+static void speaker_write(const void *buf, int frames, size_t *sent_len)
+{
+    int64_t start = esp_timer_get_time(), end;
+    int64_t fill = out.dma_fill_us - (start - out.dma_write_us);
+
+    if (out.dma_write_us && start - out.dma_write_us < PLAYBACK_IDLE_MS * 1000LL) {
+        if (fill < 0) {
+            out.underflows++;
+        } else if (fill < frames_us(out.block_frames)) {
+            out.late_writes++;
+        }
+    }
+    if (fill < 0) {
+        fill = 0;
+    }
+    i2s_write(I2S_PORT_NUM, buf, frames * out.frame_bytes, sent_len, portMAX_DELAY);
+    end = esp_timer_get_time();
+    /* While the write blocked, the DMA was full and playing */
+    fill += frames_us(frames) - (end - start);
+    if (fill > frames_us(out.queued_frames + out.block_frames)) {
+        fill = frames_us(out.queued_frames + out.block_frames);
+    } else if (fill < 0) {
+        fill = 0;
+    }
+    out.dma_fill_us = fill;
+    out.dma_write_us = end;
+}
+
+/* Blocks while the jitter buffer is full, which paces the SDK to real time */
+static void playback_queue(const int16_t *buf, int frames)
+{
+    while (frames) {
+        int n = jitter_buffer_write(&pb.jb, buf, frames);
+        xSemaphoreGive(pb.data);
+        buf += n * PLAYBACK_CHANNELS;
+        frames -= n;
+        if (frames) {
+            xSemaphoreTake(pb.space, portMAX_DELAY);
+        }
+    }
+}
+
+/* Frames of the current earcon for this block, picking up a new one first */
+static int cue_frames()
+{
+    int pending = cue.pending;
+    uint32_t left;
+
+    if (pending) {
+        cue.pending = 0;
+        cue.cur = earcon_get(pending - 1);
+        cue.pos = 0;
+    }
+    if (!cue.cur) {
+        return 0;
+    }
+    left = cue.cur->frames - cue.pos;
+    return left < out.block_frames ? left : out.block_frames;
+}
+
+static void cue_played(int frames)
+{
+    if (cue.pos == 0) {
+        cue.latency_us = esp_timer_get_time() - cue.trigger_us;
+        if (cue.latency_us > cue.max_latency_us) {
+            cue.max_latency_us = cue.latency_us;
+        }
+        cue.plays++;
+    }
+    cue.pos += frames;
+    if (cue.pos >= cue.cur->frames) {
+        cue.cur = NULL;
+    }
+}
+
+static void playback_task(void *arg)
+{
+    jitter_buffer_state_t state;
+    size_t sent_len;
+    int n;
+
+    while (1) {
+        n = cue_frames();
+        state = jitter_buffer_read(&pb.jb, pb.period, out.block_frames);
+        gain_ramp_apply(&out.duck, pb.period, out.block_frames, PLAYBACK_CHANNELS);
+        gain_ramp_apply(&out.volume, pb.period, out.block_frames, PLAYBACK_CHANNELS);
+        if (n && state == JITTER_BUFFER_IDLE && !pb.period_out && cue.cur->channels == PLAYBACK_CHANNELS) {
+            /* Nothing else is playing and the asset is in the speaker's
+             * format: straight from flash to the DMA */
+            speaker_write(cue.cur->samples + cue.pos * PLAYBACK_CHANNELS, n, &sent_len);
+        } else {
+            if (n) {
+                pcm_mix_s16(pb.period, cue.cur->samples + cue.pos * cue.cur->channels, n, cue.cur->channels);
+            }
+            if (pb.period_out) {
+                pb.period_out(out.block, pb.period, out.block_frames);
+                speaker_write(out.block, out.block_frames, &sent_len);
+            } else {
+                speaker_write(pb.period, out.block_frames, &sent_len);
+            }
+        }
+        if (n) {
+            cue_played(n);
+        }
+        xSemaphoreGive(pb.space);
+        if (state == JITTER_BUFFER_IDLE && jitter_buffer_depth(&pb.jb) == 0 && !cue.cur && !cue.pending) {
+            /* Leave the DMA on silence rather than looping its last
+             * buffers, and sleep until there is something to play */
+            i2s_zero_dma_buffer(I2S_PORT_NUM);
+            out.dma_write_us = 0;
+            xSemaphoreTake(pb.data, portMAX_DELAY);
+        }
+    }
+}
+
+static void playback_buffer_init()
+{
+    jitter_buffer_config_t cfg = {
+        .sample_rate = SAMPLING_RATE,
+        .channels = PLAYBACK_CHANNELS,
+        .capacity_ms = CONFIG_APP_PLAYBACK_BUFFER_MS,
+        .start_ms = CONFIG_APP_PLAYBACK_START_MS,
+        .resume_ms = CONFIG_APP_PLAYBACK_RESUME_MS,
+        .fade_ms = PLAYBACK_FADE_MS,
+        .idle_ms = PLAYBACK_IDLE_MS,
+    };
+    size_t size;
+    void *mem;
+
+    if (cfg.capacity_ms == 0) {
+        return;
+    }
+    size = jitter_buffer_mem_size(&cfg);
+    mem = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    pb.period = malloc(out.block_frames * PLAYBACK_CHANNELS * sizeof(int16_t));
+    if (!mem || !pb.period) {
+        ESP_LOGE(TAG, "No memory for a %d ms playback buffer, writing to I2S directly", cfg.capacity_ms);
+        heap_caps_free(mem);
+        free(pb.period);
+        return;
+    }
+    if (jitter_buffer_init(&pb.jb, &cfg, mem) != 0) {
+        ESP_LOGE(TAG, "Playback start and resume levels must not exceed the buffer, writing to I2S directly");
+        heap_caps_free(mem);
+        free(pb.period);
+        return;
+    }
+    if (out.format != PCM_OUT_S16) {
+        pb.period_out = pcm_out_kernel(PLAYBACK_CHANNELS, out.format);
+    }
+    pb.data = xSemaphoreCreateBinary();
+    pb.space = xSemaphoreCreateBinary();
+    pb.enabled = true;
+    app_task_create(APP_TASK_PLAYBACK, &playback_task, NULL);
+    ESP_LOGI(TAG, "Playback buffer: %d ms (%d bytes), start at %d ms, resume at %d ms", cfg.capacity_ms, (int) size,
+             cfg.start_ms, cfg.resume_ms);
+}
+
+void app_playback_get_stats(app_playback_stats_t *stats, bool reset)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->enabled = pb.enabled;
+    if (pb.enabled) {
+        jitter_buffer_get_stats(&pb.jb, &stats->jb, reset);
+    }
+    stats->earcons = cue.plays;
+    stats->earcon_latency_us = cue.latency_us;
+    stats->earcon_max_latency_us = cue.max_latency_us;
+    stats->dma_latency_us = frames_us(out.queued_frames);
+    stats->underflows = out.underflows;
+    stats->late_writes = out.late_writes;
+}
+
+void app_playback_earcon(earcon_id_t id)
+{
+    if (!pb.enabled || !earcon_get(id)) {
+        return;
+    }
+    cue.trigger_us = esp_timer_get_time();
+    __sync_synchronize();
+    cue.pending = id + 1;
+    xSemaphoreGive(pb.data);
+}
+
+/* Hands a resampled block to the jitter buffer or the speaker. The kernel
+ * is picked again only when the stream's channel count changes. */
+static int playback_write(int16_t *in, int frames, int channels, size_t *sent_len)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (now - out.last_write_us > PLAYBACK_IDLE_MS * 1000LL) {
+        app_dsp_response_started();
+    }
+    if (out.stopped && now - out.last_write_us > PLAYBACK_IDLE_MS * 1000LL) {
+        /* A new stream, after the one that was stopped */
+        out.stopped = false;
+        volume_apply(PLAYBACK_VOLUME_MS);
+    }
+    out.last_write_us = now;
+    if (out.stopped) {
+        *sent_len = frames * channels * sizeof(int16_t);
+        return 0;
+    }
+    if (channels != out.stream_channels) {
+        out.stream_out = pcm_out_kernel(channels, pb.enabled ? PCM_OUT_S16 : out.format);
+        if (!out.stream_out) {
+            ESP_LOGE(TAG, "Can't play %d channel audio", channels);
+            return -1;
+        }
+        out.stream_channels = channels;
+    }
+    if (pb.enabled) {
+        if (channels != PLAYBACK_CHANNELS) {
+            out.stream_out(stereo_buf, in, frames);
+            in = stereo_buf;
+        }
+        playback_queue(in, frames);
+        *sent_len = frames * PLAYBACK_CHANNELS * sizeof(int16_t);
+        return 0;
+    }
+    while (frames) {
+        int n = frames < out.block_frames ? frames : out.block_frames;
+        gain_ramp_apply(&out.duck, in, n, channels);
+        gain_ramp_apply(&out.volume, in, n, channels);
+        out.stream_out(out.block, in, n);
+        speaker_write(out.block, n, sent_len);
+        in += n * channels;
+        frames -= n;
+    }
+    return 0;
+}
+
 int alexa_app_playback_data(alexa_resample_param_t *alexa_resample_param, void *buf, ssize_t len)
 {
     memset(convert_buf, 0, BUF_SZ);
@@ -79,7 +473,7 @@ int alexa_app_playback_data(alexa_resample_param_t *alexa_resample_param, void *
     int conv_len = 0;
 
     if (alexa_resample_param->alexa_resample_ch == 1) {
-        /* If mono recording, we need to up-sample, so need half the buffer empty, also uint16_t data*/
+        /* If mono recording, it is copied to both channels on the way out, so keep that within BUF_SZ, also uint16_t data*/
         convert_block_len = CONVERT_BUF_SIZE / 4;
     } else {
         /* If stereo, we won't need additional buffer space but data is uint16_t*/
@@ -93,35 +487,63 @@ int alexa_app_playback_data(alexa_resample_param_t *alexa_resample_param, void *
         }
         conv_len = audio_resample((short *)((char *)buf + send_offset), (short *)convert_buf, alexa_resample_param->alexa_resample_freq, SAMPLING_RATE,
                             current_convert_block_len / 2, BUF_SZ, alexa_resample_param->alexa_resample_ch, &resample);
-        if (alexa_resample_param->alexa_resample_ch == 1) {
-            conv_len = audio_resample_up_channel((short *)convert_buf, (short *)convert_buf, SAMPLING_RATE, SAMPLING_RATE, conv_len, BUF_SZ, &resample);
-        }
         len -= current_convert_block_len;
         /* The reason send_offset and send_len are different is because we could be converting from 24K to 16K */
         send_offset += current_convert_block_len;
-        if (DES_BITS_PER_SAM == SRC_BITS_PER_SAM) {
-            i2s_write((i2s_port_t)I2S_PORT_NUM, (char *)convert_buf, conv_len * 2, &sent_len, portMAX_DELAY);
-        } else {
-            if (DES_BITS_PER_SAM > SRC_BITS_PER_SAM) {
-                if (DES_BITS_PER_SAM % SRC_BITS_PER_SAM != 0) {
-                    ESP_LOGE(TAG, "destination bits need to be multiple of source bits");
-                    return -1;
-                }
-            } else {
-                ESP_LOGE(TAG, "destination bits need to greater then and multiple of source bits");
-                return -1;
-            }
-            i2s_write_expand((i2s_port_t)I2S_PORT_NUM, (char *)convert_buf, conv_len * 2, SRC_BITS_PER_SAM, DES_BITS_PER_SAM, &sent_len, portMAX_DELAY);
+        if (playback_write(convert_buf, conv_len / alexa_resample_param->alexa_resample_ch,
+                           alexa_resample_param->alexa_resample_ch, &sent_len) != 0) {
+            return -1;
         }
     }
     return sent_len;
 }
 
+/* Stands in for the cloud's audio: a quiet tone at the AVS speech rate,
+ * resampled and buffered like the real thing */
+#define TONE_RATE       24000
+#define TONE_BLOCK_MS   20
+#define TONE_LEVEL      1000
+
+void app_playback_tone(int hz, int ms)
+{
+    static int16_t tone[TONE_RATE * TONE_BLOCK_MS / 1000];
+    alexa_resample_param_t param = {
+        .alexa_resample_freq = TONE_RATE,
+        .alexa_resample_ch = 1,
+    };
+    static uint32_t phase;
+    uint32_t step = (uint64_t) hz * UINT32_MAX / TONE_RATE;
+
+    for (int t = 0; t < ms; t += TONE_BLOCK_MS) {
+        for (int i = 0; i < sizeof(tone) / sizeof(tone[0]); i++) {
+            tone[i] = TONE_LEVEL * sinf(phase * (2 * M_PI / UINT32_MAX));
+            phase += step;
+        }
+        if (alexa_app_playback_data(&param, tone, sizeof(tone)) < 0) {
+            return;
+        }
+    }
+}
+
 int i2s_playback_init()
 {
     int ret;
     i2s_config_t i2s_cfg = {};
     audio_board_i2s_init_default(&i2s_cfg);
+    out.format = speaker_format();
+    out.frame_bytes = pcm_out_frame_bytes(out.format);
+    out.block_frames = i2s_cfg.dma_buf_len;
+    out.queued_frames = (i2s_cfg.dma_buf_count - 1) * i2s_cfg.dma_buf_len;
+    out.block = malloc(out.block_frames * out.frame_bytes);
+    if (!out.block) {
+        ESP_LOGE(TAG, "Failed to alloc playback block");
+        return ESP_ERR_NO_MEM;
+    }
+    gain_ramp_init(&out.duck, GAIN_RAMP_UNITY);
+    gain_ramp_init(&out.volume, GAIN_RAMP_UNITY);
+    out.volume_pct = 100;
+    out.duck_gain = GAIN_RAMP_UNITY * powf(10, -CONFIG_APP_PLAYBACK_DUCK_DB / 20.0f);
+    i2s_cfg.bits_per_sample = audio_board_speaker_bits();
     ret = i2s_driver_install(I2S_PORT_NUM, &i2s_cfg, 0, NULL);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Error installing i2s driver for stream");
@@ -129,8 +551,14 @@ int i2s_playback_init()
         i2s_pin_config_t pf_i2s_pin = {0};
         audio_board_i2s_pin_config(I2S_PORT_NUM, &pf_i2s_pin);
         i2s_set_pin(I2S_PORT_NUM, &pf_i2s_pin);
-        i2s_set_clk(I2S_PORT_NUM, 48000, 16, 2);
+        i2s_set_clk(I2S_PORT_NUM, SAMPLING_RATE, audio_board_speaker_bits(), PLAYBACK_CHANNELS);
     }
     ret = i2s_zero_dma_buffer(I2S_PORT_NUM);
+    playback_buffer_init();
+    if (pb.enabled) {
+        earcon_init(SAMPLING_RATE);
+    } else {
+        ESP_LOGW(TAG, "Earcons need the playback buffer");
+    }
     return ret;
 }
@@ -0,0 +1,190 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <mem_utils.h>
+#include "app_tasks.h"
+#include "sysmon.h"
+
+/* Stack sizes in bytes, still the ones each task was created with before
+ * the table; none has been profiled yet, so the table saves no internal RAM
+ * over those tasks' old stacks. Right-sizing needs "tasks profile" run on a
+ * CONFIG_APP_TASK_PROFILE build on the board; copy its figures here, and
+ * again after changing what a task does. */
+#define NN_STACK                (8 * 1024)
+#define RB_READ_STACK           (8 * 1024)
+#define I2S_READER_STACK        5000
+#define PLAYBACK_STACK          2048
+#define UI_BUTTON_STACK         (8 * 1024)
+#define AWS_IOT_STACK           9000
+#define AWS_RX_WATCH_STACK      2048
+#define TELEMETRY_STACK         3072
+#define CAPTURE_TAP_STACK       3072
+#define WAKE_ARBITER_STACK      3072
+
+/* Recommended size is the deepest use seen plus this, in 256 byte steps */
+#define STACK_MARGIN_PCT        25
+#define STACK_MARGIN_MIN        512
+#define STACK_ROUND             256
+
+#define PRIO_DEFAULT            CONFIG_ESP32_PTHREAD_TASK_PRIO_DEFAULT
+
+typedef struct app_task_def {
+    const char *name;
+    uint32_t stack;
+    UBaseType_t prio;
+    app_task_mem_t mem;
+    StackType_t *buf;           /* internal stacks, NULL for PSRAM */
+    bool flash;                 /* writes flash, so the stack stays internal even when profiling */
+} app_task_def_t;
+
+static const char *TAG = "app_tasks";
+
+#ifdef CONFIG_APP_TASK_PROFILE
+/* Everything that can run from PSRAM does, at the profiling size, so no
+ * task overflows while its use is measured */
+#define PROFILE_STACK           (CONFIG_APP_TASK_PROFILE_STACK_KB * 1024)
+#define INTERNAL_BUF(var)       NULL
+#else
+#define INTERNAL_BUF(var)       var
+
+/* The wake word path is kept off PSRAM, its stacks are touched every chunk */
+static StackType_t nn_stack[NN_STACK];
+static StackType_t rb_read_stack[RB_READ_STACK];
+#if CONFIG_APP_PLAYBACK_BUFFER_MS > 0
+static StackType_t playback_stack[PLAYBACK_STACK];
+#endif
+#endif
+#ifdef CONFIG_AWS_IOT_SDK
+static StackType_t telemetry_stack[TELEMETRY_STACK];
+#endif
+
+/* Tasks that only wait on the network or a button run from PSRAM */
+static const app_task_def_t defs[APP_TASK_MAX] = {
+    [APP_TASK_NN] = { "nn", NN_STACK, PRIO_DEFAULT - 1, APP_TASK_INTERNAL, INTERNAL_BUF(nn_stack) },
+    [APP_TASK_RB_READ] = { "rb read task", RB_READ_STACK, PRIO_DEFAULT - 1, APP_TASK_INTERNAL,
+                           INTERNAL_BUF(rb_read_stack) },
+    [APP_TASK_I2S_READER] = { "i2s_reader", I2S_READER_STACK, 0, APP_TASK_INTERNAL },
+#if CONFIG_APP_PLAYBACK_BUFFER_MS > 0
+    [APP_TASK_PLAYBACK] = { "playback", PLAYBACK_STACK, PRIO_DEFAULT + 1, APP_TASK_INTERNAL,
+                            INTERNAL_BUF(playback_stack) },
+#endif
+    [APP_TASK_UI_BUTTON] = { "ui-button-thread", UI_BUTTON_STACK, PRIO_DEFAULT, APP_TASK_PSRAM },
+#ifdef CONFIG_AWS_IOT_SDK
+    [APP_TASK_AWS_IOT] = { "aws_iot_task", AWS_IOT_STACK, 5, APP_TASK_PSRAM },
+    [APP_TASK_AWS_RX_WATCH] = { "aws_rx_watch", AWS_RX_WATCH_STACK, 5, APP_TASK_PSRAM },
+    [APP_TASK_TELEMETRY] = { "telemetry", TELEMETRY_STACK, 1, APP_TASK_INTERNAL, telemetry_stack, true },
+#endif
+#ifdef CONFIG_APP_CAPTURE_TAP
+    [APP_TASK_CAPTURE_TAP] = { "capture_tap", CAPTURE_TAP_STACK, PRIO_DEFAULT - 2, APP_TASK_PSRAM },
+#endif
+#ifdef CONFIG_APP_WAKE_ARBITER
+    [APP_TASK_WAKE_ARBITER] = { "wake_arbiter", WAKE_ARBITER_STACK, PRIO_DEFAULT, APP_TASK_PSRAM },
+#endif
+};
+
+static StaticTask_t tcbs[APP_TASK_MAX];
+static TaskHandle_t handles[APP_TASK_MAX];
+
+uint32_t app_task_stack_size(app_task_id_t id)
+{
+    const app_task_def_t *def = &defs[id];
+
+#ifdef CONFIG_APP_TASK_PROFILE
+    if (def->name && !def->flash) {
+        return PROFILE_STACK > def->stack ? PROFILE_STACK : def->stack;
+    }
+#endif
+    return def->stack;
+}
+
+TaskHandle_t app_task_create(app_task_id_t id, TaskFunction_t fn, void *arg)
+{
+    const app_task_def_t *def = &defs[id];
+    uint32_t size = app_task_stack_size(id);
+    StackType_t *stack = def->buf;
+
+    if (!def->name || id == APP_TASK_I2S_READER || handles[id]) {
+        ESP_LOGE(TAG, "Task %d can't be created here", id);
+        return NULL;
+    }
+    if (!stack) {
+        stack = mem_alloc(size, EXTERNAL);
+        if (!stack) {
+            ESP_LOGE(TAG, "No PSRAM for the %s stack", def->name);
+            return NULL;
+        }
+    }
+    handles[id] = xTaskCreateStatic(fn, def->name, size, arg, def->prio, stack, &tcbs[id]);
+    return handles[id];
+}
+
+static uint32_t stack_recommend(uint32_t used)
+{
+    uint32_t margin = used * STACK_MARGIN_PCT / 100;
+
+    if (margin < STACK_MARGIN_MIN) {
+        margin = STACK_MARGIN_MIN;
+    }
+    return (used + margin + STACK_ROUND - 1) / STACK_ROUND * STACK_ROUND;
+}
+
+void app_task_get_stats(app_task_stats_t stats[APP_TASK_MAX])
+{
+    sysmon_stats_t sm;
+    sysmon_task_t *tasks;
+    int n;
+
+    sysmon_get_stats(&sm);
+    tasks = malloc((sm.tasks ? sm.tasks : 1) * sizeof(sysmon_task_t));
+    n = tasks ? sysmon_get_tasks(tasks, sm.tasks) : 0;
+
+    memset(stats, 0, APP_TASK_MAX * sizeof(app_task_stats_t));
+    for (int id = 0; id < APP_TASK_MAX; id++) {
+        const app_task_def_t *def = &defs[id];
+        app_task_stats_t *s = &stats[id];
+
+        if (!def->name) {
+            continue;
+        }
+        s->enabled = true;
+        s->name = def->name;
+        s->mem = def->mem;
+        s->stack = def->stack;
+        s->alloc = app_task_stack_size(id);
+        for (int i = 0; i < n; i++) {
+            /* FreeRTOS keeps configMAX_TASK_NAME_LEN - 1 characters of a name */
+            if (strncmp(tasks[i].name, def->name, SYSMON_TASK_NAME_LEN - 1) == 0 &&
+                tasks[i].stack_free <= s->alloc) {
+                s->running = true;
+                s->used = s->alloc - tasks[i].stack_free;
+                s->recommended = stack_recommend(s->used);
+                break;
+            }
+        }
+    }
+    free(tasks);
+}
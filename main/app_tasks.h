@@ -0,0 +1,91 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _APP_TASKS_H_
+#define _APP_TASKS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Long-lived app tasks, one entry each in the table in app_tasks.c */
+typedef enum app_task_id {
+    APP_TASK_NN,
+    APP_TASK_RB_READ,
+    APP_TASK_I2S_READER,        /*!< created by the I2S stream, only its stack size is ours */
+    APP_TASK_PLAYBACK,
+    APP_TASK_UI_BUTTON,
+    APP_TASK_AWS_IOT,
+    APP_TASK_AWS_RX_WATCH,
+    APP_TASK_TELEMETRY,
+    APP_TASK_CAPTURE_TAP,
+    APP_TASK_WAKE_ARBITER,
+    APP_TASK_MAX,
+} app_task_id_t;
+
+typedef enum app_task_mem {
+    APP_TASK_INTERNAL,          /*!< reserved at link time */
+    APP_TASK_PSRAM,             /*!< allocated when the task is created */
+} app_task_mem_t;
+
+typedef struct app_task_stats {
+    bool enabled;               /*!< built into this configuration */
+    const char *name;
+    app_task_mem_t mem;
+    uint32_t stack;             /*!< bytes in the table */
+    uint32_t alloc;             /*!< bytes actually given, larger in profiling builds */
+    bool running;               /*!< seen in the last sysmon sample */
+    uint32_t used;              /*!< deepest stack use since the task started, bytes */
+    uint32_t recommended;       /*!< used plus margin, 0 if not running */
+} app_task_stats_t;
+
+/**
+ * @brief  create a task from the table with a static TCB and stack
+ *
+ * Each task can be created once; tasks that stop and start again park
+ * instead of deleting themselves. Returns NULL if the task isn't built in,
+ * was already created or its PSRAM stack can't be allocated.
+ */
+TaskHandle_t app_task_create(app_task_id_t id, TaskFunction_t fn, void *arg);
+
+/**
+ * @brief  stack to give a task created elsewhere, bytes
+ */
+uint32_t app_task_stack_size(app_task_id_t id);
+
+/**
+ * @brief  stack use of every table task as of the last sysmon sample
+ *
+ * Take a sample with sysmon_sample_now() first for current figures.
+ */
+void app_task_get_stats(app_task_stats_t stats[APP_TASK_MAX]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _APP_TASKS_H_ */
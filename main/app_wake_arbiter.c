@@ -0,0 +1,275 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+#include "app_wake_arbiter.h"
+#include "app_tasks.h"
+
+#ifdef CONFIG_APP_WAKE_ARBITER
+
+#define WAKE_ARBITER_HELLO_MS       10000
+#define WAKE_ARBITER_PEER_TIMEOUT_MS    (3 * WAKE_ARBITER_HELLO_MS + 5000)
+/* Covers a wake word still being detected on a slower unit */
+#define WAKE_ARBITER_HOLD_MS        1500
+
+static const char *TAG = "wake_arbiter";
+
+static struct {
+    wake_arbiter_t arb;
+    /* Guards arb, last and the tx socket */
+    SemaphoreHandle_t lock;
+    int rx_fd;
+    int tx_fd;
+    struct sockaddr_in group;
+    volatile TaskHandle_t waiter;
+    wake_arbiter_result_t last;
+    uint32_t rx;
+    uint32_t tx_errors;
+} wa = {
+    .rx_fd = -1,
+    .tx_fd = -1,
+};
+
+static uint32_t now_ms()
+{
+    return esp_timer_get_time() / 1000;
+}
+
+static void wake_arbiter_send(const wake_arbiter_msg_t *msg)
+{
+    if (sendto(wa.tx_fd, msg, sizeof(*msg), 0, (struct sockaddr *) &wa.group, sizeof(wa.group)) != sizeof(*msg)) {
+        wa.tx_errors++;
+    }
+}
+
+/* Hello beacons and everything the group sends; decides our claim when a
+ * better one or a win comes in */
+static void wake_arbiter_task(void *arg)
+{
+    wake_arbiter_msg_t msg;
+    uint8_t buf[sizeof(msg) + 1];
+    uint32_t next_hello = now_ms();
+    struct timeval tv;
+    int n;
+
+    for (;;) {
+        int32_t wait = next_hello - now_ms();
+        if (wait <= 0) {
+            xSemaphoreTake(wa.lock, portMAX_DELAY);
+            wake_arbiter_hello(&wa.arb, &msg);
+            wake_arbiter_send(&msg);
+            xSemaphoreGive(wa.lock);
+            next_hello += WAKE_ARBITER_HELLO_MS;
+            continue;
+        }
+        tv.tv_sec = wait / 1000;
+        tv.tv_usec = (wait % 1000) * 1000;
+        setsockopt(wa.rx_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        n = recv(wa.rx_fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            continue;
+        }
+        xSemaphoreTake(wa.lock, portMAX_DELAY);
+        wa.rx++;
+        if (wake_arbiter_receive(&wa.arb, buf, n, now_ms()) == WAKE_ARBITER_LOSE) {
+            wa.last = WAKE_ARBITER_LOSE;
+            if (wa.waiter) {
+                xTaskNotifyGive(wa.waiter);
+            }
+        }
+        xSemaphoreGive(wa.lock);
+    }
+}
+
+bool app_wake_arbiter_running()
+{
+    return wa.lock != NULL;
+}
+
+bool app_wake_arbiter_claim(uint32_t score)
+{
+    wake_arbiter_msg_t msg;
+    wake_arbiter_result_t r;
+    int wait;
+
+    if (!wa.lock) {
+        return true;
+    }
+    xSemaphoreTake(wa.lock, portMAX_DELAY);
+    wa.waiter = xTaskGetCurrentTaskHandle();
+    r = wake_arbiter_claim(&wa.arb, score, now_ms(), &msg);
+    wa.last = r;
+    wake_arbiter_send(&msg);
+    while (r == WAKE_ARBITER_PENDING) {
+        wait = wake_arbiter_timeout(&wa.arb, now_ms());
+        xSemaphoreGive(wa.lock);
+        ulTaskNotifyTake(pdTRUE, wait / portTICK_RATE_MS + 1);
+        xSemaphoreTake(wa.lock, portMAX_DELAY);
+        r = wake_arbiter_poll(&wa.arb, now_ms(), &msg);
+        if (r == WAKE_ARBITER_WIN && wa.last == WAKE_ARBITER_PENDING) {
+            wake_arbiter_send(&msg);
+        }
+        wa.last = r;
+    }
+    wa.waiter = NULL;
+    wake_arbiter_done(&wa.arb);
+    xSemaphoreGive(wa.lock);
+    ESP_LOGI(TAG, "Claim with score %u %s", score, r == WAKE_ARBITER_WIN ? "won" : "lost");
+    return r == WAKE_ARBITER_WIN;
+}
+
+bool app_wake_arbiter_resolve()
+{
+    wake_arbiter_msg_t msg;
+    bool won;
+
+    if (!wa.lock) {
+        return true;
+    }
+    xSemaphoreTake(wa.lock, portMAX_DELAY);
+    if (wake_arbiter_resolve(&wa.arb, now_ms(), &msg) == WAKE_ARBITER_WIN && wa.last == WAKE_ARBITER_PENDING) {
+        wake_arbiter_send(&msg);
+        wa.last = WAKE_ARBITER_WIN;
+        if (wa.waiter) {
+            xTaskNotifyGive(wa.waiter);
+        }
+    }
+    won = wa.last != WAKE_ARBITER_LOSE;
+    xSemaphoreGive(wa.lock);
+    return won;
+}
+
+void app_wake_arbiter_get_stats(app_wake_arbiter_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!wa.lock) {
+        return;
+    }
+    stats->enabled = true;
+    xSemaphoreTake(wa.lock, portMAX_DELAY);
+    wake_arbiter_get_stats(&wa.arb, &stats->arb, now_ms());
+    stats->rx = wa.rx;
+    stats->tx_errors = wa.tx_errors;
+    xSemaphoreGive(wa.lock);
+}
+
+esp_err_t app_wake_arbiter_init()
+{
+    wake_arbiter_config_t cfg = {
+        .window_ms = CONFIG_APP_WAKE_ARBITER_WINDOW_MS,
+        .hold_ms = WAKE_ARBITER_HOLD_MS,
+        .peer_timeout_ms = WAKE_ARBITER_PEER_TIMEOUT_MS,
+    };
+    struct sockaddr_in local = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_APP_WAKE_ARBITER_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    struct ip_mreq mreq = {
+        .imr_interface.s_addr = htonl(INADDR_ANY),
+    };
+    uint8_t ttl = 1, loop = 0;
+    uint8_t mac[6];
+
+    esp_efuse_mac_get_default(mac);
+    cfg.device_id = (mac[2] << 24) | (mac[3] << 16) | (mac[4] << 8) | mac[5];
+    wake_arbiter_init(&wa.arb, &cfg);
+
+    wa.group.sin_family = AF_INET;
+    wa.group.sin_port = htons(CONFIG_APP_WAKE_ARBITER_PORT);
+    if (!inet_aton(CONFIG_APP_WAKE_ARBITER_GROUP, &wa.group.sin_addr)) {
+        ESP_LOGE(TAG, "Bad multicast group %s", CONFIG_APP_WAKE_ARBITER_GROUP);
+        return ESP_ERR_INVALID_ARG;
+    }
+    mreq.imr_multiaddr = wa.group.sin_addr;
+
+    wa.rx_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    wa.tx_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (wa.rx_fd < 0 || wa.tx_fd < 0 ||
+            bind(wa.rx_fd, (struct sockaddr *) &local, sizeof(local)) != 0 ||
+            setsockopt(wa.rx_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0) {
+        ESP_LOGE(TAG, "Failed to join %s:%d", CONFIG_APP_WAKE_ARBITER_GROUP, CONFIG_APP_WAKE_ARBITER_PORT);
+        goto fail;
+    }
+    /* The group is the room, not the building */
+    setsockopt(wa.tx_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    setsockopt(wa.tx_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+    /* Claims are only arbitrated once the lock exists */
+    wa.lock = xSemaphoreCreateMutex();
+    if (!wa.lock || !app_task_create(APP_TASK_WAKE_ARBITER, &wake_arbiter_task, NULL)) {
+        goto fail;
+    }
+    ESP_LOGI(TAG, "Arbitrating wake words in %s:%d as %08x", CONFIG_APP_WAKE_ARBITER_GROUP,
+             CONFIG_APP_WAKE_ARBITER_PORT, cfg.device_id);
+    return ESP_OK;
+
+fail:
+    if (wa.lock) {
+        vSemaphoreDelete(wa.lock);
+        wa.lock = NULL;
+    }
+    if (wa.rx_fd >= 0) {
+        close(wa.rx_fd);
+    }
+    if (wa.tx_fd >= 0) {
+        close(wa.tx_fd);
+    }
+    wa.rx_fd = wa.tx_fd = -1;
+    return ESP_FAIL;
+}
+
+#else
+
+esp_err_t app_wake_arbiter_init()
+{
+    return ESP_OK;
+}
+
+bool app_wake_arbiter_running()
+{
+    return false;
+}
+
+bool app_wake_arbiter_claim(uint32_t score)
+{
+    return true;
+}
+
+bool app_wake_arbiter_resolve()
+{
+    return true;
+}
+
+void app_wake_arbiter_get_stats(app_wake_arbiter_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif /* CONFIG_APP_WAKE_ARBITER */
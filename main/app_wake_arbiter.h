@@ -0,0 +1,78 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _APP_WAKE_ARBITER_H_
+#define _APP_WAKE_ARBITER_H_
+
+#include <stdbool.h>
+#include <esp_err.h>
+#include <wake_arbiter.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct app_wake_arbiter_stats {
+    bool enabled;
+    wake_arbiter_stats_t arb;
+    uint32_t rx;                /*!< messages received from the group */
+    uint32_t tx_errors;
+} app_wake_arbiter_stats_t;
+
+/**
+ * @brief  join the arbitration group, if CONFIG_APP_WAKE_ARBITER is set
+ *
+ * Needs the station to be connected.
+ */
+esp_err_t app_wake_arbiter_init();
+
+/**
+ * @brief  whether detections need to be arbitrated
+ */
+bool app_wake_arbiter_running();
+
+/**
+ * @brief  claim a wake word detection against the other devices
+ *
+ * Blocks until it is decided, at most CONFIG_APP_WAKE_ARBITER_WINDOW_MS,
+ * less if there are no peers or a better claim comes in.
+ *
+ * @return true if this device should open the dialog
+ */
+bool app_wake_arbiter_claim(uint32_t score);
+
+/**
+ * @brief  decide the claim in progress now, on what has been heard so far
+ *
+ * For the capture path, once it can't hold the audio any longer.
+ *
+ * @return false if the claim in progress or the last one was lost
+ */
+bool app_wake_arbiter_resolve();
+
+void app_wake_arbiter_get_stats(app_wake_arbiter_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _APP_WAKE_ARBITER_H_ */
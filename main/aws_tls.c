@@ -0,0 +1,527 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* TLS connect for the AWS IoT MQTT client.
+ *
+ * The SDK's mbedTLS layer parses the PEM credentials, seeds a DRBG and does a
+ * full handshake on every connect and reconnect. Here the credentials are
+ * embedded as DER (converted at build time, see component.mk) and parsed once
+ * at boot, the DRBG is seeded once, and the session from the last handshake is
+ * offered to the server so reconnects can skip the certificate exchange and
+ * the expensive public key operations. The session is also saved to NVS so
+ * this works for the first connect after a reboot.
+ */
+
+#ifdef CONFIG_AWS_IOT_SDK
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <nvs.h>
+#include <mem_utils.h>
+#include <lwip/sockets.h>
+#include <lwip/netdb.h>
+#include <mbedtls/platform.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include "aws_tls.h"
+#include "telemetry_store.h"
+
+extern const uint8_t aws_root_ca_der_start[] asm("_binary_aws_root_ca_der_start");
+extern const uint8_t aws_root_ca_der_end[] asm("_binary_aws_root_ca_der_end");
+extern const uint8_t certificate_der_start[] asm("_binary_certificate_der_start");
+extern const uint8_t certificate_der_end[] asm("_binary_certificate_der_end");
+extern const uint8_t private_der_start[] asm("_binary_private_der_start");
+extern const uint8_t private_der_end[] asm("_binary_private_der_end");
+
+/* Same as the SDK's mbedTLS layer: reads block only for as long as the
+ * caller's timer allows, this is just the fallback */
+#define AWS_TLS_READ_TIMEOUT_MS     10
+#define AWS_TLS_DRBG_PERS           "aws_iot_tls"
+#define AWS_TLS_NVS_NAMESPACE       "aws_tls"
+#define AWS_TLS_NVS_SESSION_KEY     "session"
+#define AWS_TLS_BLOB_VERSION        1
+#define AWS_TLS_MAX_TICKET_LEN      512
+/* Sessions are saved this long after the last change */
+#define AWS_TLS_SAVE_DELAY_US       (1000 * 1000)
+/* Retries while the telemetry queue is full, then the session isn't saved */
+#define AWS_TLS_SAVE_RETRIES        10
+
+static const char *TAG = "aws_tls";
+
+#ifdef CONFIG_AWS_IOT_TLS_SESSION_NVS
+/* The parts of mbedtls_ssl_session needed to resume. The peer certificate is
+ * left out: it was verified in the full handshake and isn't used again. */
+typedef struct aws_tls_session_blob {
+    uint32_t version;
+    int64_t start;
+    int32_t ciphersuite;
+    int32_t compression;
+    uint32_t id_len;
+    uint8_t id[32];
+    uint8_t master[48];
+    uint32_t verify_result;
+    uint32_t ticket_lifetime;
+    uint32_t ticket_len;
+    uint8_t mfl_code;
+    uint8_t trunc_hmac;
+    uint8_t encrypt_then_mac;
+    uint8_t reserved;
+    uint8_t ticket[AWS_TLS_MAX_TICKET_LEN];
+} aws_tls_session_blob_t;
+#endif
+
+static struct aws_tls {
+    mbedtls_x509_crt cacert;
+    mbedtls_x509_crt clicert;
+    mbedtls_pk_context pkey;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_ssl_session session;
+    bool session_valid;
+    aws_tls_timing_t timing;
+#ifdef CONFIG_AWS_IOT_TLS_SESSION_NVS
+    aws_tls_session_blob_t blob;
+    SemaphoreHandle_t blob_lock;
+    esp_timer_handle_t save_timer;
+    int save_retries;
+#endif
+} at;
+
+#ifdef CONFIG_AWS_IOT_TLS_SESSION_NVS
+static size_t aws_tls_blob_len(const aws_tls_session_blob_t *blob)
+{
+    return offsetof(aws_tls_session_blob_t, ticket) + blob->ticket_len;
+}
+
+static bool aws_tls_session_to_blob(aws_tls_session_blob_t *blob, const mbedtls_ssl_session *session)
+{
+    memset(blob, 0, sizeof(*blob));
+    if (session->id_len > sizeof(blob->id)) {
+        return false;
+    }
+    blob->version = AWS_TLS_BLOB_VERSION;
+#ifdef MBEDTLS_HAVE_TIME
+    blob->start = session->start;
+#endif
+    blob->ciphersuite = session->ciphersuite;
+    blob->compression = session->compression;
+    blob->id_len = session->id_len;
+    memcpy(blob->id, session->id, session->id_len);
+    memcpy(blob->master, session->master, sizeof(blob->master));
+    blob->verify_result = session->verify_result;
+#ifdef MBEDTLS_SSL_SESSION_TICKETS
+    if (session->ticket_len > sizeof(blob->ticket)) {
+        return false;
+    }
+    blob->ticket_lifetime = session->ticket_lifetime;
+    blob->ticket_len = session->ticket_len;
+    if (session->ticket_len) {
+        memcpy(blob->ticket, session->ticket, session->ticket_len);
+    }
+#endif
+#ifdef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+    blob->mfl_code = session->mfl_code;
+#endif
+#ifdef MBEDTLS_SSL_TRUNCATED_HMAC
+    blob->trunc_hmac = session->trunc_hmac;
+#endif
+#ifdef MBEDTLS_SSL_ENCRYPT_THEN_MAC
+    blob->encrypt_then_mac = session->encrypt_then_mac;
+#endif
+    return true;
+}
+
+static bool aws_tls_session_from_blob(mbedtls_ssl_session *session, const aws_tls_session_blob_t *blob)
+{
+    if (blob->version != AWS_TLS_BLOB_VERSION || blob->id_len > sizeof(blob->id) ||
+            blob->ticket_len > sizeof(blob->ticket)) {
+        return false;
+    }
+    mbedtls_ssl_session_init(session);
+#ifdef MBEDTLS_HAVE_TIME
+    session->start = (time_t) blob->start;
+#endif
+    session->ciphersuite = blob->ciphersuite;
+    session->compression = blob->compression;
+    session->id_len = blob->id_len;
+    memcpy(session->id, blob->id, blob->id_len);
+    memcpy(session->master, blob->master, sizeof(session->master));
+    session->verify_result = blob->verify_result;
+#ifdef MBEDTLS_SSL_SESSION_TICKETS
+    if (blob->ticket_len) {
+        session->ticket = mbedtls_calloc(1, blob->ticket_len);
+        if (!session->ticket) {
+            return false;
+        }
+        memcpy(session->ticket, blob->ticket, blob->ticket_len);
+        session->ticket_len = blob->ticket_len;
+        session->ticket_lifetime = blob->ticket_lifetime;
+    }
+#endif
+#ifdef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+    session->mfl_code = blob->mfl_code;
+#endif
+#ifdef MBEDTLS_SSL_TRUNCATED_HMAC
+    session->trunc_hmac = blob->trunc_hmac;
+#endif
+#ifdef MBEDTLS_SSL_ENCRYPT_THEN_MAC
+    session->encrypt_then_mac = blob->encrypt_then_mac;
+#endif
+    return true;
+}
+
+/* Runs in the telemetry task. The AWS IoT task has its stack in PSRAM and
+ * must not write flash itself. */
+static void aws_tls_save(void *arg)
+{
+    nvs_handle handle;
+
+    xSemaphoreTake(at.blob_lock, portMAX_DELAY);
+    if (nvs_open(AWS_TLS_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        if (at.blob.version) {
+            nvs_set_blob(handle, AWS_TLS_NVS_SESSION_KEY, &at.blob, aws_tls_blob_len(&at.blob));
+        } else {
+            nvs_erase_key(handle, AWS_TLS_NVS_SESSION_KEY);
+        }
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+    xSemaphoreGive(at.blob_lock);
+}
+
+/* Only debounces: a flash write here would hold up every other esp_timer
+ * callback for its duration */
+static void aws_tls_save_cb(void *arg)
+{
+    esp_err_t err = telemetry_store_call(aws_tls_save, NULL);
+
+    if (err == ESP_ERR_INVALID_STATE) {
+        /* No telemetry task without its partition. This task's stack is
+         * internal too; the other timers wait out this one write. */
+        aws_tls_save(NULL);
+    } else if (err != ESP_OK && ++at.save_retries < AWS_TLS_SAVE_RETRIES) {
+        esp_timer_start_once(at.save_timer, AWS_TLS_SAVE_DELAY_US);
+        return;
+    } else if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Telemetry queue full, TLS session not saved");
+    }
+    at.save_retries = 0;
+}
+
+static void aws_tls_load_session()
+{
+    nvs_handle handle;
+    size_t len = sizeof(at.blob);
+
+    if (nvs_open(AWS_TLS_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_blob(handle, AWS_TLS_NVS_SESSION_KEY, &at.blob, &len) == ESP_OK &&
+            len >= offsetof(aws_tls_session_blob_t, ticket) && len == aws_tls_blob_len(&at.blob) &&
+            aws_tls_session_from_blob(&at.session, &at.blob)) {
+        ESP_LOGI(TAG, "Loaded saved TLS session");
+        at.session_valid = true;
+    } else {
+        memset(&at.blob, 0, sizeof(at.blob));
+    }
+    nvs_close(handle);
+}
+
+static void aws_tls_save_session()
+{
+    aws_tls_session_blob_t *blob = mem_alloc(sizeof(aws_tls_session_blob_t), EXTERNAL);
+    bool changed;
+
+    if (!blob) {
+        return;
+    }
+    if (!at.session_valid || !aws_tls_session_to_blob(blob, &at.session)) {
+        memset(blob, 0, sizeof(*blob));
+    }
+    xSemaphoreTake(at.blob_lock, portMAX_DELAY);
+    changed = memcmp(blob, &at.blob, sizeof(*blob)) != 0;
+    if (changed) {
+        memcpy(&at.blob, blob, sizeof(*blob));
+    }
+    xSemaphoreGive(at.blob_lock);
+    mem_free(blob);
+
+    if (changed) {
+        esp_timer_stop(at.save_timer);
+        esp_timer_start_once(at.save_timer, AWS_TLS_SAVE_DELAY_US);
+    }
+}
+#else
+static inline void aws_tls_save_session()
+{
+}
+#endif /* CONFIG_AWS_IOT_TLS_SESSION_NVS */
+
+static void aws_tls_forget_session()
+{
+    if (!at.session_valid) {
+        return;
+    }
+    mbedtls_ssl_session_free(&at.session);
+    mbedtls_ssl_session_init(&at.session);
+    at.session_valid = false;
+    aws_tls_save_session();
+}
+
+static void aws_tls_cache_session(const mbedtls_ssl_context *ssl)
+{
+    mbedtls_ssl_session_free(&at.session);
+    mbedtls_ssl_session_init(&at.session);
+    at.session_valid = (mbedtls_ssl_get_session(ssl, &at.session) == 0);
+#ifdef MBEDTLS_X509_CRT_PARSE_C
+    if (at.session.peer_cert) {
+        mbedtls_x509_crt_free(at.session.peer_cert);
+        mbedtls_free(at.session.peer_cert);
+        at.session.peer_cert = NULL;
+    }
+#endif
+    aws_tls_save_session();
+}
+
+static IoT_Error_t aws_tls_destroy(Network *pNetwork)
+{
+    TLSDataParams *tls = &pNetwork->tlsDataParams;
+
+    /* The credentials and DRBG are shared by all connections and stay */
+    mbedtls_net_free(&tls->server_fd);
+    mbedtls_ssl_free(&tls->ssl);
+    mbedtls_ssl_config_free(&tls->conf);
+    return SUCCESS;
+}
+
+static uint32_t aws_tls_elapsed_ms(int64_t *since)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t ms = (now - *since) / 1000;
+    *since = now;
+    return ms;
+}
+
+static IoT_Error_t aws_tls_connect(Network *pNetwork, TLSConnectParams *params)
+{
+    TLSDataParams *tls = &pNetwork->tlsDataParams;
+    TLSConnectParams *cp = &pNetwork->tlsConnectParams;
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_protocol = IPPROTO_TCP,
+    };
+    struct addrinfo *addrs = NULL, *cur;
+    char port[6];
+    int64_t t;
+    IoT_Error_t rc;
+    int one = 1;
+    int ret;
+
+    if (params) {
+        *cp = *params;
+    }
+    /* Release whatever a failed attempt may have left behind */
+    aws_tls_destroy(pNetwork);
+    mbedtls_net_init(&tls->server_fd);
+    mbedtls_ssl_init(&tls->ssl);
+    mbedtls_ssl_config_init(&tls->conf);
+    memset(&at.timing, 0, sizeof(at.timing));
+
+    t = esp_timer_get_time();
+    snprintf(port, sizeof(port), "%d", cp->DestinationPort);
+    ret = getaddrinfo(cp->pDestinationURL, port, &hints, &addrs);
+    at.timing.dns_ms = aws_tls_elapsed_ms(&t);
+    if (ret != 0 || !addrs) {
+        ESP_LOGE(TAG, "DNS lookup of %s failed", cp->pDestinationURL);
+        rc = NETWORK_ERR_NET_UNKNOWN_HOST;
+        goto exit;
+    }
+
+    rc = NETWORK_ERR_NET_CONNECT_FAILED;
+    for (cur = addrs; cur; cur = cur->ai_next) {
+        int fd = socket(cur->ai_family, cur->ai_socktype, cur->ai_protocol);
+        if (fd < 0) {
+            rc = NETWORK_ERR_NET_SOCKET_FAILED;
+            continue;
+        }
+        /* MQTT packets are small and each one waits for its answer; with
+         * Nagle the CONNECT after a resumed handshake sits behind the
+         * broker's delayed ACK of our Finished */
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(fd, cur->ai_addr, cur->ai_addrlen) == 0) {
+            tls->server_fd.fd = fd;
+            rc = SUCCESS;
+            break;
+        }
+        close(fd);
+    }
+    freeaddrinfo(addrs);
+    at.timing.tcp_ms = aws_tls_elapsed_ms(&t);
+    if (rc != SUCCESS) {
+        ESP_LOGE(TAG, "TCP connect to %s:%s failed", cp->pDestinationURL, port);
+        goto exit;
+    }
+
+    rc = SSL_CONNECTION_ERROR;
+    if ((ret = mbedtls_ssl_config_defaults(&tls->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                           MBEDTLS_SSL_PRESET_DEFAULT)) != 0) {
+        ESP_LOGE(TAG, "mbedtls_ssl_config_defaults returned -0x%x", -ret);
+        goto exit;
+    }
+    mbedtls_ssl_conf_authmode(&tls->conf, cp->ServerVerificationFlag ? MBEDTLS_SSL_VERIFY_REQUIRED : MBEDTLS_SSL_VERIFY_OPTIONAL);
+    mbedtls_ssl_conf_rng(&tls->conf, mbedtls_ctr_drbg_random, &at.ctr_drbg);
+    mbedtls_ssl_conf_ca_chain(&tls->conf, &at.cacert, NULL);
+    if ((ret = mbedtls_ssl_conf_own_cert(&tls->conf, &at.clicert, &at.pkey)) != 0) {
+        ESP_LOGE(TAG, "mbedtls_ssl_conf_own_cert returned -0x%x", -ret);
+        rc = NETWORK_SSL_CERT_ERROR;
+        goto exit;
+    }
+    mbedtls_ssl_conf_read_timeout(&tls->conf, cp->timeout_ms);
+#ifdef MBEDTLS_SSL_SESSION_TICKETS
+    mbedtls_ssl_conf_session_tickets(&tls->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+    if ((ret = mbedtls_ssl_setup(&tls->ssl, &tls->conf)) != 0) {
+        ESP_LOGE(TAG, "mbedtls_ssl_setup returned -0x%x", -ret);
+        goto exit;
+    }
+    if ((ret = mbedtls_ssl_set_hostname(&tls->ssl, cp->pDestinationURL)) != 0) {
+        ESP_LOGE(TAG, "mbedtls_ssl_set_hostname returned -0x%x", -ret);
+        goto exit;
+    }
+    mbedtls_ssl_set_bio(&tls->ssl, &tls->server_fd, mbedtls_net_send, NULL, mbedtls_net_recv_timeout);
+    if (at.session_valid) {
+        mbedtls_ssl_set_session(&tls->ssl, &at.session);
+    }
+
+    while ((ret = mbedtls_ssl_handshake(&tls->ssl)) != 0) {
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            ESP_LOGE(TAG, "TLS handshake failed -0x%x", -ret);
+            /* In case it's the cached session the server is unhappy with */
+            aws_tls_forget_session();
+            goto exit;
+        }
+    }
+    if (cp->ServerVerificationFlag && (ret = mbedtls_ssl_get_verify_result(&tls->ssl)) != 0) {
+        ESP_LOGE(TAG, "Server certificate verification failed 0x%x", ret);
+        rc = NETWORK_SSL_CERT_ERROR;
+        goto exit;
+    }
+    /* A resumed session keeps the master secret of the cached one */
+    at.timing.resumed = at.session_valid &&
+                        !memcmp(tls->ssl.session->master, at.session.master, sizeof(at.session.master));
+    at.timing.tls_ms = aws_tls_elapsed_ms(&t);
+    at.timing.done_us = t;
+    aws_tls_cache_session(&tls->ssl);
+    mbedtls_ssl_conf_read_timeout(&tls->conf, AWS_TLS_READ_TIMEOUT_MS);
+
+    ESP_LOGI(TAG, "Connected to %s: DNS %d ms, TCP %d ms, TLS %d ms (%s)", cp->pDestinationURL,
+             at.timing.dns_ms, at.timing.tcp_ms, at.timing.tls_ms, at.timing.resumed ? "resumed" : "full handshake");
+    return SUCCESS;
+
+exit:
+    aws_tls_destroy(pNetwork);
+    return rc;
+}
+
+void aws_tls_attach(Network *network)
+{
+    network->connect = aws_tls_connect;
+    network->destroy = aws_tls_destroy;
+    mbedtls_net_init(&network->tlsDataParams.server_fd);
+    mbedtls_ssl_init(&network->tlsDataParams.ssl);
+    mbedtls_ssl_config_init(&network->tlsDataParams.conf);
+}
+
+bool aws_tls_writable(Network *network)
+{
+    int fd = network->tlsDataParams.server_fd.fd;
+    struct timeval tv = { 0 };
+    fd_set wfds;
+
+    if (fd < 0) {
+        return false;
+    }
+    FD_ZERO(&wfds);
+    FD_SET(fd, &wfds);
+    return select(fd + 1, NULL, &wfds, NULL, &tv) == 1;
+}
+
+const aws_tls_timing_t *aws_tls_get_timing()
+{
+    return &at.timing;
+}
+
+esp_err_t aws_tls_init()
+{
+    int ret;
+
+    mbedtls_x509_crt_init(&at.cacert);
+    mbedtls_x509_crt_init(&at.clicert);
+    mbedtls_pk_init(&at.pkey);
+    mbedtls_entropy_init(&at.entropy);
+    mbedtls_ctr_drbg_init(&at.ctr_drbg);
+    mbedtls_ssl_session_init(&at.session);
+
+    if ((ret = mbedtls_x509_crt_parse_der(&at.cacert, aws_root_ca_der_start,
+                                          aws_root_ca_der_end - aws_root_ca_der_start)) != 0) {
+        ESP_LOGE(TAG, "Failed to parse root CA -0x%x", -ret);
+        return ESP_FAIL;
+    }
+    if ((ret = mbedtls_x509_crt_parse_der(&at.clicert, certificate_der_start,
+                                          certificate_der_end - certificate_der_start)) != 0) {
+        ESP_LOGE(TAG, "Failed to parse device certificate -0x%x", -ret);
+        return ESP_FAIL;
+    }
+    if ((ret = mbedtls_pk_parse_key(&at.pkey, private_der_start, private_der_end - private_der_start, NULL, 0)) != 0) {
+        ESP_LOGE(TAG, "Failed to parse device key -0x%x", -ret);
+        return ESP_FAIL;
+    }
+    if ((ret = mbedtls_ctr_drbg_seed(&at.ctr_drbg, mbedtls_entropy_func, &at.entropy,
+                                     (const unsigned char *) AWS_TLS_DRBG_PERS, strlen(AWS_TLS_DRBG_PERS))) != 0) {
+        ESP_LOGE(TAG, "Failed to seed DRBG -0x%x", -ret);
+        return ESP_FAIL;
+    }
+
+#ifdef CONFIG_AWS_IOT_TLS_SESSION_NVS
+    at.blob_lock = xSemaphoreCreateMutex();
+    esp_timer_create_args_t timer_conf = {
+        .callback = aws_tls_save_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "aws_tls_save_tm"
+    };
+    if (!at.blob_lock || esp_timer_create(&timer_conf, &at.save_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create session save timer");
+        return ESP_FAIL;
+    }
+    aws_tls_load_session();
+#endif
+    return ESP_OK;
+}
+#endif /* CONFIG_AWS_IOT_SDK */
@@ -0,0 +1,75 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _AWS_TLS_H_
+#define _AWS_TLS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+#include "aws_iot_mqtt_client_interface.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct aws_tls_timing {
+    uint32_t dns_ms;
+    uint32_t tcp_ms;
+    uint32_t tls_ms;
+    bool resumed;               /*!< the handshake resumed a cached session */
+    int64_t done_us;            /*!< esp_timer time at which the handshake completed */
+} aws_tls_timing_t;
+
+/**
+ * @brief  parse the embedded credentials and load any saved TLS session
+ *
+ * Must be called from a task with its stack in internal RAM, since it reads NVS.
+ */
+esp_err_t aws_tls_init();
+
+/**
+ * @brief  make the MQTT client connect through aws_tls
+ *
+ * Call after aws_iot_mqtt_init(). Replaces the connect and destroy hooks of
+ * the SDK's mbedTLS network layer, keeping its read and write.
+ */
+void aws_tls_attach(Network *network);
+
+/**
+ * @brief  check whether a write on the connection would go out without blocking
+ *
+ * The SDK's write only gives up after the MQTT command timeout, so optional
+ * publishes made from the MQTT task check this first and retry later.
+ */
+bool aws_tls_writable(Network *network);
+
+/**
+ * @brief  phase timings of the last connection attempt
+ */
+const aws_tls_timing_t *aws_tls_get_timing();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _AWS_TLS_H_ */
@@ -0,0 +1,148 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "cbor_writer.h"
+
+#define CBOR_MAJOR_UINT     (0 << 5)
+#define CBOR_MAJOR_NINT     (1 << 5)
+#define CBOR_MAJOR_BYTES    (2 << 5)
+#define CBOR_MAJOR_TEXT     (3 << 5)
+#define CBOR_MAJOR_ARRAY    (4 << 5)
+#define CBOR_MAJOR_MAP      (5 << 5)
+#define CBOR_SIMPLE_FALSE   0xf4
+#define CBOR_SIMPLE_TRUE    0xf5
+
+void cbor_writer_init(cbor_writer_t *w, uint8_t *buf, size_t size)
+{
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+    w->overflow = false;
+}
+
+/* Initial byte plus the argument in the shortest of the 0/1/2/4/8 byte forms */
+static void cbor_put_head(cbor_writer_t *w, uint8_t major, uint64_t val)
+{
+    uint8_t *p;
+    size_t n;
+
+    if (val < 24) {
+        n = 1;
+    } else if (val <= UINT8_MAX) {
+        n = 2;
+    } else if (val <= UINT16_MAX) {
+        n = 3;
+    } else if (val <= UINT32_MAX) {
+        n = 5;
+    } else {
+        n = 9;
+    }
+    if (w->len + n > w->size) {
+        w->overflow = true;
+        return;
+    }
+    p = w->buf + w->len;
+    w->len += n;
+
+    switch (n) {
+    case 1:
+        p[0] = major | (uint8_t) val;
+        break;
+    case 2:
+        p[0] = major | 24;
+        p[1] = (uint8_t) val;
+        break;
+    case 3:
+        p[0] = major | 25;
+        p[1] = (uint8_t) (val >> 8);
+        p[2] = (uint8_t) val;
+        break;
+    case 5:
+        p[0] = major | 26;
+        p[1] = (uint8_t) (val >> 24);
+        p[2] = (uint8_t) (val >> 16);
+        p[3] = (uint8_t) (val >> 8);
+        p[4] = (uint8_t) val;
+        break;
+    default:
+        p[0] = major | 27;
+        for (int i = 8; i > 0; i--) {
+            p[i] = (uint8_t) val;
+            val >>= 8;
+        }
+        break;
+    }
+}
+
+static void cbor_put_raw(cbor_writer_t *w, const void *data, size_t len)
+{
+    if (w->len + len > w->size) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+void cbor_put_uint(cbor_writer_t *w, uint64_t val)
+{
+    cbor_put_head(w, CBOR_MAJOR_UINT, val);
+}
+
+void cbor_put_int(cbor_writer_t *w, int64_t val)
+{
+    if (val < 0) {
+        /* Negative integers are encoded as -1 - n */
+        cbor_put_head(w, CBOR_MAJOR_NINT, (uint64_t) (-1 - val));
+    } else {
+        cbor_put_head(w, CBOR_MAJOR_UINT, (uint64_t) val);
+    }
+}
+
+void cbor_put_bool(cbor_writer_t *w, bool val)
+{
+    uint8_t b = val ? CBOR_SIMPLE_TRUE : CBOR_SIMPLE_FALSE;
+    cbor_put_raw(w, &b, 1);
+}
+
+void cbor_put_text(cbor_writer_t *w, const char *str, size_t len)
+{
+    cbor_put_head(w, CBOR_MAJOR_TEXT, len);
+    cbor_put_raw(w, str, len);
+}
+
+void cbor_put_bytes(cbor_writer_t *w, const uint8_t *data, size_t len)
+{
+    cbor_put_head(w, CBOR_MAJOR_BYTES, len);
+    cbor_put_raw(w, data, len);
+}
+
+void cbor_put_array(cbor_writer_t *w, size_t count)
+{
+    cbor_put_head(w, CBOR_MAJOR_ARRAY, count);
+}
+
+void cbor_put_map(cbor_writer_t *w, size_t count)
+{
+    cbor_put_head(w, CBOR_MAJOR_MAP, count);
+}
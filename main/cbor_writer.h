@@ -0,0 +1,73 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _CBOR_WRITER_H_
+#define _CBOR_WRITER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Streaming CBOR (RFC 7049) encoder into a caller supplied buffer. Nothing is
+ * allocated. Writes past the end of the buffer are dropped and set 'overflow',
+ * so a sequence of puts needs only one check at the end. */
+typedef struct cbor_writer {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    bool overflow;
+} cbor_writer_t;
+
+void cbor_writer_init(cbor_writer_t *w, uint8_t *buf, size_t size);
+
+void cbor_put_uint(cbor_writer_t *w, uint64_t val);
+
+void cbor_put_int(cbor_writer_t *w, int64_t val);
+
+void cbor_put_bool(cbor_writer_t *w, bool val);
+
+void cbor_put_text(cbor_writer_t *w, const char *str, size_t len);
+
+void cbor_put_bytes(cbor_writer_t *w, const uint8_t *data, size_t len);
+
+/* The 'count' items (key/value pairs for a map) must follow */
+void cbor_put_array(cbor_writer_t *w, size_t count);
+
+void cbor_put_map(cbor_writer_t *w, size_t count);
+
+/**
+ * @brief  encoded length, or -1 if the buffer was too small
+ */
+static inline int cbor_writer_len(const cbor_writer_t *w)
+{
+    return w->overflow ? -1 : (int) w->len;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CBOR_WRITER_H_ */
@@ -8,5 +8,16 @@ COMPONENT_ADD_INCLUDEDIRS := .
 COMPONENT_SRCDIRS := .
 
 ifdef CONFIG_AWS_IOT_SDK
-COMPONENT_EMBED_TXTFILES := certs/aws-root-ca.pem certs/certificate.pem.crt certs/private.pem.key
+# The credentials are embedded as DER so they can be parsed without a base64
+# pass, see aws_tls.c. Needs openssl on the build host.
+COMPONENT_EMBED_FILES := certs/aws-root-ca.der certs/certificate.der certs/private.der
+
+$(COMPONENT_PATH)/certs/aws-root-ca.der: $(COMPONENT_PATH)/certs/aws-root-ca.pem
+	openssl x509 -in $< -outform DER -out $@
+
+$(COMPONENT_PATH)/certs/certificate.der: $(COMPONENT_PATH)/certs/certificate.pem.crt
+	openssl x509 -in $< -outform DER -out $@
+
+$(COMPONENT_PATH)/certs/private.der: $(COMPONENT_PATH)/certs/private.pem.key
+	openssl pkey -in $< -outform DER -out $@
 endif
@@ -0,0 +1,128 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+#include <rom/crc.h>
+#include "earcon.h"
+
+static const char *TAG = "earcon";
+
+typedef struct earcon_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t crc;
+} earcon_header_t;
+
+typedef struct earcon_entry {
+    char name[EARCON_NAME_LEN];
+    uint32_t offset;
+    uint32_t frames;
+    uint32_t sample_rate;
+    uint16_t channels;
+    uint16_t reserved;
+} earcon_entry_t;
+
+static const char *earcon_names[EARCON_MAX] = {
+    [EARCON_WAKE] = "wake",
+    [EARCON_END] = "end",
+    [EARCON_ERROR] = "error",
+};
+
+static struct {
+    const uint8_t *map;
+    spi_flash_mmap_handle_t map_handle;
+    earcon_t assets[EARCON_MAX];
+} ec;
+
+const char *earcon_name(earcon_id_t id)
+{
+    return id < EARCON_MAX ? earcon_names[id] : "?";
+}
+
+static void earcon_add(const esp_partition_t *part, const earcon_entry_t *e, int sample_rate)
+{
+    char name[EARCON_NAME_LEN + 1] = {0};
+    size_t bytes;
+
+    memcpy(name, e->name, EARCON_NAME_LEN);
+    for (int id = 0; id < EARCON_MAX; id++) {
+        if (strcmp(name, earcon_names[id]) != 0) {
+            continue;
+        }
+        bytes = (size_t) e->frames * e->channels * sizeof(int16_t);
+        if (e->sample_rate != sample_rate || e->channels < 1 || e->channels > 2) {
+            ESP_LOGE(TAG, "Earcon %s is %d Hz %d channel, need %d Hz mono or stereo", name, e->sample_rate,
+                     e->channels, sample_rate);
+        } else if ((e->offset & 3) || e->offset > part->size || bytes > part->size - e->offset) {
+            ESP_LOGE(TAG, "Earcon %s is outside the partition", name);
+        } else {
+            ec.assets[id].samples = (const int16_t *) (ec.map + e->offset);
+            ec.assets[id].frames = e->frames;
+            ec.assets[id].channels = e->channels;
+            ESP_LOGI(TAG, "Earcon %s: %d ms", name, e->frames * 1000 / sample_rate);
+        }
+        return;
+    }
+}
+
+esp_err_t earcon_init(int sample_rate)
+{
+    const esp_partition_t *part;
+    const earcon_header_t *hdr;
+    const earcon_entry_t *entries;
+
+    part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, EARCON_PARTITION_SUBTYPE, EARCON_PARTITION_LABEL);
+    if (!part) {
+        ESP_LOGW(TAG, "No earcon partition, cues are LED only");
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (esp_partition_mmap(part, 0, part->size, SPI_FLASH_MMAP_DATA, (const void **) &ec.map, &ec.map_handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map earcon partition");
+        return ESP_FAIL;
+    }
+    hdr = (const earcon_header_t *) ec.map;
+    entries = (const earcon_entry_t *) (hdr + 1);
+    if (hdr->magic != EARCON_MAGIC || hdr->version != EARCON_VERSION ||
+            sizeof(*hdr) + hdr->count * sizeof(earcon_entry_t) > part->size ||
+            crc32_le(0, (const uint8_t *) entries, hdr->count * sizeof(earcon_entry_t)) != hdr->crc) {
+        ESP_LOGW(TAG, "Earcon partition is empty or corrupt, flash it with tools/earcon_pack.py");
+        spi_flash_munmap(ec.map_handle);
+        ec.map = NULL;
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int i = 0; i < hdr->count; i++) {
+        earcon_add(part, &entries[i], sample_rate);
+    }
+    return ESP_OK;
+}
+
+const earcon_t *earcon_get(earcon_id_t id)
+{
+    if (id >= EARCON_MAX || !ec.assets[id].samples) {
+        return NULL;
+    }
+    return &ec.assets[id];
+}
@@ -0,0 +1,85 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EARCON_H_
+#define _EARCON_H_
+
+#include <stdint.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Custom data subtype of the "earcons" partition in partitions.csv */
+#define EARCON_PARTITION_SUBTYPE    0x41
+#define EARCON_PARTITION_LABEL      "earcons"
+
+/*
+ * Partition layout, written by tools/earcon_pack.py. All little-endian.
+ *
+ *   header      magic "ECON", u16 version, u16 count, u32 crc32 of the entries
+ *   entries     count x { char name[16], u32 offset, u32 frames,
+ *                         u32 sample_rate, u16 channels, u16 reserved }
+ *   samples     16-bit interleaved PCM, each asset 4-byte aligned, offsets
+ *               from the start of the partition
+ */
+#define EARCON_MAGIC                0x4e4f4345
+#define EARCON_VERSION              1
+#define EARCON_NAME_LEN             16
+
+typedef enum earcon_id {
+    EARCON_WAKE,            /*!< "wake": the wake word was heard */
+    EARCON_END,             /*!< "end": the device stopped listening */
+    EARCON_ERROR,           /*!< "error": something went wrong, e.g. Wi-Fi dropped */
+    EARCON_MAX,
+} earcon_id_t;
+
+typedef struct earcon {
+    const int16_t *samples; /*!< in the flash mapping, never copied */
+    uint32_t frames;
+    int channels;
+} earcon_t;
+
+/**
+ * @brief  map the earcon partition and look up the assets
+ *
+ * The partition stays mapped for good, so the assets can be played from any
+ * task without touching the heap.
+ */
+esp_err_t earcon_init(int sample_rate);
+
+/**
+ * @brief  asset for a cue, NULL if the partition doesn't have it
+ */
+const earcon_t *earcon_get(earcon_id_t id);
+
+/**
+ * @brief  name of a cue as stored in the partition
+ */
+const char *earcon_name(earcon_id_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EARCON_H_ */
@@ -29,6 +29,7 @@
 #include <unistd.h>
 #include <limits.h>
 #include <string.h>
+#include <time.h>
 
 #include <mem_utils.h>
 
@@ -44,32 +45,36 @@
 
 #include "nvs.h"
 #include "nvs_flash.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
 #ifdef CONFIG_AWS_IOT_SDK
+#include "mbedtls/ssl.h"
+#include "cJSON.h"
 #include "aws_iot_config.h"
 #include "aws_iot_log.h"
 #include "aws_iot_version.h"
 #include "aws_iot_mqtt_client_interface.h"
+#include "app_aws_iot.h"
+#include "telemetry_store.h"
+#include "aws_tls.h"
+#include "telemetry_codec.h"
+#include "app_dsp.h"
+#include "app_tasks.h"
 
 static const char *TAG = "subpub";
 
 /* CA Root certificate, device ("Thing") certificate and device
  * ("Thing") key.
 
-   Example can be configured one of two ways:
-
-   "Embedded Certs" are loaded from files in "certs/" and embedded into the app binary.
-
-   "Filesystem Certs" are loaded from the filesystem (SD card, etc.)
+   The certs in "certs/" are converted to DER at build time and embedded into
+   the app binary. They are parsed once by aws_tls_init().
 
    See example README for more details.
 */
 
-extern const uint8_t aws_root_ca_pem_start[] asm("_binary_aws_root_ca_pem_start");
-extern const uint8_t aws_root_ca_pem_end[] asm("_binary_aws_root_ca_pem_end");
-extern const uint8_t certificate_pem_crt_start[] asm("_binary_certificate_pem_crt_start");
-extern const uint8_t certificate_pem_crt_end[] asm("_binary_certificate_pem_crt_end");
-extern const uint8_t private_pem_key_start[] asm("_binary_private_pem_key_start");
-extern const uint8_t private_pem_key_end[] asm("_binary_private_pem_key_end");
+extern const uint8_t aws_root_ca_der_start[] asm("_binary_aws_root_ca_der_start");
+extern const uint8_t certificate_der_start[] asm("_binary_certificate_der_start");
+extern const uint8_t private_der_start[] asm("_binary_private_der_start");
 
 /**
  * @brief Default MQTT HOST URL is pulled from the aws_iot_config.h
@@ -81,7 +86,149 @@ char HostAddress[255] = AWS_IOT_MQTT_HOST;
  */
 uint32_t port = AWS_IOT_MQTT_PORT;
 
-xQueueHandle wake_word_sem;
+/* Notification bits the AWS IoT task blocks on */
+#define AWS_EVT_PUBLISH     BIT0
+#define AWS_EVT_RX          BIT1
+#define AWS_EVT_KEEPALIVE   BIT2
+
+#define AWS_IOT_KEEPALIVE_SEC       10
+/* The socket is known to be readable when yield is called, so it only has to drain it */
+#define AWS_IOT_YIELD_TIMEOUT_MS    10
+#define AWS_IOT_EVENT_QUEUE_LEN     8
+/* Upper bound on a single select(), so a socket replaced by a reconnect is picked up */
+#define AWS_IOT_RX_WATCH_TIMEOUT_SEC AWS_IOT_KEEPALIVE_SEC
+/* Records replayed from the telemetry log per wakeup, so live traffic isn't starved */
+#define AWS_IOT_REPLAY_BATCH        8
+
+#define AWS_IOT_TOPIC               "test_topic/esp32"
+#define AWS_IOT_PAYLOAD_MAX         100
+
+#define AWS_IOT_SHADOW_PREFIX       "$aws/things/" CONFIG_AWS_IOT_THING_NAME "/shadow/"
+#define AWS_IOT_SHADOW_UPDATE_TOPIC AWS_IOT_SHADOW_PREFIX "update"
+#define AWS_IOT_SHADOW_DELTA_TOPIC  AWS_IOT_SHADOW_PREFIX "update/delta"
+#define AWS_IOT_SHADOW_PAYLOAD_MAX  192
+
+typedef enum aws_iot_format {
+    AWS_IOT_FMT_JSON,
+    AWS_IOT_FMT_CBOR,
+} aws_iot_format_t;
+
+typedef struct aws_iot_topic {
+    const char *name;
+    aws_iot_format_t format;
+} aws_iot_topic_t;
+
+static const aws_iot_topic_t aws_iot_telemetry_topic = {
+    .name = CONFIG_AWS_IOT_TELEMETRY_TOPIC,
+#ifdef CONFIG_AWS_IOT_TELEMETRY_CBOR
+    .format = AWS_IOT_FMT_CBOR,
+#else
+    .format = AWS_IOT_FMT_JSON,
+#endif
+};
+
+static const aws_iot_topic_t aws_iot_health_topic = {
+    .name = CONFIG_AWS_IOT_HEALTH_TOPIC,
+#ifdef CONFIG_AWS_IOT_HEALTH_CBOR
+    .format = AWS_IOT_FMT_CBOR,
+#else
+    .format = AWS_IOT_FMT_JSON,
+#endif
+};
+
+static TaskHandle_t aws_iot_task_handle;
+static TaskHandle_t rx_watch_task_handle;
+static xQueueHandle aws_event_queue;
+static esp_timer_handle_t keepalive_timer;
+static volatile bool aws_iot_online;
+static uint32_t aws_iot_seq;
+static portMUX_TYPE aws_iot_seq_lock = portMUX_INITIALIZER_UNLOCKED;
+static int32_t wake_word_count = 1;
+/* Last DSP parameter set reported to the shadow */
+static app_dsp_params_t reported_params;
+static bool reported_params_valid;
+
+esp_err_t aws_iot_post_event(aws_iot_event_type_t type, int32_t value)
+{
+    aws_iot_event_t evt = {
+        .boot = telemetry_store_get_boot_id(),
+        .timestamp = time(NULL),
+        .type = type,
+        .value = value,
+    };
+
+    if (!aws_iot_task_handle) {
+        return ESP_FAIL;
+    }
+    portENTER_CRITICAL(&aws_iot_seq_lock);
+    evt.seq = aws_iot_seq++;
+    portEXIT_CRITICAL(&aws_iot_seq_lock);
+
+    if (aws_iot_online && xQueueSend(aws_event_queue, &evt, 0) == pdTRUE) {
+        xTaskNotify(aws_iot_task_handle, AWS_EVT_PUBLISH, eSetBits);
+        return ESP_OK;
+    }
+    /* Synthetic load is posted faster than the queue drains, logging the
+     * overflow would only wear the flash and replay it later */
+    if (type == AWS_IOT_EVT_BENCH) {
+        return ESP_FAIL;
+    }
+    return telemetry_store_append(&evt);
+}
+
+static void keepalive_timer_cb(void *arg)
+{
+    xTaskNotify(aws_iot_task_handle, AWS_EVT_KEEPALIVE, eSetBits);
+}
+
+/* Blocks in select() on the MQTT socket once armed by the AWS IoT task, and
+ * tells it when there is something to read. The AWS IoT task re-arms it after
+ * draining the socket, so a readable socket is reported only once. The
+ * socket comes with each arm, since the client belongs to the AWS IoT task
+ * and reconnects swap it there. */
+static void aws_iot_rx_watch_task(void *arg)
+{
+    bool armed = false;
+    uint32_t value;
+    fd_set rfds;
+    struct timeval tv;
+    int fd = -1, ret;
+
+    while (1) {
+        if (!armed) {
+            xTaskNotifyWait(0, ULONG_MAX, &value, portMAX_DELAY);
+            fd = (int) value;
+            armed = true;
+        } else if (xTaskNotifyWait(0, ULONG_MAX, &value, 0) == pdTRUE) {
+            /* Re-armed while waiting out a timeout, possibly after a reconnect */
+            fd = (int) value;
+        }
+        FD_ZERO(&rfds);
+        FD_SET(fd, &rfds);
+        tv.tv_sec = AWS_IOT_RX_WATCH_TIMEOUT_SEC;
+        tv.tv_usec = 0;
+        ret = select(fd + 1, &rfds, NULL, NULL, &tv);
+        if (ret > 0) {
+            armed = false;
+            xTaskNotify(aws_iot_task_handle, AWS_EVT_RX, eSetBits);
+        } else if (ret < 0) {
+            /* Socket went away underneath us, wait for the next connection */
+            armed = false;
+        }
+    }
+}
+
+static void aws_iot_rx_watch_arm(AWS_IoT_Client *client)
+{
+    int fd = client->networkStack.tlsDataParams.server_fd.fd;
+
+    /* mbedTLS may already hold decrypted data that select() can't see */
+    if (mbedtls_ssl_get_bytes_avail(&client->networkStack.tlsDataParams.ssl) > 0) {
+        xTaskNotify(aws_iot_task_handle, AWS_EVT_RX, eSetBits);
+    } else if (fd >= 0) {
+        xTaskNotify(rx_watch_task_handle, fd, eSetValueWithOverwrite);
+    }
+}
 
 void iot_subscribe_callback_handler(AWS_IoT_Client *pClient, char *topicName, uint16_t topicNameLen,
                                     IoT_Publish_Message_Params *params, void *pData) {
@@ -89,10 +236,134 @@ void iot_subscribe_callback_handler(AWS_IoT_Client *pClient, char *topicName, ui
     ESP_LOGI(TAG, "%.*s\t%.*s", topicNameLen, topicName, (int) params->payloadLen, (char *)params->payload);
 }
 
+/* Overlays the fields present in a delta's "dsp" state on top of params,
+ * since a delta only carries what differs from the reported state. */
+static esp_err_t aws_iot_shadow_parse_dsp(const cJSON *dsp, app_dsp_params_t *params)
+{
+    const struct {
+        const char *key;
+        int *field;
+    } fields[] = {
+        { "wake_hits", &params->wake_hits },
+        { "vad_threshold", &params->vad_threshold },
+        { "preroll_ms", &params->preroll_ms },
+    };
+    const cJSON *item;
+
+    if (!cJSON_IsObject(dsp)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    item = cJSON_GetObjectItem(dsp, "version");
+    if (item) {
+        if (!cJSON_IsNumber(item) || item->valuedouble < 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        params->version = item->valuedouble;
+    }
+    for (int i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        item = cJSON_GetObjectItem(dsp, fields[i].key);
+        if (!item) {
+            continue;
+        }
+        if (!cJSON_IsNumber(item)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        *fields[i].field = item->valueint;
+    }
+    item = cJSON_GetObjectItem(dsp, "gain");
+    if (item) {
+        if (!cJSON_IsNumber(item) || item->valuedouble < 0 || item->valuedouble > APP_DSP_GAIN_Q8_MAX / 256) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        params->gain_q8 = item->valuedouble * 256 + 0.5;
+    }
+    return ESP_OK;
+}
+
+/* Shadow delta, e.g. {"version":12,"state":{"dsp":{"version":3,"gain":1.5}}}.
+ * The fields are merged onto the staged set, so a delta that arrives before
+ * the audio path picked up the previous one keeps that one's fields. The set
+ * is staged with app_dsp_set_params() and reported from the main loop once
+ * the audio path has actually switched to it. */
+static void aws_iot_shadow_delta_handler(AWS_IoT_Client *pClient, char *topicName, uint16_t topicNameLen,
+                                         IoT_Publish_Message_Params *params, void *pData)
+{
+    app_dsp_params_t dsp_params;
+    cJSON *root;
+    char *json;
+
+    /* The payload isn't NUL terminated */
+    json = mem_alloc(params->payloadLen + 1, EXTERNAL);
+    if (!json) {
+        ESP_LOGE(TAG, "No memory for shadow delta");
+        return;
+    }
+    memcpy(json, params->payload, params->payloadLen);
+    json[params->payloadLen] = '\0';
+    root = cJSON_Parse(json);
+    mem_free(json);
+    if (!root) {
+        ESP_LOGE(TAG, "Malformed shadow delta");
+        return;
+    }
+
+    const cJSON *state = cJSON_GetObjectItem(root, "state");
+    const cJSON *dsp = state ? cJSON_GetObjectItem(state, "dsp") : NULL;
+    if (dsp) {
+        app_dsp_get_staged_params(&dsp_params);
+        if (aws_iot_shadow_parse_dsp(dsp, &dsp_params) != ESP_OK || app_dsp_set_params(&dsp_params) != ESP_OK) {
+            ESP_LOGE(TAG, "Ignoring invalid DSP params in shadow delta");
+        }
+    }
+    cJSON_Delete(root);
+}
+
+/* Reports the DSP parameters in use whenever they differ from what was last
+ * reported. This also reports the initial set after connecting, which makes
+ * the shadow service send a delta for anything still pending. It runs on the
+ * MQTT task, so it is skipped while the socket can't take the write and
+ * retried on the next wakeup, rather than blocking for the command timeout. */
+static void aws_iot_shadow_report(AWS_IoT_Client *client)
+{
+    IoT_Publish_Message_Params msg;
+    char payload[AWS_IOT_SHADOW_PAYLOAD_MAX];
+    app_dsp_params_t params;
+    int len;
+
+    app_dsp_get_params(&params);
+    if (reported_params_valid && memcmp(&params, &reported_params, sizeof(params)) == 0) {
+        return;
+    }
+    if (!aws_tls_writable(&client->networkStack)) {
+        return;
+    }
+    len = snprintf(payload, sizeof(payload),
+                   "{\"state\":{\"reported\":{\"dsp\":{\"version\":%u,\"wake_hits\":%d,"
+                   "\"vad_threshold\":%d,\"preroll_ms\":%d,\"gain\":%d.%03d}}}}",
+                   params.version, params.wake_hits, params.vad_threshold, params.preroll_ms,
+                   params.gain_q8 / 256, ((params.gain_q8 % 256) * 1000) / 256);
+    if (len >= sizeof(payload)) {
+        ESP_LOGE(TAG, "Shadow report doesn't fit in the payload buffer");
+        return;
+    }
+
+    msg.qos = QOS0;
+    msg.payload = payload;
+    msg.payloadLen = len;
+    msg.isRetained = 0;
+    if (aws_iot_mqtt_publish(client, AWS_IOT_SHADOW_UPDATE_TOPIC, strlen(AWS_IOT_SHADOW_UPDATE_TOPIC), &msg) == SUCCESS) {
+        ESP_LOGI(TAG, "Reported DSP params version %u", params.version);
+        reported_params = params;
+        reported_params_valid = true;
+    }
+}
+
 void disconnectCallbackHandler(AWS_IoT_Client *pClient, void *data) {
     ESP_LOGW(TAG, "MQTT Disconnect");
     IoT_Error_t rc = FAILURE;
 
+    aws_iot_online = false;
+
     if(NULL == pClient) {
         return;
     }
@@ -110,29 +381,129 @@ void disconnectCallbackHandler(AWS_IoT_Client *pClient, void *data) {
     }
 }
 
-void aws_iot_task(void *param) {
-    char cPayload[100];
+/* Wake word events carry the running wake word count as their value */
+static int32_t aws_iot_event_value(const aws_iot_event_t *evt)
+{
+    return (evt->type == AWS_IOT_EVT_WAKE_WORD) ? wake_word_count : evt->value;
+}
 
-    int32_t i = 1;
+/* Device health goes to its own topic, so it can be encoded for and read by
+ * something other than what consumes the wake word events */
+static const aws_iot_topic_t *aws_iot_event_topic(const aws_iot_event_t *evt)
+{
+    switch (evt->type) {
+    case AWS_IOT_EVT_WAKE_WORD:
+    case AWS_IOT_EVT_BENCH:
+        return &aws_iot_telemetry_topic;
+    default:
+        return &aws_iot_health_topic;
+    }
+}
+
+static IoT_Error_t aws_iot_publish_event(AWS_IoT_Client *client, const aws_iot_event_t *evt)
+{
+    const aws_iot_topic_t *topic = aws_iot_event_topic(evt);
+    telemetry_record_t rec = {
+        .type = evt->type,
+        .value = aws_iot_event_value(evt),
+        .boot = evt->boot,
+        .seq = evt->seq,
+        .timestamp = evt->timestamp,
+        .wake_word = evt->type == AWS_IOT_EVT_WAKE_WORD,
+    };
+    uint8_t payload[AWS_IOT_PAYLOAD_MAX];
+    IoT_Publish_Message_Params paramsQOS1;
+    IoT_Error_t rc;
+    int len;
+
+    if (topic->format == AWS_IOT_FMT_CBOR) {
+        len = telemetry_encode_cbor(&rec, payload, sizeof(payload));
+    } else {
+        len = telemetry_encode_json(&rec, (char *) payload, sizeof(payload));
+    }
+    if (len < 0) {
+        ESP_LOGE(TAG, "Event %d doesn't fit in the payload buffer, dropping it", evt->type);
+        return SUCCESS;
+    }
 
+    paramsQOS1.qos = QOS1;
+    paramsQOS1.payload = (void *) payload;
+    paramsQOS1.payloadLen = len;
+    paramsQOS1.isRetained = 0;
+    rc = aws_iot_mqtt_publish(client, topic->name, strlen(topic->name), &paramsQOS1);
+    if (rc == MQTT_REQUEST_TIMEOUT_ERROR) {
+        /* The (boot, seq) pair lets the cloud side drop the duplicate if it did arrive */
+        ESP_LOGW(TAG, "QOS1 publish ack not received.");
+        rc = SUCCESS;
+    }
+    if (rc == SUCCESS && evt->type == AWS_IOT_EVT_WAKE_WORD) {
+        wake_word_count++;
+    }
+    return rc;
+}
+
+/* Publish everything queued while online. On the first failure the rest of
+ * the queue goes to the telemetry log, to be replayed after reconnecting. */
+static void aws_iot_publish_queued(AWS_IoT_Client *client)
+{
+    aws_iot_event_t evt;
+
+    while (xQueueReceive(aws_event_queue, &evt, 0) == pdTRUE) {
+        if (aws_iot_online && aws_iot_publish_event(client, &evt) == SUCCESS) {
+            continue;
+        }
+        aws_iot_online = false;
+        telemetry_store_append(&evt);
+    }
+}
+
+static void aws_iot_replay(AWS_IoT_Client *client)
+{
+    telemetry_entry_t batch[AWS_IOT_REPLAY_BATCH];
+    int n, sent;
+
+    n = telemetry_store_peek(batch, AWS_IOT_REPLAY_BATCH);
+    for (sent = 0; sent < n; sent++) {
+        if (aws_iot_publish_event(client, &batch[sent].evt) != SUCCESS) {
+            aws_iot_online = false;
+            break;
+        }
+    }
+    if (sent) {
+        ESP_LOGI(TAG, "Replayed %d offline events", sent);
+        telemetry_store_ack(batch[sent - 1].lsn);
+    }
+    if (sent == n && telemetry_store_pending()) {
+        /* Come back for the next batch after servicing anything else */
+        xTaskNotify(aws_iot_task_handle, AWS_EVT_PUBLISH, eSetBits);
+    }
+}
+
+/* Time from the end of the TLS handshake to CONNACK, logged after the
+ * per-phase network timings from aws_tls */
+static void aws_iot_log_mqtt_connect_time()
+{
+    const aws_tls_timing_t *timing = aws_tls_get_timing();
+    ESP_LOGI(TAG, "MQTT CONNECT took %d ms", (int) ((esp_timer_get_time() - timing->done_us) / 1000));
+}
+
+void aws_iot_task(void *param) {
     IoT_Error_t rc = FAILURE;
 
     AWS_IoT_Client client;
     IoT_Client_Init_Params mqttInitParams = iotClientInitParamsDefault;
     IoT_Client_Connect_Params connectParams = iotClientConnectParamsDefault;
 
-    IoT_Publish_Message_Params paramsQOS0;
-    IoT_Publish_Message_Params paramsQOS1;
-
     ESP_LOGI(TAG, "AWS IoT SDK Version %d.%d.%d-%s", VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH, VERSION_TAG);
 
     mqttInitParams.enableAutoReconnect = false; // We enable this later below
     mqttInitParams.pHostURL = HostAddress;
     mqttInitParams.port = port;
 
-    mqttInitParams.pRootCALocation = (const char *)aws_root_ca_pem_start;
-    mqttInitParams.pDeviceCertLocation = (const char *)certificate_pem_crt_start;
-    mqttInitParams.pDevicePrivateKeyLocation = (const char *)private_pem_key_start;
+    /* Only passed through to aws_tls_connect(), which uses the copies parsed at init */
+    mqttInitParams.pRootCALocation = (const char *)aws_root_ca_der_start;
+    mqttInitParams.pDeviceCertLocation = (const char *)certificate_der_start;
+    mqttInitParams.pDevicePrivateKeyLocation = (const char *)private_der_start;
 
     mqttInitParams.mqttCommandTimeout_ms = 20000;
     mqttInitParams.tlsHandshakeTimeout_ms = 5000;
@@ -145,8 +516,9 @@ void aws_iot_task(void *param) {
         ESP_LOGE(TAG, "aws_iot_mqtt_init returned error : %d ", rc);
         abort();
     }
+    aws_tls_attach(&client.networkStack);
 
-    connectParams.keepAliveIntervalInSec = 10;
+    connectParams.keepAliveIntervalInSec = AWS_IOT_KEEPALIVE_SEC;
     connectParams.isCleanSession = true;
     connectParams.MQTTVersion = MQTT_3_1_1;
     
@@ -156,6 +528,7 @@ void aws_iot_task(void *param) {
     connectParams.isWillMsgPresent = false;
 
     ESP_LOGI(TAG, "Connecting to AWS...");
+    int64_t connect_start = esp_timer_get_time();
     do {
         rc = aws_iot_mqtt_connect(&client, &connectParams);
         if(SUCCESS != rc) {
@@ -163,6 +536,8 @@ void aws_iot_task(void *param) {
             vTaskDelay(1000 / portTICK_RATE_MS);
         }
     } while(SUCCESS != rc);
+    ESP_LOGI(TAG, "Connected to AWS in %d ms", (int) ((esp_timer_get_time() - connect_start) / 1000));
+    aws_iot_log_mqtt_connect_time();
 
     /*
      * Enable Auto Reconnect functionality. Minimum and Maximum time of Exponential backoff are set in aws_iot_config.h
@@ -175,46 +550,69 @@ void aws_iot_task(void *param) {
         abort();
     }
 
-    const char *TOPIC = "test_topic/esp32";
-    const int TOPIC_LEN = strlen(TOPIC);
-
     ESP_LOGI(TAG, "Subscribing...");
-    rc = aws_iot_mqtt_subscribe(&client, TOPIC, TOPIC_LEN, QOS0, iot_subscribe_callback_handler, NULL);
+    rc = aws_iot_mqtt_subscribe(&client, AWS_IOT_TOPIC, strlen(AWS_IOT_TOPIC), QOS0, iot_subscribe_callback_handler, NULL);
     if(SUCCESS != rc) {
         ESP_LOGE(TAG, "Error subscribing : %d ", rc);
         abort();
     }
+    rc = aws_iot_mqtt_subscribe(&client, AWS_IOT_SHADOW_DELTA_TOPIC, strlen(AWS_IOT_SHADOW_DELTA_TOPIC), QOS1,
+                                aws_iot_shadow_delta_handler, NULL);
+    if(SUCCESS != rc) {
+        ESP_LOGE(TAG, "Error subscribing to shadow delta : %d ", rc);
+        abort();
+    }
 
-    sprintf(cPayload, "%s : %d ", "hello from SDK", i);
-
-    paramsQOS0.qos = QOS0;
-    paramsQOS0.payload = (void *) cPayload;
-    paramsQOS0.isRetained = 0;
+    /* Keepalive pings and reconnect backoff are both driven from yield, so a
+     * timer at half the keepalive interval is all that's needed to wake us
+     * when there is no traffic. */
+    esp_timer_create_args_t timer_conf = {
+        .callback = keepalive_timer_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "aws_keepalive_tm"
+    };
+    if (esp_timer_create(&timer_conf, &keepalive_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create keepalive timer");
+        abort();
+    }
+    esp_timer_start_periodic(keepalive_timer, (AWS_IOT_KEEPALIVE_SEC * 1000 * 1000U) / 2);
 
-    paramsQOS1.qos = QOS1;
-    paramsQOS1.payload = (void *) cPayload;
-    paramsQOS1.isRetained = 0;
+    rx_watch_task_handle = app_task_create(APP_TASK_AWS_RX_WATCH, &aws_iot_rx_watch_task, NULL);
+    aws_iot_online = true;
+    aws_iot_rx_watch_arm(&client);
+    /* Replay whatever was logged before we got connected */
+    xTaskNotify(aws_iot_task_handle, AWS_EVT_PUBLISH, eSetBits);
 
     while((NETWORK_ATTEMPTING_RECONNECT == rc || NETWORK_RECONNECTED == rc || SUCCESS == rc)) {
+        uint32_t events = 0;
+        bool yielded = false;
+
+        xTaskNotifyWait(0, ULONG_MAX, &events, portMAX_DELAY);
+
+        if (events & (AWS_EVT_RX | AWS_EVT_KEEPALIVE)) {
+            yielded = true;
+            rc = aws_iot_mqtt_yield(&client, AWS_IOT_YIELD_TIMEOUT_MS);
+            aws_iot_online = (SUCCESS == rc || NETWORK_RECONNECTED == rc);
+            if (NETWORK_RECONNECTED == rc) {
+                aws_iot_log_mqtt_connect_time();
+            }
+        }
 
-        //Max time the yield function will wait for read messages
-        rc = aws_iot_mqtt_yield(&client, 100);
+        aws_iot_publish_queued(&client);
         if(NETWORK_ATTEMPTING_RECONNECT == rc) {
-            // If the client is attempting to reconnect we will skip the rest of the loop.
+            // If the client is attempting to reconnect, wait for the next keepalive tick.
             continue;
         }
-
-        ESP_LOGI(TAG, "Stack remaining for task '%s' is %d bytes", pcTaskGetTaskName(NULL), uxTaskGetStackHighWaterMark(NULL));
-        if (xSemaphoreTake(wake_word_sem, 1000/portTICK_RATE_MS) != pdTRUE) {
-            continue;
+        if (aws_iot_online) {
+            /* Picks up a staged DSP parameter set on the first wakeup after the audio path applied it */
+            aws_iot_shadow_report(&client);
+            aws_iot_replay(&client);
         }
-        //vTaskDelay(1000 / portTICK_RATE_MS);
-        sprintf(cPayload, "{ \"wake_word_count\" : %d }", i++);
-        paramsQOS1.payloadLen = strlen(cPayload);
-        rc = aws_iot_mqtt_publish(&client, TOPIC, TOPIC_LEN, &paramsQOS1);
-        if (rc == MQTT_REQUEST_TIMEOUT_ERROR) {
-            ESP_LOGW(TAG, "QOS1 publish ack not received.");
-            rc = SUCCESS;
+        /* Only a yield drains the socket; a publish wakeup leaves the watch
+         * as it was */
+        if (yielded) {
+            aws_iot_rx_watch_arm(&client);
         }
     }
 
@@ -222,15 +620,15 @@ void aws_iot_task(void *param) {
     abort();
 }
 
-#define AWS_IOT_TASK_STACK_SIZE  9000
-
 void aws_iot_init()
 {
-    StackType_t *task_stack = (StackType_t *)mem_alloc(AWS_IOT_TASK_STACK_SIZE, EXTERNAL);
-    static StaticTask_t task_buf;
-
-    wake_word_sem = xSemaphoreCreateBinary();
+    if (aws_tls_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to load AWS IoT credentials");
+        return;
+    }
+    aws_event_queue = xQueueCreate(AWS_IOT_EVENT_QUEUE_LEN, sizeof(aws_iot_event_t));
+    telemetry_store_init();
 
-    xTaskCreateStatic(&aws_iot_task, "aws_iot_task", AWS_IOT_TASK_STACK_SIZE, NULL, 5, task_stack, &task_buf);
+    aws_iot_task_handle = app_task_create(APP_TASK_AWS_IOT, &aws_iot_task, NULL);
 }
 #endif
@@ -0,0 +1,270 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <mem_utils.h>
+#include "sysmon.h"
+#ifdef CONFIG_AWS_IOT_SDK
+#include "app_aws_iot.h"
+#include "app_dsp.h"
+#endif
+
+/* Room for tasks created between counting them and reading their state */
+#define SYSMON_TASK_SLACK   4
+
+static const char *TAG = "sysmon";
+
+static struct {
+    esp_timer_handle_t timer;
+    SemaphoreHandle_t lock;
+    sysmon_sample_t *ring;
+    uint32_t ring_len;
+    uint32_t samples;
+    uint32_t periodic;          /* samples taken by the timer */
+    uint32_t sample_us;
+    uint32_t max_sample_us;
+    uint32_t failed;            /* samples without a task table */
+    uint32_t skipped;           /* timer samples skipped while the console held the lock */
+    int ntasks;
+    int task_cap;
+    sysmon_task_t *tasks;       /* in PSRAM, grown with the number of tasks */
+    TaskStatus_t *status;
+} sm;
+
+static void sysmon_read_heap(sysmon_heap_t *heap, uint32_t caps)
+{
+    heap->free = heap_caps_get_free_size(caps);
+    heap->min_free = heap_caps_get_minimum_free_size(caps);
+    heap->largest = heap_caps_get_largest_free_block(caps);
+}
+
+static bool sysmon_grow_tables(int n)
+{
+    sysmon_task_t *tasks;
+    TaskStatus_t *status;
+
+    if (n <= sm.task_cap) {
+        return true;
+    }
+    tasks = mem_alloc(n * sizeof(sysmon_task_t), EXTERNAL);
+    status = mem_alloc(n * sizeof(TaskStatus_t), EXTERNAL);
+    if (!tasks || !status) {
+        mem_free(tasks);
+        mem_free(status);
+        return false;
+    }
+    memcpy(tasks, sm.tasks, sm.ntasks * sizeof(sysmon_task_t));
+    mem_free(sm.tasks);
+    mem_free(sm.status);
+    sm.tasks = tasks;
+    sm.status = status;
+    sm.task_cap = n;
+    return true;
+}
+
+/* High-water marks only ever go down, so the table from the last sample is
+ * all the history the stacks need. The ring keeps the lowest one. */
+static bool sysmon_read_tasks(sysmon_sample_t *s)
+{
+    UBaseType_t n = uxTaskGetNumberOfTasks() + SYSMON_TASK_SLACK;
+
+    if (!sysmon_grow_tables(n)) {
+        return false;
+    }
+    /* Nothing is returned if more tasks were created in between than the slack covers */
+    n = uxTaskGetSystemState(sm.status, sm.task_cap, NULL);
+    if (n == 0) {
+        return false;
+    }
+
+    s->stack_min = UINT32_MAX;
+    for (int i = 0; i < n; i++) {
+        /* StackType_t is a byte on the ESP32, so the mark is in bytes */
+        uint32_t hwm = sm.status[i].usStackHighWaterMark;
+
+        strlcpy(sm.tasks[i].name, sm.status[i].pcTaskName, SYSMON_TASK_NAME_LEN);
+        sm.tasks[i].stack_free = hwm;
+        if (hwm < s->stack_min) {
+            s->stack_min = hwm;
+            strlcpy(s->stack_min_task, sm.tasks[i].name, SYSMON_TASK_NAME_LEN);
+        }
+    }
+    sm.ntasks = n;
+    s->tasks = n;
+    return true;
+}
+
+#if defined(CONFIG_AWS_IOT_SDK) && CONFIG_APP_SYSMON_TELEMETRY_SAMPLES > 0
+static void sysmon_publish(const sysmon_sample_t *s)
+{
+    aws_iot_post_event(AWS_IOT_EVT_HEAP_INTERNAL_FREE, s->internal.free);
+    aws_iot_post_event(AWS_IOT_EVT_HEAP_INTERNAL_MIN, s->internal.min_free);
+    aws_iot_post_event(AWS_IOT_EVT_HEAP_INTERNAL_LARGEST, s->internal.largest);
+    aws_iot_post_event(AWS_IOT_EVT_HEAP_PSRAM_FREE, s->psram.free);
+    aws_iot_post_event(AWS_IOT_EVT_HEAP_PSRAM_MIN, s->psram.min_free);
+    aws_iot_post_event(AWS_IOT_EVT_HEAP_PSRAM_LARGEST, s->psram.largest);
+    if (s->tasks) {
+        aws_iot_post_event(AWS_IOT_EVT_STACK_MIN, s->stack_min);
+    }
+}
+#endif
+
+static void sysmon_sample(bool periodic)
+{
+    sysmon_sample_t s = {
+        .uptime_s = esp_timer_get_time() / 1000000,
+    };
+    int64_t start = esp_timer_get_time();
+    uint32_t us;
+
+    /* The esp_timer task runs every timer, so it doesn't wait on the console */
+    if (xSemaphoreTake(sm.lock, periodic ? 0 : portMAX_DELAY) != pdTRUE) {
+        sm.skipped++;
+        return;
+    }
+    sysmon_read_heap(&s.internal, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    sysmon_read_heap(&s.psram, MALLOC_CAP_SPIRAM);
+    if (!sysmon_read_tasks(&s)) {
+        /* The table of the last good sample stays, no tasks marks this one */
+        sm.failed++;
+    }
+    sm.ring[sm.samples % sm.ring_len] = s;
+    sm.samples++;
+    us = esp_timer_get_time() - start;
+    sm.sample_us = us;
+    if (us > sm.max_sample_us) {
+        sm.max_sample_us = us;
+    }
+    xSemaphoreGive(sm.lock);
+    if (!periodic) {
+        return;
+    }
+
+#if defined(CONFIG_AWS_IOT_SDK) && CONFIG_APP_SYSMON_TELEMETRY_SAMPLES > 0
+    /* Samples taken from the console stay off the cloud's fixed cadence */
+    if ((sm.periodic % CONFIG_APP_SYSMON_TELEMETRY_SAMPLES) == 0) {
+        sysmon_publish(&s);
+    }
+#endif
+#ifdef CONFIG_AWS_IOT_SDK
+    app_dsp_report_wake_skips();
+#endif
+    sm.periodic++;
+}
+
+static void sysmon_timer_cb(void *arg)
+{
+    sysmon_sample(true);
+}
+
+void sysmon_sample_now()
+{
+    if (sm.ring) {
+        sysmon_sample(false);
+    }
+}
+
+int sysmon_get_samples(sysmon_sample_t *samples, int max)
+{
+    uint32_t n, first;
+
+    if (!sm.ring) {
+        return 0;
+    }
+    xSemaphoreTake(sm.lock, portMAX_DELAY);
+    n = sm.samples < sm.ring_len ? sm.samples : sm.ring_len;
+    if (n > max) {
+        n = max;
+    }
+    first = sm.samples - n;
+    for (int i = 0; i < n; i++) {
+        samples[i] = sm.ring[(first + i) % sm.ring_len];
+    }
+    xSemaphoreGive(sm.lock);
+    return n;
+}
+
+int sysmon_get_tasks(sysmon_task_t *tasks, int max)
+{
+    int n;
+
+    if (!sm.ring) {
+        return 0;
+    }
+    xSemaphoreTake(sm.lock, portMAX_DELAY);
+    n = sm.ntasks < max ? sm.ntasks : max;
+    memcpy(tasks, sm.tasks, n * sizeof(sysmon_task_t));
+    xSemaphoreGive(sm.lock);
+    return n;
+}
+
+void sysmon_get_stats(sysmon_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (!sm.ring) {
+        return;
+    }
+    xSemaphoreTake(sm.lock, portMAX_DELAY);
+    stats->period_s = CONFIG_APP_SYSMON_PERIOD_S;
+    stats->samples = sm.samples;
+    stats->ring_len = sm.ring_len;
+    stats->sample_us = sm.sample_us;
+    stats->max_sample_us = sm.max_sample_us;
+    stats->tasks = sm.ntasks;
+    stats->failed = sm.failed;
+    stats->skipped = sm.skipped;
+    xSemaphoreGive(sm.lock);
+}
+
+esp_err_t sysmon_init()
+{
+    sysmon_sample_t *ring;
+    esp_timer_create_args_t timer_conf = {
+        .callback = sysmon_timer_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "sysmon_tm"
+    };
+
+    ring = mem_alloc(CONFIG_APP_SYSMON_RING_LEN * sizeof(sysmon_sample_t), EXTERNAL);
+    sm.lock = xSemaphoreCreateMutex();
+    if (!ring || !sm.lock) {
+        ESP_LOGE(TAG, "Failed to allocate the sample ring");
+        return ESP_ERR_NO_MEM;
+    }
+    if (esp_timer_create(&timer_conf, &sm.timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create sample timer");
+        return ESP_FAIL;
+    }
+    sm.ring_len = CONFIG_APP_SYSMON_RING_LEN;
+    sm.ring = ring;
+    /* A first sample now gives the baseline right after boot */
+    sysmon_sample(true);
+    esp_timer_start_periodic(sm.timer, CONFIG_APP_SYSMON_PERIOD_S * 1000000ULL);
+    return ESP_OK;
+}
@@ -0,0 +1,104 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _SYSMON_H_
+#define _SYSMON_H_
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SYSMON_TASK_NAME_LEN    configMAX_TASK_NAME_LEN
+
+/** Heap of one memory type, in bytes */
+typedef struct sysmon_heap {
+    uint32_t free;
+    uint32_t min_free;          /*!< lowest free since boot */
+    uint32_t largest;           /*!< largest free block, falls as the heap fragments */
+} sysmon_heap_t;
+
+/** One entry of the sample ring */
+typedef struct sysmon_sample {
+    uint32_t uptime_s;
+    sysmon_heap_t internal;
+    sysmon_heap_t psram;
+    uint32_t stack_min;         /*!< lowest stack high-water mark of any task, bytes */
+    char stack_min_task[SYSMON_TASK_NAME_LEN];
+    uint32_t tasks;             /*!< 0 if the tasks couldn't be read, and stack_min is not set */
+} sysmon_sample_t;
+
+/** Stack high-water mark of a task, bytes never touched since it started */
+typedef struct sysmon_task {
+    char name[SYSMON_TASK_NAME_LEN];
+    uint32_t stack_free;
+} sysmon_task_t;
+
+typedef struct sysmon_stats {
+    uint32_t period_s;
+    uint32_t samples;           /*!< taken since boot */
+    uint32_t ring_len;
+    uint32_t sample_us;         /*!< time the last sample took */
+    uint32_t max_sample_us;
+    int tasks;                  /*!< in the task table, enough for sysmon_get_tasks() */
+    uint32_t failed;            /*!< samples that couldn't read the tasks */
+    uint32_t skipped;           /*!< periodic samples skipped while the console read the ring */
+} sysmon_stats_t;
+
+/**
+ * @brief  start sampling the heaps and task stacks
+ *
+ * Samples are taken every CONFIG_APP_SYSMON_PERIOD_S from the esp_timer task
+ * into a ring in PSRAM, and published as telemetry every
+ * CONFIG_APP_SYSMON_TELEMETRY_SAMPLES samples.
+ */
+esp_err_t sysmon_init();
+
+/**
+ * @brief  copy out recent samples, oldest first
+ *
+ * Returns the number of samples copied, at most max.
+ */
+int sysmon_get_samples(sysmon_sample_t *samples, int max);
+
+/**
+ * @brief  copy out the task table from the last sample
+ *
+ * Returns the number of tasks copied, at most max.
+ */
+int sysmon_get_tasks(sysmon_task_t *tasks, int max);
+
+void sysmon_get_stats(sysmon_stats_t *stats);
+
+/**
+ * @brief  take a sample now, in addition to the periodic ones
+ */
+void sysmon_sample_now();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SYSMON_H_ */
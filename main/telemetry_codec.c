@@ -0,0 +1,58 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include "telemetry_codec.h"
+#include "cbor_writer.h"
+
+int telemetry_encode_json(const telemetry_record_t *rec, char *buf, size_t size)
+{
+    int len;
+
+    if (rec->wake_word) {
+        len = snprintf(buf, size, "{ \"wake_word_count\" : %d, \"boot\" : %u, \"seq\" : %u, \"ts\" : %u }",
+                       rec->value, rec->boot, rec->seq, rec->timestamp);
+    } else {
+        len = snprintf(buf, size, "{ \"type\" : %u, \"value\" : %d, \"boot\" : %u, \"seq\" : %u, \"ts\" : %u }",
+                       rec->type, rec->value, rec->boot, rec->seq, rec->timestamp);
+    }
+    return (len >= 0 && (size_t) len < size) ? len : -1;
+}
+
+int telemetry_encode_cbor(const telemetry_record_t *rec, uint8_t *buf, size_t size)
+{
+    cbor_writer_t w;
+
+    cbor_writer_init(&w, buf, size);
+    cbor_put_map(&w, 5);
+    cbor_put_uint(&w, TELEMETRY_KEY_TYPE);
+    cbor_put_uint(&w, rec->type);
+    cbor_put_uint(&w, TELEMETRY_KEY_BOOT);
+    cbor_put_uint(&w, rec->boot);
+    cbor_put_uint(&w, TELEMETRY_KEY_SEQ);
+    cbor_put_uint(&w, rec->seq);
+    cbor_put_uint(&w, TELEMETRY_KEY_TS);
+    cbor_put_uint(&w, rec->timestamp);
+    cbor_put_uint(&w, TELEMETRY_KEY_VALUE);
+    cbor_put_int(&w, rec->value);
+    return cbor_writer_len(&w);
+}
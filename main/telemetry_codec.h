@@ -0,0 +1,72 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TELEMETRY_CODEC_H_
+#define _TELEMETRY_CODEC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Map keys of the CBOR telemetry encoding, see tools/telemetry_decode.py */
+enum {
+    TELEMETRY_KEY_TYPE = 0,
+    TELEMETRY_KEY_BOOT,
+    TELEMETRY_KEY_SEQ,
+    TELEMETRY_KEY_TS,
+    TELEMETRY_KEY_VALUE,
+};
+
+/* One event as it is published. Kept free of ESP-IDF headers so
+ * tools/telemetry_bench.c can build the encoders on the host. */
+typedef struct telemetry_record {
+    uint32_t type;              /*!< aws_iot_event_type_t */
+    int32_t value;
+    uint32_t boot;
+    uint32_t seq;
+    uint32_t timestamp;
+    bool wake_word;             /*!< JSON keeps the wake_word_count form existing consumers read */
+} telemetry_record_t;
+
+/**
+ * @brief  encode as JSON text, without the terminating NUL
+ *
+ * @return length, or -1 if the buffer was too small
+ */
+int telemetry_encode_json(const telemetry_record_t *rec, char *buf, size_t size);
+
+/**
+ * @brief  encode as a CBOR map with the integer keys above
+ *
+ * @return length, or -1 if the buffer was too small
+ */
+int telemetry_encode_cbor(const telemetry_record_t *rec, uint8_t *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TELEMETRY_CODEC_H_ */
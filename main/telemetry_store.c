@@ -0,0 +1,489 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Append-only log of undelivered telemetry in its own flash partition.
+ *
+ * Records are fixed size slots addressed by a log sequence number (lsn),
+ * slot = lsn % nslots. The writer walks the partition as a ring and erases a
+ * sector only when it enters it, so erases are spread evenly over all the
+ * sectors. Delivered records are marked by clearing their 'consumed' word,
+ * which needs no erase. When the log is full the oldest sector is recycled and
+ * its undelivered records are dropped.
+ *
+ * All flash writes happen in the telemetry task, whose stack is in internal
+ * RAM. Reads go through a read-only mmap of the partition, so any task can
+ * peek at the log.
+ *
+ * An erase turns the flash cache off on both cores for tens of ms, which
+ * stalls capture and playback with it. Erases therefore wait for the audio
+ * to go quiet: the next sector is erased ahead while nothing plays and no
+ * dialog is open, and a write that finds its sector unerased waits for that
+ * too. Record writes are short and go ahead at any time.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+#include <esp_timer.h>
+#include <nvs.h>
+#include <rom/crc.h>
+#include "telemetry_store.h"
+#include "app_tasks.h"
+#include "app_dsp.h"
+#include "app_playback.h"
+
+#define TELEMETRY_MAGIC             0x7e1e
+#define TELEMETRY_CONSUMED          0
+#define TELEMETRY_SLOTS_PER_SEC     (SPI_FLASH_SEC_SIZE / sizeof(telemetry_slot_t))
+#define TELEMETRY_QUEUE_LEN         16
+#define TELEMETRY_NVS_NAMESPACE     "telemetry"
+#define TELEMETRY_NVS_BOOT_KEY      "boot"
+/* How often an idle telemetry task looks for a sector to erase ahead */
+#define TELEMETRY_QUIET_POLL_MS     500
+
+static const char *TAG = "telemetry";
+
+/* Everything before 'consumed' is written in one go. 'consumed' is left erased
+ * and cleared to TELEMETRY_CONSUMED once the record has been delivered. */
+typedef struct telemetry_slot {
+    uint16_t magic;
+    uint16_t type;
+    uint32_t lsn;
+    uint32_t boot;
+    uint32_t seq;
+    uint32_t timestamp;
+    int32_t value;
+    uint32_t crc;
+    uint32_t consumed;
+} telemetry_slot_t;
+
+typedef enum telemetry_op_type {
+    TELEMETRY_OP_APPEND,
+    TELEMETRY_OP_ACK,
+    TELEMETRY_OP_CALL,
+} telemetry_op_type_t;
+
+typedef struct telemetry_op {
+    telemetry_op_type_t type;
+    union {
+        aws_iot_event_t evt;
+        uint32_t lsn;
+        struct {
+            void (*fn)(void *);
+            void *arg;
+        } call;
+    } u;
+} telemetry_op_t;
+
+static struct telemetry_store {
+    const esp_partition_t *part;
+    const telemetry_slot_t *map;
+    spi_flash_mmap_handle_t map_handle;
+    uint32_t nslots;
+    uint32_t head;              /* lsn of the next record to be written */
+    uint32_t tail;              /* lsn of the oldest undelivered record */
+    uint32_t marked;            /* records before this lsn have 'consumed' cleared in flash */
+    uint32_t boot;
+    uint32_t erased;            /* lsn of a sector start known to be erased ahead */
+    telemetry_store_stats_t stats;
+    /* dropped is counted from the posting tasks too */
+    portMUX_TYPE drop_lock;
+    SemaphoreHandle_t lock;
+    xQueueHandle queue;
+} ts = {
+    .drop_lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static void telemetry_drop(uint32_t n)
+{
+    portENTER_CRITICAL(&ts.drop_lock);
+    ts.stats.dropped += n;
+    portEXIT_CRITICAL(&ts.drop_lock);
+}
+
+static inline const telemetry_slot_t *telemetry_slot(uint32_t lsn)
+{
+    return &ts.map[lsn % ts.nslots];
+}
+
+static inline uint32_t telemetry_slot_crc(const telemetry_slot_t *slot)
+{
+    return crc32_le(0, (const uint8_t *) slot, offsetof(telemetry_slot_t, crc));
+}
+
+static bool telemetry_slot_valid(const telemetry_slot_t *slot, uint32_t lsn)
+{
+    return slot->magic == TELEMETRY_MAGIC && slot->lsn == lsn && slot->crc == telemetry_slot_crc(slot);
+}
+
+static bool telemetry_blank(const void *buf, size_t len)
+{
+    const uint32_t *p = (const uint32_t *) buf;
+    for (size_t i = 0; i < len / sizeof(uint32_t); i++) {
+        if (p[i] != 0xffffffff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool telemetry_audio_quiet()
+{
+    return !app_dsp_in_dialog() && !app_playback_busy();
+}
+
+static void telemetry_erase_sector(uint32_t idx)
+{
+    int64_t start = esp_timer_get_time();
+    uint32_t us;
+
+    esp_partition_erase_range(ts.part, idx * sizeof(telemetry_slot_t), SPI_FLASH_SEC_SIZE);
+    us = esp_timer_get_time() - start;
+    ts.stats.erases++;
+    if (us > ts.stats.max_erase_us) {
+        ts.stats.max_erase_us = us;
+    }
+}
+
+/* Erases the sector the writer enters next while the audio is quiet, unless
+ * it still holds undelivered records */
+static void telemetry_erase_ahead()
+{
+    uint32_t next, idx;
+
+    xSemaphoreTake(ts.lock, portMAX_DELAY);
+    next = (ts.head / TELEMETRY_SLOTS_PER_SEC + 1) * TELEMETRY_SLOTS_PER_SEC;
+    idx = next % ts.nslots;
+    if (next != ts.erased && (int32_t)(ts.tail - (next - ts.nslots + TELEMETRY_SLOTS_PER_SEC)) >= 0 &&
+            telemetry_audio_quiet()) {
+        if (!telemetry_blank(&ts.map[idx], SPI_FLASH_SEC_SIZE)) {
+            telemetry_erase_sector(idx);
+        }
+        ts.erased = next;
+    }
+    xSemaphoreGive(ts.lock);
+}
+
+/* Rebuild head and tail from flash. The undelivered records are the run of
+ * valid, unconsumed records ending at the newest one. */
+static void telemetry_store_scan()
+{
+    bool found = false;
+    uint32_t newest = 0;
+
+    for (uint32_t i = 0; i < ts.nslots; i++) {
+        const telemetry_slot_t *slot = &ts.map[i];
+        if (slot->lsn % ts.nslots != i || !telemetry_slot_valid(slot, slot->lsn)) {
+            continue;
+        }
+        if (!found || (int32_t)(slot->lsn - newest) > 0) {
+            newest = slot->lsn;
+        }
+        found = true;
+    }
+
+    if (!found) {
+        /* First boot, or leftovers from some other use of this flash. Not
+         * formatted here, the audio is already running: the writer erases
+         * each sector as it enters it. */
+        ts.head = ts.tail = ts.marked = 0;
+        return;
+    }
+
+    ts.head = newest + 1;
+    ts.tail = ts.head;
+    for (uint32_t lsn = newest; ts.head - lsn <= ts.nslots; lsn--) {
+        const telemetry_slot_t *slot = telemetry_slot(lsn);
+        if (!telemetry_slot_valid(slot, lsn) || slot->consumed == TELEMETRY_CONSUMED) {
+            break;
+        }
+        ts.tail = lsn;
+    }
+    ts.marked = ts.tail;
+}
+
+static void telemetry_store_write(const aws_iot_event_t *evt)
+{
+    telemetry_slot_t slot;
+    uint32_t idx;
+
+    xSemaphoreTake(ts.lock, portMAX_DELAY);
+    while (1) {
+        idx = ts.head % ts.nslots;
+        if (idx % TELEMETRY_SLOTS_PER_SEC == 0) {
+            bool erase = !telemetry_blank(&ts.map[idx], SPI_FLASH_SEC_SIZE);
+
+            if (erase && !telemetry_audio_quiet()) {
+                /* Not erased ahead, hold the write until the audio is quiet.
+                 * Only this task moves head, so it stays put meanwhile. */
+                int64_t start = esp_timer_get_time();
+                uint32_t ms;
+
+                xSemaphoreGive(ts.lock);
+                while (!telemetry_audio_quiet()) {
+                    vTaskDelay(TELEMETRY_QUIET_POLL_MS / portTICK_RATE_MS);
+                }
+                xSemaphoreTake(ts.lock, portMAX_DELAY);
+                ms = (esp_timer_get_time() - start) / 1000;
+                ts.stats.deferred++;
+                if (ms > ts.stats.max_defer_ms) {
+                    ts.stats.max_defer_ms = ms;
+                }
+            }
+            /* Entering a sector, recycle it whole */
+            if (ts.head - ts.tail > ts.nslots - TELEMETRY_SLOTS_PER_SEC) {
+                uint32_t new_tail = ts.head - ts.nslots + TELEMETRY_SLOTS_PER_SEC;
+                telemetry_drop(new_tail - ts.tail);
+                ESP_LOGW(TAG, "Log full, dropped %d undelivered records", new_tail - ts.tail);
+                ts.tail = new_tail;
+                if ((int32_t)(ts.tail - ts.marked) > 0) {
+                    ts.marked = ts.tail;
+                }
+            }
+            if (erase) {
+                telemetry_erase_sector(idx);
+            }
+            break;
+        }
+        if (telemetry_blank(&ts.map[idx], sizeof(slot))) {
+            break;
+        }
+        /* Torn write from a power loss, step over it */
+        ts.head++;
+    }
+
+    memset(&slot, 0xff, sizeof(slot));
+    slot.magic = TELEMETRY_MAGIC;
+    slot.type = evt->type;
+    slot.lsn = ts.head;
+    slot.boot = evt->boot;
+    slot.seq = evt->seq;
+    slot.timestamp = evt->timestamp;
+    slot.value = evt->value;
+    slot.crc = telemetry_slot_crc(&slot);
+    if (esp_partition_write(ts.part, idx * sizeof(slot), &slot, offsetof(telemetry_slot_t, consumed)) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write record %d", ts.head);
+    }
+    ts.stats.writes++;
+    ts.head++;
+    xSemaphoreGive(ts.lock);
+}
+
+static void telemetry_store_mark(uint32_t lsn)
+{
+    const uint32_t consumed = TELEMETRY_CONSUMED;
+
+    xSemaphoreTake(ts.lock, portMAX_DELAY);
+    while ((int32_t)(lsn - ts.marked) >= 0 && ts.marked != ts.head) {
+        uint32_t idx = ts.marked % ts.nslots;
+        if (telemetry_slot_valid(&ts.map[idx], ts.marked)) {
+            esp_partition_write(ts.part, idx * sizeof(telemetry_slot_t) + offsetof(telemetry_slot_t, consumed),
+                                &consumed, sizeof(consumed));
+        }
+        ts.marked++;
+    }
+    xSemaphoreGive(ts.lock);
+}
+
+static void telemetry_task(void *arg)
+{
+    telemetry_op_t op;
+    while (1) {
+        if (xQueueReceive(ts.queue, &op, TELEMETRY_QUIET_POLL_MS / portTICK_RATE_MS) != pdTRUE) {
+            telemetry_erase_ahead();
+            continue;
+        }
+        if (op.type == TELEMETRY_OP_APPEND) {
+            telemetry_store_write(&op.u.evt);
+        } else if (op.type == TELEMETRY_OP_ACK) {
+            telemetry_store_mark(op.u.lsn);
+        } else {
+            op.u.call.fn(op.u.call.arg);
+        }
+    }
+}
+
+static uint32_t telemetry_boot_count()
+{
+    nvs_handle handle;
+    uint32_t boot = 0;
+
+    if (nvs_open(TELEMETRY_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS namespace");
+        return 0;
+    }
+    nvs_get_u32(handle, TELEMETRY_NVS_BOOT_KEY, &boot);
+    boot++;
+    nvs_set_u32(handle, TELEMETRY_NVS_BOOT_KEY, boot);
+    nvs_commit(handle);
+    nvs_close(handle);
+    return boot;
+}
+
+esp_err_t telemetry_store_init()
+{
+    ts.boot = telemetry_boot_count();
+
+    ts.part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, TELEMETRY_PARTITION_SUBTYPE, TELEMETRY_PARTITION_LABEL);
+    if (!ts.part) {
+        ESP_LOGE(TAG, "No telemetry partition, offline events will be lost");
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (esp_partition_mmap(ts.part, 0, ts.part->size, SPI_FLASH_MMAP_DATA, (const void **) &ts.map, &ts.map_handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map telemetry partition");
+        ts.map = NULL;
+        return ESP_FAIL;
+    }
+    ts.nslots = (ts.part->size / SPI_FLASH_SEC_SIZE) * TELEMETRY_SLOTS_PER_SEC;
+    telemetry_store_scan();
+    ESP_LOGI(TAG, "Boot %d, %d undelivered records in log", ts.boot, ts.head - ts.tail);
+
+    ts.lock = xSemaphoreCreateMutex();
+    ts.queue = xQueueCreate(TELEMETRY_QUEUE_LEN, sizeof(telemetry_op_t));
+    if (!ts.lock || !ts.queue) {
+        ESP_LOGE(TAG, "Failed to allocate telemetry queue");
+        return ESP_ERR_NO_MEM;
+    }
+    /* The table keeps this stack in internal RAM, which flash writes need */
+    if (!app_task_create(APP_TASK_TELEMETRY, &telemetry_task, NULL)) {
+        ESP_LOGE(TAG, "Failed to create telemetry task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+uint32_t telemetry_store_get_boot_id()
+{
+    return ts.boot;
+}
+
+esp_err_t telemetry_store_append(const aws_iot_event_t *evt)
+{
+    telemetry_op_t op = {
+        .type = TELEMETRY_OP_APPEND,
+        .u.evt = *evt,
+    };
+    if (!ts.queue || xQueueSend(ts.queue, &op, 0) != pdTRUE) {
+        telemetry_drop(1);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t telemetry_store_call(void (*fn)(void *), void *arg)
+{
+    telemetry_op_t op = {
+        .type = TELEMETRY_OP_CALL,
+        .u.call = { fn, arg },
+    };
+    if (!ts.queue) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xQueueSend(ts.queue, &op, 0) != pdTRUE) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+int telemetry_store_peek(telemetry_entry_t *entries, int max)
+{
+    int n = 0;
+
+    if (!ts.lock) {
+        return 0;
+    }
+    xSemaphoreTake(ts.lock, portMAX_DELAY);
+    for (uint32_t lsn = ts.tail; n < max && lsn != ts.head; lsn++) {
+        const telemetry_slot_t *slot = telemetry_slot(lsn);
+        if (!telemetry_slot_valid(slot, lsn)) {
+            if (n == 0) {
+                /* Nothing before it to deliver, so don't let it block the log */
+                ts.tail = lsn + 1;
+                telemetry_drop(1);
+            }
+            continue;
+        }
+        entries[n].lsn = lsn;
+        entries[n].evt.boot = slot->boot;
+        entries[n].evt.seq = slot->seq;
+        entries[n].evt.timestamp = slot->timestamp;
+        entries[n].evt.type = slot->type;
+        entries[n].evt.value = slot->value;
+        n++;
+    }
+    xSemaphoreGive(ts.lock);
+    return n;
+}
+
+void telemetry_store_ack(uint32_t lsn)
+{
+    telemetry_op_t op = {
+        .type = TELEMETRY_OP_ACK,
+        .u.lsn = lsn,
+    };
+
+    if (!ts.lock) {
+        return;
+    }
+    xSemaphoreTake(ts.lock, portMAX_DELAY);
+    /* Ignore acks for records that were recycled while being delivered */
+    if ((int32_t)(lsn - ts.tail) >= 0 && (int32_t)(ts.head - lsn) > 0) {
+        ts.tail = lsn + 1;
+    }
+    xSemaphoreGive(ts.lock);
+    /* If this gets dropped, the next ack marks the whole range anyway */
+    xQueueSend(ts.queue, &op, 0);
+}
+
+uint32_t telemetry_store_pending()
+{
+    uint32_t pending;
+
+    if (!ts.lock) {
+        return 0;
+    }
+    xSemaphoreTake(ts.lock, portMAX_DELAY);
+    pending = ts.head - ts.tail;
+    xSemaphoreGive(ts.lock);
+    return pending;
+}
+
+void telemetry_store_get_stats(telemetry_store_stats_t *stats)
+{
+    if (!ts.lock) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    xSemaphoreTake(ts.lock, portMAX_DELAY);
+    portENTER_CRITICAL(&ts.drop_lock);
+    *stats = ts.stats;
+    portEXIT_CRITICAL(&ts.drop_lock);
+    xSemaphoreGive(ts.lock);
+    stats->enabled = true;
+}
@@ -0,0 +1,111 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TELEMETRY_STORE_H_
+#define _TELEMETRY_STORE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "app_aws_iot.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Custom data subtype of the "telemetry" partition in partitions.csv */
+#define TELEMETRY_PARTITION_SUBTYPE 0x40
+#define TELEMETRY_PARTITION_LABEL   "telemetry"
+
+typedef struct telemetry_store_stats {
+    bool enabled;
+    uint32_t writes;            /*!< records written since boot */
+    uint32_t erases;
+    uint32_t max_erase_us;      /*!< longest erase, the audio stalls this long */
+    uint32_t deferred;          /*!< writes that waited for the audio to go quiet to erase */
+    uint32_t max_defer_ms;
+    uint32_t dropped;           /*!< events lost to a full queue, a full log or a bad record */
+} telemetry_store_stats_t;
+
+typedef struct telemetry_entry {
+    uint32_t lsn;               /*!< position in the log, used to acknowledge it */
+    aws_iot_event_t evt;
+} telemetry_entry_t;
+
+/**
+ * @brief  mount the telemetry log and start the task that writes it
+ *
+ * Must be called from a task with its stack in internal RAM, since it reads
+ * and updates NVS.
+ */
+esp_err_t telemetry_store_init();
+
+/**
+ * @brief  boot counter, which together with the event sequence number
+ *         identifies an event for de-duplication on the cloud side
+ */
+uint32_t telemetry_store_get_boot_id();
+
+/**
+ * @brief  queue an event to be appended to the log
+ *
+ * Never blocks. The flash write happens later from the telemetry task, so
+ * this is safe to call from the audio path and from tasks with PSRAM stacks.
+ */
+esp_err_t telemetry_store_append(const aws_iot_event_t *evt);
+
+/**
+ * @brief  run fn from the telemetry task
+ *
+ * For the other flash writes of the AWS IoT side: the telemetry task has
+ * its stack in internal RAM and already serialises the log writes. Never
+ * blocks.
+ *
+ * @return ESP_FAIL if the queue is full, ESP_ERR_INVALID_STATE if the store
+ *         isn't running
+ */
+esp_err_t telemetry_store_call(void (*fn)(void *), void *arg);
+
+/**
+ * @brief  copy up to max of the oldest unacknowledged entries
+ *
+ * @return number of entries copied
+ */
+int telemetry_store_peek(telemetry_entry_t *entries, int max);
+
+/**
+ * @brief  mark every entry up to and including lsn as delivered
+ */
+void telemetry_store_ack(uint32_t lsn);
+
+/**
+ * @brief  number of entries waiting to be delivered
+ */
+uint32_t telemetry_store_pending();
+
+void telemetry_store_get_stats(telemetry_store_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TELEMETRY_STORE_H_ */
@@ -25,10 +25,10 @@
 #include <nvs_flash.h>
 #include <esp_timer.h>
 #include <speaker.h>
-#include <mem_utils.h>
 #include <alexa_app_cb.h>
 #include <app_dsp.h>
 #include "ui_button.h"
+#include "app_tasks.h"
 #include <ui_led.h>
         
 #define UI_BUTTON_QUEUE_LENGTH 1
@@ -107,15 +107,12 @@ esp_err_t ui_button_init()
         return ESP_FAIL;
     }
     ui_button_gpio_init();
-    StackType_t *ui_button_task_stack = (StackType_t *)mem_alloc(UI_BUTTON_TASK_BUFFER_SZ, EXTERNAL);
-    static StaticTask_t ui_button_task_buf;
     button_st.ui_button_sem = xSemaphoreCreateBinary();
     if (button_st.ui_button_sem == NULL) {
         ESP_LOGE(UI_BUTTON_TAG, "Could not create queue");
         return ESP_FAIL;
     }
-    button_st.ui_button_task_handle = xTaskCreateStatic(ui_button_task, "ui-button-thread", UI_BUTTON_TASK_BUFFER_SZ,
-                                      NULL, CONFIG_ESP32_PTHREAD_TASK_PRIO_DEFAULT, ui_button_task_stack, &ui_button_task_buf);
+    button_st.ui_button_task_handle = app_task_create(APP_TASK_UI_BUTTON, ui_button_task, NULL);
     if (button_st.ui_button_task_handle == NULL) {
         ESP_LOGE(UI_BUTTON_TAG, "Could not create button task");
         return ESP_FAIL;
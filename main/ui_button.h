@@ -36,8 +36,6 @@
 extern "C" {
 #endif
 
-#define UI_BUTTON_TASK_BUFFER_SZ (8 * 1024)
-
 #define GPIO_RECORD_BUTTON 0
 #define GPIO_MODE_BUTTON   39
 #define ESP_INTR_FLAG_DEFAULT        0
@@ -0,0 +1,49 @@
+/*
+ *      Copyright 2018, Espressif Systems (Shanghai) Pte Ltd.
+ *  All rights regarding this code and its modifications reserved.
+ *
+ * This code contains confidential information of Espressif Systems
+ * (Shanghai) Pte Ltd. No licenses or other rights express or implied,
+ * by estoppel or otherwise are granted herein.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <esp_wwe.h>
+#include <wake_engine.h>
+
+/* ESP-WWE only says hit or miss, and keeps no state worth resetting */
+
+static int wwe_init(void)
+{
+    return esp_wwe_init() == ESP_OK ? 0 : -1;
+}
+
+static void wwe_detect(int16_t *samples, int chunks, uint8_t *confidence)
+{
+    int chunk = esp_wwe_get_sample_chunksize();
+
+    for (int i = 0; i < chunks; i++) {
+        confidence[i] = esp_wwe_detect(samples + i * chunk) ? WAKE_ENGINE_CONFIDENCE_MAX : 0;
+    }
+}
+
+const wake_engine_t wake_engine_esp_wwe = {
+    .name = "esp-wwe",
+    .init = wwe_init,
+    .sample_rate = esp_wwe_get_sample_rate,
+    .chunk_samples = esp_wwe_get_sample_chunksize,
+    .max_batch = 1,
+    .detect = wwe_detect,
+};
@@ -0,0 +1,402 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+/*
+ * Host loopback test of wake word arbitration.
+ *
+ * Runs -n devices as threads, each with the wake_arbiter core and its own
+ * sockets in a multicast group on the loopback interface, the way
+ * app_wake_arbiter.c does on the LAN. Every trial puts the talker at a
+ * random distance from each device, which sets its level and so its score,
+ * and each device detects the wake word after the sound reaches it plus up
+ * to -j ms of engine jitter. A device misses the wake word with -m
+ * probability and drops each message it receives with -l probability.
+ * Trials are spaced so that one trial's win, held for -H ms, doesn't
+ * suppress the next.
+ *
+ * Prints how often exactly one device won, and whether it was the one that
+ * heard the wake word best, and the latency arbitration added to the win.
+ *
+ * Build from the repository root:
+ *   cc -O2 -pthread -o arb_sim -Icomponents/audio_dsp tools/arb_sim.c \
+ *      components/audio_dsp/wake_arbiter.c -lm
+ *
+ * Usage:
+ *   arb_sim [-n devices] [-t trials] [-w window_ms] [-j jitter_ms] [-H hold_ms]
+ *           [-m miss] [-l loss] [-p port]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+#include "wake_arbiter.h"
+
+#define MAX_DEVICES     WAKE_ARBITER_MAX_PEERS
+#define GROUP           "239.255.77.77"
+#define HELLOS          3
+#define HELLO_GAP_MS    20
+/* Talker's level at 1 m and the room's noise floor, mean absolute */
+#define LEVEL_1M        3000
+#define NOISE_FLOOR     60
+#define SOUND_M_PER_MS  0.343
+
+typedef struct device {
+    int index;
+    pthread_t thread;
+    wake_arbiter_t arb;
+    int rx_fd;
+    int tx_fd;
+    unsigned int seed;
+    /* Set by main for each trial */
+    bool detects;
+    uint32_t detect_ms;         /* after the trial start */
+    uint32_t score;
+    /* Set by the device */
+    wake_arbiter_result_t result;
+    uint32_t decide_ms;
+} device_t;
+
+static device_t devices[MAX_DEVICES];
+static int n_devices = 4;
+static int trials = 100;
+static int window_ms = 100;
+static int jitter_ms = 80;
+static int hold_ms = 500;
+static double miss_p;
+static double loss_p;
+static int port = 41235;
+static struct sockaddr_in group;
+static pthread_barrier_t barrier;
+static uint32_t trial_start_ms;
+static struct timespec t0;
+
+static uint32_t now_ms()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - t0.tv_sec) * 1000 + (t.tv_nsec - t0.tv_nsec) / 1000000;
+}
+
+/* Long enough for the last win to be announced and its hold to run out,
+ * with margin for the sound to travel */
+static int trial_ms()
+{
+    return jitter_ms + window_ms + hold_ms + 100;
+}
+
+static void send_msg(device_t *d, const wake_arbiter_msg_t *msg)
+{
+    sendto(d->tx_fd, msg, sizeof(*msg), 0, (struct sockaddr *) &group, sizeof(group));
+}
+
+/* Takes in whatever arrives until until_ms, or until a pending claim is due */
+static void receive(device_t *d, uint32_t until_ms)
+{
+    uint8_t buf[sizeof(wake_arbiter_msg_t) + 1];
+    struct timeval tv;
+    fd_set fds;
+    int32_t wait, due;
+    ssize_t n;
+
+    for (;;) {
+        wait = (int32_t) (until_ms - now_ms());
+        due = wake_arbiter_timeout(&d->arb, now_ms());
+        if (due >= 0 && due < wait) {
+            wait = due;
+        }
+        if (wait <= 0) {
+            return;
+        }
+        tv.tv_sec = wait / 1000;
+        tv.tv_usec = (wait % 1000) * 1000;
+        FD_ZERO(&fds);
+        FD_SET(d->rx_fd, &fds);
+        if (select(d->rx_fd + 1, &fds, NULL, NULL, &tv) <= 0) {
+            continue;
+        }
+        n = recv(d->rx_fd, buf, sizeof(buf), 0);
+        if (n <= 0 || (double) rand_r(&d->seed) / RAND_MAX < loss_p) {
+            continue;
+        }
+        if (wake_arbiter_receive(&d->arb, buf, n, now_ms()) == WAKE_ARBITER_LOSE && !d->decide_ms) {
+            d->result = WAKE_ARBITER_LOSE;
+            d->decide_ms = now_ms() - (trial_start_ms + d->detect_ms);
+            return;
+        }
+    }
+}
+
+static void run_trial(device_t *d)
+{
+    uint32_t end_ms = trial_start_ms + trial_ms();
+    wake_arbiter_msg_t msg;
+    wake_arbiter_result_t r;
+
+    d->result = WAKE_ARBITER_IDLE;
+    d->decide_ms = 0;
+    if (d->detects) {
+        receive(d, trial_start_ms + d->detect_ms);
+        r = wake_arbiter_claim(&d->arb, d->score, now_ms(), &msg);
+        send_msg(d, &msg);
+        while (r == WAKE_ARBITER_PENDING) {
+            receive(d, end_ms);
+            if (d->result == WAKE_ARBITER_LOSE) {
+                break;
+            }
+            r = wake_arbiter_poll(&d->arb, now_ms(), &msg);
+            if (r == WAKE_ARBITER_WIN) {
+                send_msg(d, &msg);
+            }
+        }
+        if (d->result != WAKE_ARBITER_LOSE) {
+            d->result = r;
+            d->decide_ms = now_ms() - (trial_start_ms + d->detect_ms);
+        }
+        wake_arbiter_done(&d->arb);
+    }
+    receive(d, end_ms);
+}
+
+static void *device_task(void *arg)
+{
+    device_t *d = arg;
+    wake_arbiter_msg_t msg;
+
+    for (int i = 0; i < HELLOS; i++) {
+        wake_arbiter_hello(&d->arb, &msg);
+        send_msg(d, &msg);
+        receive(d, now_ms() + HELLO_GAP_MS);
+    }
+    for (int t = 0; t < trials; t++) {
+        pthread_barrier_wait(&barrier);     /* main has set up the trial */
+        run_trial(d);
+        pthread_barrier_wait(&barrier);     /* done, main collects */
+    }
+    return NULL;
+}
+
+static int device_open(device_t *d)
+{
+    struct sockaddr_in local = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    struct ip_mreq mreq = {
+        .imr_multiaddr = group.sin_addr,
+    };
+    struct in_addr lo = {
+        .s_addr = htonl(INADDR_LOOPBACK),
+    };
+    wake_arbiter_config_t cfg = {
+        .device_id = 0x1000 + d->index,
+        .window_ms = window_ms,
+        .hold_ms = hold_ms,
+        .peer_timeout_ms = 0,
+    };
+    unsigned char loop = 1, ttl = 0;
+    int on = 1;
+
+    wake_arbiter_init(&d->arb, &cfg);
+    mreq.imr_interface = lo;
+    d->rx_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    d->tx_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (d->rx_fd < 0 || d->tx_fd < 0) {
+        return -1;
+    }
+    setsockopt(d->rx_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#ifdef SO_REUSEPORT
+    setsockopt(d->rx_fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+#endif
+    if (bind(d->rx_fd, (struct sockaddr *) &local, sizeof(local)) != 0 ||
+            setsockopt(d->rx_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0) {
+        return -1;
+    }
+    /* Every device is on this host, so the sender's own copy is the others' */
+    setsockopt(d->tx_fd, IPPROTO_IP, IP_MULTICAST_IF, &lo, sizeof(lo));
+    setsockopt(d->tx_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    setsockopt(d->tx_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    return 0;
+}
+
+static double uniform(double lo, double hi)
+{
+    return lo + (hi - lo) * rand() / RAND_MAX;
+}
+
+/* Places the talker and decides who hears what; returns the best device, -1 if none */
+static int setup_trial()
+{
+    int best = -1;
+
+    for (int i = 0; i < n_devices; i++) {
+        device_t *d = &devices[i];
+        double dist_m = uniform(0.5, 6);
+        uint32_t level = LEVEL_1M / dist_m;
+        uint32_t floor = NOISE_FLOOR * uniform(0.8, 1.25);
+
+        d->detects = uniform(0, 1) >= miss_p;
+        d->detect_ms = dist_m / SOUND_M_PER_MS + uniform(0, jitter_ms);
+        /* Engine confidence tracks the SNR, loosely */
+        d->score = wake_arbiter_score(level, floor, 255 - dist_m * 15 + uniform(-20, 20));
+        if (d->detects && (best < 0 || d->score > devices[best].score ||
+                           (d->score == devices[best].score && d->arb.cfg.device_id > devices[best].arb.cfg.device_id))) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    int one = 0, none = 0, many = 0, right = 0, nobody = 0;
+    uint64_t win_ms_total = 0, decide_ms_total = 0;
+    uint32_t win_ms_max = 0, decided = 0;
+    wake_arbiter_stats_t stats;
+    uint32_t losses = 0, suppressed = 0;
+
+    while ((opt = getopt(argc, argv, "n:t:w:j:H:m:l:p:")) != -1) {
+        switch (opt) {
+        case 'n':
+            n_devices = atoi(optarg);
+            break;
+        case 't':
+            trials = atoi(optarg);
+            break;
+        case 'w':
+            window_ms = atoi(optarg);
+            break;
+        case 'j':
+            jitter_ms = atoi(optarg);
+            break;
+        case 'H':
+            hold_ms = atoi(optarg);
+            break;
+        case 'm':
+            miss_p = atof(optarg);
+            break;
+        case 'l':
+            loss_p = atof(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n devices] [-t trials] [-w window_ms] [-j jitter_ms] [-H hold_ms] "
+                    "[-m miss] [-l loss] [-p port]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (n_devices < 1 || n_devices > MAX_DEVICES) {
+        fprintf(stderr, "1 to %d devices\n", MAX_DEVICES);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    srand(time(NULL));
+    group.sin_family = AF_INET;
+    group.sin_port = htons(port);
+    inet_aton(GROUP, &group.sin_addr);
+    pthread_barrier_init(&barrier, NULL, n_devices + 1);
+    for (int i = 0; i < n_devices; i++) {
+        devices[i].index = i;
+        devices[i].seed = rand();
+        if (device_open(&devices[i]) != 0) {
+            perror("device sockets");
+            return 1;
+        }
+    }
+    for (int i = 0; i < n_devices; i++) {
+        pthread_create(&devices[i].thread, NULL, device_task, &devices[i]);
+    }
+    usleep((HELLOS + 1) * HELLO_GAP_MS * 1000);
+
+    for (int t = 0; t < trials; t++) {
+        int best = setup_trial();
+        int winners = 0, winner = -1;
+
+        trial_start_ms = now_ms() + 5;
+        pthread_barrier_wait(&barrier);
+        pthread_barrier_wait(&barrier);
+
+        for (int i = 0; i < n_devices; i++) {
+            device_t *d = &devices[i];
+            if (d->result == WAKE_ARBITER_WIN) {
+                winners++;
+                winner = i;
+            }
+            if (d->result != WAKE_ARBITER_IDLE) {
+                decide_ms_total += d->decide_ms;
+                decided++;
+            }
+        }
+        if (best < 0) {
+            nobody++;
+            continue;
+        }
+        if (winners == 1) {
+            one++;
+            right += winner == best;
+            win_ms_total += devices[winner].decide_ms;
+            if (devices[winner].decide_ms > win_ms_max) {
+                win_ms_max = devices[winner].decide_ms;
+            }
+        } else if (winners == 0) {
+            none++;
+        } else {
+            many++;
+        }
+    }
+    for (int i = 0; i < n_devices; i++) {
+        pthread_join(devices[i].thread, NULL);
+        wake_arbiter_get_stats(&devices[i].arb, &stats, now_ms());
+        losses += stats.losses;
+        suppressed += stats.suppressed;
+        close(devices[i].rx_fd);
+        close(devices[i].tx_fd);
+    }
+
+    trials -= nobody;
+    printf("%d devices, %d trials with a detection, window %d ms, jitter %d ms, miss %.2f, loss %.2f\n",
+           n_devices, trials, window_ms, jitter_ms, miss_p, loss_p);
+    if (!trials) {
+        return 0;
+    }
+    printf("one winner %.1f%%, none %d, several %d\n", 100.0 * one / trials, none, many);
+    printf("winner heard it best %.1f%% of trials\n", 100.0 * right / trials);
+    if (one) {
+        printf("winner's added latency avg %.1f ms, max %u ms\n", (double) win_ms_total / one, win_ms_max);
+    }
+    if (decided) {
+        printf("all claims decided in avg %.1f ms; lost %u to better claims, %u to wins\n",
+               (double) decide_ms_total / decided, losses, suppressed);
+    }
+    return many || none ? 2 : 0;
+}
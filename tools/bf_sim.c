@@ -0,0 +1,226 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+/*
+ * Host simulation of the audio_dsp two microphone beamformer.
+ *
+ * Places a clean recording at an angle from broadside, adds noise to both
+ * microphones (uncorrelated, or from a second direction with -j), runs the
+ * beamformer on the resulting stereo capture in 20 ms blocks, and reports
+ * the SNR at one microphone against the SNR of the beamformer output, the
+ * tracked steering delay and the time per block. Recordings must be 16 kHz
+ * 16-bit mono WAV; -w saves the synthetic stereo capture.
+ *
+ * Build from the repository root:
+ *   cc -O2 -o bf_sim -Icomponents/audio_dsp tools/bf_sim.c tools/wav_io.c \
+ *      components/audio_dsp/fft.c components/audio_dsp/beamformer.c -lm
+ *
+ * Usage:
+ *   bf_sim [-a deg] [-j deg] [-d spacing_mm] [-s snr_db] [-b] [-w stereo.wav] noise.wav clean.wav
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "beamformer.h"
+#include "wav_io.h"
+
+#define BLOCK           320
+#define SOUND_M_PER_S   343.0
+#define SINC_TAPS       32
+
+/* x delayed by a fractional number of samples, windowed sinc */
+static double *frac_delay(const double *x, size_t len, double delay)
+{
+    double *y = calloc(len, sizeof(double));
+    int di = floor(delay);
+    double f = delay - di;
+
+    for (size_t n = 0; n < len; n++) {
+        double acc = 0;
+        for (int t = -SINC_TAPS / 2; t < SINC_TAPS / 2; t++) {
+            long i = (long) n - di - t;
+            if (i < 0 || i >= (long) len) {
+                continue;
+            }
+            double u = t - f;
+            double sinc = (fabs(u) < 1e-9) ? 1 : sin(M_PI * u) / (M_PI * u);
+            double w = 0.5 * (1 + cos(M_PI * u / (SINC_TAPS / 2 + 1)));
+            acc += x[i] * sinc * w;
+        }
+        y[n] = acc;
+    }
+    return y;
+}
+
+static double power(const double *x, size_t len)
+{
+    double e = 0;
+    for (size_t i = 0; i < len; i++) {
+        e += x[i] * x[i];
+    }
+    return e / len;
+}
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-a deg] [-j deg] [-d spacing_mm] [-s snr_db] [-b] [-w stereo.wav] noise.wav clean.wav\n", prog);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    double angle = 40, jam_angle = NAN, snr_db = 0;
+    int spacing_mm = 65, opt;
+    beamformer_mode_t mode = BEAMFORMER_STEERED;
+    const char *stereo_path = NULL;
+    wav_t noise, clean;
+
+    while ((opt = getopt(argc, argv, "a:j:d:s:bw:")) != -1) {
+        switch (opt) {
+        case 'a':
+            angle = atof(optarg);
+            break;
+        case 'j':
+            jam_angle = atof(optarg);
+            break;
+        case 'd':
+            spacing_mm = atoi(optarg);
+            break;
+        case 's':
+            snr_db = atof(optarg);
+            break;
+        case 'b':
+            mode = BEAMFORMER_BROADSIDE;
+            break;
+        case 'w':
+            stereo_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2 || wav_read(argv[optind], &noise) != 0 || wav_read(argv[optind + 1], &clean) != 0) {
+        usage(argv[0]);
+    }
+
+    size_t len = clean.len;
+    double *src = calloc(len, sizeof(double));
+    double *n1 = malloc(len * sizeof(double)), *n2;
+    for (size_t i = 0; i < len; i++) {
+        src[i] = clean.data[i];
+        n1[i] = noise.data[i % noise.len];
+    }
+    double spacing_samples = spacing_mm / 1000.0 * WAV_SAMP_RATE / SOUND_M_PER_S;
+    double delay = spacing_samples * sin(angle * M_PI / 180);
+    double *s1 = frac_delay(src, len, 0);
+    double *s2 = frac_delay(src, len, delay);
+    if (isnan(jam_angle)) {
+        /* Uncorrelated: the second mic hears a different stretch of the noise */
+        n2 = malloc(len * sizeof(double));
+        for (size_t i = 0; i < len; i++) {
+            n2[i] = noise.data[(i + noise.len / 2) % noise.len];
+        }
+    } else {
+        n2 = frac_delay(n1, len, spacing_samples * sin(jam_angle * M_PI / 180));
+    }
+    double scale = sqrt(power(s1, len) / (power(n1, len) * pow(10, snr_db / 10)));
+
+    int16_t *cap = malloc(len * 2 * sizeof(int16_t));
+    for (size_t i = 0; i < len; i++) {
+        double l = s1[i] + n1[i] * scale, r = s2[i] + n2[i] * scale;
+        cap[2 * i] = fmax(INT16_MIN, fmin(INT16_MAX, lround(l)));
+        cap[2 * i + 1] = fmax(INT16_MIN, fmin(INT16_MAX, lround(r)));
+    }
+    if (stereo_path) {
+        wav_write(stereo_path, cap, len, 2);
+    }
+
+    beamformer_config_t cfg = {
+        .mode = mode,
+        .mic_spacing_mm = spacing_mm,
+        .sample_rate = WAV_SAMP_RATE,
+    };
+    beamformer_t *bf = beamformer_create(&cfg);
+    beamformer_stats_t stats;
+    if (!bf) {
+        fprintf(stderr, "Unsupported mic spacing\n");
+        return 1;
+    }
+    int16_t *mono = malloc(len * sizeof(int16_t));
+    double total_ns = 0, max_ns = 0;
+    uint64_t total_cycles = 0;
+    int blocks = 0;
+    for (size_t s = 0; s + BLOCK <= len; s += BLOCK) {
+        int16_t block[2 * BLOCK];
+        memcpy(block, cap + 2 * s, sizeof(block));
+        double t = now_ns();
+#ifdef HAVE_TSC
+        uint64_t c = __rdtsc();
+#endif
+        beamformer_process(bf, block, BLOCK);
+#ifdef HAVE_TSC
+        total_cycles += __rdtsc() - c;
+#endif
+        t = now_ns() - t;
+        total_ns += t;
+        max_ns = fmax(max_ns, t);
+        memcpy(mono + s, block, BLOCK * sizeof(int16_t));
+        blocks++;
+    }
+    beamformer_get_stats(bf, &stats);
+    beamformer_destroy(bf);
+
+    /* Everything that isn't the source as heard by the first mic counts as
+     * noise, including steering errors. Skip the first second while the
+     * steering settles. */
+    size_t lat = BF_MAX_LAG + 1, skip = WAV_SAMP_RATE, end = blocks * BLOCK;
+    double sig = 0, err_in = 0, err_out = 0;
+    for (size_t i = skip; i < end; i++) {
+        sig += s1[i - lat] * s1[i - lat];
+        err_in += (cap[2 * i] - s1[i]) * (cap[2 * i] - s1[i]);
+        err_out += (mono[i] - s1[i - lat]) * (mono[i] - s1[i - lat]);
+    }
+    double snr_in = 10 * log10(sig / err_in), snr_out = 10 * log10(sig / err_out);
+
+    printf("source %.0f deg, true delay %.2f samples, tracked %.2f samples (%u/%u frames updated)\n",
+           angle, delay, stats.delay_q8 / 256.0, stats.updates, stats.frames);
+    printf("snr at mic: %.2f dB, beamformer: %.2f dB, gain %.2f dB\n", snr_in, snr_out, snr_out - snr_in);
+    printf("per %d-sample block: %.1f us", BLOCK, total_ns / blocks / 1000);
+#ifdef HAVE_TSC
+    printf(", %.0f host cycles", (double) total_cycles / blocks);
+#endif
+    printf("; worst %.1f us\n", max_ns / 1000);
+    return 0;
+}
@@ -0,0 +1,206 @@
+#!/usr/bin/env python
+#
+# Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+"""Collect capture tap streams from the device into WAV files.
+
+Listens for the TCP connection made by the "tap start" console command (see
+main/app_capture_tap.c) and writes each stream of each connection to
+PREFIX-N-raw.wav and PREFIX-N-processed.wav, N counting connections. Frames
+the device dropped show up as gaps in the sequence numbers; they are filled
+with silence so the files stay aligned in time, and listed together with
+the frame timestamps in PREFIX-N.json. A change of format mid-stream starts
+a new file, PREFIX-N-raw-1.wav and so on.
+
+    capture_tap_recv.py -o field-unit
+    (device) tap start 192.168.1.10 5005 raw processed
+
+Only depends on the standard library.
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import socket
+import struct
+import sys
+import wave
+
+# components/audio_dsp/capture_tap.h
+MAGIC = 0x50415443
+VERSION = 1
+HEADER = struct.Struct('<IBBBBIIIQ')
+STREAMS = ('raw', 'processed')
+
+MAX_GAPS_LISTED = 1000
+
+
+class TapError(ValueError):
+    pass
+
+
+class Stream(object):
+    def __init__(self, prefix, name):
+        self.prefix = prefix
+        self.name = name
+        self.wav = None
+        self.fmt = None
+        self.files = []
+        self.next_seq = None
+        self.last_len = 0
+        self.last_ts = None
+        self.frames = 0
+        self.bytes = 0
+        self.lost_frames = 0
+        self.gaps = []
+        self.first_ts_us = None
+        self.max_interval_us = 0
+
+    def open(self, fmt):
+        sample_rate, bits, channels = fmt
+        path = '%s-%s.wav' % (self.prefix, self.name)
+        if self.files:
+            path = '%s-%s-%d.wav' % (self.prefix, self.name, len(self.files))
+        self.close()
+        self.wav = wave.open(path, 'wb')
+        self.wav.setnchannels(channels)
+        self.wav.setsampwidth(bits // 8)
+        self.wav.setframerate(sample_rate)
+        self.fmt = fmt
+        self.files.append({'path': path, 'sample_rate': sample_rate, 'bits': bits, 'channels': channels})
+
+    def close(self):
+        if self.wav:
+            self.wav.close()
+            self.wav = None
+
+    def add(self, seq, fmt, ts_us, pcm):
+        if fmt != self.fmt:
+            self.open(fmt)
+        if self.next_seq is not None and seq != self.next_seq:
+            missing = (seq - self.next_seq) & 0xffffffff
+            self.lost_frames += missing
+            if len(self.gaps) < MAX_GAPS_LISTED:
+                self.gaps.append({'seq': self.next_seq, 'frames': missing, 'ts_us': ts_us})
+            # Same length as the last frame, the device pushes fixed size buffers
+            self.wav.writeframes(b'\0' * (self.last_len * missing))
+        if self.last_ts is not None:
+            self.max_interval_us = max(self.max_interval_us, ts_us - self.last_ts)
+        if self.first_ts_us is None:
+            self.first_ts_us = ts_us
+        self.wav.writeframes(pcm)
+        self.next_seq = (seq + 1) & 0xffffffff
+        self.last_len = len(pcm)
+        self.last_ts = ts_us
+        self.frames += 1
+        self.bytes += len(pcm)
+
+    def metadata(self):
+        return {
+            'files': self.files,
+            'frames': self.frames,
+            'bytes': self.bytes,
+            'lost_frames': self.lost_frames,
+            'gaps': self.gaps,
+            'first_ts_us': self.first_ts_us,
+            'last_ts_us': self.last_ts,
+            'max_interval_us': self.max_interval_us,
+        }
+
+
+def recv_exact(conn, n):
+    buf = b''
+    while len(buf) < n:
+        chunk = conn.recv(n - len(buf))
+        if not chunk:
+            return None
+        buf += chunk
+    return buf
+
+
+def collect(conn, prefix):
+    """Write one connection's frames out, returns the metadata."""
+    streams = [Stream(prefix, name) for name in STREAMS]
+    error = None
+    try:
+        while True:
+            hdr = recv_exact(conn, HEADER.size)
+            if hdr is None:
+                break
+            magic, version, stream, bits, channels, seq, sample_rate, length, ts_us = HEADER.unpack(hdr)
+            if magic != MAGIC or version != VERSION:
+                raise TapError('bad frame header, magic %08x version %d' % (magic, version))
+            if stream >= len(STREAMS) or bits not in (16, 32) or not channels:
+                raise TapError('unsupported frame: stream %d, %d bits, %d channels' % (stream, bits, channels))
+            pcm = recv_exact(conn, (length + 3) & ~3)
+            if pcm is None:
+                break
+            streams[stream].add(seq, (sample_rate, bits, channels), ts_us, pcm[:length])
+    except (TapError, socket.error) as e:
+        error = str(e)
+    except KeyboardInterrupt:
+        error = 'interrupted'
+    finally:
+        for s in streams:
+            s.close()
+    meta = dict((s.name, s.metadata()) for s in streams if s.frames)
+    if error:
+        meta['error'] = error
+    return meta
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-o', '--prefix', default='tap', help='output file prefix (default: tap)')
+    parser.add_argument('-p', '--port', type=int, default=5005, help='TCP port (default: 5005)')
+    parser.add_argument('-b', '--bind', default='0.0.0.0', help='address to listen on')
+    parser.add_argument('--once', action='store_true', help='exit after the first connection closes')
+    args = parser.parse_args()
+
+    srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind((args.bind, args.port))
+    srv.listen(1)
+    print('Listening on %s:%d' % (args.bind, args.port))
+
+    n = 0
+    try:
+        while True:
+            conn, addr = srv.accept()
+            prefix = '%s-%d' % (args.prefix, n)
+            print('%s:%d connected, writing %s-*' % (addr[0], addr[1], prefix))
+            meta = collect(conn, prefix)
+            conn.close()
+            meta['peer'] = addr[0]
+            with open(prefix + '.json', 'w') as f:
+                json.dump(meta, f, indent=2, sort_keys=True)
+            for name in STREAMS:
+                if name in meta:
+                    print('  %s: %d frames, %d lost' % (name, meta[name]['frames'], meta[name]['lost_frames']))
+            if 'error' in meta:
+                print('  stopped on error: %s' % meta['error'], file=sys.stderr)
+            n += 1
+            if args.once or meta.get('error') == 'interrupted':
+                break
+    except KeyboardInterrupt:
+        pass
+    finally:
+        srv.close()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,537 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+/*
+ * Host benchmark for the on-device command spotter.
+ *
+ * Enrolls templates from some recordings and streams others through
+ * cmd_spot in 20 ms frames, as read_rb_task does after a wake word. A file
+ * stands for the audio just after the wake word; its first 200 ms are fed
+ * once beforehand to settle the VAD, so it should start with a little
+ * background noise. Reports how many commands were acted on locally, and
+ * correctly, how much other speech was wrongly taken for a command, the
+ * decision latency after the end of speech, how long audio is held before
+ * falling through to the cloud, and the CPU per frame and per match.
+ *
+ * The corpus is a list file with one recording per line:
+ *   <wav> enroll <command>
+ *   <wav> test <command>|none [speech_end_ms]
+ * Paths are relative to the list file, '#' starts a comment. Recordings
+ * must be 16 kHz 16-bit mono WAV. Without speech_end_ms the end of speech
+ * is taken as the last frame within 20 dB of the loudest.
+ *
+ * With -S instead of a corpus it makes up commands from synthetic vowels
+ * and fricatives, which checks the plumbing and gives the CPU figures but
+ * says little about accuracy on real speech.
+ *
+ * Build from the repository root:
+ *   cc -O2 -o cmd_bench -Icomponents/audio_dsp tools/cmd_bench.c tools/wav_io.c \
+ *      components/audio_dsp/cmd_spot.c components/audio_dsp/endpoint.c components/audio_dsp/fft.c -lm
+ *
+ * Usage:
+ *   cmd_bench [-d max_distance] [-m margin_pct] [-t trailing_ms] -S | corpus.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cmd_spot.h"
+#include "wav_io.h"
+
+#define FRAME           (WAV_SAMP_RATE / 50)
+#define FRAME_MS        20
+#define PRIME_MS        200
+#define NO_SPEECH_MS    1500
+#define MAX_LABELS      16
+/* Defaults as in Kconfig */
+#define DEFAULT_MAX_DISTANCE    40
+#define DEFAULT_MARGIN_PCT      20
+#define DEFAULT_TRAILING_MS     300
+/* Synthetic corpus */
+#define SYN_ENROLL      3
+#define SYN_TESTS       20
+#define SYN_OTHERS      60
+#define SYN_LEAD_MS     300
+#define SYN_TAIL_MS     1000
+
+typedef struct {
+    char *path;
+    int16_t *data;
+    size_t len;
+    bool enroll;
+    int label;              /* -1 for speech that isn't a command */
+    int end_ms;             /* -1 if not labelled */
+} entry_t;
+
+static char labels[MAX_LABELS][32];
+static int n_labels;
+static cmd_spot_config_t cfg = {
+    .sample_rate = WAV_SAMP_RATE,
+    .max_distance = DEFAULT_MAX_DISTANCE,
+    .margin_pct = DEFAULT_MARGIN_PCT,
+    .trailing_silence_ms = DEFAULT_TRAILING_MS,
+    .no_speech_ms = NO_SPEECH_MS,
+};
+
+static double *frame_us;
+static size_t frames, frames_cap;
+static double match_us_sum, match_us_max;
+static int matches;
+
+static double now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int label_id(const char *name)
+{
+    for (int i = 0; i < n_labels; i++) {
+        if (!strcmp(labels[i], name)) {
+            return i;
+        }
+    }
+    if (n_labels == MAX_LABELS) {
+        return -2;
+    }
+    snprintf(labels[n_labels], sizeof(labels[0]), "%s", name);
+    return n_labels++;
+}
+
+static int load_corpus(const char *list, entry_t **entries)
+{
+    char line[1024], dir[1024] = "";
+    const char *slash = strrchr(list, '/');
+    int n = 0, cap = 0, lineno = 0;
+    FILE *f = fopen(list, "r");
+
+    if (!f) {
+        perror(list);
+        return -1;
+    }
+    if (slash) {
+        snprintf(dir, sizeof(dir), "%.*s/", (int) (slash - list), list);
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char path[1024], kind[8], name[32];
+        int end_ms = -1, label = -1;
+        char *hash = strchr(line, '#');
+        wav_t wav;
+
+        lineno++;
+        if (hash) {
+            *hash = '\0';
+        }
+        int fields = sscanf(line, "%1023s %7s %31s %d", path, kind, name, &end_ms);
+        if (fields <= 0) {
+            continue;
+        }
+        if (fields < 3 || (strcmp(kind, "enroll") && strcmp(kind, "test")) ||
+                (!strcmp(kind, "enroll") && !strcmp(name, "none"))) {
+            fprintf(stderr, "%s:%d: expected <wav> enroll <command> or <wav> test <command>|none [speech_end_ms]\n",
+                    list, lineno);
+            fclose(f);
+            return -1;
+        }
+        if (strcmp(name, "none") && (label = label_id(name)) < 0) {
+            fprintf(stderr, "%s:%d: more than %d commands\n", list, lineno, MAX_LABELS);
+            fclose(f);
+            return -1;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            *entries = realloc(*entries, cap * sizeof(entry_t));
+        }
+        entry_t *e = &(*entries)[n++];
+        e->path = malloc(strlen(dir) + strlen(path) + 1);
+        sprintf(e->path, "%s%s", path[0] == '/' ? "" : dir, path);
+        if (wav_read(e->path, &wav) != 0) {
+            fclose(f);
+            return -1;
+        }
+        e->data = wav.data;
+        e->len = wav.len;
+        e->enroll = !strcmp(kind, "enroll");
+        e->label = label;
+        e->end_ms = end_ms;
+    }
+    fclose(f);
+    return n;
+}
+
+/* Last frame within 20 dB of the loudest */
+static int speech_end_ms(const entry_t *e)
+{
+    uint32_t peak = 0, level;
+    int end = 0;
+
+    for (size_t pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i + FRAME <= e->len; i += FRAME) {
+            level = 0;
+            for (int k = 0; k < FRAME; k++) {
+                level += abs(e->data[i + k]);
+            }
+            if (pass == 0 && level > peak) {
+                peak = level;
+            } else if (pass == 1 && level * 10 >= peak) {
+                end = (i + FRAME) * 1000 / WAV_SAMP_RATE;
+            }
+        }
+    }
+    return end;
+}
+
+/*
+ * Synthetic speech: syllables of an optional fricative and a vowel, the
+ * vowel a harmonic series shaped by two formants. Every command is a fixed
+ * sequence, said each time with a different pitch, pace, vocal tract
+ * length and level.
+ */
+
+typedef struct {
+    int f1, f2;
+} vowel_t;
+
+static const vowel_t vowels[] = {
+    { 730, 1090 }, { 270, 2290 }, { 300, 870 }, { 530, 1840 },
+    { 570, 840 }, { 660, 1720 }, { 490, 1350 }, { 520, 1190 },
+};
+#define N_VOWELS        (sizeof(vowels) / sizeof(vowels[0]))
+
+typedef struct {
+    const char *name;
+    const char *syllables;  /* vowel index, '+' before one for a fricative */
+} syn_command_t;
+
+static const syn_command_t syn_commands[] = {
+    { "stop", "+42" },
+    { "cancel", "5+3" },
+    { "volume_up", "4217" },
+    { "volume_down", "42+50" },
+    { "mute", "+21" },
+    { "unmute", "7+21" },
+};
+#define N_SYN_COMMANDS  (sizeof(syn_commands) / sizeof(syn_commands[0]))
+
+static double uniform(double lo, double hi)
+{
+    return lo + (hi - lo) * rand() / RAND_MAX;
+}
+
+static double gauss()
+{
+    return sqrt(-2 * log(uniform(1e-9, 1))) * cos(2 * M_PI * uniform(0, 1));
+}
+
+static void syn_vowel(double *out, int n, const vowel_t *v, double f0, double tract)
+{
+    double phase[64] = { 0 };
+    double amp[64];
+    int harmonics = 0;
+
+    for (int k = 1; k < 64 && k * f0 < 7500; k++, harmonics++) {
+        double f = k * f0;
+        double a1 = exp(-pow((f - v->f1 * tract) / 120, 2));
+        double a2 = exp(-pow((f - v->f2 * tract) / 180, 2));
+        amp[k - 1] = (a1 + 0.6 * a2 + 0.05) / k;
+    }
+    for (int i = 0; i < n; i++) {
+        double env = fmin(1, fmin(i, n - i) / (0.015 * WAV_SAMP_RATE));
+        double s = 0;
+        for (int k = 0; k < harmonics; k++) {
+            phase[k] += 2 * M_PI * (k + 1) * f0 / WAV_SAMP_RATE;
+            s += amp[k] * sin(phase[k]);
+        }
+        out[i] += env * s;
+    }
+}
+
+static void syn_fricative(double *out, int n)
+{
+    double last = 0;
+
+    for (int i = 0; i < n; i++) {
+        double env = fmin(1, fmin(i, n - i) / (0.01 * WAV_SAMP_RATE));
+        double x = gauss();
+        out[i] += env * 0.15 * (x - last);
+        last = x;
+    }
+}
+
+/* Says a syllable sequence, with SYN_LEAD_MS of background noise before it
+ * and SYN_TAIL_MS after */
+static void syn_say(entry_t *e, const char *syllables)
+{
+    double f0 = uniform(95, 180), tract = uniform(0.92, 1.1), pace = uniform(0.8, 1.25);
+    double gain = 4000 * pow(10, uniform(-6, 6) / 20), noise = 25;
+    size_t cap = (SYN_LEAD_MS + SYN_TAIL_MS) * WAV_SAMP_RATE / 1000 + strlen(syllables) * WAV_SAMP_RATE / 2;
+    double *buf = calloc(cap, sizeof(double));
+    size_t pos = SYN_LEAD_MS * WAV_SAMP_RATE / 1000;
+
+    for (const char *s = syllables; *s; s++) {
+        if (*s == '+') {
+            int n = uniform(0.05, 0.08) * pace * WAV_SAMP_RATE;
+            syn_fricative(buf + pos, n);
+            pos += n;
+            continue;
+        }
+        int n = uniform(0.12, 0.18) * pace * WAV_SAMP_RATE;
+        syn_vowel(buf + pos, n, &vowels[(*s - '0') % N_VOWELS], f0 * uniform(0.95, 1.05), tract);
+        pos += n + uniform(0, 0.03) * WAV_SAMP_RATE;
+    }
+    e->end_ms = pos * 1000 / WAV_SAMP_RATE;
+    e->len = pos + SYN_TAIL_MS * WAV_SAMP_RATE / 1000;
+    e->data = malloc(e->len * sizeof(int16_t));
+    for (size_t i = 0; i < e->len; i++) {
+        double v = buf[i] * gain + gauss() * noise;
+        e->data[i] = v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : lrint(v);
+    }
+    free(buf);
+}
+
+static int syn_corpus(entry_t **entries)
+{
+    int n = N_SYN_COMMANDS * (SYN_ENROLL + SYN_TESTS) + SYN_OTHERS;
+    char other[16];
+    int i = 0;
+
+    *entries = calloc(n, sizeof(entry_t));
+    for (size_t c = 0; c < N_SYN_COMMANDS; c++) {
+        int label = label_id(syn_commands[c].name);
+        for (int k = 0; k < SYN_ENROLL + SYN_TESTS; k++, i++) {
+            entry_t *e = &(*entries)[i];
+            e->path = "synthetic";
+            e->enroll = k < SYN_ENROLL;
+            e->label = label;
+            syn_say(e, syn_commands[c].syllables);
+        }
+    }
+    for (int k = 0; k < SYN_OTHERS; k++, i++) {
+        /* Half short like a command, half a longer request */
+        int len = k % 2 ? 2 + rand() % 3 : 6 + rand() % 6;
+        int j = 0;
+        for (int s = 0; s < len; s++) {
+            if (rand() % 3 == 0) {
+                other[j++] = '+';
+            }
+            other[j++] = '0' + rand() % N_VOWELS;
+        }
+        other[j] = '\0';
+        (*entries)[i].path = "synthetic";
+        (*entries)[i].label = -1;
+        syn_say(&(*entries)[i], other);
+    }
+    return n;
+}
+
+static void record_frame(double us)
+{
+    if (frames == frames_cap) {
+        frames_cap = frames_cap ? frames_cap * 2 : 4096;
+        frame_us = realloc(frame_us, frames_cap * sizeof(double));
+    }
+    frame_us[frames++] = us;
+}
+
+/* Streams a file as after a wake word; returns the result and when it came */
+static cmd_spot_result_t run(cmd_spot_t *cs, const entry_t *e, bool enrolling, int *decided_ms)
+{
+    cmd_spot_result_t r = CMD_SPOT_PENDING;
+    size_t prime = PRIME_MS * WAV_SAMP_RATE / 1000;
+
+    cmd_spot_stop(cs);
+    for (size_t i = 0; i + FRAME <= prime && i + FRAME <= e->len; i += FRAME) {
+        cmd_spot_process(cs, e->data + i, FRAME);
+    }
+    cmd_spot_start(cs, enrolling);
+    *decided_ms = -1;
+    for (size_t i = 0; r == CMD_SPOT_PENDING; i += FRAME) {
+        static const int16_t silence[FRAME];
+        /* Past the end of the file, as if the room went quiet */
+        const int16_t *buf = i + FRAME <= e->len ? e->data + i : silence;
+        double t0 = now_us(), us;
+
+        r = cmd_spot_process(cs, buf, FRAME);
+        us = now_us() - t0;
+        if (r == CMD_SPOT_PENDING) {
+            record_frame(us);
+        } else {
+            /* The frame that decides carries the match */
+            match_us_sum += us;
+            if (us > match_us_max) {
+                match_us_max = us;
+            }
+            matches++;
+            *decided_ms = (i + FRAME) * 1000 / WAV_SAMP_RATE;
+        }
+    }
+    return r;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-d max_distance] [-m margin_pct] [-t trailing_ms] -S | corpus.txt\n", prog);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    entry_t *entries = NULL;
+    bool synthetic = false;
+    int n, opt, templates = 0;
+    int commands = 0, local_right = 0, local_wrong = 0, others = 0, false_accepts = 0;
+    int latency_count = 0, latency_max = 0, held_count = 0, held_max = 0;
+    double latency_sum = 0, held_sum = 0;
+    cmd_spot_t *cs;
+
+    while ((opt = getopt(argc, argv, "d:m:t:S")) != -1) {
+        switch (opt) {
+        case 'd':
+            cfg.max_distance = atoi(optarg);
+            break;
+        case 'm':
+            cfg.margin_pct = atoi(optarg);
+            break;
+        case 't':
+            cfg.trailing_silence_ms = atoi(optarg);
+            break;
+        case 'S':
+            synthetic = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (synthetic == (optind < argc)) {
+        usage(argv[0]);
+    }
+    if (synthetic) {
+        srand(1);
+        n = syn_corpus(&entries);
+    } else {
+        n = load_corpus(argv[optind], &entries);
+    }
+    if (n < 0) {
+        return 1;
+    }
+    cs = cmd_spot_create(&cfg);
+
+    for (int i = 0; i < n; i++) {
+        entry_t *e = &entries[i];
+        const int8_t *seg;
+        int hops, decided_ms;
+        int8_t *copy;
+
+        if (!e->enroll) {
+            continue;
+        }
+        run(cs, e, true, &decided_ms);
+        seg = cmd_spot_segment(cs, &hops);
+        if (!seg || templates == CMD_SPOT_MAX_TEMPLATES) {
+            fprintf(stderr, "%s: not enrolled, %s\n", e->path, seg ? "too many templates" : "no speech");
+            continue;
+        }
+        copy = malloc(hops * CMD_SPOT_BANDS);
+        memcpy(copy, seg, hops * CMD_SPOT_BANDS);
+        cmd_spot_set_template(cs, templates++, e->label, copy, hops);
+    }
+    printf("%d templates for %d commands, max distance %.1f dB, margin %d%%, trailing silence %d ms\n",
+           templates, n_labels, cfg.max_distance / 10.0, cfg.margin_pct, cfg.trailing_silence_ms);
+
+    for (int i = 0; i < n; i++) {
+        entry_t *e = &entries[i];
+        cmd_spot_match_t m;
+        cmd_spot_result_t r;
+        int decided_ms, end_ms;
+
+        if (e->enroll) {
+            continue;
+        }
+        r = run(cs, e, false, &decided_ms);
+        cmd_spot_get_match(cs, &m);
+        if (e->label >= 0) {
+            commands++;
+        } else {
+            others++;
+        }
+        if (r == CMD_SPOT_MATCH) {
+            if (m.label == e->label) {
+                local_right++;
+            } else if (e->label >= 0) {
+                local_wrong++;
+            } else {
+                false_accepts++;
+            }
+            end_ms = e->end_ms >= 0 ? e->end_ms : speech_end_ms(e);
+            latency_sum += decided_ms - end_ms;
+            latency_count++;
+            if (decided_ms - end_ms > latency_max) {
+                latency_max = decided_ms - end_ms;
+            }
+        } else {
+            held_sum += decided_ms;
+            held_count++;
+            if (decided_ms > held_max) {
+                held_max = decided_ms;
+            }
+        }
+    }
+
+    if (commands) {
+        printf("commands: %d of %d acted on locally (%.1f%%), %d as the wrong command, %d to the cloud\n",
+               local_right, commands, 100.0 * local_right / commands, local_wrong,
+               commands - local_right - local_wrong);
+    }
+    if (others) {
+        printf("other speech: %d of %d taken for a command (%.1f%%)\n", false_accepts, others,
+               100.0 * false_accepts / others);
+    }
+    if (latency_count) {
+        printf("local decision after end of speech: avg %.0f ms, max %d ms\n", latency_sum / latency_count,
+               latency_max);
+    }
+    if (held_count) {
+        printf("held before falling through to the cloud: avg %.0f ms, max %d ms after the wake word\n",
+               held_sum / held_count, held_max);
+    }
+    if (frames) {
+        double sum = 0;
+        for (size_t i = 0; i < frames; i++) {
+            sum += frame_us[i];
+        }
+        qsort(frame_us, frames, sizeof(double), cmp_double);
+        printf("per %d ms frame: mean %.1f us, p99 %.1f us, max %.1f us; deciding frame: mean %.1f us, max %.1f us\n",
+               FRAME_MS, sum / frames, frame_us[frames * 99 / 100], frame_us[frames - 1],
+               match_us_sum / matches, match_us_max);
+    }
+    cmd_spot_destroy(cs);
+    return 0;
+}
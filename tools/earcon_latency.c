@@ -0,0 +1,272 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+/*
+ * Host measurement of earcon trigger to sound latency.
+ *
+ * Runs the earcon path of app_simple_alexa_cb.c on threads. A trigger
+ * thread does what app_playback_earcon() does: it stamps the time, sets
+ * the pending cue and gives the semaphore. A playback thread loops like
+ * playback_task. It picks the cue up at its next block, mixes it in with
+ * pcm_mix_s16(), and writes the block to the I2S DMA. When nothing is
+ * playing it sleeps on the semaphore. Each trial triggers at a random time.
+ *
+ * The DMA is a model clocked at 48 kHz, not hardware. It has -c buffers of
+ * -b frames, as in the board's I2S config. A write blocks until a buffer is
+ * free. A write after the DMA ran dry lands at the next buffer boundary,
+ * which is how the IDF 3.1 driver reuses its free buffers.
+ *
+ * Reports, with the speaker idle and with a stream playing:
+ *   queued  trigger to the first block handed to the DMA (what the
+ *           "earcon" command shows on the device)
+ *   heard   trigger to the DMA reaching the first frame of the cue
+ * The thread wakeups and the mixing are measured on the host, and the DMA
+ * wait comes from the model. On the device, use "earcon <name> <count>".
+ *
+ * Build from the repository root:
+ *   cc -O2 -pthread -o earcon_latency -Icomponents/audio_dsp tools/earcon_latency.c \
+ *      components/audio_dsp/pcm_convert.c -lm
+ *
+ * Usage:
+ *   earcon_latency [-n trials] [-b block_frames] [-c dma_buffers] [-x seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "pcm_convert.h"
+
+#define RATE            48000
+#define CHANNELS        2
+#define MAX_BLOCK       1024
+#define CUE_MS          150
+#define CUE_FRAMES      (RATE * CUE_MS / 1000)
+/* Gap between trials, so the speaker goes idle again when nothing streams */
+#define TRIAL_GAP_MS    250
+#define TRIAL_JITTER_MS 200
+
+static int block_frames = 300, dma_buffers = 3;
+static int16_t cue_samples[CUE_FRAMES * CHANNELS];
+
+/* DMA model: frames handed to it, and the clock that plays them */
+static int64_t dma_t0;
+static int64_t dma_written;
+
+static struct {
+    volatile int pending;
+    volatile int64_t trigger_ns;
+    bool active;
+    uint32_t pos;
+    volatile bool done;
+    int64_t queued_ns;
+    int64_t heard_ns;
+} cue;
+
+static volatile bool streaming, running;
+static sem_t data;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_ns(int64_t ns)
+{
+    struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+
+    if (ns > 0) {
+        nanosleep(&ts, NULL);
+    }
+}
+
+static int64_t dma_played(int64_t now)
+{
+    return (now - dma_t0) * RATE / 1000000000;
+}
+
+/* i2s_write() of one block, returns the frame at which it starts playing */
+static int64_t dma_write(int frames)
+{
+    int64_t start;
+
+    for (;;) {
+        int64_t played = dma_played(now_ns());
+        int64_t ahead;
+
+        if (dma_written < played) {
+            /* Ran dry, the block goes into the buffer after the one playing */
+            dma_written = (played / block_frames + 1) * block_frames;
+        }
+        ahead = dma_written + frames - played;
+        if (ahead <= (int64_t) dma_buffers * block_frames) {
+            break;
+        }
+        sleep_ns((ahead - (int64_t) dma_buffers * block_frames) * 1000000000 / RATE);
+    }
+    start = dma_written;
+    dma_written += frames;
+    return start;
+}
+
+/* playback_task, with a quiet tone standing in for a stream */
+static void *playback_thread(void *arg)
+{
+    static int16_t period[MAX_BLOCK * CHANNELS];
+    uint32_t phase = 0;
+
+    (void) arg;
+    while (running) {
+        int pending = cue.pending, n = 0;
+        bool first;
+        int64_t start;
+
+        if (pending) {
+            cue.pending = 0;
+            cue.active = true;
+            cue.pos = 0;
+        }
+        memset(period, 0, block_frames * CHANNELS * sizeof(int16_t));
+        if (streaming) {
+            for (int i = 0; i < block_frames; i++, phase++) {
+                period[2 * i] = period[2 * i + 1] = 1000 * sinf(phase * (2 * M_PI * 440 / RATE));
+            }
+        }
+        if (cue.active) {
+            n = CUE_FRAMES - (int) cue.pos;
+            n = n < block_frames ? n : block_frames;
+            pcm_mix_s16(period, cue_samples + cue.pos * CHANNELS, n, CHANNELS);
+        }
+        first = cue.active && cue.pos == 0;
+        start = dma_write(block_frames);
+        if (first) {
+            cue.queued_ns = now_ns() - cue.trigger_ns;
+            cue.heard_ns = dma_t0 + start * 1000000000 / RATE - cue.trigger_ns;
+            cue.done = true;
+        }
+        if (cue.active) {
+            cue.pos += n;
+            cue.active = cue.pos < CUE_FRAMES;
+        }
+        if (!streaming && !cue.active && !cue.pending) {
+            sem_wait(&data);
+        }
+    }
+    return NULL;
+}
+
+typedef struct result {
+    double queued_sum, queued_max;
+    double heard_sum, heard_min, heard_max;
+} result_t;
+
+static void run(int trials, bool stream, result_t *r)
+{
+    pthread_t thread;
+
+    memset(r, 0, sizeof(*r));
+    r->heard_min = INFINITY;
+    streaming = stream;
+    running = true;
+    dma_t0 = now_ns();
+    dma_written = 0;
+    sem_init(&data, 0, 0);
+    pthread_create(&thread, NULL, playback_thread, NULL);
+    for (int t = 0; t < trials; t++) {
+        sleep_ns((TRIAL_GAP_MS + rand() % TRIAL_JITTER_MS) * 1000000LL + rand() % 1000000);
+        /* app_playback_earcon() */
+        cue.done = false;
+        cue.trigger_ns = now_ns();
+        __sync_synchronize();
+        cue.pending = 1;
+        sem_post(&data);
+        while (!cue.done) {
+            sleep_ns(100000);
+        }
+        double queued = cue.queued_ns / 1e6, heard = cue.heard_ns / 1e6;
+        r->queued_sum += queued;
+        r->queued_max = fmax(r->queued_max, queued);
+        r->heard_sum += heard;
+        r->heard_min = fmin(r->heard_min, heard);
+        r->heard_max = fmax(r->heard_max, heard);
+    }
+    running = false;
+    streaming = false;
+    sem_post(&data);
+    pthread_join(thread, NULL);
+    sem_destroy(&data);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-n trials] [-b block_frames] [-c dma_buffers] [-x seed]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    int trials = 100, opt;
+    result_t r;
+
+    srand(1);
+    while ((opt = getopt(argc, argv, "n:b:c:x:")) != -1) {
+        switch (opt) {
+        case 'n':
+            trials = atoi(optarg);
+            break;
+        case 'b':
+            block_frames = atoi(optarg);
+            break;
+        case 'c':
+            dma_buffers = atoi(optarg);
+            break;
+        case 'x':
+            srand(atoi(optarg));
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (trials <= 0 || block_frames <= 0 || block_frames > MAX_BLOCK || dma_buffers < 2) {
+        usage(argv[0]);
+    }
+    for (int i = 0; i < CUE_FRAMES; i++) {
+        cue_samples[2 * i] = cue_samples[2 * i + 1] = 8000 * sinf(i * (2 * M_PI * 880 / RATE));
+    }
+
+    printf("%d trials, %d DMA buffers of %d frames (%.2f ms)\n", trials, dma_buffers, block_frames,
+           block_frames * 1000.0 / RATE);
+    printf("%-10s %10s %10s %10s %10s %10s\n", "speaker", "queued avg", "queued max", "heard min", "heard avg",
+           "heard max");
+    for (int stream = 0; stream <= 1; stream++) {
+        run(trials, stream, &r);
+        printf("%-10s %10.2f %10.2f %10.2f %10.2f %10.2f\n", stream ? "playing" : "idle", r.queued_sum / trials,
+               r.queued_max, r.heard_min, r.heard_sum / trials, r.heard_max);
+    }
+    return 0;
+}
@@ -0,0 +1,187 @@
+#!/usr/bin/env python
+#
+# Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Build the earcon partition image played by main/earcon.c.
+
+Each cue is given as name=file.wav. The file must be 16-bit PCM, mono or
+stereo. It is resampled to 48 kHz here so the device can play it straight
+from flash. Cues that aren't given get a built-in tone. Stereo is best on
+16-bit speakers, since the device then hands the mapped flash to I2S without
+converting it. The partition offset and size are read from partitions.csv.
+
+    earcon_pack.py -o earcons.bin
+    earcon_pack.py -o earcons.bin wake=wake.wav end=end.wav
+    esptool.py --chip esp32 write_flash 0x330000 earcons.bin
+
+Only depends on the standard library.
+"""
+
+from __future__ import print_function
+
+import argparse
+import array
+import csv
+import math
+import os
+import struct
+import sys
+import wave
+import zlib
+
+# main/earcon.h
+MAGIC = 0x4e4f4345
+VERSION = 1
+NAME_LEN = 16
+PARTITION_LABEL = 'earcons'
+NAMES = ('wake', 'end', 'error')
+SAMPLE_RATE = 48000
+HEADER = struct.Struct('<IHHI')
+ENTRY = struct.Struct('<%dsIIIHH' % NAME_LEN)
+
+FADE_MS = 5
+TONE_LEVEL = 0.25
+
+# Built-in cues as (frequency Hz, duration ms) notes, 0 Hz is a rest
+TONES = {
+    'wake': [(660, 70), (880, 90)],
+    'end': [(880, 70), (660, 90)],
+    'error': [(330, 120), (0, 60), (330, 120)],
+}
+
+
+def raised_cosine(i, n):
+    return 0.5 - 0.5 * math.cos(math.pi * i / n)
+
+
+def tone(notes):
+    """Stereo samples for a list of notes, each faded in and out."""
+    out = array.array('h')
+    fade = SAMPLE_RATE * FADE_MS // 1000
+    for freq, ms in notes:
+        n = SAMPLE_RATE * ms // 1000
+        for i in range(n):
+            edge = min(i, n - 1 - i)
+            g = raised_cosine(edge, fade) if edge < fade else 1.0
+            v = int(round(32767 * TONE_LEVEL * g * math.sin(2 * math.pi * freq * i / SAMPLE_RATE))) if freq else 0
+            out.append(v)
+            out.append(v)
+    return out, 2
+
+
+def resample(samples, channels, rate):
+    """Linear interpolation to SAMPLE_RATE; fine for short cues."""
+    if rate == SAMPLE_RATE:
+        return samples
+    frames = len(samples) // channels
+    n = int(frames * SAMPLE_RATE // rate)
+    out = array.array('h')
+    for j in range(n):
+        x = j * float(rate) / SAMPLE_RATE
+        i = int(x)
+        f = x - i
+        for c in range(channels):
+            a = samples[i * channels + c]
+            b = samples[min(i + 1, frames - 1) * channels + c]
+            out.append(int(round(a + (b - a) * f)))
+    return out
+
+
+def load_wav(path):
+    w = wave.open(path, 'rb')
+    try:
+        if w.getsampwidth() != 2 or w.getnchannels() not in (1, 2):
+            sys.exit('%s: need 16-bit mono or stereo PCM' % path)
+        samples = array.array('h')
+        samples.frombytes(w.readframes(w.getnframes()))
+        if sys.byteorder != 'little':
+            samples.byteswap()
+        return resample(samples, w.getnchannels(), w.getframerate()), w.getnchannels()
+    finally:
+        w.close()
+
+
+def partition(path):
+    """Offset and size of the earcon partition in a partitions.csv."""
+    def number(s):
+        s = s.strip()
+        mult = 1
+        if s[-1:] in ('K', 'k'):
+            s, mult = s[:-1], 1024
+        elif s[-1:] in ('M', 'm'):
+            s, mult = s[:-1], 1024 * 1024
+        return int(s, 0) * mult
+
+    with open(path) as f:
+        for row in csv.reader(f):
+            if row and row[0].strip() == PARTITION_LABEL:
+                return number(row[3]), number(row[4])
+    sys.exit('%s has no %s partition' % (path, PARTITION_LABEL))
+
+
+def pack(cues, size):
+    """Image for {name: (samples, channels)}, padded to size with 0xff."""
+    names = sorted(cues, key=lambda n: NAMES.index(n) if n in NAMES else len(NAMES))
+    offset = HEADER.size + ENTRY.size * len(names)
+    entries = b''
+    data = b''
+    for name in names:
+        samples, channels = cues[name]
+        if sys.byteorder != 'little':
+            samples = array.array('h', samples)
+            samples.byteswap()
+        offset += -offset % 4
+        data += b'\xff' * (offset - HEADER.size - ENTRY.size * len(names) - len(data))
+        entries += ENTRY.pack(name.encode('ascii'), offset, len(samples) // channels, SAMPLE_RATE, channels, 0)
+        data += samples.tobytes()
+        offset += len(samples) * 2
+    image = HEADER.pack(MAGIC, VERSION, len(names), zlib.crc32(entries) & 0xffffffff) + entries + data
+    if len(image) > size:
+        sys.exit('Earcons take %d bytes, the partition holds %d' % (len(image), size))
+    return image + b'\xff' * (size - len(image))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('cues', nargs='*', metavar='name=file.wav', help='cue to replace (%s)' % ', '.join(NAMES))
+    parser.add_argument('-o', '--output', default='earcons.bin', help='image to write (default: earcons.bin)')
+    parser.add_argument('--partitions', default=os.path.join(os.path.dirname(__file__), '..', 'partitions.csv'),
+                        help='partition table (default: the project one)')
+    args = parser.parse_args()
+
+    cues = {}
+    for name in NAMES:
+        cues[name] = tone(TONES[name])
+    for arg in args.cues:
+        name, _, path = arg.partition('=')
+        if name not in NAMES or not path:
+            parser.error('expected name=file.wav with name one of %s' % ', '.join(NAMES))
+        if len(name) > NAME_LEN:
+            parser.error('%s: names are at most %d characters' % (name, NAME_LEN))
+        cues[name] = load_wav(path)
+
+    offset, size = partition(args.partitions)
+    image = pack(cues, size)
+    with open(args.output, 'wb') as f:
+        f.write(image)
+    for name in sorted(cues, key=NAMES.index):
+        samples, channels = cues[name]
+        print('%-6s %4d ms %s' % (name, len(samples) // channels * 1000 // SAMPLE_RATE,
+                                  'stereo' if channels == 2 else 'mono'))
+    print('Wrote %s, flash with: esptool.py --chip esp32 write_flash 0x%x %s' % (args.output, offset, args.output))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,200 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+/*
+ * Host simulation of local end of speech detection.
+ *
+ * Each clean utterance gets lead-in and trailing noise, as if a wake word
+ * had just been spoken and the talker then went quiet, and is fed to the
+ * audio_dsp endpointer in 20 ms frames the way read_rb_task does. The
+ * baseline is cloud endpointing: StopCapture arrives -c ms after the end
+ * of speech. Counts utterances the endpointer cut short (ended before the
+ * end of speech, judged on the clean signal) and reports the time from the
+ * end of speech to the local end against the cloud's -c. The difference is
+ * the time to response that closing the recognize stream at the local end
+ * would gain. The device can't close it, so it only cues the end earcon
+ * there and the gain isn't realized; its "endpoint" command shows the same
+ * gap as the local end to the cloud's stop. Recordings must be 16 kHz
+ * 16-bit mono WAV.
+ *
+ * Build from the repository root:
+ *   cc -O2 -o ep_sim -Icomponents/audio_dsp tools/ep_sim.c tools/wav_io.c \
+ *      components/audio_dsp/endpoint.c -lm
+ *
+ * Usage:
+ *   ep_sim [-t trailing_ms] [-c cloud_ms] [-p pad_ms] [-s snr_db] noise.wav clean.wav...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "endpoint.h"
+#include "wav_io.h"
+
+#define BLOCK           320
+#define BLOCK_MS        20
+#define LEAD_MS         1000
+/* Frames within this of the loudest one count as speech in the clean signal */
+#define SPEECH_END_DB   -30.0
+/* Same settings as app_dsp */
+#define SPEECH_RATIO_Q8 (3 * 256)
+#define MIN_LEVEL       50
+#define MIN_SPEECH_MS   200
+#define NO_SPEECH_MS    5000
+
+static int speech_end_ms(const int16_t *x, size_t len)
+{
+    double peak = 0, level[len / BLOCK + 1];
+    size_t frames = len / BLOCK;
+
+    for (size_t f = 0; f < frames; f++) {
+        double e = 0;
+        for (int i = 0; i < BLOCK; i++) {
+            e += (double) x[f * BLOCK + i] * x[f * BLOCK + i];
+        }
+        level[f] = e / BLOCK;
+        peak = fmax(peak, level[f]);
+    }
+    for (size_t f = frames; f > 0; f--) {
+        if (10 * log10(level[f - 1] / peak + 1e-12) > SPEECH_END_DB) {
+            return f * BLOCK_MS;
+        }
+    }
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t trailing_ms] [-c cloud_ms] [-p pad_ms] [-s snr_db] noise.wav clean.wav...\n", prog);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    int trailing_ms = 800, cloud_ms = 1500, pad_ms = 4000, opt;
+    double snr_db = 20;
+    wav_t noise;
+
+    while ((opt = getopt(argc, argv, "t:c:p:s:")) != -1) {
+        switch (opt) {
+        case 't':
+            trailing_ms = atoi(optarg);
+            break;
+        case 'c':
+            cloud_ms = atoi(optarg);
+            break;
+        case 'p':
+            pad_ms = atoi(optarg);
+            break;
+        case 's':
+            snr_db = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind < 2 || wav_read(argv[optind], &noise) != 0 || noise.len == 0) {
+        usage(argv[0]);
+    }
+
+    endpoint_config_t cfg = {
+        .sample_rate = WAV_SAMP_RATE,
+        .trailing_silence_ms = trailing_ms,
+        .no_speech_ms = NO_SPEECH_MS,
+        .min_speech_ms = MIN_SPEECH_MS,
+        .speech_ratio_q8 = SPEECH_RATIO_Q8,
+        .min_level = MIN_LEVEL,
+    };
+    long gain_ms = 0;
+    int files = 0, ended = 0, cut = 0;
+    long end_delay_ms = 0;
+    int timed = 0, max_end_delay_ms = 0;
+
+    for (int a = optind + 1; a < argc; a++) {
+        wav_t clean;
+        if (wav_read(argv[a], &clean) != 0) {
+            return 1;
+        }
+        size_t lead = LEAD_MS * WAV_SAMP_RATE / 1000, pad = (size_t) pad_ms * WAV_SAMP_RATE / 1000;
+        size_t len = lead + clean.len + pad;
+        int16_t *x = calloc(len, sizeof(int16_t));
+        double ec = 0, en = 0;
+        for (size_t i = 0; i < clean.len; i++) {
+            ec += (double) clean.data[i] * clean.data[i];
+            en += (double) noise.data[i % noise.len] * noise.data[i % noise.len];
+        }
+        double scale = sqrt(ec / (en * pow(10, snr_db / 10)));
+        for (size_t i = 0; i < len; i++) {
+            double v = noise.data[i % noise.len] * scale;
+            if (i >= lead && i < lead + clean.len) {
+                v += clean.data[i - lead];
+            }
+            x[i] = fmax(INT16_MIN, fmin(INT16_MAX, lround(v)));
+        }
+
+        /* Times from the start of the utterance, i.e. the end of the lead-in */
+        int end_ms = speech_end_ms(clean.data, clean.len);
+        int total_ms = (clean.len + pad) * 1000 / WAV_SAMP_RATE;
+        int cloud_stop_ms = end_ms + cloud_ms < total_ms ? end_ms + cloud_ms : total_ms;
+        int local_stop_ms = cloud_stop_ms;
+        endpoint_state_t st = ENDPOINT_IDLE;
+        endpoint_t ep;
+
+        endpoint_init(&ep, &cfg);
+        for (size_t pos = 0; pos + BLOCK <= len; pos += BLOCK) {
+            if (pos == lead) {
+                endpoint_start(&ep);
+            }
+            st = endpoint_process(&ep, x + pos, BLOCK);
+            if (st == ENDPOINT_END || st == ENDPOINT_NO_SPEECH) {
+                int t = (pos + BLOCK - lead) * 1000 / WAV_SAMP_RATE;
+                local_stop_ms = t < cloud_stop_ms ? t : cloud_stop_ms;
+                break;
+            }
+        }
+        bool was_cut = (st == ENDPOINT_END || st == ENDPOINT_NO_SPEECH) && local_stop_ms < end_ms;
+        printf("%s: speech ends %d ms, cloud stops %d ms, local %s at %d ms%s\n", argv[a], end_ms, cloud_stop_ms,
+               st == ENDPOINT_END ? "end" : st == ENDPOINT_NO_SPEECH ? "no speech" : "none", local_stop_ms,
+               was_cut ? " (cut short)" : "");
+        files++;
+        ended += (st == ENDPOINT_END);
+        cut += was_cut;
+        if (st == ENDPOINT_END && !was_cut) {
+            timed++;
+            end_delay_ms += local_stop_ms - end_ms;
+            gain_ms += cloud_stop_ms - local_stop_ms;
+            if (local_stop_ms - end_ms > max_end_delay_ms) {
+                max_end_delay_ms = local_stop_ms - end_ms;
+            }
+        }
+        free(x);
+        free(clean.data);
+    }
+    printf("%d utterances, %d ended locally, %d cut short\n", files, ended, cut);
+    if (timed) {
+        printf("end of speech to local end: %.0f ms on average, %d ms at most (cloud: %d ms)\n",
+               (double) end_delay_ms / timed, max_end_delay_ms, cloud_ms);
+        printf("time to response gain if the stream closed there: %.0f ms on average\n",
+               (double) gain_ms / timed);
+    }
+    return 0;
+}
@@ -0,0 +1,282 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+/*
+ * Host simulation of the playback jitter buffer against bursty network
+ * delivery.
+ *
+ * The server sends -P ms packets in real time. Each packet arrives after a
+ * random delay of up to -j ms. With probability -q, a packet starts a stall
+ * lasting -S ms on average, and nothing is delivered until the stall ends,
+ * when the backlog arrives in one burst. Delivery is in order, as on TCP.
+ * The writer queues packets as they arrive and blocks while the buffer is
+ * full, and the reader takes a 10 ms period every 10 ms, like the playback
+ * task.
+ *
+ * The same delivery is played twice. The first pass models the old direct
+ * write to the 20 ms I2S DMA ring, with no fades. The second pass uses the
+ * jitter buffer. For each pass the tool reports underruns, concealed time,
+ * depth and clicks. A click is a sample step more than twice the largest
+ * step in the source. The source is a 440 Hz tone, or a 16 kHz mono WAV
+ * given with -i.
+ *
+ * Build from the repository root:
+ *   cc -O2 -o jb_sim -Icomponents/audio_dsp tools/jb_sim.c tools/wav_io.c \
+ *      components/audio_dsp/jitter_buffer.c components/audio_dsp/gain_ramp.c -lm
+ *
+ * Usage:
+ *   jb_sim [-c capacity_ms] [-s start_ms] [-r resume_ms] [-f fade_ms] [-P packet_ms]
+ *          [-j jitter_ms] [-q stall_prob] [-S stall_ms] [-d seconds] [-x seed]
+ *          [-i in.wav] [-o out.wav]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "jitter_buffer.h"
+#include "wav_io.h"
+
+#define PERIOD_MS       10
+#define PERIOD          (WAV_SAMP_RATE * PERIOD_MS / 1000)
+#define FRAMES_PER_MS   (WAV_SAMP_RATE / 1000)
+/* Playback DMA ring of the old direct path: 3 buffers of 300 frames at 48 kHz */
+#define DMA_MS          20
+#define IDLE_MS         500
+#define TAIL_MS         1000
+
+typedef struct {
+    int16_t *data;
+    size_t len;
+    int packet_ms;
+    int *arrival_ms;    /* per packet */
+    int packets;
+} stream_t;
+
+static uint32_t rng_state;
+
+static double rnd(void)
+{
+    /* xorshift32, so runs repeat across hosts */
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (rng_state >> 8) / 16777216.0;
+}
+
+static void make_arrivals(stream_t *s, int jitter_ms, double stall_prob, int stall_ms)
+{
+    int prev = 0, stall_until = 0;
+
+    s->packets = (s->len + s->packet_ms * FRAMES_PER_MS - 1) / (s->packet_ms * FRAMES_PER_MS);
+    s->arrival_ms = malloc(s->packets * sizeof(int));
+    for (int k = 0; k < s->packets; k++) {
+        int sent = k * s->packet_ms;
+        if (rnd() < stall_prob) {
+            stall_until = sent - stall_ms * log(1 - rnd());
+        }
+        int t = sent + s->packet_ms + jitter_ms * rnd();
+        if (t < stall_until) {
+            t = stall_until;
+        }
+        if (t < prev) {
+            t = prev;
+        }
+        s->arrival_ms[k] = prev = t;
+    }
+}
+
+static int max_step(const int16_t *x, size_t len)
+{
+    int m = 0;
+    for (size_t i = 1; i < len; i++) {
+        m = fmax(m, abs(x[i] - x[i - 1]));
+    }
+    return m;
+}
+
+/* Plays the stream through a jitter buffer in 1 ms steps and returns the
+ * output, which runs TAIL_MS past the last arrival */
+static int16_t *run(const stream_t *s, const jitter_buffer_config_t *cfg, jitter_buffer_stats_t *stats,
+                    size_t *out_len)
+{
+    jitter_buffer_t jb;
+    void *mem = malloc(jitter_buffer_mem_size(cfg));
+    int end_ms = s->arrival_ms[s->packets - 1] + cfg->capacity_ms + TAIL_MS;
+    int16_t *out = calloc((size_t) end_ms * FRAMES_PER_MS + PERIOD, sizeof(int16_t));
+    size_t written = 0, played = 0;
+    int k = 0;
+
+    if (jitter_buffer_init(&jb, cfg, mem) != 0) {
+        fprintf(stderr, "bad jitter buffer settings\n");
+        exit(2);
+    }
+    for (int t = 0; t < end_ms; t++) {
+        /* Everything that has arrived, as far as it fits */
+        while (k < s->packets && s->arrival_ms[k] <= t) {
+            size_t packet_end = (size_t) (k + 1) * s->packet_ms * FRAMES_PER_MS;
+            if (packet_end > s->len) {
+                packet_end = s->len;
+            }
+            written += jitter_buffer_write(&jb, s->data + written, packet_end - written);
+            if (written < packet_end) {
+                break;
+            }
+            k++;
+        }
+        if (t % PERIOD_MS == PERIOD_MS - 1) {
+            jitter_buffer_read(&jb, out + played, PERIOD);
+            played += PERIOD;
+        }
+    }
+    jitter_buffer_get_stats(&jb, stats, false);
+    free(mem);
+    *out_len = played;
+    return out;
+}
+
+static void report(const char *name, const jitter_buffer_stats_t *st, const int16_t *out, size_t len, int click_step)
+{
+    int clicks = 0;
+    for (size_t i = 1; i < len; i++) {
+        clicks += abs(out[i] - out[i - 1]) > click_step;
+    }
+    printf("%-14s %9u %12u %9u %9u %7d\n", name, st->underruns, st->concealed_ms, st->avg_depth_ms,
+           st->max_depth_ms, clicks);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-c capacity_ms] [-s start_ms] [-r resume_ms] [-f fade_ms] [-P packet_ms]\n"
+            "       [-j jitter_ms] [-q stall_prob] [-S stall_ms] [-d seconds] [-x seed] [-i in.wav] [-o out.wav]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    jitter_buffer_config_t cfg = {
+        .sample_rate = WAV_SAMP_RATE,
+        .channels = 1,
+        .capacity_ms = 500,
+        .start_ms = 150,
+        .resume_ms = 300,
+        .fade_ms = 5,
+        .idle_ms = IDLE_MS,
+    };
+    int jitter_ms = 40, stall_ms = 300, seconds = 60, opt;
+    double stall_prob = 0.01;
+    const char *in_path = NULL, *out_path = NULL;
+    stream_t s = { .packet_ms = 20 };
+
+    rng_state = 1;
+    while ((opt = getopt(argc, argv, "c:s:r:f:P:j:q:S:d:x:i:o:")) != -1) {
+        switch (opt) {
+        case 'c':
+            cfg.capacity_ms = atoi(optarg);
+            break;
+        case 's':
+            cfg.start_ms = atoi(optarg);
+            break;
+        case 'r':
+            cfg.resume_ms = atoi(optarg);
+            break;
+        case 'f':
+            cfg.fade_ms = atoi(optarg);
+            break;
+        case 'P':
+            s.packet_ms = atoi(optarg);
+            break;
+        case 'j':
+            jitter_ms = atoi(optarg);
+            break;
+        case 'q':
+            stall_prob = atof(optarg);
+            break;
+        case 'S':
+            stall_ms = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atoi(optarg);
+            break;
+        case 'x':
+            rng_state = strtoul(optarg, NULL, 0) | 1;
+            break;
+        case 'i':
+            in_path = optarg;
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc || s.packet_ms <= 0) {
+        usage(argv[0]);
+    }
+
+    if (in_path) {
+        wav_t in;
+        if (wav_read(in_path, &in) != 0) {
+            return 1;
+        }
+        s.data = in.data;
+        s.len = in.len;
+    } else {
+        s.len = (size_t) seconds * WAV_SAMP_RATE;
+        s.data = malloc(s.len * sizeof(int16_t));
+        for (size_t i = 0; i < s.len; i++) {
+            s.data[i] = lround(16000 * sin(2 * M_PI * 440 * i / WAV_SAMP_RATE));
+        }
+    }
+    if (s.len == 0) {
+        usage(argv[0]);
+    }
+    make_arrivals(&s, jitter_ms, stall_prob, stall_ms);
+
+    jitter_buffer_config_t direct = {
+        .sample_rate = WAV_SAMP_RATE,
+        .channels = 1,
+        .capacity_ms = DMA_MS,
+        .start_ms = PERIOD_MS,
+        .resume_ms = PERIOD_MS,
+        .fade_ms = 0,
+        .idle_ms = IDLE_MS,
+    };
+    jitter_buffer_stats_t st;
+    int click_step = 2 * max_step(s.data, s.len);
+    size_t len;
+    int16_t *out;
+
+    printf("%-14s %9s %12s %9s %9s %7s\n", "", "underruns", "concealed ms", "avg depth", "max depth", "clicks");
+    out = run(&s, &direct, &st, &len);
+    report("direct", &st, out, len, click_step);
+    free(out);
+    out = run(&s, &cfg, &st, &len);
+    report("jitter buffer", &st, out, len, click_step);
+    if (out_path && wav_write(out_path, out, len, 1) != 0) {
+        return 1;
+    }
+    free(out);
+    free(s.arrival_ms);
+    free(s.data);
+    return 0;
+}
@@ -0,0 +1,217 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+/*
+ * Host evaluation of the audio_dsp noise suppressor.
+ *
+ * Mixes each clean recording with a noise recording at the requested SNR,
+ * runs the suppressor over it in 20 ms blocks exactly as the device does,
+ * and reports SNR before/after plus the time taken per STFT frame.
+ * Recordings must be 16 kHz 16-bit mono WAV; the noise is looped as needed.
+ *
+ * Build from the repository root:
+ *   cc -O2 -o ns_eval -Icomponents/audio_dsp tools/ns_eval.c tools/wav_io.c \
+ *      components/audio_dsp/fft.c components/audio_dsp/noise_suppress.c -lm
+ *
+ * Usage:
+ *   ns_eval [-s snr_db] [-g min_gain_db] [-o out.wav] noise.wav clean.wav...
+ *
+ * Host timings are only good for comparing revisions; the on-device cost is
+ * shown by the "ns" console command.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "noise_suppress.h"
+#include "wav_io.h"
+
+#define BLOCK           320
+/* Segmental SNR over 20 ms segments, clamped as usual */
+#define SEG_SNR_MIN     -10.0
+#define SEG_SNR_MAX     35.0
+
+static double energy(const int16_t *x, size_t len)
+{
+    double e = 0;
+    for (size_t i = 0; i < len; i++) {
+        e += (double) x[i] * x[i];
+    }
+    return e;
+}
+
+/* SNR of `test` against `ref`, global and segmental */
+static void snr(const int16_t *ref, const int16_t *test, size_t len, double *global, double *seg)
+{
+    double sig = 0, err = 0, seg_sum = 0;
+    int segs = 0;
+
+    for (size_t s = 0; s + BLOCK <= len; s += BLOCK) {
+        double ss = 0, se = 0;
+        for (int i = 0; i < BLOCK; i++) {
+            double d = (double) test[s + i] - ref[s + i];
+            ss += (double) ref[s + i] * ref[s + i];
+            se += d * d;
+        }
+        sig += ss;
+        err += se;
+        /* Silent segments say nothing about the signal */
+        if (ss > BLOCK * 100.0) {
+            double v = 10 * log10(ss / (se + 1e-9));
+            seg_sum += (v < SEG_SNR_MIN) ? SEG_SNR_MIN : (v > SEG_SNR_MAX) ? SEG_SNR_MAX : v;
+            segs++;
+        }
+    }
+    *global = 10 * log10(sig / (err + 1e-9));
+    *seg = segs ? seg_sum / segs : 0;
+}
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-s snr_db] [-g min_gain_db] [-o out.wav] noise.wav clean.wav...\n", prog);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    double snr_db = 5, min_gain_db = -15;
+    const char *out_path = NULL;
+    double in_snr_sum = 0, out_snr_sum = 0, in_seg_sum = 0, out_seg_sum = 0;
+    double total_ns = 0, max_block_ns = 0;
+    uint64_t total_cycles = 0;
+    uint32_t total_frames = 0;
+    wav_t noise;
+    int opt, files = 0;
+
+    while ((opt = getopt(argc, argv, "s:g:o:")) != -1) {
+        switch (opt) {
+        case 's':
+            snr_db = atof(optarg);
+            break;
+        case 'g':
+            min_gain_db = atof(optarg);
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind < 2) {
+        usage(argv[0]);
+    }
+    if (wav_read(argv[optind], &noise) != 0 || noise.len == 0) {
+        return 1;
+    }
+
+    noise_suppress_config_t cfg = {
+        .min_gain_q15 = lround(pow(10, min_gain_db / 20) * 32768),
+    };
+    printf("%-32s %8s %8s %8s %8s\n", "file", "snr_in", "snr_out", "seg_in", "seg_out");
+
+    for (int a = optind + 1; a < argc; a++) {
+        wav_t clean;
+        if (wav_read(argv[a], &clean) != 0) {
+            continue;
+        }
+        size_t len = clean.len;
+        int16_t *noisy = malloc(len * 2);
+        int16_t *out = malloc((len + NS_LATENCY) * 2);
+        double es = energy(clean.data, len);
+        double en = 0;
+
+        for (size_t i = 0; i < len; i++) {
+            double v = noise.data[i % noise.len];
+            en += v * v;
+        }
+        double scale = (en > 0) ? sqrt(es / (en * pow(10, snr_db / 10))) : 0;
+        for (size_t i = 0; i < len; i++) {
+            long v = clean.data[i] + lround(noise.data[i % noise.len] * scale);
+            noisy[i] = (v > INT16_MAX) ? INT16_MAX : (v < INT16_MIN) ? INT16_MIN : v;
+        }
+
+        noise_suppress_t *ns = noise_suppress_create(&cfg);
+        noise_suppress_stats_t stats;
+        memcpy(out, noisy, len * 2);
+        memset(out + len, 0, NS_LATENCY * 2);
+        for (size_t s = 0; s < len + NS_LATENCY; s += BLOCK) {
+            int n = (len + NS_LATENCY - s < BLOCK) ? len + NS_LATENCY - s : BLOCK;
+            double t = now_ns();
+#ifdef HAVE_TSC
+            uint64_t c = __rdtsc();
+#endif
+            noise_suppress_process(ns, out + s, n);
+#ifdef HAVE_TSC
+            total_cycles += __rdtsc() - c;
+#endif
+            t = now_ns() - t;
+            total_ns += t;
+            if (t > max_block_ns) {
+                max_block_ns = t;
+            }
+        }
+        noise_suppress_get_stats(ns, &stats);
+        total_frames += stats.frames;
+        noise_suppress_destroy(ns);
+
+        double in_g, in_s, out_g, out_s;
+        snr(clean.data, noisy, len, &in_g, &in_s);
+        snr(clean.data, out + NS_LATENCY, len, &out_g, &out_s);
+        printf("%-32s %8.2f %8.2f %8.2f %8.2f\n", argv[a], in_g, out_g, in_s, out_s);
+        in_snr_sum += in_g;
+        out_snr_sum += out_g;
+        in_seg_sum += in_s;
+        out_seg_sum += out_s;
+        files++;
+
+        if (out_path && a == argc - 1) {
+            wav_write(out_path, out + NS_LATENCY, len, 1);
+        }
+        free(clean.data);
+        free(noisy);
+        free(out);
+    }
+    if (!files) {
+        return 1;
+    }
+    printf("\nmean snr improvement: %.2f dB (segmental %.2f dB) over %d files\n",
+           (out_snr_sum - in_snr_sum) / files, (out_seg_sum - in_seg_sum) / files, files);
+    printf("per STFT frame: %.1f us", total_ns / total_frames / 1000);
+#ifdef HAVE_TSC
+    printf(", %.0f host cycles", (double) total_cycles / total_frames);
+#endif
+    printf("; worst %d-sample block %.1f us\n", BLOCK, max_block_ns / 1000);
+    return 0;
+}
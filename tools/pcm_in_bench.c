@@ -0,0 +1,204 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+/*
+ * Host microbenchmark of the capture conversion.
+ *
+ * Reduces one I2S DMA buffer of microphone frames to 16-bit mono, as
+ * dsp_write_cb() does before the ring buffer, for every slot layout the
+ * board can be built with and for both DMA buffer sizes of the capture
+ * profiles. The kernels from components/audio_dsp/pcm_convert.c are timed
+ * against a plain per-sample loop doing the same arithmetic, and their
+ * output is checked against it first. Costs are per output sample; on x86
+ * the cycles are TSC ticks. Host timings only show the relative cost; run
+ * on the device for absolute numbers.
+ *
+ * Build from the repository root:
+ *   cc -O2 -o pcm_in_bench -Icomponents/audio_dsp tools/pcm_in_bench.c \
+ *      components/audio_dsp/pcm_convert.c
+ *
+ * Usage:
+ *   pcm_in_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "pcm_convert.h"
+
+#define MAX_FRAMES      480
+#define MIC_SHIFT       14      /* CONFIG_APP_DSP_MIC_SHIFT default */
+
+typedef struct capture_case {
+    const char *name;
+    int bits;
+    int channels;
+    bool dither;
+} capture_case_t;
+
+static const capture_case_t cases[] = {
+    { "16 mono", 16, 1, false },
+    { "16 stereo", 16, 2, false },
+    { "32 mono", 32, 1, false },
+    { "32 stereo", 32, 2, false },
+    { "32 stereo dither", 32, 2, true },
+};
+
+static const int block_frames[] = { 300, 480 };
+
+static uint32_t xorshift(uint32_t *s)
+{
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *s = x;
+    return x;
+}
+
+static int16_t sat16(int64_t v)
+{
+    return v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v;
+}
+
+/* The same arithmetic as the kernels, one sample at a time, into a separate
+ * buffer */
+static __attribute__((noinline)) int reference(int16_t *out, const void *in, int frames, const capture_case_t *c,
+                                               uint32_t *seed)
+{
+    int64_t round = 1LL << (MIC_SHIFT - 1);
+
+    for (int i = 0; i < frames; i++) {
+        if (c->bits == 16) {
+            out[i] = ((const int16_t *) in)[i * c->channels];
+            continue;
+        }
+        int64_t v = ((const int32_t *) in)[i * c->channels] + round;
+        if (c->dither) {
+            uint32_t r = xorshift(seed);
+            v += (int32_t) (r & 0x3fff) - (int32_t) ((r >> 16) & 0x3fff);
+        }
+        out[i] = sat16(v >> MIC_SHIFT);
+    }
+    return frames;
+}
+
+static int kernel(void *buf, int frames, const capture_case_t *c, uint32_t *seed)
+{
+    pcm_convert_t cv = {
+        .shift = MIC_SHIFT,
+        .dither = c->dither,
+        .channels = c->channels,
+        .channel = 0,
+        .seed = *seed,
+    };
+    int n;
+
+    if (c->bits == 16) {
+        return pcm_select_s16(buf, frames, c->channels, 0);
+    }
+    n = pcm_convert_s32_to_s16(&cv, buf, frames);
+    *seed = cv.seed;
+    return n;
+}
+
+static void fill(int32_t *buf, int words)
+{
+    for (int i = 0; i < words; i++) {
+        /* Microphone level audio, with the odd full scale slot */
+        buf[i] = (i % 97 == 0) ? INT32_MAX : (int32_t) (rand() << 8) / 64;
+    }
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t cycles(void)
+{
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+    static int32_t src[MAX_FRAMES * 2], buf[MAX_FRAMES * 2];
+    static int16_t ref[MAX_FRAMES];
+    volatile int16_t sink = 0;
+    int failed = 0;
+
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+    srand(1);
+    fill(src, MAX_FRAMES * 2);
+    printf("%-17s %6s %10s %10s %10s %10s %8s\n", "slots", "frames", "loop ns", "kernel ns", "loop cyc",
+           "kernel cyc", "speedup");
+    for (int c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        for (int b = 0; b < sizeof(block_frames) / sizeof(block_frames[0]); b++) {
+            const capture_case_t *cc = &cases[c];
+            int frames = block_frames[b];
+            uint32_t ref_seed = 1, seed = 1;
+
+            memcpy(buf, src, sizeof(buf));
+            reference(ref, src, frames, cc, &ref_seed);
+            if (kernel(buf, frames, cc, &seed) != frames || memcmp(buf, ref, frames * sizeof(int16_t)) != 0) {
+                printf("%s output differs from the per-sample loop\n", cc->name);
+                failed = 1;
+                continue;
+            }
+
+            double t0 = now_ns();
+            uint64_t c0 = cycles();
+            for (int i = 0; i < iterations; i++) {
+                reference(ref, src, frames, cc, &ref_seed);
+                sink ^= ref[i % frames];
+            }
+            double t1 = now_ns();
+            uint64_t c1 = cycles();
+            for (int i = 0; i < iterations; i++) {
+                /* The kernels work in place, like on the device; converting
+                 * converted data costs the same */
+                kernel(buf, frames, cc, &seed);
+                sink ^= ((int16_t *) buf)[i % frames];
+            }
+            double t2 = now_ns();
+            uint64_t c2 = cycles();
+            double samples = (double) iterations * frames;
+            printf("%-17s %6d %10.2f %10.2f %10.2f %10.2f %7.1fx\n", cc->name, frames, (t1 - t0) / samples,
+                   (t2 - t1) / samples, (c1 - c0) / samples, (c2 - c1) / samples, (t1 - t0) / (t2 - t1));
+        }
+    }
+    return failed;
+}
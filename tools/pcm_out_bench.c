@@ -0,0 +1,161 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+/*
+ * Host microbenchmark of the playback output kernels.
+ *
+ * Converts one I2S DMA buffer of 48 kHz 16-bit frames, 300 frames as on
+ * the board, for every speaker format and for mono and stereo streams. The
+ * kernels are timed against the path they replace. Mono streams used to be
+ * copied to both channels first. 16-bit output then went out with a plain
+ * copy. Wider output went through i2s_write_expand(), which zero-fills the
+ * low bytes and copies each sample with a byte loop; with 24 bits it packs
+ * three bytes per sample. Each kernel's output is checked against the old
+ * path before timing. Host timings only show the relative cost; run on the
+ * device for absolute numbers.
+ *
+ * Build from the repository root:
+ *   cc -O2 -o pcm_out_bench -Icomponents/audio_dsp tools/pcm_out_bench.c \
+ *      components/audio_dsp/pcm_convert.c
+ *
+ * Usage:
+ *   pcm_out_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "pcm_convert.h"
+
+#define BLOCK_FRAMES    300
+
+static const char *format_names[PCM_OUT_FORMAT_MAX] = {
+    [PCM_OUT_S16] = "16",
+    [PCM_OUT_S24_IN_32] = "24-in-32",
+    [PCM_OUT_S32] = "32",
+};
+
+/* audio_resample_up_channel() for a mono stream */
+static __attribute__((noinline)) void upmix(int16_t *out, const int16_t *in, int frames)
+{
+    for (int i = frames - 1; i >= 0; i--) {
+        out[2 * i] = out[2 * i + 1] = in[i];
+    }
+}
+
+/* The per-sample loop of i2s_write_expand() */
+static __attribute__((noinline)) void expand(uint8_t *out, const int16_t *in, int samples, int aim_bytes)
+{
+    const uint8_t *src = (const uint8_t *) in;
+    int zero_bytes = aim_bytes - 2;
+    int i = 0;
+
+    for (int j = 0; j < samples * 2; j += 2) {
+        for (int tail = 0; tail < zero_bytes; tail++) {
+            out[i++] = 0;
+        }
+        memcpy(&out[i], &src[j], 2);
+        i += 2;
+    }
+}
+
+static void old_path(uint8_t *out, int16_t *stereo, const int16_t *in, int channels, pcm_out_format_t format)
+{
+    const int16_t *frames = in;
+
+    if (channels == 1) {
+        upmix(stereo, in, BLOCK_FRAMES);
+        frames = stereo;
+    }
+    if (format == PCM_OUT_S16) {
+        memcpy(out, frames, BLOCK_FRAMES * 2 * sizeof(int16_t));
+    } else {
+        expand(out, frames, BLOCK_FRAMES * 2, format == PCM_OUT_S32 ? 4 : 3);
+    }
+}
+
+/* The old 24-bit output is packed, compare it slot by slot */
+static int matches(const uint8_t *old, const uint8_t *new, pcm_out_format_t format)
+{
+    if (format != PCM_OUT_S24_IN_32) {
+        return memcmp(old, new, BLOCK_FRAMES * pcm_out_frame_bytes(format)) == 0;
+    }
+    for (int i = 0; i < BLOCK_FRAMES * 2; i++) {
+        if (memcmp(old + 3 * i, new + 4 * i, 3) != 0 || (int8_t) new[4 * i + 3] != ((int8_t) new[4 * i + 2] >> 7)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+    int16_t in[BLOCK_FRAMES * 2], stereo[BLOCK_FRAMES * 2];
+    uint8_t old[BLOCK_FRAMES * 8], new[BLOCK_FRAMES * 8];
+    volatile uint8_t sink = 0;
+    int failed = 0;
+
+    srand(1);
+    for (int i = 0; i < BLOCK_FRAMES * 2; i++) {
+        in[i] = rand() - RAND_MAX / 2;
+    }
+    printf("%-10s %-7s %10s %10s %8s\n", "output", "stream", "old ns/fr", "new ns/fr", "speedup");
+    for (int f = 0; f < PCM_OUT_FORMAT_MAX; f++) {
+        for (int channels = 1; channels <= 2; channels++) {
+            pcm_out_fn_t kernel = pcm_out_kernel(channels, f);
+
+            memset(old, 0, sizeof(old));
+            memset(new, 0, sizeof(new));
+            old_path(old, stereo, in, channels, f);
+            kernel(new, in, BLOCK_FRAMES);
+            if (!matches(old, new, f)) {
+                printf("%s bit %s output differs from the old path\n", format_names[f], channels == 1 ? "mono" : "stereo");
+                failed = 1;
+                continue;
+            }
+
+            double t0 = now_ns();
+            for (int i = 0; i < iterations; i++) {
+                old_path(old, stereo, in, channels, f);
+                sink ^= old[i % sizeof(old)];
+            }
+            double t1 = now_ns();
+            for (int i = 0; i < iterations; i++) {
+                kernel(new, in, BLOCK_FRAMES);
+                sink ^= new[i % sizeof(new)];
+            }
+            double t2 = now_ns();
+            double old_ns = (t1 - t0) / iterations / BLOCK_FRAMES;
+            double new_ns = (t2 - t1) / iterations / BLOCK_FRAMES;
+            printf("%-10s %-7s %10.2f %10.2f %7.1fx\n", format_names[f], channels == 1 ? "mono" : "stereo",
+                   old_ns, new_ns, old_ns / new_ns);
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,232 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+/*
+ * Host loopback test of the capture tap.
+ *
+ * Plays the part of the device: 20 ms frames of a 16 kHz mono WAV (or a
+ * 440 Hz tone) are pushed in real time into a raw tap, as 32-bit stereo
+ * like the DMA buffers of 32-bit I2S mics, and a processed tap, as 16-bit
+ * mono, while a sender thread streams both over TCP the way
+ * app_capture_tap.c does. The sender can be limited to -r KB/s, or stalled
+ * for -k ms one second in, to make the taps fill up and drop. Prints the
+ * tap counters, which the collector's metadata should match: its lost
+ * frames are the drops here, less any after the last frame that was sent.
+ *
+ * Build from the repository root:
+ *   cc -O2 -pthread -o tap_sim -Icomponents/audio_dsp tools/tap_sim.c tools/wav_io.c \
+ *      components/audio_dsp/capture_tap.c -lm
+ *
+ * Usage:
+ *   tools/capture_tap_recv.py --once -o /tmp/tap &
+ *   tap_sim [-a host] [-p port] [-b buffer_kb] [-r kbps] [-k stall_ms] [-d seconds] [-i in.wav]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include "capture_tap.h"
+#include "wav_io.h"
+
+#define FRAME_MS        20
+#define FRAME           (WAV_SAMP_RATE * FRAME_MS / 1000)
+#define RAW_CHANNELS    2
+#define STALL_AT_US     1000000
+
+static capture_tap_t taps[CAPTURE_TAP_STREAMS];
+static volatile bool producing = true;
+static const char *host = "127.0.0.1";
+static const char *port = "5005";
+static int rate_kbps;
+static int stall_ms;
+static uint32_t sent_frames;
+static uint64_t sent_bytes;
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int tap_connect(void)
+{
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *addrs;
+    int fd;
+
+    if (getaddrinfo(host, port, &hints, &addrs) != 0) {
+        return -1;
+    }
+    fd = socket(addrs->ai_family, addrs->ai_socktype, addrs->ai_protocol);
+    if (fd >= 0 && connect(fd, addrs->ai_addr, addrs->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+    return fd;
+}
+
+static int send_all(int fd, const uint8_t *buf, uint32_t len)
+{
+    while (len) {
+        ssize_t n = send(fd, buf, len, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Same loop as capture_tap_task(), minus the reconnecting */
+static void *sender(void *arg)
+{
+    int fd = *(int *) arg;
+    int64_t start = now_us();
+    bool stalled = false;
+    const void *frame;
+    uint32_t len;
+
+    for (;;) {
+        bool idle = true;
+        if (stall_ms && !stalled && now_us() - start >= STALL_AT_US) {
+            usleep(stall_ms * 1000);
+            stalled = true;
+        }
+        for (int s = 0; s < CAPTURE_TAP_STREAMS; s++) {
+            frame = capture_tap_peek(&taps[s], &len);
+            if (!frame) {
+                continue;
+            }
+            idle = false;
+            if (send_all(fd, frame, len) != 0) {
+                fprintf(stderr, "send failed\n");
+                return NULL;
+            }
+            capture_tap_consume(&taps[s]);
+            sent_frames++;
+            sent_bytes += len;
+        }
+        if (rate_kbps) {
+            int64_t due = start + (int64_t) (sent_bytes / 1024) * 1000000 / rate_kbps;
+            if (due > now_us()) {
+                usleep(due - now_us());
+            }
+        }
+        if (idle) {
+            if (!producing) {
+                break;
+            }
+            usleep(FRAME_MS * 1000 / 2);
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *in_path = NULL;
+    int buffer_kb = 64, seconds = 5;
+    wav_t wav = {0};
+    int32_t raw[FRAME * RAW_CHANNELS];
+    pthread_t thread;
+    int64_t start;
+    void *mem[CAPTURE_TAP_STREAMS];
+    size_t frames;
+    int opt, fd;
+
+    while ((opt = getopt(argc, argv, "a:p:b:r:k:d:i:")) != -1) {
+        switch (opt) {
+        case 'a': host = optarg; break;
+        case 'p': port = optarg; break;
+        case 'b': buffer_kb = atoi(optarg); break;
+        case 'r': rate_kbps = atoi(optarg); break;
+        case 'k': stall_ms = atoi(optarg); break;
+        case 'd': seconds = atoi(optarg); break;
+        case 'i': in_path = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-a host] [-p port] [-b buffer_kb] [-r kbps] [-k stall_ms] "
+                    "[-d seconds] [-i in.wav]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (in_path) {
+        if (wav_read(in_path, &wav) != 0) {
+            return 1;
+        }
+    } else {
+        wav.len = (size_t) seconds * WAV_SAMP_RATE;
+        wav.data = malloc(wav.len * sizeof(int16_t));
+        for (size_t i = 0; i < wav.len; i++) {
+            wav.data[i] = 8000 * sin(2 * M_PI * 440 * i / WAV_SAMP_RATE);
+        }
+    }
+    for (int s = 0; s < CAPTURE_TAP_STREAMS; s++) {
+        mem[s] = malloc(buffer_kb * 1024);
+        capture_tap_init(&taps[s], s, mem[s], buffer_kb * 1024);
+    }
+
+    fd = tap_connect();
+    if (fd < 0) {
+        fprintf(stderr, "Can't connect to %s:%s, is capture_tap_recv.py running?\n", host, port);
+        return 1;
+    }
+    pthread_create(&thread, NULL, sender, &fd);
+
+    start = now_us();
+    frames = wav.len / FRAME;
+    for (size_t f = 0; f < frames; f++) {
+        const int16_t *pcm = wav.data + f * FRAME;
+        int64_t ts = f * FRAME_MS * 1000;
+        for (int i = 0; i < FRAME; i++) {
+            raw[i * 2] = raw[i * 2 + 1] = pcm[i] * 65536;
+        }
+        capture_tap_push(&taps[CAPTURE_TAP_RAW], raw, sizeof(raw), 32, RAW_CHANNELS, WAV_SAMP_RATE, ts);
+        capture_tap_push(&taps[CAPTURE_TAP_PROCESSED], pcm, FRAME * sizeof(int16_t), 16, 1, WAV_SAMP_RATE, ts);
+        if (start + ts + FRAME_MS * 1000 > now_us()) {
+            usleep(start + ts + FRAME_MS * 1000 - now_us());
+        }
+    }
+    producing = false;
+    pthread_join(thread, NULL);
+    close(fd);
+
+    printf("%zu frames per stream, sent %u frames, %llu bytes\n", frames, sent_frames,
+           (unsigned long long) sent_bytes);
+    for (int s = 0; s < CAPTURE_TAP_STREAMS; s++) {
+        printf("%-9s queued %u, dropped %u (%u bytes), peak %u of %u bytes\n",
+               s == CAPTURE_TAP_RAW ? "raw" : "processed", taps[s].stats.frames, taps[s].stats.dropped,
+               taps[s].stats.dropped_bytes, taps[s].stats.max_used, taps[s].size);
+        free(mem[s]);
+    }
+    free(wav.data);
+    return 0;
+}
@@ -0,0 +1,189 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+/*
+ * Host benchmark of the telemetry encodings.
+ *
+ * Encodes one event of each kind the device publishes, with values of the
+ * size seen on the board, as JSON and as CBOR through the encoders in
+ * main/telemetry_codec.c. Prints the payload sizes, the bytes each publish
+ * puts on the wire once MQTT (QoS 1 PUBLISH and its PUBACK) and a TLS 1.2
+ * AES-GCM record are added, and the encode time. Host timings only show
+ * the relative cost; run on the device for absolute numbers. -x prints
+ * each CBOR payload in hex for tools/telemetry_decode.py --hex.
+ *
+ * Build from the repository root:
+ *   cc -O2 -o telemetry_bench -Imain tools/telemetry_bench.c main/telemetry_codec.c \
+ *      main/cbor_writer.c
+ *
+ * Usage:
+ *   telemetry_bench [-n iterations] [-t topic] [-x]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "telemetry_codec.h"
+
+#define PAYLOAD_MAX         100     /* AWS_IOT_PAYLOAD_MAX */
+/* TLS 1.2 record header, explicit nonce and tag of AES-GCM */
+#define TLS_RECORD_BYTES    (5 + 8 + 16)
+#define MQTT_PUBACK_BYTES   4
+
+typedef struct sample_event {
+    const char *name;
+    telemetry_record_t rec;
+} sample_event_t;
+
+/* Boot and sequence numbers of a device some weeks into a soak run */
+#define BOOT    37
+#define TS      1540000000u
+
+static const sample_event_t events[] = {
+    { "wake_word", { 1, 12, BOOT, 1042, TS, true } },
+    { "heap_internal_free", { 3, 61234, BOOT, 1043, TS, false } },
+    { "heap_internal_min", { 4, 48900, BOOT, 1044, TS, false } },
+    { "heap_internal_largest", { 5, 31744, BOOT, 1045, TS, false } },
+    { "heap_psram_free", { 6, 3145728, BOOT, 1046, TS, false } },
+    { "heap_psram_min", { 7, 2990112, BOOT, 1047, TS, false } },
+    { "heap_psram_largest", { 8, 2031616, BOOT, 1048, TS, false } },
+    { "stack_min", { 9, 412, BOOT, 1049, TS, false } },
+    { "wake_skipped", { 10, 3, BOOT, 1050, TS, false } },
+};
+
+#define EVENTS  ((int) (sizeof(events) / sizeof(events[0])))
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int varint_len(int len)
+{
+    return len < 128 ? 1 : len < 16384 ? 2 : 3;
+}
+
+/* PUBLISH with a packet id, its PUBACK, each in a TLS record of its own */
+static int wire_bytes(int payload, int topic_len)
+{
+    int remaining = 2 + topic_len + 2 + payload;
+
+    return 1 + varint_len(remaining) + remaining + TLS_RECORD_BYTES + MQTT_PUBACK_BYTES + TLS_RECORD_BYTES;
+}
+
+static double encode_ns(const telemetry_record_t *rec, bool cbor, int iterations)
+{
+    uint8_t buf[PAYLOAD_MAX];
+    volatile int sink = 0;
+    telemetry_record_t r = *rec;
+    int64_t t = now_ns();
+
+    for (int i = 0; i < iterations; i++) {
+        /* A new sequence number each time, as on the device */
+        r.seq = rec->seq + (i & 0xffff);
+        sink += cbor ? telemetry_encode_cbor(&r, buf, sizeof(buf)) :
+                telemetry_encode_json(&r, (char *) buf, sizeof(buf));
+    }
+    (void) sink;
+    return (double) (now_ns() - t) / iterations;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *topic = "test_topic/esp32";
+    int iterations = 1000000;
+    bool hex = false;
+    uint8_t buf[PAYLOAD_MAX];
+    int json_sum = 0, cbor_sum = 0, json_wire = 0, cbor_wire = 0;
+    double json_ns_sum = 0, cbor_ns_sum = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:t:x")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 't':
+            topic = optarg;
+            break;
+        case 'x':
+            hex = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-t topic] [-x]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (iterations <= 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    if (!hex) {
+        printf("%-22s %5s %5s %6s %6s %8s %8s\n", "event", "json", "cbor", "json", "cbor", "json", "cbor");
+        printf("%-22s %5s %5s %6s %6s %8s %8s\n", "", "bytes", "bytes", "wire", "wire", "ns", "ns");
+    }
+    for (int i = 0; i < EVENTS; i++) {
+        const telemetry_record_t *rec = &events[i].rec;
+        int json = telemetry_encode_json(rec, (char *) buf, sizeof(buf));
+        int cbor = telemetry_encode_cbor(rec, buf, sizeof(buf));
+        int jw, cw;
+        double jns, cns;
+
+        if (json < 0 || cbor < 0) {
+            fprintf(stderr, "%s doesn't fit in %d bytes\n", events[i].name, PAYLOAD_MAX);
+            return 1;
+        }
+        if (hex) {
+            printf("%s ", events[i].name);
+            for (int b = 0; b < cbor; b++) {
+                printf("%02x", buf[b]);
+            }
+            printf("\n");
+            continue;
+        }
+        jw = wire_bytes(json, strlen(topic));
+        cw = wire_bytes(cbor, strlen(topic));
+        jns = encode_ns(rec, false, iterations);
+        cns = encode_ns(rec, true, iterations);
+        printf("%-22s %5d %5d %6d %6d %8.1f %8.1f\n", events[i].name, json, cbor, jw, cw, jns, cns);
+        json_sum += json;
+        cbor_sum += cbor;
+        json_wire += jw;
+        cbor_wire += cw;
+        json_ns_sum += jns;
+        cbor_ns_sum += cns;
+    }
+    if (hex) {
+        return 0;
+    }
+    printf("%-22s %5.1f %5.1f %6.1f %6.1f %8.1f %8.1f\n", "mean", (double) json_sum / EVENTS,
+           (double) cbor_sum / EVENTS, (double) json_wire / EVENTS, (double) cbor_wire / EVENTS,
+           json_ns_sum / EVENTS, cbor_ns_sum / EVENTS);
+    printf("cbor: %.0f%% of the json payload, %.0f%% of the bytes on the wire, %.1fx faster to encode\n",
+           100.0 * cbor_sum / json_sum, 100.0 * cbor_wire / json_wire, json_ns_sum / cbor_ns_sum);
+    return 0;
+}
@@ -0,0 +1,171 @@
+#!/usr/bin/env python
+#
+# Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Decode CBOR telemetry published by the device into JSON.
+
+The device encodes each event as a CBOR map with small integer keys (see
+telemetry_encode_cbor() in main/telemetry_codec.c). This expands the
+keys and event types to the names used by the JSON encoding.
+
+    telemetry_decode.py payload.bin
+    telemetry_decode.py --hex a500011801...
+
+Only depends on the standard library, so it can be dropped into a cloud
+function as is; decode() takes the raw MQTT payload.
+"""
+
+from __future__ import print_function
+
+import argparse
+import binascii
+import json
+import struct
+import sys
+
+KEYS = {0: 'type', 1: 'boot', 2: 'seq', 3: 'ts', 4: 'value'}
+
+# aws_iot_event_type_t in main/app_aws_iot.h
+EVENT_TYPES = {
+    1: 'wake_word',
+    2: 'bench',
+    3: 'heap_internal_free',
+    4: 'heap_internal_min',
+    5: 'heap_internal_largest',
+    6: 'heap_psram_free',
+    7: 'heap_psram_min',
+    8: 'heap_psram_largest',
+    9: 'stack_min',
+    10: 'wake_skipped',
+    11: 'capture_lost',
+}
+
+
+class CBORDecodeError(ValueError):
+    pass
+
+
+class _Reader(object):
+    def __init__(self, data):
+        self.data = bytearray(data)
+        self.pos = 0
+
+    def take(self, n):
+        if self.pos + n > len(self.data):
+            raise CBORDecodeError('truncated payload')
+        chunk = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return chunk
+
+    def argument(self, info):
+        if info < 24:
+            return info
+        if info == 24:
+            return self.take(1)[0]
+        if info == 25:
+            return struct.unpack('>H', bytes(self.take(2)))[0]
+        if info == 26:
+            return struct.unpack('>I', bytes(self.take(4)))[0]
+        if info == 27:
+            return struct.unpack('>Q', bytes(self.take(8)))[0]
+        raise CBORDecodeError('indefinite lengths are not used by the device')
+
+    def item(self):
+        initial = self.take(1)[0]
+        major, info = initial >> 5, initial & 0x1f
+        if major == 7:
+            return self.simple(info)
+        val = self.argument(info)
+        if major == 0:
+            return val
+        if major == 1:
+            return -1 - val
+        if major == 2:
+            return binascii.hexlify(bytes(self.take(val))).decode()
+        if major == 3:
+            return bytes(self.take(val)).decode('utf-8')
+        if major == 4:
+            return [self.item() for _ in range(val)]
+        if major == 5:
+            return dict((self.item(), self.item()) for _ in range(val))
+        # Tags carry no meaning for the telemetry, return the tagged item
+        return self.item()
+
+    def simple(self, info):
+        if info == 20:
+            return False
+        if info == 21:
+            return True
+        if info in (22, 23):
+            return None
+        if info == 25:
+            return _half_to_float(struct.unpack('>H', bytes(self.take(2)))[0])
+        if info == 26:
+            return struct.unpack('>f', bytes(self.take(4)))[0]
+        if info == 27:
+            return struct.unpack('>d', bytes(self.take(8)))[0]
+        raise CBORDecodeError('unsupported simple value %d' % info)
+
+
+def _half_to_float(h):
+    exp = (h >> 10) & 0x1f
+    mant = h & 0x3ff
+    if exp == 0:
+        val = mant * 2.0 ** -24
+    elif exp == 31:
+        val = float('inf') if mant == 0 else float('nan')
+    else:
+        val = (mant + 1024) * 2.0 ** (exp - 25)
+    return -val if h & 0x8000 else val
+
+
+def decode(payload):
+    """Decode one telemetry payload into a dict with named fields."""
+    reader = _Reader(payload)
+    record = reader.item()
+    if reader.pos != len(reader.data):
+        raise CBORDecodeError('%d trailing bytes' % (len(reader.data) - reader.pos))
+    if not isinstance(record, dict):
+        raise CBORDecodeError('telemetry record is not a map')
+    named = dict((KEYS.get(k, k), v) for k, v in record.items())
+    if named.get('type') in EVENT_TYPES:
+        named['type'] = EVENT_TYPES[named['type']]
+    if named.get('type') == 'wake_word':
+        named['wake_word_count'] = named.pop('value')
+    return named
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('payload', nargs='?', help='file with the raw payload (default: stdin)')
+    parser.add_argument('--hex', help='payload as a hex string')
+    args = parser.parse_args()
+
+    if args.hex:
+        data = binascii.unhexlify(args.hex.replace(' ', ''))
+    elif args.payload:
+        with open(args.payload, 'rb') as f:
+            data = f.read()
+    else:
+        data = getattr(sys.stdin, 'buffer', sys.stdin).read()
+
+    try:
+        print(json.dumps(decode(data), sort_keys=True))
+    except CBORDecodeError as e:
+        sys.exit('Invalid telemetry payload: %s' % e)
+
+
+if __name__ == '__main__':
+    main()
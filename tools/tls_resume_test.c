@@ -0,0 +1,534 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+/*
+ * Host loopback test of the AWS IoT connect path.
+ *
+ * A thread stands in for the broker: TLS 1.2 with client certificates, as
+ * AWS IoT requires, session IDs and tickets, and a CONNACK for every MQTT
+ * CONNECT. The client connects -n times in each of four ways and times
+ * DNS, TCP, TLS and MQTT CONNECT the way aws_tls.c logs them:
+ *
+ *   pem      PEM credentials parsed and a full handshake on every connect,
+ *            as the SDK's mbedTLS layer did
+ *   parsed   credentials parsed once, full handshake
+ *   resumed  credentials parsed once, the session of the last handshake
+ *            offered, as aws_tls.c does on reconnects
+ *   reboot   as resumed, but the session goes through a file between
+ *            connects the way aws_tls.c keeps it in NVS across reboots
+ *
+ * The keys are fresh RSA-2048 ones, the size of AWS IoT device keys. OpenSSL
+ * does the TLS here rather than mbedTLS, so the CPU times are the host's;
+ * the round trips and bytes are what the device sees. The client waits
+ * -r ms each time it turns from sending to waiting for a reply, and for
+ * the TCP connect, to stand in for the link.
+ *
+ * Build from the repository root:
+ *   cc -O2 -pthread -o tls_resume_test tools/tls_resume_test.c -lssl -lcrypto
+ *
+ * Usage:
+ *   tls_resume_test [-n connects] [-r rtt_ms] [-p port]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#define KEY_BITS            2048
+#define CIPHERS             "ECDHE-RSA-AES128-GCM-SHA256"
+#define SESSION_FILE        "/tmp/tls_resume_test.session"
+#define CERT_DAYS           30
+
+enum { MODE_PEM, MODE_PARSED, MODE_RESUMED, MODE_REBOOT, MODE_MAX };
+static const char *mode_names[MODE_MAX] = { "pem", "parsed", "resumed", "reboot" };
+
+typedef struct phase_times {
+    double creds_ms, dns_ms, tcp_ms, tls_ms, mqtt_ms;
+    uint32_t bytes;
+    uint32_t round_trips;
+    bool resumed;
+} phase_times_t;
+
+/* Traffic seen by the client's socket BIO */
+typedef struct wire {
+    uint32_t bytes;
+    uint32_t round_trips;
+    bool wrote;
+} wire_t;
+
+static int connects = 20;
+static int rtt_ms;
+static int port = 8883;
+
+static EVP_PKEY *ca_key, *server_key, *client_key;
+static X509 *ca_cert, *server_cert, *client_cert;
+/* What the SDK had embedded */
+static char *ca_pem, *cert_pem, *key_pem;
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static double elapsed_ms(int64_t *since)
+{
+    int64_t now = now_us();
+    double ms = (now - *since) / 1000.0;
+
+    *since = now;
+    return ms;
+}
+
+static void die(const char *what)
+{
+    fprintf(stderr, "%s failed\n", what);
+    ERR_print_errors_fp(stderr);
+    exit(1);
+}
+
+static X509 *make_cert(const char *cn, EVP_PKEY *key, X509 *issuer, EVP_PKEY *issuer_key, long serial)
+{
+    X509 *x = X509_new();
+
+    X509_set_version(x, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(x), serial);
+    X509_gmtime_adj(X509_getm_notBefore(x), 0);
+    X509_gmtime_adj(X509_getm_notAfter(x), CERT_DAYS * 24 * 3600L);
+    X509_set_pubkey(x, key);
+    X509_NAME_add_entry_by_txt(X509_get_subject_name(x), "CN", MBSTRING_ASC, (const unsigned char *) cn, -1, -1, 0);
+    X509_set_issuer_name(x, X509_get_subject_name(issuer ? issuer : x));
+    if (!issuer) {
+        X509V3_CTX ctx;
+        X509_EXTENSION *ext;
+
+        X509V3_set_ctx(&ctx, x, x, NULL, NULL, 0);
+        ext = X509V3_EXT_conf_nid(NULL, &ctx, NID_basic_constraints, "critical,CA:TRUE");
+        X509_add_ext(x, ext, -1);
+        X509_EXTENSION_free(ext);
+    }
+    if (!X509_sign(x, issuer_key ? issuer_key : key, EVP_sha256())) {
+        die("X509_sign");
+    }
+    return x;
+}
+
+static char *to_pem(X509 *x, EVP_PKEY *key)
+{
+    BIO *bio = BIO_new(BIO_s_mem());
+    char *data, *pem;
+    long len;
+
+    if (x) {
+        PEM_write_bio_X509(bio, x);
+    } else {
+        PEM_write_bio_PrivateKey(bio, key, NULL, NULL, 0, NULL, NULL);
+    }
+    len = BIO_get_mem_data(bio, &data);
+    pem = malloc(len + 1);
+    memcpy(pem, data, len);
+    pem[len] = 0;
+    BIO_free(bio);
+    return pem;
+}
+
+static void make_credentials(void)
+{
+    ca_key = EVP_RSA_gen(KEY_BITS);
+    server_key = EVP_RSA_gen(KEY_BITS);
+    client_key = EVP_RSA_gen(KEY_BITS);
+    if (!ca_key || !server_key || !client_key) {
+        die("EVP_RSA_gen");
+    }
+    ca_cert = make_cert("tls_resume_test CA", ca_key, NULL, NULL, 1);
+    server_cert = make_cert("localhost", server_key, ca_cert, ca_key, 2);
+    client_cert = make_cert("tls_resume_test device", client_key, ca_cert, ca_key, 3);
+    ca_pem = to_pem(ca_cert, NULL);
+    cert_pem = to_pem(client_cert, NULL);
+    key_pem = to_pem(NULL, client_key);
+}
+
+static SSL_CTX *ctx_new(const SSL_METHOD *method)
+{
+    SSL_CTX *ctx = SSL_CTX_new(method);
+
+    if (!ctx) {
+        die("SSL_CTX_new");
+    }
+    /* mbedTLS in ESP-IDF 3.1 stops at TLS 1.2 */
+    SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_cipher_list(ctx, CIPHERS);
+    return ctx;
+}
+
+static void ctx_set_credentials(SSL_CTX *ctx, X509 *ca, X509 *cert, EVP_PKEY *key)
+{
+    X509_STORE_add_cert(SSL_CTX_get_cert_store(ctx), ca);
+    if (SSL_CTX_use_certificate(ctx, cert) != 1 || SSL_CTX_use_PrivateKey(ctx, key) != 1) {
+        die("loading credentials");
+    }
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
+}
+
+/* Reads one MQTT packet, returns its type or -1 */
+static int mqtt_read_packet(SSL *ssl)
+{
+    uint8_t hdr, b, buf[256];
+    uint32_t len = 0;
+    int shift = 0;
+
+    if (SSL_read(ssl, &hdr, 1) != 1) {
+        return -1;
+    }
+    do {
+        if (SSL_read(ssl, &b, 1) != 1) {
+            return -1;
+        }
+        len |= (b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    while (len) {
+        int n = SSL_read(ssl, buf, len < sizeof(buf) ? len : sizeof(buf));
+        if (n <= 0) {
+            return -1;
+        }
+        len -= n;
+    }
+    return hdr >> 4;
+}
+
+static void *broker_thread(void *arg)
+{
+    static const uint8_t connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    int lfd = *(int *) arg;
+    SSL_CTX *ctx = ctx_new(TLS_server_method());
+    const unsigned char sid_ctx[] = "tls_resume_test";
+
+    ctx_set_credentials(ctx, ca_cert, server_cert, server_key);
+    SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx));
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+
+    while (1) {
+        int fd = accept(lfd, NULL, NULL);
+        SSL *ssl;
+
+        if (fd < 0) {
+            continue;
+        }
+        ssl = SSL_new(ctx);
+        SSL_set_fd(ssl, fd);
+        if (SSL_accept(ssl) == 1 && mqtt_read_packet(ssl) == 1) {
+            SSL_write(ssl, connack, sizeof(connack));
+            /* Until the client disconnects */
+            mqtt_read_packet(ssl);
+        }
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+        close(fd);
+    }
+    return NULL;
+}
+
+static int broker_start(void)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port),
+                                .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    static int lfd;
+    int one = 1;
+    pthread_t thread;
+
+    lfd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (lfd < 0 || bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(lfd, 4) != 0) {
+        perror("broker");
+        return -1;
+    }
+    pthread_create(&thread, NULL, broker_thread, &lfd);
+    pthread_detach(thread);
+    return 0;
+}
+
+/* Counts the bytes, and stands in for the link: turning from sending to
+ * waiting for the other side costs a round trip */
+static long wire_cb(BIO *bio, int oper, const char *argp, size_t len, int argi, long argl, int ret,
+                    size_t *processed)
+{
+    wire_t *w = (wire_t *) BIO_get_callback_arg(bio);
+
+    if (oper == BIO_CB_READ && w->wrote) {
+        w->wrote = false;
+        w->round_trips++;
+        usleep(rtt_ms * 1000);
+    } else if (oper == (BIO_CB_WRITE | BIO_CB_RETURN) && ret > 0) {
+        w->wrote = true;
+        w->bytes += *processed;
+    } else if (oper == (BIO_CB_READ | BIO_CB_RETURN) && ret > 0) {
+        w->bytes += *processed;
+    }
+    return ret;
+}
+
+static SSL_CTX *client_ctx(bool from_pem, double *creds_ms)
+{
+    SSL_CTX *ctx = ctx_new(TLS_client_method());
+    int64_t t = now_us();
+
+    if (from_pem) {
+        BIO *ca_bio = BIO_new_mem_buf(ca_pem, -1);
+        BIO *cert_bio = BIO_new_mem_buf(cert_pem, -1);
+        BIO *key_bio = BIO_new_mem_buf(key_pem, -1);
+        X509 *ca = PEM_read_bio_X509(ca_bio, NULL, NULL, NULL);
+        X509 *cert = PEM_read_bio_X509(cert_bio, NULL, NULL, NULL);
+        EVP_PKEY *key = PEM_read_bio_PrivateKey(key_bio, NULL, NULL, NULL);
+
+        if (!ca || !cert || !key) {
+            die("PEM parse");
+        }
+        ctx_set_credentials(ctx, ca, cert, key);
+        X509_free(ca);
+        X509_free(cert);
+        EVP_PKEY_free(key);
+        BIO_free(ca_bio);
+        BIO_free(cert_bio);
+        BIO_free(key_bio);
+    } else {
+        ctx_set_credentials(ctx, ca_cert, client_cert, client_key);
+    }
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    *creds_ms = elapsed_ms(&t);
+    return ctx;
+}
+
+static SSL_SESSION *session_load(SSL_CTX *ctx)
+{
+    uint8_t blob[4096];
+    const uint8_t *p = blob;
+    FILE *f = fopen(SESSION_FILE, "rb");
+    size_t len;
+
+    if (!f) {
+        return NULL;
+    }
+    len = fread(blob, 1, sizeof(blob), f);
+    fclose(f);
+    return d2i_SSL_SESSION(NULL, &p, len);
+}
+
+static void session_save(SSL_SESSION *session)
+{
+    uint8_t *blob = NULL;
+    int len = i2d_SSL_SESSION(session, &blob);
+    FILE *f = fopen(SESSION_FILE, "wb");
+
+    if (f && len > 0) {
+        fwrite(blob, 1, len, f);
+    }
+    if (f) {
+        fclose(f);
+    }
+    OPENSSL_free(blob);
+}
+
+/* One connect the way aws_tls_connect() does it, then a CONNECT/CONNACK */
+static int connect_once(SSL_CTX *ctx, SSL_SESSION **session, phase_times_t *pt)
+{
+    static const uint8_t mqtt_connect[] = {
+        0x10, 0x12, 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02, 0x04, 0xb0,
+        0x00, 0x06, 't', 'h', 'i', 'n', 'g', '1'
+    };
+    static const uint8_t disconnect[] = { 0xe0, 0x00 };
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *addrs;
+    char port_str[8];
+    wire_t w = { 0 };
+    int one = 1;
+    int64_t t = now_us();
+    SSL *ssl;
+    BIO *bio;
+    int fd;
+
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    if (getaddrinfo("localhost", port_str, &hints, &addrs) != 0) {
+        return -1;
+    }
+    pt->dns_ms = elapsed_ms(&t);
+    fd = socket(addrs->ai_family, addrs->ai_socktype, addrs->ai_protocol);
+    /* As aws_tls.c: without it the CONNECT after a resumed handshake waits
+     * for the broker's delayed ACK of the client Finished */
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    usleep(rtt_ms * 1000);
+    if (connect(fd, addrs->ai_addr, addrs->ai_addrlen) != 0) {
+        freeaddrinfo(addrs);
+        close(fd);
+        return -1;
+    }
+    freeaddrinfo(addrs);
+    pt->tcp_ms = elapsed_ms(&t);
+
+    ssl = SSL_new(ctx);
+    bio = BIO_new_socket(fd, BIO_NOCLOSE);
+    BIO_set_callback_ex(bio, wire_cb);
+    BIO_set_callback_arg(bio, (char *) &w);
+    SSL_set_bio(ssl, bio, bio);
+    if (*session) {
+        SSL_set_session(ssl, *session);
+    }
+    if (SSL_connect(ssl) != 1) {
+        /* Like aws_tls_forget_session() */
+        SSL_SESSION_free(*session);
+        *session = NULL;
+        SSL_free(ssl);
+        close(fd);
+        return -1;
+    }
+    pt->tls_ms = elapsed_ms(&t);
+    pt->resumed = SSL_session_reused(ssl);
+
+    SSL_write(ssl, mqtt_connect, sizeof(mqtt_connect));
+    if (mqtt_read_packet(ssl) != 2) {
+        SSL_free(ssl);
+        close(fd);
+        return -1;
+    }
+    pt->mqtt_ms = elapsed_ms(&t);
+    pt->bytes = w.bytes;
+    pt->round_trips = w.round_trips;
+
+    /* The ticket may arrive with the last handshake flight, after
+     * SSL_connect() has returned, so the session is taken after CONNACK */
+    SSL_SESSION_free(*session);
+    *session = SSL_get1_session(ssl);
+    SSL_write(ssl, disconnect, sizeof(disconnect));
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    close(fd);
+    return 0;
+}
+
+static void run_mode(int mode)
+{
+    phase_times_t sum = { 0 }, pt;
+    SSL_CTX *ctx = NULL;
+    SSL_SESSION *session = NULL;
+    int ok = 0, resumed = 0;
+    double total_min = 1e9;
+
+    remove(SESSION_FILE);
+    for (int i = 0; i < connects; i++) {
+        memset(&pt, 0, sizeof(pt));
+        if (mode == MODE_PEM || mode == MODE_REBOOT || !ctx) {
+            /* A fresh context each time, nothing carried over in RAM */
+            SSL_CTX_free(ctx);
+            ctx = client_ctx(mode == MODE_PEM, &pt.creds_ms);
+        }
+        if (mode == MODE_REBOOT) {
+            SSL_SESSION_free(session);
+            session = session_load(ctx);
+        }
+        if (connect_once(ctx, &session, &pt) != 0) {
+            fprintf(stderr, "%s: connect %d failed\n", mode_names[mode], i);
+            ERR_print_errors_fp(stderr);
+            continue;
+        }
+        if (mode == MODE_PARSED || mode == MODE_PEM) {
+            SSL_SESSION_free(session);
+            session = NULL;
+        } else if (mode == MODE_REBOOT && session) {
+            session_save(session);
+        }
+        ok++;
+        resumed += pt.resumed;
+        sum.creds_ms += pt.creds_ms;
+        sum.dns_ms += pt.dns_ms;
+        sum.tcp_ms += pt.tcp_ms;
+        sum.tls_ms += pt.tls_ms;
+        sum.mqtt_ms += pt.mqtt_ms;
+        sum.bytes += pt.bytes;
+        sum.round_trips += pt.round_trips;
+        double total = pt.creds_ms + pt.dns_ms + pt.tcp_ms + pt.tls_ms + pt.mqtt_ms;
+        if (total < total_min) {
+            total_min = total;
+        }
+    }
+    SSL_SESSION_free(session);
+    SSL_CTX_free(ctx);
+    remove(SESSION_FILE);
+    if (!ok) {
+        printf("%-8s no successful connects\n", mode_names[mode]);
+        return;
+    }
+    printf("%-8s %7.2f %7.2f %7.2f %7.2f %7.2f %8.2f %8.2f %6u %4.1f %4d/%d\n", mode_names[mode],
+           sum.creds_ms / ok, sum.dns_ms / ok, sum.tcp_ms / ok, sum.tls_ms / ok, sum.mqtt_ms / ok,
+           (sum.creds_ms + sum.dns_ms + sum.tcp_ms + sum.tls_ms + sum.mqtt_ms) / ok, total_min,
+           sum.bytes / ok, (double) sum.round_trips / ok, resumed, ok);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:p:")) != -1) {
+        switch (opt) {
+        case 'n':
+            connects = atoi(optarg);
+            break;
+        case 'r':
+            rtt_ms = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n connects] [-r rtt_ms] [-p port]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (connects <= 0 || rtt_ms < 0) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+    make_credentials();
+    if (broker_start() != 0) {
+        return 1;
+    }
+
+    printf("%d connects per mode, %d ms round trip, RSA-%d, %s\n", connects, rtt_ms, KEY_BITS, CIPHERS);
+    printf("%-8s %7s %7s %7s %7s %7s %8s %8s %6s %4s %s\n", "mode", "creds", "dns", "tcp", "tls", "mqtt",
+           "total", "best", "bytes", "rtts", "resumed");
+    for (int mode = 0; mode < MODE_MAX; mode++) {
+        run_mode(mode);
+    }
+    printf("(times in ms, mean over the connects; rtts are the TLS and MQTT round trips)\n");
+    return 0;
+}
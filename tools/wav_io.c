@@ -0,0 +1,107 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wav_io.h"
+
+static uint32_t rd32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint16_t rd16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static void wr32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+int wav_read(const char *path, wav_t *wav)
+{
+    uint8_t hdr[12], chunk[8], fmt[16];
+    int have_fmt = 0;
+    FILE *f = fopen(path, "rb");
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    if (fread(hdr, 1, 12, f) != 12 || memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4)) {
+        fprintf(stderr, "%s: not a WAV file\n", path);
+        goto fail;
+    }
+    while (fread(chunk, 1, 8, f) == 8) {
+        uint32_t size = rd32(chunk + 4);
+        if (!memcmp(chunk, "fmt ", 4) && size >= 16) {
+            if (fread(fmt, 1, 16, f) != 16) {
+                break;
+            }
+            if (rd16(fmt) != 1 || rd16(fmt + 2) != 1 || rd32(fmt + 4) != WAV_SAMP_RATE || rd16(fmt + 14) != 16) {
+                fprintf(stderr, "%s: need 16 kHz 16-bit mono PCM\n", path);
+                goto fail;
+            }
+            have_fmt = 1;
+            fseek(f, size - 16 + (size & 1), SEEK_CUR);
+        } else if (!memcmp(chunk, "data", 4) && have_fmt) {
+            wav->len = size / 2;
+            wav->data = malloc(wav->len * 2 + 1);
+            if (!wav->data || fread(wav->data, 2, wav->len, f) != wav->len) {
+                fprintf(stderr, "%s: short data chunk\n", path);
+                goto fail;
+            }
+            fclose(f);
+            return 0;
+        } else {
+            fseek(f, size + (size & 1), SEEK_CUR);
+        }
+    }
+    fprintf(stderr, "%s: no audio data\n", path);
+fail:
+    fclose(f);
+    return -1;
+}
+
+int wav_write(const char *path, const int16_t *data, size_t frames, int channels)
+{
+    uint8_t hdr[44] = "RIFF....WAVEfmt \x10\0\0\0\x01\0\x01\0........\x02\0\x10\0data....";
+    size_t bytes = frames * channels * sizeof(int16_t);
+    FILE *f = fopen(path, "wb");
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    hdr[22] = channels;
+    hdr[32] = channels * sizeof(int16_t);
+    wr32(hdr + 4, 36 + bytes);
+    wr32(hdr + 24, WAV_SAMP_RATE);
+    wr32(hdr + 28, WAV_SAMP_RATE * channels * sizeof(int16_t));
+    wr32(hdr + 40, bytes);
+    fwrite(hdr, 1, sizeof(hdr), f);
+    fwrite(data, sizeof(int16_t) * channels, frames, f);
+    fclose(f);
+    return 0;
+}
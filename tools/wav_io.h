@@ -0,0 +1,49 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+#ifndef _WAV_IO_H_
+#define _WAV_IO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Minimal WAV reading and writing for the host tools. Only 16 kHz 16-bit
+ * PCM, and only on little-endian hosts, like the device.
+ */
+
+#define WAV_SAMP_RATE   16000
+
+typedef struct {
+    int16_t *data;
+    size_t len;
+} wav_t;
+
+/**
+ * @brief  read a mono file, printing the reason on failure
+ *
+ * @return 0 on success; wav->data is then malloc()ed
+ */
+int wav_read(const char *path, wav_t *wav);
+
+/**
+ * @brief  write interleaved frames of `channels` samples each
+ */
+int wav_write(const char *path, const int16_t *data, size_t frames, int channels);
+
+#endif /* _WAV_IO_H_ */
@@ -0,0 +1,482 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+/*
+ * Host benchmark for the wake word engine and the detection logic in
+ * nn_task.
+ *
+ * Streams every file of a labelled corpus through a wake_engine_t framed
+ * as on the device: read_rb_task takes 20 ms capture frames, gates each
+ * frame on its level and cuts the frames that pass into the engine's
+ * chunks; nn_task runs batches of -b chunks through the same wake_detect
+ * logic. Optionally runs again with noise mixed in at each -s SNR. Reports the detection rate on positives, false accepts per
+ * hour on negatives, trigger latency after the end of the keyword and the
+ * time per engine call. -j writes it all, per file too, as JSON for
+ * comparing builds.
+ *
+ * The corpus is a list file with one recording per line:
+ *   <wav> pos [keyword_end_ms]
+ *   <wav> neg
+ * Paths are relative to the list file, '#' starts a comment. Recordings
+ * must be 16 kHz 16-bit mono WAV. A positive counts as detected if it
+ * triggers no earlier than -e ms before the labelled end of the keyword
+ * (anywhere, if there is no label).
+ *
+ * Build from the repository root, naming the engine's wake_engine_t and
+ * adding its sources (main/wake_engine_wwe.c plus a host build of ESP-WWE
+ * for the default):
+ *   cc -O2 -o wwe_bench -DBENCH_ENGINE=wake_engine_energy -Icomponents/audio_dsp \
+ *      tools/wwe_bench.c tools/wav_io.c components/audio_dsp/wake_detect.c \
+ *      components/audio_dsp/frontend.c tools/wwe_energy_engine.c -lm
+ * tools/wwe_energy_engine.c stands in for an engine to check the harness
+ * itself; its numbers say nothing about wake word accuracy.
+ *
+ * Usage:
+ *   wwe_bench [-k hits] [-c min_confidence] [-r refractory_ms] [-b batch]
+ *             [-v vad_level] [-f] [-e early_ms]
+ *             [-n noise.wav [-s snr_db]...] [-j out.json] corpus.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frontend.h"
+#include "wake_detect.h"
+#include "wake_engine.h"
+#include "wav_io.h"
+
+#ifndef BENCH_ENGINE
+#define BENCH_ENGINE    wake_engine_esp_wwe
+#endif
+extern const wake_engine_t BENCH_ENGINE;
+static const wake_engine_t *engine = &BENCH_ENGINE;
+
+#define MAX_SNRS        8
+#define MAX_TRIGGERS    64
+/* Stands in for the dialog, during which the device doesn't listen */
+#define DEFAULT_REFRACTORY_MS   3000
+#define DEFAULT_MIN_CONFIDENCE  50
+#define DEFAULT_EARLY_MS        500
+/* Front end settings app_dsp uses, for -f */
+#define AGC_TARGET_LEVEL        3000
+#define AGC_GATE_LEVEL          30
+#define AGC_ATTACK_SHIFT        1
+#define AGC_RELEASE_SHIFT       5
+#define AGC_MAX_GAIN_DB         12
+/* read_rb_task's capture frame, SAMPLE_SZ in app_dsp.c */
+#define FRAME_SAMPLES           320
+
+typedef struct {
+    char *path;
+    bool positive;
+    int keyword_end_ms;     /* -1 if not labelled */
+} entry_t;
+
+typedef struct {
+    char name[16];
+    int positives;
+    int detected;
+    int extra_triggers;
+    double negative_s;
+    int false_accepts;
+    double latency_sum_ms;
+    int latency_count;
+    int latency_max_ms;
+} condition_t;
+
+static wake_detect_config_t wd_cfg = {
+    .min_confidence = DEFAULT_MIN_CONFIDENCE,
+    .hits = 1,
+    .refractory_ms = DEFAULT_REFRACTORY_MS,
+};
+static int vad_level;
+static bool use_frontend;
+static int early_ms = DEFAULT_EARLY_MS;
+static int chunk;
+static int batch = 1;
+
+static double *call_us;
+static size_t calls, calls_cap;
+
+static FILE *json;
+static bool json_first_file = true;
+
+static double now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int frame_level(const int16_t *buf, int samples)
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < samples; i++) {
+        sum += abs(buf[i]);
+    }
+    return sum / samples;
+}
+
+static void record_call(double us)
+{
+    if (calls == calls_cap) {
+        calls_cap = calls_cap ? calls_cap * 2 : 4096;
+        call_us = realloc(call_us, calls_cap * sizeof(double));
+    }
+    call_us[calls++] = us;
+}
+
+/* Runs one recording, returns the number of triggers and their times */
+static int run(int16_t *audio, size_t len, int *trigger_ms)
+{
+    wake_detect_t wd;
+    frontend_t fe;
+    int triggers = 0;
+
+    wake_detect_init(&wd, &wd_cfg);
+    if (use_frontend) {
+        frontend_config_t fe_cfg = {
+            .dc_block = true,
+            .agc = true,
+            .target_level = AGC_TARGET_LEVEL,
+            .gate_level = AGC_GATE_LEVEL,
+            .max_gain_q8 = 256 * pow(10, AGC_MAX_GAIN_DB / 20.0),
+            .attack_shift = AGC_ATTACK_SHIFT,
+            .release_shift = AGC_RELEASE_SHIFT,
+        };
+        frontend_init(&fe, &fe_cfg);
+    }
+    int16_t *pending = malloc(batch * chunk * sizeof(int16_t));
+    uint32_t pending_ms[batch];
+    uint8_t confidence[batch];
+    int n = 0, fill = 0;
+
+    if (engine->reset) {
+        engine->reset();
+    }
+    for (size_t pos = 0; pos + FRAME_SAMPLES <= len; pos += FRAME_SAMPLES) {
+        int16_t *buf = audio + pos;
+
+        if (use_frontend) {
+            frontend_process(&fe, buf, FRAME_SAMPLES);
+        }
+        /* read_rb_task doesn't pass quiet frames to the engine, and drops
+         * the part of a chunk gathered before one */
+        if (vad_level && frame_level(buf, FRAME_SAMPLES) < vad_level) {
+            fill = 0;
+            continue;
+        }
+        for (int done = 0; done < FRAME_SAMPLES;) {
+            int take = chunk - fill < FRAME_SAMPLES - done ? chunk - fill : FRAME_SAMPLES - done;
+
+            memcpy(pending + n * chunk + fill, buf + done, take * sizeof(int16_t));
+            fill += take;
+            done += take;
+            if (fill < chunk) {
+                continue;
+            }
+            fill = 0;
+            pending_ms[n++] = (pos + done) * 1000 / WAV_SAMP_RATE;
+            if (n < batch) {
+                continue;
+            }
+            double t = now_us();
+            engine->detect(pending, n, confidence);
+            record_call((now_us() - t) / n);
+            for (int i = 0; i < n; i++) {
+                /* Latency includes waiting for the batch to fill, as on the device */
+                if (wake_detect_update(&wd, confidence[i], pending_ms[i]) && triggers < MAX_TRIGGERS) {
+                    trigger_ms[triggers++] = pending_ms[n - 1];
+                }
+            }
+            n = 0;
+        }
+    }
+    free(pending);
+    return triggers;
+}
+
+static void mix(int16_t *out, const int16_t *clean, size_t len, const wav_t *noise, double snr_db, size_t offset)
+{
+    double ec = 0, en = 0;
+    for (size_t i = 0; i < len; i++) {
+        double n = noise->data[(i + offset) % noise->len];
+        ec += (double) clean[i] * clean[i];
+        en += n * n;
+    }
+    double scale = (en > 0) ? sqrt(ec / (en * pow(10, snr_db / 10))) : 0;
+    for (size_t i = 0; i < len; i++) {
+        double v = clean[i] + noise->data[(i + offset) % noise->len] * scale;
+        out[i] = fmax(INT16_MIN, fmin(INT16_MAX, lround(v)));
+    }
+}
+
+static void score(condition_t *c, const entry_t *e, size_t len, const int *trigger_ms, int triggers)
+{
+    if (!e->positive) {
+        c->negative_s += (double) len / WAV_SAMP_RATE;
+        c->false_accepts += triggers;
+        return;
+    }
+    c->positives++;
+    bool hit = false;
+    for (int i = 0; i < triggers; i++) {
+        if (hit || (e->keyword_end_ms >= 0 && trigger_ms[i] < e->keyword_end_ms - early_ms)) {
+            c->extra_triggers++;
+            continue;
+        }
+        hit = true;
+        c->detected++;
+        if (e->keyword_end_ms >= 0) {
+            int latency = trigger_ms[i] - e->keyword_end_ms;
+            c->latency_sum_ms += latency;
+            c->latency_count++;
+            if (c->latency_count == 1 || latency > c->latency_max_ms) {
+                c->latency_max_ms = latency;
+            }
+        }
+    }
+}
+
+static void json_file(const condition_t *c, const entry_t *e, const int *trigger_ms, int triggers)
+{
+    if (!json) {
+        return;
+    }
+    fprintf(json, "%s\n    {\"path\": \"%s\", \"label\": \"%s\", \"condition\": \"%s\", \"triggers_ms\": [",
+            json_first_file ? "" : ",", e->path, e->positive ? "pos" : "neg", c->name);
+    for (int i = 0; i < triggers; i++) {
+        fprintf(json, "%s%d", i ? ", " : "", trigger_ms[i]);
+    }
+    fprintf(json, "]}");
+    json_first_file = false;
+}
+
+static int load_corpus(const char *list, entry_t **entries)
+{
+    char line[1024], dir[1024] = "";
+    const char *slash = strrchr(list, '/');
+    int n = 0, cap = 0, lineno = 0;
+    FILE *f = fopen(list, "r");
+
+    if (!f) {
+        perror(list);
+        return -1;
+    }
+    if (slash) {
+        snprintf(dir, sizeof(dir), "%.*s/", (int) (slash - list), list);
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char path[1024], label[8];
+        int end_ms = -1;
+        char *hash = strchr(line, '#');
+
+        lineno++;
+        if (hash) {
+            *hash = '\0';
+        }
+        int fields = sscanf(line, "%1023s %7s %d", path, label, &end_ms);
+        if (fields <= 0) {
+            continue;
+        }
+        if (fields < 2 || (strcmp(label, "pos") && strcmp(label, "neg"))) {
+            fprintf(stderr, "%s:%d: expected <wav> pos|neg [keyword_end_ms]\n", list, lineno);
+            fclose(f);
+            return -1;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            *entries = realloc(*entries, cap * sizeof(entry_t));
+        }
+        entry_t *e = &(*entries)[n++];
+        e->path = malloc(strlen(dir) + strlen(path) + 1);
+        sprintf(e->path, "%s%s", path[0] == '/' ? "" : dir, path);
+        e->positive = !strcmp(label, "pos");
+        e->keyword_end_ms = e->positive ? end_ms : -1;
+    }
+    fclose(f);
+    return n;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-k hits] [-c min_confidence] [-r refractory_ms] [-b batch]\n"
+            "       [-v vad_level] [-f] [-e early_ms] [-n noise.wav [-s snr_db]...] [-j out.json] corpus.txt\n", prog);
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    double snrs[MAX_SNRS];
+    int nsnr = 0, opt;
+    const char *noise_path = NULL, *json_path = NULL;
+    wav_t noise = { 0 };
+    entry_t *entries = NULL;
+
+    while ((opt = getopt(argc, argv, "k:c:r:b:v:fe:n:s:j:")) != -1) {
+        switch (opt) {
+        case 'k':
+            wd_cfg.hits = atoi(optarg);
+            break;
+        case 'c':
+            wd_cfg.min_confidence = atoi(optarg);
+            break;
+        case 'b':
+            batch = atoi(optarg);
+            break;
+        case 'r':
+            wd_cfg.refractory_ms = atoi(optarg);
+            break;
+        case 'v':
+            vad_level = atoi(optarg);
+            break;
+        case 'f':
+            use_frontend = true;
+            break;
+        case 'e':
+            early_ms = atoi(optarg);
+            break;
+        case 'n':
+            noise_path = optarg;
+            break;
+        case 's':
+            if (nsnr == MAX_SNRS) {
+                usage(argv[0]);
+            }
+            snrs[nsnr++] = atof(optarg);
+            break;
+        case 'j':
+            json_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1 || wd_cfg.hits < 1 || batch < 1 || (nsnr && !noise_path)) {
+        usage(argv[0]);
+    }
+    int entries_num = load_corpus(argv[optind], &entries);
+    if (entries_num <= 0) {
+        return 1;
+    }
+    if (noise_path && (wav_read(noise_path, &noise) != 0 || noise.len == 0)) {
+        return 1;
+    }
+    if (noise_path && !nsnr) {
+        snrs[nsnr++] = 10;
+    }
+    if (engine->init() != 0 || engine->sample_rate() != WAV_SAMP_RATE) {
+        fprintf(stderr, "Engine %s init failed or not at 16 kHz\n", engine->name);
+        return 1;
+    }
+    chunk = engine->chunk_samples();
+    if (batch > engine->max_batch) {
+        fprintf(stderr, "Engine %s takes at most %d chunks per call\n", engine->name, engine->max_batch);
+        return 1;
+    }
+    if (json_path && !(json = fopen(json_path, "w"))) {
+        perror(json_path);
+        return 1;
+    }
+    if (json) {
+        fprintf(json, "{\n  \"config\": {\"engine\": \"%s\", \"hits\": %d, \"min_confidence\": %d, "
+                "\"refractory_ms\": %d, \"batch\": %d, \"vad_level\": %d, \"frontend\": %s, \"early_ms\": %d, "
+                "\"chunk_samples\": %d},\n  \"files\": [", engine->name, wd_cfg.hits, wd_cfg.min_confidence,
+                wd_cfg.refractory_ms, batch, vad_level, use_frontend ? "true" : "false", early_ms, chunk);
+    }
+
+    int nconds = 1 + nsnr;
+    condition_t *conds = calloc(nconds, sizeof(condition_t));
+    strcpy(conds[0].name, "clean");
+    for (int s = 0; s < nsnr; s++) {
+        snprintf(conds[1 + s].name, sizeof(conds[1 + s].name), "snr%+g", snrs[s]);
+    }
+    for (int i = 0; i < entries_num; i++) {
+        const entry_t *e = &entries[i];
+        wav_t w;
+        int trigger_ms[MAX_TRIGGERS];
+
+        if (wav_read(e->path, &w) != 0) {
+            return 1;
+        }
+        int16_t *buf = malloc(w.len * sizeof(int16_t) + 1);
+        for (int c = 0; c < nconds; c++) {
+            if (c == 0) {
+                memcpy(buf, w.data, w.len * sizeof(int16_t));
+            } else {
+                /* A different stretch of the noise for each file */
+                mix(buf, w.data, w.len, &noise, snrs[c - 1], (size_t) i * 7919 * WAV_SAMP_RATE / 1000);
+            }
+            int triggers = run(buf, w.len, trigger_ms);
+            score(&conds[c], e, w.len, trigger_ms, triggers);
+            json_file(&conds[c], e, trigger_ms, triggers);
+        }
+        free(buf);
+        free(w.data);
+    }
+
+    qsort(call_us, calls, sizeof(double), cmp_double);
+    double sum_us = 0;
+    for (size_t i = 0; i < calls; i++) {
+        sum_us += call_us[i];
+    }
+    double mean_us = calls ? sum_us / calls : 0;
+    double p99_us = calls ? call_us[calls * 99 / 100] : 0;
+    double max_us = calls ? call_us[calls - 1] : 0;
+
+    if (json) {
+        fprintf(json, "\n  ],\n  \"conditions\": [");
+    }
+    for (int c = 0; c < nconds; c++) {
+        const condition_t *k = &conds[c];
+        double rate = k->positives ? (double) k->detected / k->positives : 0;
+        double hours = k->negative_s / 3600;
+        double fa_h = hours > 0 ? k->false_accepts / hours : 0;
+        double lat = k->latency_count ? k->latency_sum_ms / k->latency_count : 0;
+
+        printf("%-8s detected %d/%d (%.1f%%), %d extra; %d false accepts in %.2f h (%.2f/h); "
+               "latency mean %.0f ms, max %d ms\n", k->name, k->detected, k->positives, rate * 100,
+               k->extra_triggers, k->false_accepts, hours, fa_h, lat, k->latency_max_ms);
+        if (json) {
+            fprintf(json, "%s\n    {\"name\": \"%s\", \"positives\": %d, \"detected\": %d, \"detection_rate\": %.4f, "
+                    "\"extra_triggers\": %d, \"negative_hours\": %.4f, \"false_accepts\": %d, \"fa_per_hour\": %.3f, "
+                    "\"latency_mean_ms\": %.1f, \"latency_max_ms\": %d}", c ? "," : "", k->name, k->positives,
+                    k->detected, rate, k->extra_triggers, hours, k->false_accepts, fa_h, lat, k->latency_max_ms);
+        }
+    }
+    printf("engine %s: %zu calls of %d x %d samples, per chunk mean %.1f us, p99 %.1f us, max %.1f us\n",
+           engine->name, calls, batch, chunk, mean_us, p99_us, max_us);
+    if (json) {
+        fprintf(json, "\n  ],\n  \"cpu_us_per_chunk\": {\"calls\": %zu, \"mean\": %.2f, \"p99\": %.2f, \"max\": %.2f}\n}\n",
+                calls, mean_us, p99_us, max_us);
+        fclose(json);
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+/*
+*
+* Copyright 2015-2018 Espressif Systems (Shanghai) PTE LTD
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+*/
+
+/*
+ * Stand-in wake word engine so wwe_bench can be checked on a host without
+ * an engine build. Confidence rises with how far a chunk is above a slowly
+ * tracked floor, reaching 50 at 20 dB: an onset detector, not a keyword
+ * spotter. Takes any batch size.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include "wake_engine.h"
+
+#define CHUNK_SAMPLES   320
+#define MAX_BATCH       8
+/* Confidence points per dB above the floor */
+#define POINTS_PER_DB   2.5f
+
+static uint32_t floor_level;
+
+static int energy_init(void)
+{
+    floor_level = 0;
+    return 0;
+}
+
+static void energy_reset(void)
+{
+    floor_level = 0;
+}
+
+static int energy_sample_rate(void)
+{
+    return 16000;
+}
+
+static int energy_chunk_samples(void)
+{
+    return CHUNK_SAMPLES;
+}
+
+static int chunk_confidence(const int16_t *samples)
+{
+    uint32_t level = 0;
+    int conf = 0;
+
+    for (int i = 0; i < CHUNK_SAMPLES; i++) {
+        level += abs(samples[i]);
+    }
+    level /= CHUNK_SAMPLES;
+    if (floor_level && level > floor_level) {
+        conf = POINTS_PER_DB * 20 * log10f((float) level / floor_level);
+        conf = conf > WAKE_ENGINE_CONFIDENCE_MAX ? WAKE_ENGINE_CONFIDENCE_MAX : conf;
+    }
+    /* Falls quickly, rises slowly */
+    if (!floor_level || level < floor_level) {
+        floor_level = level ? level : 1;
+    } else {
+        floor_level += (level - floor_level) / 64 + 1;
+    }
+    return conf;
+}
+
+static void energy_detect(int16_t *samples, int chunks, uint8_t *confidence)
+{
+    for (int i = 0; i < chunks; i++) {
+        confidence[i] = chunk_confidence(samples + i * CHUNK_SAMPLES);
+    }
+}
+
+const wake_engine_t wake_engine_energy = {
+    .name = "energy",
+    .init = energy_init,
+    .sample_rate = energy_sample_rate,
+    .chunk_samples = energy_chunk_samples,
+    .max_batch = MAX_BATCH,
+    .detect = energy_detect,
+    .reset = energy_reset,
+};